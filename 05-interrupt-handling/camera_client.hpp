@@ -0,0 +1,649 @@
+// camera_client.hpp - Header-only C++ client for /dev/camera (v2_with_waitqueue.c)
+//
+// interrupt_test.c, poll_test.c and frame_streamer.c each write their own
+// open / poll / read loop with their own buffers. This header does it
+// once:
+//
+//   camera::Device  the open device (RAII fd) and a pool of frame buffers,
+//                   allocated once, huge-page backed when the kernel allows;
+//                   pinned in place (no copy or move) for its Frames and
+//                   Loop watches
+//   camera::Frame   a move-only view of one pool buffer; destroying it
+//                   hands the buffer back, so frames are never allocated
+//                   or copied after read()
+//   camera::Loop    epoll over any number of devices, delivering frames to
+//                   callbacks or, with C++20, to `co_await loop.next_frame(dev)`
+//
+// The driver has no mmap(), so read() copying into a pool buffer is the
+// one copy left. When the driver answers CAMERA_IOC_FRAME_INFO, every
+// frame carries its interrupt and read timestamps.
+//
+// C++17 for Device, Frame and Loop callbacks; C++20 adds Task and the
+// coroutine API. A Loop and its Devices belong to one thread; a Frame may
+// be released on any thread.
+//
+//   camera::Device dev;                       // /dev/camera, 4 buffers
+//   if (!dev.ok()) { errno = dev.error(); perror("open"); }
+//   camera::Frame f = dev.next_frame();       // blocking
+//   use(f.pixels(), f.width(), f.height());   // buffer returns with f
+#ifndef CAMERA_CLIENT_HPP
+#define CAMERA_CLIENT_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#define CAMERA_CLIENT_COROUTINES 1
+#endif
+
+#include "camera_ioctl.h"
+
+namespace camera {
+
+constexpr const char *kDefaultPath = "/dev/camera";
+constexpr int kWidth = 640;
+constexpr int kHeight = 480;
+constexpr size_t kFrameSize = kWidth * kHeight * 2;    // RAW12 in 16-bit samples
+
+namespace detail {
+
+inline uint64_t clock_ns(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+} // namespace detail
+
+// Owning file descriptor
+class UniqueFd {
+public:
+    UniqueFd() = default;
+    explicit UniqueFd(int fd) : fd_(fd) {}
+    ~UniqueFd() { reset(); }
+    UniqueFd(UniqueFd &&other) noexcept : fd_(other.release()) {}
+    UniqueFd &operator=(UniqueFd &&other) noexcept
+    {
+        if (this != &other)
+            reset(other.release());
+        return *this;
+    }
+    UniqueFd(const UniqueFd &) = delete;
+    UniqueFd &operator=(const UniqueFd &) = delete;
+
+    int get() const { return fd_; }
+    int release() { return std::exchange(fd_, -1); }
+    void reset(int fd = -1)
+    {
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = fd;
+    }
+    explicit operator bool() const { return fd_ >= 0; }
+
+private:
+    int fd_ = -1;
+};
+
+// 'count' buffers of 'size' bytes in one 2 MB aligned anonymous mapping,
+// advised MADV_HUGEPAGE before anything touches it and then faulted in up
+// front, so transparent huge pages back it when enabled; plus one spill
+// buffer that soaks up frames read while the application holds all the
+// others. Buffers are handed out by index; put() may be called from any
+// thread.
+class BufferPool {
+public:
+    BufferPool(size_t count, size_t size)
+        : stride_((size + 4095) & ~size_t(4095)), count_(count)
+    {
+        map_size_ = ((count + 1) * stride_ + kHugePage - 1) & ~(kHugePage - 1);
+
+        // THP only backs aligned 2 MB extents: map a huge page more, trim
+        void *p = mmap(nullptr, map_size_ + kHugePage, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            error_ = errno;
+            return;
+        }
+        uint8_t *raw = static_cast<uint8_t *>(p);
+        uint8_t *aligned = reinterpret_cast<uint8_t *>(
+            (reinterpret_cast<uintptr_t>(raw) + kHugePage - 1) & ~uintptr_t(kHugePage - 1));
+        if (aligned > raw)
+            munmap(raw, aligned - raw);
+        if (aligned + map_size_ < raw + map_size_ + kHugePage)
+            munmap(aligned + map_size_, raw + kHugePage - aligned);
+        base_ = aligned;
+
+        // Advise first, then touch: pages faulted in before are 4 KB for good
+#ifdef MADV_HUGEPAGE
+        madvise(base_, map_size_, MADV_HUGEPAGE);
+#endif
+        std::memset(base_, 0, map_size_);
+
+        free_.reserve(count);
+        for (size_t i = count; i > 0; i--)
+            free_.push_back(static_cast<int>(i - 1));
+    }
+    ~BufferPool()
+    {
+        if (base_)
+            munmap(base_, map_size_);
+    }
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    bool ok() const { return base_ != nullptr; }
+    int error() const { return error_; }
+
+    // A free buffer's index, -1 when all of them are out
+    int get()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.empty())
+            return -1;
+        int index = free_.back();
+        free_.pop_back();
+        return index;
+    }
+    void put(int index)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(index);     // never grows past the reserve()
+    }
+
+    uint8_t *data(int index) const { return base_ + static_cast<size_t>(index) * stride_; }
+    int spill() const { return static_cast<int>(count_); }
+    size_t size() const { return stride_; }
+    size_t count() const { return count_; }
+    size_t available()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return free_.size();
+    }
+
+private:
+    static constexpr size_t kHugePage = 2u << 20;
+
+    uint8_t *base_ = nullptr;
+    size_t map_size_ = 0;
+    size_t stride_;
+    size_t count_;
+    int error_ = 0;
+    std::mutex mutex_;
+    std::vector<int> free_;
+};
+
+// Driver timestamps of a frame, CLOCK_REALTIME ns; 0 = not known
+struct FrameInfo {
+    uint32_t sequence = 0;          // driver frame number, else our own count
+    uint64_t synth_ns = 0;          // "interrupt": pattern generated
+    uint64_t irq_ns = 0;            // readers woken
+    uint64_t read_ns = 0;           // copy_to_user() done
+    uint64_t received_ns = 0;       // read() returned to us
+};
+
+// One captured frame: a view of a pool buffer, which goes back to the
+// pool when the Frame is destroyed or reset(). Move-only, and must not
+// outlive the Device it came from.
+class Frame {
+public:
+    Frame() = default;
+    ~Frame() { reset(); }
+    Frame(Frame &&other) noexcept
+        : pool_(std::exchange(other.pool_, nullptr)), index_(other.index_), len_(other.len_),
+          width_(other.width_), height_(other.height_), info_(other.info_)
+    {
+    }
+    Frame &operator=(Frame &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            pool_ = std::exchange(other.pool_, nullptr);
+            index_ = other.index_;
+            len_ = other.len_;
+            width_ = other.width_;
+            height_ = other.height_;
+            info_ = other.info_;
+        }
+        return *this;
+    }
+    Frame(const Frame &) = delete;
+    Frame &operator=(const Frame &) = delete;
+
+    explicit operator bool() const { return pool_ != nullptr; }
+
+    const uint8_t *data() const { return pool_ ? pool_->data(index_) : nullptr; }
+    const uint16_t *pixels() const { return reinterpret_cast<const uint16_t *>(data()); }
+    size_t size() const { return len_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    uint32_t sequence() const { return info_.sequence; }
+    const FrameInfo &info() const { return info_; }
+
+    // Give the buffer back now instead of at destruction
+    void reset()
+    {
+        if (pool_)
+            pool_->put(index_);
+        pool_ = nullptr;
+    }
+
+private:
+    friend class Device;
+    Frame(BufferPool *pool, int index, size_t len, int width, int height, const FrameInfo &info)
+        : pool_(pool), index_(index), len_(len), width_(width), height_(height), info_(info)
+    {
+    }
+
+    BufferPool *pool_ = nullptr;
+    int index_ = -1;
+    size_t len_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    FrameInfo info_;
+};
+
+struct DeviceConfig {
+    const char *path = kDefaultPath;
+    size_t buffers = 4;             // frames the application may hold at once
+    size_t frame_size = kFrameSize; // largest read()
+    int width = kWidth;
+    int height = kHeight;
+};
+
+// The open device and its buffer pool. Failures don't throw: check ok(),
+// error() is the errno of the last failure. Neither copyable nor movable;
+// every Frame it returned must be gone, and a Loop must unwatch() it,
+// before it is destroyed.
+class Device {
+public:
+    explicit Device(const DeviceConfig &config = DeviceConfig())
+        : Device(UniqueFd(::open(config.path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)), config)
+    {
+    }
+
+    // Adopt an fd opened elsewhere; it is switched to O_NONBLOCK
+    Device(UniqueFd fd, const DeviceConfig &config) : fd_(std::move(fd)), config_(config)
+    {
+        if (!fd_) {
+            error_ = errno;
+            return;
+        }
+        fcntl(fd_.get(), F_SETFL, fcntl(fd_.get(), F_GETFL) | O_NONBLOCK);
+        pool_ = std::make_unique<BufferPool>(config.buffers, config.frame_size);
+        if (!pool_->ok()) {
+            error_ = pool_->error();
+            pool_.reset();
+        }
+    }
+
+    // Frames and Loop watches point at the Device and its pool: it stays put
+    Device(const Device &) = delete;
+    Device &operator=(const Device &) = delete;
+
+    bool ok() const { return fd_ && pool_; }
+    int error() const { return error_; }
+    int fd() const { return fd_.get(); }
+    const DeviceConfig &config() const { return config_; }
+    BufferPool &pool() { return *pool_; }
+    unsigned long frames() const { return frames_; }
+    unsigned long dropped() const { return dropped_; }
+
+    // Read the frame the driver has ready without blocking. Empty if there
+    // is none (error() EAGAIN), every buffer is held (ENOBUFS: the frame
+    // is read and dropped so the driver can go on), or on errors.
+    Frame try_read()
+    {
+        int index = pool_->get();
+        bool spill = index < 0;
+        uint8_t *buf = pool_->data(spill ? pool_->spill() : index);
+        ssize_t n;
+
+        do {
+            n = ::read(fd_.get(), buf, config_.frame_size);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            error_ = n == 0 ? ENODATA : errno;
+            if (!spill)
+                pool_->put(index);
+            return Frame();
+        }
+
+        FrameInfo info;
+        info.received_ns = detail::clock_ns(CLOCK_REALTIME);
+        info.sequence = static_cast<uint32_t>(++frames_);
+        if (frame_info_) {
+            struct camera_frame_info ci;
+
+            if (ioctl(fd_.get(), CAMERA_IOC_FRAME_INFO, &ci) == 0) {
+                info.sequence = ci.frame_count;
+                info.synth_ns = ci.synth_ns;
+                info.irq_ns = ci.irq_ns;
+                info.read_ns = ci.read_ns;
+            } else {
+                frame_info_ = false;    // older driver: don't ask again
+            }
+        }
+        if (spill) {
+            dropped_++;
+            error_ = ENOBUFS;
+            return Frame();
+        }
+        return Frame(pool_.get(), index, static_cast<size_t>(n), config_.width,
+                     config_.height, info);
+    }
+
+    // Wait up to timeout_ms (-1 = forever) for the next frame. Empty on
+    // timeout (error() ETIMEDOUT), a signal (EINTR) or errors.
+    Frame next_frame(int timeout_ms = -1)
+    {
+        uint64_t deadline = timeout_ms < 0 ? 0 :
+            detail::clock_ns(CLOCK_MONOTONIC) + static_cast<uint64_t>(timeout_ms) * 1000000;
+        struct pollfd pfd = { fd_.get(), POLLIN, 0 };
+
+        for (;;) {
+            Frame f = try_read();
+            if (f || (error_ != EAGAIN && error_ != ENOBUFS))
+                return f;
+
+            int wait = -1;
+            if (timeout_ms >= 0) {
+                uint64_t now = detail::clock_ns(CLOCK_MONOTONIC);
+                wait = now >= deadline ? 0 : static_cast<int>((deadline - now + 999999) / 1000000);
+            }
+            int ret = ::poll(&pfd, 1, wait);
+            if (ret == 0) {
+                error_ = ETIMEDOUT;
+                return Frame();
+            }
+            if (ret < 0) {
+                error_ = errno;
+                return Frame();
+            }
+        }
+    }
+
+private:
+    UniqueFd fd_;
+    std::unique_ptr<BufferPool> pool_;  // stable address: frames point at it
+    DeviceConfig config_;
+    int error_ = 0;
+    bool frame_info_ = true;            // driver answers CAMERA_IOC_FRAME_INFO
+    unsigned long frames_ = 0;
+    unsigned long dropped_ = 0;
+};
+
+#if CAMERA_CLIENT_COROUTINES
+// Eagerly started coroutine owned by its Task: keep the Task until done()
+class Task {
+public:
+    struct promise_type {
+        Task get_return_object()
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other) {
+            if (handle_)
+                handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    ~Task()
+    {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    bool done() const { return !handle_ || handle_.done(); }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : handle_(h) {}
+    std::coroutine_handle<promise_type> handle_;
+};
+#endif
+
+// epoll over devices. Registrations allocate; delivering frames doesn't.
+class Loop {
+    struct Watch;
+
+public:
+    using Callback = std::function<void(Frame)>;
+
+    Loop() : epfd_(epoll_create1(EPOLL_CLOEXEC))
+    {
+        if (!epfd_)
+            error_ = errno;
+    }
+    Loop(const Loop &) = delete;
+    Loop &operator=(const Loop &) = delete;
+
+    bool ok() const { return static_cast<bool>(epfd_); }
+    int error() const { return error_; }
+
+    // Deliver every frame of dev to cb (dev must outlive the watch)
+    bool watch(Device &dev, Callback cb)
+    {
+        Watch *w = find(dev);
+        if (!w)
+            w = add(dev, EPOLLIN);
+        if (!w)
+            return false;
+        w->cb = std::move(cb);
+        return arm(*w, EPOLLIN);
+    }
+
+    // Safe from a callback, for its own device or any other
+    void unwatch(Device &dev)
+    {
+        for (auto it = watches_.begin(); it != watches_.end(); ++it) {
+            if ((*it)->dev == &dev) {
+                epoll_ctl(epfd_.get(), EPOLL_CTL_DEL, dev.fd(), nullptr);
+                // The running callback or the current batch of events may
+                // still point at it, so it is only freed after the batch
+                (*it)->dead = true;
+                if (dispatching_)
+                    graveyard_.push_back(std::move(*it));
+                watches_.erase(it);
+                return;
+            }
+        }
+    }
+
+    // Wait up to timeout_ms for frames and deliver them. Returns the
+    // number delivered (0 on timeout or a signal), -1 on errors.
+    int run_once(int timeout_ms = -1)
+    {
+        struct epoll_event events[16];
+        int delivered = 0;
+
+        int n = epoll_wait(epfd_.get(), events, 16, timeout_ms);
+        if (n < 0) {
+            error_ = errno;
+            return errno == EINTR ? 0 : -1;
+        }
+        dispatching_ = true;
+        for (int i = 0; i < n; i++) {
+            auto *w = static_cast<Watch *>(events[i].data.ptr);
+            if (!w->dead)
+                delivered += dispatch(*w);
+        }
+        dispatching_ = false;
+        graveyard_.clear();
+        return delivered;
+    }
+
+    // run_once() until stop() or an error
+    int run()
+    {
+        stopped_ = false;
+        while (!stopped_) {
+            if (run_once() < 0)
+                return -1;
+        }
+        return 0;
+    }
+    void stop() { stopped_ = true; }
+
+#if CAMERA_CLIENT_COROUTINES
+    // co_await loop.next_frame(dev): resumes inside run_once() with the
+    // next frame, or an empty one if the device failed (dev.error()) or
+    // could not be polled (loop.error()).
+    class FrameAwaiter {
+    public:
+        bool await_ready()
+        {
+            if (!watch_)
+                return true;
+            frame_ = watch_->dev->try_read();
+            int err = watch_->dev->error();
+            return frame_ || (err != EAGAIN && err != ENOBUFS);
+        }
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            watch_->waiter = h;
+            watch_->result = &frame_;
+            if (loop_->arm(*watch_, EPOLLIN | EPOLLONESHOT))
+                return true;
+            // Nothing would ever wake us: resume now with no frame
+            watch_->waiter = nullptr;
+            watch_->result = nullptr;
+            return false;
+        }
+        Frame await_resume() { return std::move(frame_); }
+
+    private:
+        friend class Loop;
+        FrameAwaiter(Loop *loop, Watch *watch) : loop_(loop), watch_(watch) {}
+
+        Loop *loop_;
+        Watch *watch_;
+        Frame frame_;
+    };
+
+    FrameAwaiter next_frame(Device &dev)
+    {
+        Watch *w = find(dev);
+        if (!w)
+            w = add(dev, 0);
+        return FrameAwaiter(this, w);
+    }
+#endif
+
+private:
+    struct Watch {
+        Device *dev;
+        Callback cb;
+        bool dead = false;              // unwatched, freed after the batch
+#if CAMERA_CLIENT_COROUTINES
+        std::coroutine_handle<> waiter;
+        Frame *result = nullptr;
+#endif
+    };
+
+    Watch *find(Device &dev)
+    {
+        for (auto &w : watches_) {
+            if (w->dev == &dev)
+                return w.get();
+        }
+        return nullptr;
+    }
+
+    Watch *add(Device &dev, uint32_t events)
+    {
+        auto w = std::make_unique<Watch>();
+        struct epoll_event ev = {};
+
+        w->dev = &dev;
+        ev.events = events;
+        ev.data.ptr = w.get();
+        if (epoll_ctl(epfd_.get(), EPOLL_CTL_ADD, dev.fd(), &ev) < 0) {
+            error_ = errno;
+            return nullptr;
+        }
+        watches_.push_back(std::move(w));
+        return watches_.back().get();
+    }
+
+    bool arm(Watch &w, uint32_t events)
+    {
+        struct epoll_event ev = {};
+
+        ev.events = events;
+        ev.data.ptr = &w;
+        if (epoll_ctl(epfd_.get(), EPOLL_CTL_MOD, w.dev->fd(), &ev) < 0) {
+            error_ = errno;
+            return false;
+        }
+        return true;
+    }
+
+    // The device is readable: hand its frame to the waiter or callback
+    int dispatch(Watch &w)
+    {
+        Frame f = w.dev->try_read();
+        int err = w.dev->error();
+
+        if (!f && (err == EAGAIN || err == ENOBUFS)) {
+#if CAMERA_CLIENT_COROUTINES
+            if (w.waiter)
+                arm(w, EPOLLIN | EPOLLONESHOT);     // nothing after all
+#endif
+            return 0;
+        }
+#if CAMERA_CLIENT_COROUTINES
+        if (w.waiter) {
+            *w.result = std::move(f);
+            std::exchange(w.waiter, nullptr).resume();
+            return 1;
+        }
+#endif
+        if (!f) {
+            // Device gone: stop polling it instead of spinning on the error
+            epoll_ctl(epfd_.get(), EPOLL_CTL_DEL, w.dev->fd(), nullptr);
+            return 0;
+        }
+        if (w.cb)
+            w.cb(std::move(f));
+        return 1;
+    }
+
+    UniqueFd epfd_;
+    std::vector<std::unique_ptr<Watch>> watches_;
+    std::vector<std::unique_ptr<Watch>> graveyard_;     // unwatched mid-batch
+    bool dispatching_ = false;
+    bool stopped_ = false;
+    int error_ = 0;
+};
+
+} // namespace camera
+
+#endif // CAMERA_CLIENT_HPP
@@ -0,0 +1,33 @@
+/*
+ * camera_ioctl.h - ioctl interface of /dev/camera (v2_with_waitqueue.c)
+ *
+ * Shared between the driver and user space (07-network-streaming uses it
+ * to trace where a frame's latency goes).
+ */
+
+#ifndef CAMERA_IOCTL_H
+#define CAMERA_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* Device magic number - must be unique in the system */
+#define CAMERA_IOC_MAGIC 'C'
+
+/*
+ * Timing of the frame returned by the most recent read()
+ * All times are CLOCK_REALTIME in ns, the clock user space stamps frames
+ * with, so driver and application timestamps can be subtracted directly.
+ */
+struct camera_frame_info {
+    __u32 frame_count;          /* Driver frame number of that frame */
+    __u32 reserved;
+    __u64 synth_ns;             /* "Interrupt": test pattern generation started */
+    __u64 irq_ns;               /* wake_up_interruptible() called */
+    __u64 read_ns;              /* copy_to_user() finished */
+};
+
+/* Get the timing of the last frame read (kernel -> user) */
+#define CAMERA_IOC_FRAME_INFO   _IOR(CAMERA_IOC_MAGIC, 1, struct camera_frame_info)
+
+#endif /* CAMERA_IOCTL_H */
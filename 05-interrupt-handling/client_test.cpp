@@ -0,0 +1,184 @@
+/*
+ * client_test.cpp
+ *
+ * interrupt_test.c again, on top of camera_client.hpp: the same
+ * wait-for-interrupt, read-the-frame loop, written three ways:
+ *
+ *   blocking   camera::Device::next_frame()
+ *   callback   camera::Loop::watch() + run()
+ *   coroutine  co_await loop.next_frame(dev) (C++20)
+ *
+ * Each frame is a view of a pool buffer allocated at open; the buffer is
+ * handed back when the Frame goes out of scope.
+ *
+ * Usage: ./client_test [-m blocking|callback|coroutine] [-n FRAMES] [DEVICE]
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "camera_client.hpp"
+
+namespace {
+
+volatile sig_atomic_t stop_requested = 0;
+
+void handle_signal(int) { stop_requested = 1; }
+
+void print_frame(const camera::Frame &f)
+{
+    const camera::FrameInfo &info = f.info();
+
+    printf("[Frame %u] %zu bytes, %dx%d, first pixels %u %u %u", f.sequence(), f.size(),
+           f.width(), f.height(), f.pixels()[0], f.pixels()[1], f.pixels()[2]);
+    if (info.irq_ns)
+        printf(", interrupt -> read() %.1f us", (info.received_ns - info.irq_ns) / 1e3);
+    printf("\n");
+}
+
+int run_blocking(camera::Device &dev, int max_frames)
+{
+    for (int count = 0; count < max_frames && !stop_requested; count++) {
+        camera::Frame f = dev.next_frame();
+        if (!f) {
+            if (dev.error() == EINTR)
+                break;
+            fprintf(stderr, "Read failed: %s\n", strerror(dev.error()));
+            return 1;
+        }
+        print_frame(f);
+    }
+    return 0;
+}
+
+int run_callback(camera::Device &dev, int max_frames)
+{
+    camera::Loop loop;
+    int count = 0;
+
+    if (!loop.watch(dev, [&](camera::Frame f) {
+            print_frame(f);
+            if (++count >= max_frames)
+                loop.stop();
+        })) {
+        fprintf(stderr, "epoll failed: %s\n", strerror(loop.error()));
+        return 1;
+    }
+    // run() would do, but Ctrl+C should end the loop too
+    while (count < max_frames && !stop_requested) {
+        if (loop.run_once() < 0) {
+            fprintf(stderr, "epoll_wait failed: %s\n", strerror(loop.error()));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#if CAMERA_CLIENT_COROUTINES
+camera::Task capture(camera::Loop &loop, camera::Device &dev, int max_frames, int &status)
+{
+    for (int count = 0; count < max_frames; count++) {
+        camera::Frame f = co_await loop.next_frame(dev);
+        if (!f) {
+            fprintf(stderr, "Read failed: %s\n", strerror(dev.error()));
+            status = 1;
+            co_return;
+        }
+        print_frame(f);
+    }
+}
+
+int run_coroutine(camera::Device &dev, int max_frames)
+{
+    camera::Loop loop;
+    int status = 0;
+
+    camera::Task task = capture(loop, dev, max_frames, status);
+    while (!task.done() && !stop_requested) {
+        if (loop.run_once() < 0) {
+            fprintf(stderr, "epoll_wait failed: %s\n", strerror(loop.error()));
+            return 1;
+        }
+    }
+    return status;
+}
+#endif
+
+void usage(const char *prog)
+{
+    printf("Usage: %s [-m blocking|callback|coroutine] [-n FRAMES] [DEVICE]\n", prog);
+    printf("  DEVICE defaults to %s\n", camera::kDefaultPath);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    camera::DeviceConfig config;
+    const char *mode = "blocking";
+    int max_frames = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:n:h")) != -1) {
+        switch (opt) {
+        case 'm':
+            mode = optarg;
+            break;
+        case 'n':
+            max_frames = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        config.path = argv[optind];
+    if (max_frames <= 0) {
+        fprintf(stderr, "Invalid frame count\n");
+        return 1;
+    }
+
+    struct sigaction sa = {};
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    camera::Device dev(config);
+    if (!dev.ok()) {
+        fprintf(stderr, "Failed to open %s: %s\n", config.path, strerror(dev.error()));
+        printf("\nTroubleshooting:\n");
+        printf("1. Check if module is loaded: lsmod | grep v2_with_waitqueue\n");
+        printf("2. Check if device exists: ls -l %s\n", config.path);
+        printf("3. Load module: sudo insmod v2_with_waitqueue.ko\n");
+        return 1;
+    }
+    printf("Device %s opened, %zu x %zu KB frame buffers, %s API\n", config.path,
+           dev.pool().count(), dev.pool().size() / 1024, mode);
+
+    int ret;
+    if (strcmp(mode, "blocking") == 0) {
+        ret = run_blocking(dev, max_frames);
+    } else if (strcmp(mode, "callback") == 0) {
+        ret = run_callback(dev, max_frames);
+#if CAMERA_CLIENT_COROUTINES
+    } else if (strcmp(mode, "coroutine") == 0) {
+        ret = run_coroutine(dev, max_frames);
+#endif
+    } else {
+        fprintf(stderr, "Unknown mode: %s\n", mode);
+        return 1;
+    }
+
+    printf("Total frames captured: %lu (%lu dropped, all buffers held)\n",
+           dev.frames() - dev.dropped(), dev.dropped());
+    return ret;
+}
@@ -28,6 +28,10 @@
 #include <linux/poll.h>
 #include <linux/uaccess.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/cpumask.h>
+#include "camera_ioctl.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Jeff");
@@ -76,12 +80,34 @@ static bool data_ready = false;
 static int frame_count = 0;
 static char *frame_buffer = NULL;  // Dynamically allocated
 
+/*
+ * Frame timing for CAMERA_IOC_FRAME_INFO
+ * - cur_info: the frame in frame_buffer (written by the timer)
+ * - read_info: the frame the last read() returned (what ioctl reports)
+ * The lock keeps the timer from tearing a copy made in process context.
+ */
+static struct camera_frame_info cur_info;
+static struct camera_frame_info read_info;
+static DEFINE_SPINLOCK(info_lock);
+
 /* ============================================
  * Timer (Simulating Hardware Interrupt)
  * ============================================ */
 
 static struct timer_list my_timer;
 
+/*
+ * Module parameter: CPU the frame timer (our "interrupt") runs on
+ * - -1 (default): the CPU that armed it, the kernel may migrate it
+ * - N: start it on CPU N and pin it there (TIMER_PINNED)
+ * Pick a housekeeping CPU so frame work never preempts the streamer
+ * threads pinned to other (isolated) CPUs:
+ *   sudo insmod v2_with_waitqueue.ko housekeeping_cpu=0
+ */
+static int housekeeping_cpu = -1;
+module_param(housekeeping_cpu, int, 0444);
+MODULE_PARM_DESC(housekeeping_cpu, "CPU for the frame timer (-1 = any)");
+
 /* ============================================
  * Test Pattern Generation
  * ============================================ */
@@ -125,6 +151,8 @@ static void generate_test_pattern(void)
  */
 static void simulate_camera_interrupt(void)
 {
+    u64 synth_ns = ktime_get_real_ns();
+
     /* Simulate: Camera captured a new frame */
     frame_count++;
     
@@ -149,6 +177,13 @@ static void simulate_camera_interrupt(void)
      * - "interruptible" means processes can be woken by signals
      * - After this, poll() will return to user space
      */
+    spin_lock(&info_lock);
+    cur_info.frame_count = frame_count;
+    cur_info.synth_ns = synth_ns;
+    cur_info.irq_ns = ktime_get_real_ns();
+    cur_info.read_ns = 0;
+    spin_unlock(&info_lock);
+
     wake_up_interruptible(&my_wait_queue);
     
     pr_info("IRQ: wake_up() called, processes should wake now\n");
@@ -170,7 +205,7 @@ static void timer_callback(struct timer_list *t)
     /* Call our interrupt handler simulation */
     simulate_camera_interrupt();
     
-    /* Re-arm timer for next "frame capture" */
+    /* Re-arm timer for next "frame capture" (TIMER_PINNED: same CPU) */
     mod_timer(&my_timer, jiffies + msecs_to_jiffies(2000));
 }
 
@@ -228,6 +263,12 @@ static ssize_t my_read(struct file *file, char __user *buf,
     /* Reset data ready flag (data has been consumed) */
     data_ready = false;
     
+    /* Remember which frame this was, for CAMERA_IOC_FRAME_INFO */
+    spin_lock_bh(&info_lock);
+    read_info = cur_info;
+    read_info.read_ns = ktime_get_real_ns();
+    spin_unlock_bh(&info_lock);
+    
     pr_info("READ: Sent %zu bytes to user\n", bytes_to_copy);
     
     return bytes_to_copy;
@@ -268,6 +309,31 @@ static unsigned int my_poll(struct file *file, poll_table *wait)
     return mask;
 }
 
+/*
+ * ioctl() - Called when user calls ioctl() on the device
+ * 
+ * CAMERA_IOC_FRAME_INFO: timing of the last frame read, so user space
+ * can split its latency into driver, wake-up and copy time
+ */
+static long my_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct camera_frame_info info;
+    
+    switch (cmd) {
+    case CAMERA_IOC_FRAME_INFO:
+        spin_lock_bh(&info_lock);
+        info = read_info;
+        spin_unlock_bh(&info_lock);
+        
+        if (copy_to_user((void __user *)arg, &info, sizeof(info)))
+            return -EFAULT;
+        return 0;
+        
+    default:
+        return -ENOTTY;
+    }
+}
+
 /* File operations structure */
 static struct file_operations fops = {
     .owner = THIS_MODULE,
@@ -275,6 +341,7 @@ static struct file_operations fops = {
     .release = my_release,
     .read = my_read,
     .poll = my_poll,
+    .unlocked_ioctl = my_ioctl,
 };
 
 /* ============================================
@@ -290,6 +357,13 @@ static int __init interrupt_v2_init(void)
     pr_info("Module 05 v2: Initializing\n");
     pr_info("========================================\n");
     
+    /* 0. Check the module parameter before touching anything */
+    if (housekeeping_cpu >= 0 &&
+        (housekeeping_cpu >= nr_cpu_ids || !cpu_online(housekeeping_cpu))) {
+        pr_err("housekeeping_cpu=%d is not an online CPU\n", housekeeping_cpu);
+        return -EINVAL;
+    }
+    
     /* 1. Allocate device number */
     ret = alloc_chrdev_region(&dev, 0, 1, DEVICE_NAME);
     if (ret < 0) {
@@ -345,8 +419,16 @@ static int __init interrupt_v2_init(void)
     pr_info("Frame buffer allocated: %d bytes\n", FRAME_SIZE);
     
     /* 7. Start timer (simulating periodic camera interrupts) */
-    timer_setup(&my_timer, timer_callback, 0);
-    mod_timer(&my_timer, jiffies + msecs_to_jiffies(2000));
+    if (housekeeping_cpu >= 0) {
+        /* add_timer_on() queues it on that CPU, TIMER_PINNED keeps it there */
+        timer_setup(&my_timer, timer_callback, TIMER_PINNED);
+        my_timer.expires = jiffies + msecs_to_jiffies(2000);
+        add_timer_on(&my_timer, housekeeping_cpu);
+        pr_info("Frame timer pinned to CPU %d\n", housekeeping_cpu);
+    } else {
+        timer_setup(&my_timer, timer_callback, 0);
+        mod_timer(&my_timer, jiffies + msecs_to_jiffies(2000));
+    }
     
     pr_info("Timer started: simulating camera frames every 2 seconds\n");
     pr_info("========================================\n");
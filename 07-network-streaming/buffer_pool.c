@@ -0,0 +1,279 @@
+// buffer_pool.c - Huge-page, NUMA-local frame buffer arena (see buffer_pool.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "buffer_pool.h"
+
+#define POOL_PAGE 4096
+#define POOL_MAX_NODES 1024
+
+static size_t align_up(size_t n, size_t a)
+{
+    return (n + a - 1) & ~(a - 1);
+}
+
+int pool_local_node(void)
+{
+    unsigned int cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) < 0)
+        return -1;
+    return (int)node;
+}
+
+/*
+ * Prefer 'node' for every page of the arena. MPOL_PREFERRED rather than
+ * MPOL_BIND: a node that runs out of (huge) pages falls back to another
+ * one instead of failing the fault with SIGBUS in the middle of a frame.
+ */
+static int bind_node(void *addr, size_t len, int node)
+{
+    unsigned long mask[POOL_MAX_NODES / (8 * sizeof(unsigned long))];
+
+    if (node < 0 || node >= POOL_MAX_NODES)
+        return -1;
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+
+    // The kernel reads maxnode - 1 bits
+    return syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask,
+                   8 * sizeof(mask) + 1, 0) < 0 ? -1 : 0;
+}
+
+/*
+ * 2 MB aligned mapping, anonymous or of fd: THP can only back aligned
+ * 2 MB extents. MAP_FAILED on error.
+ */
+static char *map_aligned(size_t size, int fd)
+{
+    size_t slack = POOL_HUGE_PAGE;
+    char *p, *aligned;
+
+    p = mmap(NULL, size + slack, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return MAP_FAILED;
+    aligned = (char *)align_up((uintptr_t)p, POOL_HUGE_PAGE);
+    if (aligned > p)
+        munmap(p, aligned - p);
+    if (aligned + size < p + size + slack)
+        munmap(aligned + size, p + size + slack - (aligned + size));
+
+    // A shared arena replaces the placeholder with the memfd
+    if (fd >= 0 && mmap(aligned, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                        fd, 0) == MAP_FAILED) {
+        munmap(aligned, size);
+        return MAP_FAILED;
+    }
+    return aligned;
+}
+
+/*
+ * One attempt at size bytes with 'backing'. A shared arena gets a fresh
+ * memfd in *fd, closed again if the mapping fails. NULL on error.
+ */
+static char *map_arena(size_t size, enum pool_backing backing, int shared, int *fd)
+{
+    char *p = MAP_FAILED;
+    int err;
+
+    *fd = -1;
+    if (shared) {
+        *fd = memfd_create("frame_buffers", MFD_CLOEXEC | MFD_ALLOW_SEALING |
+                           (backing == POOL_HUGETLB ? MFD_HUGETLB : 0));
+        if (*fd < 0 || ftruncate(*fd, size) < 0)
+            goto fail;
+    }
+
+    if (backing == POOL_HUGETLB && !shared)
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    else if (backing == POOL_THP)
+        p = map_aligned(size, *fd);
+    else if (shared)        // hugetlb or plain pages, the memfd decides
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+    else
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED)
+        return p;
+
+fail:
+    err = errno;            // for the caller's perror()
+    if (*fd >= 0)
+        close(*fd);
+    *fd = -1;
+    errno = err;
+    return NULL;
+}
+
+/* Bytes of the mapping at base that THP actually backs (from smaps) */
+static size_t thp_bytes(const char *base)
+{
+    char line[256], perms[5];
+    unsigned long start, end, kb;
+    int in_range = 0;
+    size_t bytes = 0;
+    FILE *f = fopen("/proc/self/smaps", "r");
+
+    if (!f)
+        return 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%lx-%lx %4s", &start, &end, perms) == 3)
+            in_range = start == (uintptr_t)base;
+        else if (in_range && (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+                              sscanf(line, "ShmemPmdMapped: %lu kB", &kb) == 1))
+            bytes += (size_t)kb * 1024;
+    }
+    fclose(f);
+    return bytes;
+}
+
+static int pool_setup(struct buffer_pool *pool, int count, size_t size, size_t reserve,
+                      enum pool_backing want, int node, int shared)
+{
+    size_t total;
+    char *p = NULL;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->node = -1;
+    pool->fd = -1;
+    if (count < 1 || size == 0)
+        return -1;
+
+    pool->count = count;
+    pool->stride = align_up(size, POOL_PAGE);
+    pool->reserve = align_up(reserve, POOL_PAGE);
+    total = pool->reserve + pool->stride * count;
+
+    // Reserved huge pages: guaranteed 2 MB TLB entries, but only if the
+    // admin set some aside (vm.nr_hugepages)
+    if (want == POOL_AUTO || want == POOL_HUGETLB) {
+        pool->map_size = align_up(total, POOL_HUGE_PAGE);
+        p = map_arena(pool->map_size, POOL_HUGETLB, shared, &pool->fd);
+        if (p) {
+            pool->backing = POOL_HUGETLB;
+        } else if (want == POOL_HUGETLB) {
+            perror("MAP_HUGETLB failed (no reserved huge pages?)");
+            return -1;
+        }
+    }
+
+    // Transparent huge pages: best effort, the kernel may still use 4 KB
+    if (!p && (want == POOL_AUTO || want == POOL_THP)) {
+        pool->map_size = align_up(total, POOL_HUGE_PAGE);
+        p = map_arena(pool->map_size, POOL_THP, shared, &pool->fd);
+        if (p) {
+            madvise(p, pool->map_size, MADV_HUGEPAGE);
+            pool->backing = POOL_THP;
+        } else if (want == POOL_THP) {
+            perror("Failed to map frame buffers");
+            return -1;
+        }
+    }
+
+    if (!p) {
+        pool->map_size = total;
+        p = map_arena(pool->map_size, POOL_PAGES, shared, &pool->fd);
+        if (!p) {
+            perror("Failed to map frame buffers");
+            return -1;
+        }
+        pool->backing = POOL_PAGES;
+    }
+    pool->map = p;
+    pool->base = p + pool->reserve;
+
+    // Place the pages before the first touch, then touch them all now
+    if (node == POOL_NODE_LOCAL)
+        node = pool_local_node();
+    if (node >= 0 && bind_node(p, pool->map_size, node) == 0)
+        pool->node = node;
+    memset(p, 0, pool->map_size);
+
+    if (pool->backing == POOL_THP && thp_bytes(p) == 0) {
+        // THP disabled or no 2 MB extents free: say so rather than pretend
+        pool->backing = POOL_PAGES;
+    }
+    return 0;
+}
+
+int pool_init(struct buffer_pool *pool, int count, size_t size,
+              enum pool_backing want, int node)
+{
+    return pool_setup(pool, count, size, 0, want, node, 0);
+}
+
+int pool_init_shared(struct buffer_pool *pool, int count, size_t size, size_t reserve,
+                     enum pool_backing want, int node)
+{
+    return pool_setup(pool, count, size, reserve, want, node, 1);
+}
+
+void pool_destroy(struct buffer_pool *pool)
+{
+    if (pool->map) {
+        munmap(pool->map, pool->map_size);
+        if (pool->fd >= 0)
+            close(pool->fd);
+    }
+    memset(pool, 0, sizeof(*pool));
+    pool->node = -1;
+    pool->fd = -1;
+}
+
+int parse_pool_backing(const char *name, enum pool_backing *backing)
+{
+    if (strcmp(name, "auto") == 0)
+        *backing = POOL_AUTO;
+    else if (strcmp(name, "hugetlb") == 0)
+        *backing = POOL_HUGETLB;
+    else if (strcmp(name, "thp") == 0)
+        *backing = POOL_THP;
+    else if (strcmp(name, "pages") == 0)
+        *backing = POOL_PAGES;
+    else
+        return -1;
+    return 0;
+}
+
+const char *pool_backing_name(enum pool_backing backing)
+{
+    switch (backing) {
+    case POOL_AUTO:
+        return "auto";
+    case POOL_HUGETLB:
+        return "hugetlb";
+    case POOL_THP:
+        return "thp";
+    case POOL_PAGES:
+        return "pages";
+    }
+    return "?";
+}
+
+int parse_pool_node(const char *name, int *node)
+{
+    char *end;
+    long n;
+
+    if (strcmp(name, "local") == 0) {
+        *node = POOL_NODE_LOCAL;
+        return 0;
+    }
+    if (strcmp(name, "any") == 0) {
+        *node = POOL_NODE_ANY;
+        return 0;
+    }
+    n = strtol(name, &end, 10);
+    if (*name == '\0' || *end != '\0' || n < 0 || n >= POOL_MAX_NODES)
+        return -1;
+    *node = (int)n;
+    return 0;
+}
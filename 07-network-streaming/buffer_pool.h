@@ -0,0 +1,89 @@
+// buffer_pool.h - Frame buffers carved out of one huge-page backed arena
+//
+// A 640x480 RAW frame spans 150 4 KB pages; a ring of them plus a few
+// clients touching every page per frame keeps the TLB busy. The pool maps
+// all buffers as one arena, preferably in 2 MB pages:
+//
+//   hugetlb   MAP_HUGETLB, from the reserved pool (vm.nr_hugepages)
+//   thp       2 MB aligned anonymous memory with MADV_HUGEPAGE
+//   pages     plain 4 KB pages
+//
+// 'auto' tries them in that order. On multi-socket machines the arena is
+// bound (mbind) to one NUMA node, by default the node of the thread that
+// creates it, and faulted in before use, so no frame ever takes a page
+// fault or lands on a remote node. Buffers start on page boundaries,
+// which also makes them cache-line aligned.
+//
+// A shared arena (pool_init_shared()) is the same in a memfd that other
+// processes can map: hugetlb with MFD_HUGETLB, thp as shmem with
+// MADV_HUGEPAGE (needs shmem_enabled=advise), else 4 KB pages.
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POOL_HUGE_PAGE (2u << 20)
+#define POOL_NODE_LOCAL -1          // the calling thread's node
+#define POOL_NODE_ANY -2            // no binding, first-touch placement
+
+enum pool_backing {
+    POOL_AUTO,
+    POOL_HUGETLB,
+    POOL_THP,
+    POOL_PAGES,
+};
+
+struct buffer_pool {
+    char *base;                     // buffer 0
+    char *map;                      // the whole mapping, reserve bytes before base
+    size_t map_size;
+    size_t reserve;                 // bytes in front of buffer 0 (shared arenas)
+    size_t stride;                  // buffer size rounded up to a page
+    int count;
+    enum pool_backing backing;      // what the arena actually got
+    int node;                       // node it is bound to, -1 = none
+    int fd;                         // memfd of a shared arena, -1 = private
+};
+
+/*
+ * Map count buffers of size bytes. want picks the backing (POOL_AUTO
+ * falls back as far as needed, an explicit choice does not), node a NUMA
+ * node, POOL_NODE_LOCAL or POOL_NODE_ANY. Binding is best effort: a
+ * kernel or container without NUMA support leaves node at -1.
+ * Returns 0 or -1 (message printed).
+ */
+int pool_init(struct buffer_pool *pool, int count, size_t size,
+              enum pool_backing want, int node);
+
+/*
+ * The same in a memfd (pool->fd, closed by pool_destroy()) mapped shared,
+ * with 'reserve' bytes, rounded up to a page, at offset 0 in front of
+ * buffer 0: room for whatever describes the buffers to other processes.
+ */
+int pool_init_shared(struct buffer_pool *pool, int count, size_t size, size_t reserve,
+                     enum pool_backing want, int node);
+void pool_destroy(struct buffer_pool *pool);
+
+static inline void *pool_buf(const struct buffer_pool *pool, int i)
+{
+    return pool->base + (size_t)i * pool->stride;
+}
+
+/* NUMA node of the CPU the caller is running on, -1 if unknown */
+int pool_local_node(void);
+
+int parse_pool_backing(const char *name, enum pool_backing *backing);
+const char *pool_backing_name(enum pool_backing backing);
+
+/* "N", "local" or "any" */
+int parse_pool_node(const char *name, int *node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BUFFER_POOL_H */
@@ -0,0 +1,604 @@
+/*
+ * codec_test.c - Round-trip tests and throughput benchmark for raw_codec,
+ *                plus the preview binning and demosaic kernels against
+ *                plain C references and the tiled ISP against its
+ *                full-frame passes
+ *
+ * Usage:
+ *   ./codec_test                      run the tests and the benchmark
+ *   ./codec_test -d in.rc12 out.raw   decode a frame saved by frame_client.py
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "raw_codec.h"
+#include "preview.h"
+#include "demosaic.h"
+#include "isp_pipeline.h"
+
+#define FRAME_WIDTH 640
+#define FRAME_HEIGHT 480
+#define BENCH_ITERATIONS 200
+#define DEMOSAIC_BENCH_WIDTH 3840
+#define DEMOSAIC_BENCH_HEIGHT 2160
+
+#define COLOR_RED     "\033[1;31m"
+#define COLOR_GREEN   "\033[1;32m"
+#define COLOR_CYAN    "\033[1;36m"
+#define COLOR_RESET   "\033[0m"
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+enum pattern {
+    PATTERN_DRIVER,     // /dev/camera test pattern (05-interrupt-handling)
+    PATTERN_SENSOR,     // smooth scene, per-channel gain, read noise
+    PATTERN_NOISE12,    // uniform 12-bit noise: worst case for real data
+    PATTERN_NOISE16,    // full 16-bit range: exercises the 16-bit code
+};
+
+static const char *pattern_names[] = {
+    "driver gradient", "sensor-like", "12-bit noise", "16-bit noise",
+};
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void fill(uint16_t *px, int width, int height, enum pattern p, int frame)
+{
+    /* RGGB gains, roughly what a daylight white balance leaves in RAW */
+    static const int gain[2][2] = { { 9, 16 }, { 16, 6 } };
+    int i, j;
+
+    for (i = 0; i < height; i++) {
+        for (j = 0; j < width; j++) {
+            int v;
+
+            switch (p) {
+            case PATTERN_DRIVER:
+                v = ((i + j + frame * 10) * 16) % 4096;
+                break;
+            case PATTERN_SENSOR:
+                v = (((i * 3 + j * 2 + frame) % 2048) * gain[i & 1][j & 1]) / 8 +
+                    (int)(rng() % 9) - 4 + 64;
+                v = v < 0 ? 0 : v > 4095 ? 4095 : v;
+                break;
+            case PATTERN_NOISE12:
+                v = rng() & 0xfff;
+                break;
+            default:
+                v = rng() & 0xffff;
+                break;
+            }
+            px[(size_t)i * width + j] = (uint16_t)v;
+        }
+    }
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void check(int ok, const char *what)
+{
+    if (ok) {
+        printf(COLOR_GREEN "✓ %s\n" COLOR_RESET, what);
+        tests_passed++;
+    } else {
+        printf(COLOR_RED "✗ %s\n" COLOR_RESET, what);
+        tests_failed++;
+    }
+}
+
+/* Encode, decode and compare one image; prints the compression ratio */
+static void test_round_trip(int width, int height, enum pattern p)
+{
+    size_t samples = (size_t)width * height;
+    size_t cap = raw_codec_bound(width, height);
+    uint16_t *src = malloc(samples * 2);
+    uint16_t *out = malloc(samples * 2);
+    uint8_t *enc = malloc(cap);
+    char what[128];
+    size_t len;
+    int ok;
+
+    if (!src || !out || !enc) {
+        check(0, "allocate test buffers");
+        goto out;
+    }
+
+    fill(src, width, height, p, 3);
+    len = raw_encode(src, width, height, enc, cap);
+    ok = len > 0 && raw_decode(enc, len, out, samples) == 0 &&
+         memcmp(src, out, samples * 2) == 0;
+
+    snprintf(what, sizeof(what), "%dx%d %s: %zu -> %zu bytes (%.2f:1)",
+             width, height, pattern_names[p], samples * 2, len,
+             len ? (double)(samples * 2) / len : 0.0);
+    check(ok, what);
+
+    /* Every truncation of a valid stream must be rejected, not overrun */
+    if (ok && samples <= 4096) {
+        size_t cut;
+
+        for (cut = 0; cut < len; cut++)
+            if (raw_decode(enc, cut, out, samples) == 0)
+                break;
+        check(cut == len, "truncated streams are rejected");
+    }
+
+out:
+    free(src);
+    free(out);
+    free(enc);
+}
+
+static void test_bad_input(void)
+{
+    uint16_t px[64] = { 0 };
+    uint8_t enc[256];
+    size_t len;
+
+    printf("\n" COLOR_CYAN "Malformed input\n" COLOR_RESET);
+
+    check(raw_encode(px, 8, 8, enc, 16) == 0, "encode refuses a short buffer");
+
+    len = raw_encode(px, 8, 8, enc, sizeof(enc));
+    check(raw_decode(enc, len, px, 63) < 0, "decode refuses a small destination");
+
+    enc[0] ^= 0xff;
+    check(raw_decode(enc, len, px, 64) < 0, "decode refuses a bad magic");
+}
+
+/* bin2x2() (SIMD body, scalar tail) must match the obvious per-pixel loop */
+static void test_bin2x2(int width, int height, enum pattern p)
+{
+    int ow = width / 2, oh = height / 2;
+    uint16_t *src = malloc((size_t)width * height * 2);
+    uint16_t *out = malloc((size_t)ow * oh * 2 + 2);
+    char what[128];
+    int x, y, ok = 1;
+
+    if (!src || !out) {
+        check(0, "allocate test buffers");
+        goto out;
+    }
+
+    fill(src, width, height, p, 5);
+    bin2x2(src, width, height, out);
+    for (y = 0; y < oh && ok; y++)
+        for (x = 0; x < ow; x++) {
+            const uint16_t *q = src + (size_t)2 * y * width + 2 * x;
+            unsigned int sum = q[0] + q[1] + q[width] + q[width + 1];
+
+            if (out[(size_t)y * ow + x] != (sum + 2) >> 2) {
+                ok = 0;
+                break;
+            }
+        }
+
+    snprintf(what, sizeof(what), "bin2x2 %dx%d %s -> %dx%d", width, height,
+             pattern_names[p], ow, oh);
+    check(ok, what);
+
+out:
+    free(src);
+    free(out);
+}
+
+
+static const enum demosaic_isa kernel_isas[] = {
+    DEMOSAIC_SCALAR, DEMOSAIC_SSE41, DEMOSAIC_AVX2, DEMOSAIC_NEON,
+};
+
+#define N_KERNEL_ISAS (sizeof(kernel_isas) / sizeof(kernel_isas[0]))
+
+/*
+ * Every row-kernel path must match the per-pixel reference bit for bit,
+ * over the whole frame and when the frame is cut into tiles at odd offsets
+ */
+static void test_demosaic(int width, int height, enum pattern p, enum demosaic_method method)
+{
+    size_t plane = (size_t)width * height;
+    uint16_t *src = malloc(plane * 2);
+    uint16_t *ref = malloc(plane * 3 * 2);
+    uint16_t *out = malloc(plane * 3 * 2);
+    struct demosaic_out ro = { ref, ref + plane, ref + 2 * plane, (size_t)width };
+    char what[128];
+    size_t i;
+    int ok;
+
+    if (!src || !ref || !out) {
+        check(0, "allocate test buffers");
+        goto out;
+    }
+
+    fill(src, width, height, p, 3);
+    ok = demosaic_rect(src, width, width, height, 0, 0, width, height, &ro, method,
+                       DEMOSAIC_REFERENCE) == 0;
+    for (i = 0; i < plane * 3 && ok; i++)
+        ok = ref[i] <= 4095;
+    snprintf(what, sizeof(what), "demosaic %s %dx%d %s: reference in range",
+             demosaic_method_name(method), width, height, pattern_names[p]);
+    check(ok, what);
+
+    for (i = 0; i < N_KERNEL_ISAS; i++) {
+        struct demosaic_out o = { out, out + plane, out + 2 * plane, (size_t)width };
+
+        if (!demosaic_isa_supported(kernel_isas[i]))
+            continue;
+        memset(out, 0xff, plane * 3 * 2);
+        ok = demosaic_rect(src, width, width, height, 0, 0, width, height, &o, method,
+                           kernel_isas[i]) == 0 && memcmp(out, ref, plane * 3 * 2) == 0;
+        snprintf(what, sizeof(what), "demosaic %s %dx%d %s: %s matches reference",
+                 demosaic_method_name(method), width, height, pattern_names[p],
+                 demosaic_isa_name(kernel_isas[i]));
+        check(ok, what);
+    }
+
+    /* Tiles write straight into the full-frame planes */
+    {
+        const int tw = 37, th = 23;
+        int x, y;
+
+        memset(out, 0xff, plane * 3 * 2);
+        ok = 1;
+        for (y = 0; y < height && ok; y += th)
+            for (x = 0; x < width && ok; x += tw) {
+                size_t o = (size_t)y * width + x;
+                struct demosaic_out to = { out + o, out + plane + o, out + 2 * plane + o,
+                                           (size_t)width };
+
+                ok = demosaic_rect(src, width, width, height, x, y,
+                                   x + tw <= width ? tw : width - x,
+                                   y + th <= height ? th : height - y, &to, method,
+                                   DEMOSAIC_AUTO) == 0;
+            }
+        ok = ok && memcmp(out, ref, plane * 3 * 2) == 0;
+        snprintf(what, sizeof(what), "demosaic %s %dx%d %s: %dx%d tiles match",
+                 demosaic_method_name(method), width, height, pattern_names[p], tw, th);
+        check(ok, what);
+    }
+
+out:
+    free(src);
+    free(ref);
+    free(out);
+}
+
+/* A grey card must come out grey, and bad rectangles must be refused */
+static void test_demosaic_edges(void)
+{
+    enum { W = 64, H = 48 };
+    static uint16_t src[W * H], rgb[W * H * 3];
+    struct demosaic_out o = { rgb, rgb + W * H, rgb + 2 * W * H, W };
+    int m, ok;
+    size_t i;
+
+    for (m = DEMOSAIC_BILINEAR; m <= DEMOSAIC_EDGE; m++) {
+        for (i = 0; i < W * H; i++)
+            src[i] = 1234;
+        ok = demosaic(src, W, H, rgb, m) == 0;
+        for (i = 0; i < W * H * 3 && ok; i++)
+            ok = rgb[i] == 1234;
+        check(ok, m == DEMOSAIC_EDGE ? "demosaic edge keeps a flat field flat"
+                                     : "demosaic bilinear keeps a flat field flat");
+    }
+
+    check(demosaic_rect(src, W, W, H, 60, 0, 8, 8, &o, DEMOSAIC_BILINEAR,
+                        DEMOSAIC_SCALAR) < 0 &&
+          demosaic_rect(src, W, 3, 3, 0, 0, 3, 3, &o, DEMOSAIC_BILINEAR,
+                        DEMOSAIC_SCALAR) < 0 &&
+          demosaic_rect(src, W, W, H, 0, 0, 0, 8, &o, DEMOSAIC_EDGE,
+                        DEMOSAIC_SCALAR) < 0,
+          "demosaic rejects bad rectangles and tiny frames");
+}
+
+/*
+ * Fused tiles must give what six full-frame passes give, to the bit, for
+ * any tile size and thread count; two frames, so the second one runs on
+ * the gray world gains of the first
+ */
+static void test_isp(int width, int height, int threads, int tile_w, int tile_h,
+                     enum demosaic_method method)
+{
+    size_t samples = (size_t)width * height;
+    uint16_t *src = malloc(samples * 2);
+    uint8_t *tiled = malloc(samples * 3);
+    uint8_t *passes = malloc(samples * 3);
+    struct isp_pipeline *a = NULL, *b = NULL;
+    struct isp_params params;
+    double ga[3], gb[3];
+    char what[160];
+    int frame, tw, th, ok = 1;
+
+    if (!src || !tiled || !passes) {
+        check(0, "allocate test buffers");
+        goto out;
+    }
+    isp_params_default(&params);
+    params.method = method;
+    a = isp_create(width, height, &params, threads, tile_w, tile_h);
+    b = isp_create(width, height, &params, threads, tile_w, tile_h);
+    if (!a || !b) {
+        check(0, "create ISP pipelines");
+        goto out;
+    }
+
+    for (frame = 0; frame < 2 && ok; frame++) {
+        fill(src, width, height, PATTERN_SENSOR, frame);
+        memset(tiled, 0, samples * 3);
+        memset(passes, 0xff, samples * 3);
+        ok = isp_process(a, src, tiled) == 0 && isp_process_passes(b, src, passes) == 0 &&
+             memcmp(tiled, passes, samples * 3) == 0;
+        isp_gains(a, ga);
+        isp_gains(b, gb);
+        ok = ok && memcmp(ga, gb, sizeof(ga)) == 0;
+    }
+
+    isp_tile_size(a, &tw, &th);
+    snprintf(what, sizeof(what), "isp %s %dx%d, %dx%d tiles on %d threads matches passes",
+             demosaic_method_name(method), width, height, tw, th, isp_threads(a));
+    check(ok, what);
+
+out:
+    isp_destroy(a);
+    isp_destroy(b);
+    free(src);
+    free(tiled);
+    free(passes);
+}
+
+/* The sensor-like pattern is weak in R and B; gray world must boost both */
+static void test_isp_awb(void)
+{
+    enum { W = 128, H = 96 };
+    static uint16_t src[W * H];
+    static uint8_t rgb[W * H * 3];
+    struct isp_params params;
+    struct isp_pipeline *isp;
+    double gain[3];
+
+    isp_params_default(&params);
+    isp = isp_create(W, H, &params, 1, 0, 0);
+    if (!isp) {
+        check(0, "create ISP pipeline");
+        return;
+    }
+    fill(src, W, H, PATTERN_SENSOR, 0);
+    isp_process(isp, src, rgb);
+    isp_gains(isp, gain);
+    check(gain[0] > 1.2 && gain[2] > gain[0] && gain[1] == 1.0,
+          "isp gray world boosts the weaker R and B channels");
+    isp_destroy(isp);
+}
+
+static void benchmark(void)
+{
+    size_t samples = (size_t)FRAME_WIDTH * FRAME_HEIGHT;
+    size_t cap = raw_codec_bound(FRAME_WIDTH, FRAME_HEIGHT);
+    uint16_t *src = malloc(samples * 2);
+    uint16_t *out = malloc(samples * 2);
+    uint8_t *enc = malloc(cap);
+    size_t len = 0;
+    double t0, t_enc, t_dec;
+    int i;
+
+    if (!src || !out || !enc) {
+        perror("Failed to allocate benchmark buffers");
+        goto out;
+    }
+
+    printf("\n" COLOR_CYAN "Benchmark: %dx%d sensor-like, %d frames, %s path\n" COLOR_RESET,
+           FRAME_WIDTH, FRAME_HEIGHT, BENCH_ITERATIONS, raw_codec_simd());
+    fill(src, FRAME_WIDTH, FRAME_HEIGHT, PATTERN_SENSOR, 0);
+
+    t0 = now_sec();
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+        len = raw_encode(src, FRAME_WIDTH, FRAME_HEIGHT, enc, cap);
+    t_enc = (now_sec() - t0) / BENCH_ITERATIONS;
+
+    t0 = now_sec();
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+        raw_decode(enc, len, out, samples);
+    t_dec = (now_sec() - t0) / BENCH_ITERATIONS;
+
+    printf("  encode: %.3f ms/frame, %.0f MB/s, %.0f fps\n",
+           t_enc * 1e3, samples * 2 / t_enc / 1e6, 1.0 / t_enc);
+    printf("  decode: %.3f ms/frame, %.0f MB/s, %.0f fps\n",
+           t_dec * 1e3, samples * 2 / t_dec / 1e6, 1.0 / t_dec);
+    printf("  ratio:  %.2f:1 (%zu -> %zu bytes)\n",
+           (double)(samples * 2) / len, samples * 2, len);
+
+out:
+    free(src);
+    free(out);
+    free(enc);
+}
+
+/*
+ * Megapixels per second of each path on a 4K sensor-like frame. The
+ * baseline is the plain C row kernels, which split off the border like
+ * the SIMD paths do; the per-pixel reference is for the tests only.
+ */
+static void benchmark_demosaic(void)
+{
+    const int width = DEMOSAIC_BENCH_WIDTH, height = DEMOSAIC_BENCH_HEIGHT;
+    size_t plane = (size_t)width * height;
+    uint16_t *src = malloc(plane * 2);
+    uint16_t *rgb = malloc(plane * 3 * 2);
+    struct demosaic_out o = { rgb, rgb + plane, rgb + 2 * plane, (size_t)width };
+    static const enum demosaic_isa isas[] = {
+        DEMOSAIC_SCALAR, DEMOSAIC_SSE41, DEMOSAIC_AVX2, DEMOSAIC_NEON,
+    };
+    int m;
+    size_t i;
+
+    if (!src || !rgb) {
+        perror("Failed to allocate benchmark buffers");
+        goto out;
+    }
+
+    printf("\n" COLOR_CYAN "Benchmark: demosaic %dx%d sensor-like, single thread\n" COLOR_RESET,
+           width, height);
+    fill(src, width, height, PATTERN_SENSOR, 0);
+
+    for (m = DEMOSAIC_BILINEAR; m <= DEMOSAIC_EDGE; m++) {
+        double scalar_mps = 0;
+
+        for (i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+            double t0, t, mps;
+            int n = 0;
+
+            if (!demosaic_isa_supported(isas[i]))
+                continue;
+            /* At least 3 frames and half a second per path */
+            t0 = now_sec();
+            do {
+                demosaic_rect(src, width, width, height, 0, 0, width, height, &o, m, isas[i]);
+                n++;
+                t = now_sec() - t0;
+            } while (n < 3 || t < 0.5);
+            t /= n;
+            mps = plane / t / 1e6;
+            if (isas[i] == DEMOSAIC_SCALAR)
+                scalar_mps = mps;
+            printf("  %-8s %-6s: %7.2f ms/frame, %7.1f MP/s, %5.2fx scalar\n",
+                   demosaic_method_name(m), demosaic_isa_name(isas[i]), t * 1e3, mps,
+                   mps / scalar_mps);
+        }
+    }
+
+out:
+    free(src);
+    free(rgb);
+}
+
+/* Decode an .rc12 payload saved by test/frame_client.py --save */
+static int decode_file(const char *in_path, const char *out_path)
+{
+    FILE *in = NULL, *out = NULL;
+    uint8_t *enc = NULL;
+    uint16_t *px = NULL;
+    long len;
+    int width, height;
+    int ret = 1;
+
+    in = fopen(in_path, "rb");
+    if (!in) {
+        perror("Failed to open input");
+        return 1;
+    }
+    if (fseek(in, 0, SEEK_END) < 0 || (len = ftell(in)) < 0 ||
+        fseek(in, 0, SEEK_SET) < 0) {
+        perror("Failed to size input");
+        goto out;
+    }
+
+    enc = malloc(len ? len : 1);
+    if (!enc || fread(enc, 1, len, in) != (size_t)len) {
+        fprintf(stderr, "Failed to read %s\n", in_path);
+        goto out;
+    }
+    if (raw_codec_dims(enc, len, &width, &height) < 0) {
+        fprintf(stderr, "%s is not an RC12 stream\n", in_path);
+        goto out;
+    }
+
+    px = malloc((size_t)width * height * 2);
+    if (!px || raw_decode(enc, len, px, (size_t)width * height) < 0) {
+        fprintf(stderr, "Failed to decode %s\n", in_path);
+        goto out;
+    }
+
+    out = fopen(out_path, "wb");
+    if (!out || fwrite(px, 2, (size_t)width * height, out) != (size_t)width * height) {
+        perror("Failed to write output");
+        goto out;
+    }
+    printf("✓ %s: %dx%d, %ld -> %zu bytes\n", out_path, width, height, len,
+           (size_t)width * height * 2);
+    ret = 0;
+
+out:
+    if (out)
+        fclose(out);
+    fclose(in);
+    free(enc);
+    free(px);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    int p, m;
+
+    if (argc == 4 && strcmp(argv[1], "-d") == 0)
+        return decode_file(argv[2], argv[3]);
+    if (argc != 1) {
+        printf("Usage: %s [-d in.rc12 out.raw]\n", argv[0]);
+        return 1;
+    }
+
+    printf(COLOR_CYAN "Round trip (%s path)\n" COLOR_RESET, raw_codec_simd());
+    for (p = PATTERN_DRIVER; p <= PATTERN_NOISE16; p++)
+        test_round_trip(FRAME_WIDTH, FRAME_HEIGHT, p);
+
+    /* Sizes that leave partial blocks and rows without a left neighbour */
+    test_round_trip(1, 1, PATTERN_NOISE16);
+    test_round_trip(2, 7, PATTERN_SENSOR);
+    test_round_trip(37, 5, PATTERN_NOISE12);
+    test_round_trip(17, 33, PATTERN_NOISE16);
+    test_round_trip(64, 64, PATTERN_SENSOR);
+
+    test_bad_input();
+
+    printf("\n" COLOR_CYAN "Preview binning (%s path)\n" COLOR_RESET, preview_simd());
+    test_bin2x2(FRAME_WIDTH, FRAME_HEIGHT, PATTERN_NOISE16);
+    test_bin2x2(FRAME_WIDTH, FRAME_HEIGHT, PATTERN_SENSOR);
+    test_bin2x2(37, 5, PATTERN_NOISE16);
+    test_bin2x2(18, 2, PATTERN_NOISE12);
+    test_bin2x2(1, 1, PATTERN_NOISE16);
+
+    printf("\n" COLOR_CYAN "Demosaic (%s path)\n" COLOR_RESET,
+           demosaic_isa_name(DEMOSAIC_AUTO));
+    for (m = DEMOSAIC_BILINEAR; m <= DEMOSAIC_EDGE; m++) {
+        test_demosaic(FRAME_WIDTH, FRAME_HEIGHT, PATTERN_SENSOR, m);
+        test_demosaic(FRAME_WIDTH, FRAME_HEIGHT, PATTERN_DRIVER, m);
+        /* Odd sizes leave scalar tails and 1-pixel tiles at the borders */
+        test_demosaic(101, 67, PATTERN_NOISE12, m);
+        test_demosaic(4, 4, PATTERN_NOISE12, m);
+    }
+    test_demosaic_edges();
+
+    printf("\n" COLOR_CYAN "ISP pipeline\n" COLOR_RESET);
+    for (m = DEMOSAIC_BILINEAR; m <= DEMOSAIC_EDGE; m++) {
+        test_isp(FRAME_WIDTH, FRAME_HEIGHT, 3, 0, 0, m);
+        test_isp(FRAME_WIDTH, FRAME_HEIGHT, 4, 64, 32, m);
+        /* 1-pixel tiles at the right and bottom edges */
+        test_isp(129, 73, 2, 16, 12, m);
+        test_isp(4, 4, 2, 2, 2, m);
+    }
+    test_isp_awb();
+
+    benchmark();
+    benchmark_demosaic();
+
+    printf("\n%d passed, %d failed\n", tests_passed, tests_failed);
+    return tests_failed ? 1 : 0;
+}
@@ -0,0 +1,708 @@
+// coro_streamer.cpp - frame_streamer's TCP path as coroutines on executor.hpp
+//
+// The same pipeline (source -> frame ring -> every client) with each stage
+// written as a plain loop that suspends instead of blocking:
+//
+//   capture    waits for the device to poll readable (or the synthetic /
+//              replay clock), reads into a ring slot, RC12-encodes it
+//   fan-out    waits on the ring's eventfd and queues a reference to each
+//              new frame on every session
+//   accept     waits for the listening socket, starts a session per client
+//   session    one per client: waits for a queued frame, writes it, waits
+//              for the socket to drain whenever the kernel buffer is full
+//
+// All of them run on a small worker pool; one reactor thread does nothing
+// but epoll_wait(). Thousands of clients cost a coroutine frame and a
+// short queue each, not a thread. The wire format is frame_streamer's, so
+// frame_receiver and bench.py work unchanged; stream subscriptions,
+// previews, ROIs and pacing are frame_streamer-only.
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "executor.hpp"
+#include "frame_ring.h"
+#include "frame_source.h"
+#include "raw_codec.h"
+#include "stream_stats.h"
+
+namespace {
+
+constexpr int kPort = 8080;                 // same as frame_streamer
+constexpr int kRingDepth = 8;
+constexpr int kClientDepth = 4;
+constexpr int kMaxClients = 4096;
+constexpr uint64_t kPollNs = 100000000;     // re-check Ctrl+C this often
+constexpr uint64_t kDrainNs = 2000000000;   // clients get this long to catch up
+
+volatile sig_atomic_t stop_requested = 0;
+
+void handle_signal(int) { stop_requested = 1; }
+
+struct Options {
+    int frames = 0;
+    int ring_depth = kRingDepth;
+    int client_depth = kClientDepth;
+    int max_clients = kMaxClients;
+    int wait_clients = 1;
+    int threads = 0;
+    int stats = 1;
+    bool compress = false;
+    bool verbose = false;
+};
+
+// One client. The fan-out pushes frame references, the session's own
+// coroutine pops and sends them. It waits on its socket, which wakes it
+// for new frames, the end of the stream or the client hanging up.
+class Session {
+public:
+    Session(coro::Pollable *sock, const sockaddr_in &addr, int depth)
+        : sock_(sock), queue_(depth + 1)
+    {
+        snprintf(name_, sizeof(name_), "%s:%d", inet_ntoa(addr.sin_addr),
+                 ntohs(addr.sin_port));
+    }
+
+    // Queue a reference to slot; false (nothing taken) if the queue is full
+    bool push(frame_slot *slot)
+    {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (count_ == static_cast<int>(queue_.size())) {
+                frames_dropped_++;
+                return false;
+            }
+            ring_get(slot);
+            queue_[(head_ + count_++) % queue_.size()] = slot;
+        }
+        sock_->wake();
+        return true;
+    }
+
+    frame_slot *pop()
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (count_ == 0)
+            return nullptr;
+        frame_slot *slot = queue_[head_];
+        head_ = (head_ + 1) % queue_.size();
+        count_--;
+        return slot;
+    }
+
+    // No more frames will be pushed: send what is queued, then finish
+    void end()
+    {
+        ending_.store(true, std::memory_order_release);
+        sock_->wake();
+    }
+    bool ending() const { return ending_.load(std::memory_order_acquire); }
+
+    coro::Pollable *sock() const { return sock_; }
+    const char *name() const { return name_; }
+
+    unsigned long frames_sent = 0;
+    unsigned long long bytes_sent = 0;
+    unsigned long frames_dropped() const { return frames_dropped_; }
+
+private:
+    coro::Pollable *sock_;
+    char name_[32];
+    std::atomic<bool> ending_{false};
+
+    std::mutex lock_;
+    std::vector<frame_slot *> queue_;
+    int head_ = 0;
+    int count_ = 0;
+    unsigned long frames_dropped_ = 0;
+};
+
+class Streamer {
+public:
+    Streamer(coro::Executor &exec, const Options &opt, frame_source &src)
+        : exec_(exec), opt_(opt), src_(src)
+    {
+    }
+    ~Streamer()
+    {
+        if (ring_ready_)
+            ring_destroy(&ring_);
+        free(scratch_);
+    }
+
+    int init(int listen_fd)
+    {
+        size_t slot_size = src_.max_frame;
+
+        if (opt_.compress && raw_codec_bound(src_.width, src_.height) > slot_size)
+            slot_size = raw_codec_bound(src_.width, src_.height);
+        if (ring_init(&ring_, opt_.ring_depth, slot_size, DROP_NEWEST, POOL_AUTO,
+                      POOL_NODE_ANY) < 0) {
+            fprintf(stderr, "Failed to allocate frame ring\n");
+            return -1;
+        }
+        ring_ready_ = true;
+        scratch_ = static_cast<char *>(malloc(slot_size));
+        if (!scratch_) {
+            perror("Failed to allocate buffer");
+            return -1;
+        }
+        printf("✓ Frame ring: %d x %zu bytes, drop policy 'newest'\n", ring_.depth, slot_size);
+        if (opt_.compress)
+            printf("✓ RC12 lossless compression (%s)\n", raw_codec_simd());
+
+        listener_ = exec_.watch(listen_fd);
+        if (!listener_) {
+            close(listen_fd);
+            return -1;
+        }
+        return 0;
+    }
+
+    void start()
+    {
+        exec_.spawn(capture());
+        exec_.spawn(fan_out());
+        exec_.spawn(accept_clients());
+    }
+
+    stream_stats &stats() { return stats_; }
+    int captured() const { return captured_; }
+    unsigned long ring_dropped() const { return ring_.dropped; }
+    int peak_clients() const { return peak_clients_; }
+
+private:
+    coro::Task capture();
+    coro::Task fan_out();
+    coro::Task accept_clients();
+    coro::Task serve(Session *s);
+
+    void finish(Session *s);
+
+    coro::Executor &exec_;
+    const Options &opt_;
+    frame_source &src_;
+    frame_ring ring_;
+    bool ring_ready_ = false;
+    char *scratch_ = nullptr;       // read buffer when compressing
+    coro::Pollable *listener_ = nullptr;
+    stream_stats stats_ = {};
+    int captured_ = 0;
+
+    std::mutex sessions_lock_;
+    std::vector<Session *> sessions_;
+    bool ended_ = false;            // the fan-out is done, no new sessions
+    int peak_clients_ = 0;
+};
+
+// Wait for the clients, then read frames until --frames, the end of the
+// source or Ctrl+C, and close the ring behind the last one
+coro::Task Streamer::capture()
+{
+    coro::Pollable *dev = nullptr;
+    frame_header hdr;
+
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(sessions_lock_);
+            if (static_cast<int>(sessions_.size()) >= opt_.wait_clients)
+                break;
+        }
+        if (stop_requested)
+            break;
+        co_await exec_.sleep_until(coro::monotonic_ns() + kPollNs);
+    }
+    if (!stop_requested)
+        printf("Starting capture...\n");
+
+    // The device fd stays blocking (a spurious wakeup then waits in read()
+    // for the frame); the reactor gets a duplicate it may close
+    if (src_.kind == SOURCE_DEVICE) {
+        int fd = dup(src_.fd);
+
+        dev = fd >= 0 ? exec_.watch(fd) : nullptr;
+        if (!dev) {
+            perror("Failed to watch device");
+            if (fd >= 0)
+                close(fd);
+            stop_requested = 1;
+        }
+    }
+
+    while (!stop_requested && (opt_.frames == 0 || captured_ < opt_.frames)) {
+        uint64_t due_ns;
+
+        if (source_due(&src_, &due_ns) <= 0)
+            break;
+        if (dev) {
+            if (!co_await dev->readable())
+                break;
+        } else if (due_ns) {
+            // In short steps, like source_wait(), so Ctrl+C is noticed
+            while (!stop_requested && coro::monotonic_ns() < due_ns)
+                co_await exec_.sleep_until(std::min(due_ns, coro::monotonic_ns() + kPollNs));
+        } else {
+            // Unpaced: nothing preempts a coroutine, so let the fan-out
+            // and the sessions have the worker between frames
+            co_await exec_.schedule();
+        }
+        if (stop_requested)
+            break;
+
+        // The frame must be read even when it is dropped (see frame_streamer.c)
+        frame_slot *slot = ring_acquire(&ring_);
+        char *dst = slot && !opt_.compress ? slot->data : scratch_;
+        ssize_t len = source_read(&src_, dst, &hdr, nullptr);
+
+        if (len <= 0) {
+            if (slot)
+                ring_release(&ring_, slot);
+            break;
+        }
+        captured_++;
+        if (!slot) {
+            stats_dropped(&stats_);
+            if (opt_.verbose)
+                printf("[%d] Ring full, frame dropped\n", captured_);
+            continue;
+        }
+
+        slot->len = len;
+        slot->frame_no = captured_;
+        slot->stream = 0;
+        slot->hdr = hdr;
+        if (opt_.compress && !(hdr.flags & FRAME_FLAG_RC12)) {
+            slot->len = raw_encode(reinterpret_cast<const uint16_t *>(scratch_), hdr.width,
+                                   hdr.height, slot->data, ring_.frame_size);
+            slot->hdr.payload_len = static_cast<uint32_t>(slot->len);
+            slot->hdr.flags |= FRAME_FLAG_RC12;
+        } else if (opt_.compress) {
+            memcpy(slot->data, scratch_, len);
+        }
+        if (opt_.verbose)
+            printf("[%d] Read %zd bytes, queued %zu\n", captured_, len, slot->len);
+        stats_read(&stats_, slot->len);
+        ring_publish(&ring_, slot);
+    }
+
+    if (dev)
+        exec_.unwatch(dev);
+    ring_close(&ring_);
+}
+
+// Hand every published frame to every session, then wind the sessions down
+coro::Task Streamer::fan_out()
+{
+    int fd = dup(ring_.notify_fd);
+    coro::Pollable *notify = fd >= 0 ? exec_.watch(fd) : nullptr;
+    int drained = 0;
+
+    if (!notify) {
+        perror("Failed to watch frame ring");
+        if (fd >= 0)
+            close(fd);
+        stop_requested = 1;
+    }
+
+    while (notify && !drained) {
+        uint64_t counter;
+        frame_slot *slot;
+
+        // Reset the eventfd before looking, so a publish after the last
+        // ring_try_consume() still wakes us
+        if (read(notify->fd(), &counter, sizeof(counter)) < 0 && errno != EAGAIN)
+            perror("Failed to read ring eventfd");
+        while ((slot = ring_try_consume(&ring_, &drained)) != nullptr) {
+            {
+                std::lock_guard<std::mutex> lock(sessions_lock_);
+                for (Session *s : sessions_) {
+                    if (!s->push(slot) && opt_.verbose)
+                        printf("Client %s behind, frame %u dropped\n", s->name(), slot->frame_no);
+                }
+            }
+            ring_release(&ring_, slot);
+        }
+        if (!drained && !co_await notify->readable())
+            break;
+    }
+    if (notify)
+        exec_.unwatch(notify);
+
+    // No new clients; the connected ones flush what they have queued
+    {
+        std::lock_guard<std::mutex> lock(sessions_lock_);
+        ended_ = true;
+        for (Session *s : sessions_)
+            s->end();
+    }
+    exec_.cancel(listener_);
+
+    uint64_t deadline = coro::monotonic_ns() + kDrainNs;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(sessions_lock_);
+            if (sessions_.empty())
+                co_return;
+            if (coro::monotonic_ns() >= deadline) {
+                printf("Note: %zu client(s) still behind after %.0f s, closing them\n",
+                       sessions_.size(), kDrainNs / 1e9);
+                for (Session *s : sessions_)
+                    exec_.cancel(s->sock());
+                co_return;
+            }
+        }
+        co_await exec_.sleep_until(coro::monotonic_ns() + kPollNs);
+    }
+}
+
+coro::Task Streamer::accept_clients()
+{
+    for (;;) {
+        sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        int fd = accept4(listener_->fd(), reinterpret_cast<sockaddr *>(&addr), &addr_len,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (!co_await listener_->readable())
+                    break;
+            } else if (errno != EINTR && errno != ECONNABORTED) {
+                // EMFILE: the connection waits in the backlog until a
+                // client leaves, or the fan-out cancels the listener
+                perror("Accept failed");
+                co_await exec_.sleep_until(coro::monotonic_ns() + kPollNs);
+                std::lock_guard<std::mutex> lock(sessions_lock_);
+                if (ended_)
+                    break;
+            }
+            continue;
+        }
+
+        coro::Pollable *sock = exec_.watch(fd);
+        if (!sock) {
+            perror("epoll_ctl failed");
+            close(fd);
+            continue;
+        }
+        Session *s = new Session(sock, addr, opt_.client_depth);
+        int nclients = -1;
+        bool ended;
+        {
+            std::lock_guard<std::mutex> lock(sessions_lock_);
+            ended = ended_;
+            if (!ended && static_cast<int>(sessions_.size()) < opt_.max_clients) {
+                sessions_.push_back(s);
+                nclients = static_cast<int>(sessions_.size());
+                peak_clients_ = std::max(peak_clients_, nclients);
+            }
+        }
+        if (nclients < 0) {
+            if (!ended)
+                fprintf(stderr, "Rejecting client: already serving %d\n", opt_.max_clients);
+            exec_.unwatch(sock);
+            delete s;
+            continue;
+        }
+        if (opt_.verbose)
+            printf("✓ Client connected from %s (%d connected)\n", s->name(), nclients);
+        exec_.spawn(serve(s));
+    }
+    exec_.unwatch(listener_);
+}
+
+// Woken without a frame: read and ignore what the client sent (it gets
+// no requests here) and tell whether it closed the connection
+bool hung_up(Session *s)
+{
+    char buf[256];
+
+    for (;;) {
+        ssize_t n = recv(s->sock()->fd(), buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0)
+            continue;
+        if (n < 0 && errno == EINTR)
+            continue;
+        return n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+}
+
+// Write each queued frame (header, extensions, payload) to the client
+coro::Task Streamer::serve(Session *s)
+{
+    bool alive = true;
+
+    while (alive) {
+        // Read before pop(): every frame pushed ahead of end() is seen
+        bool ending = s->ending();
+        frame_slot *slot = s->pop();
+
+        if (!slot) {
+            if (ending || !co_await s->sock()->readable() || hung_up(s))
+                break;
+            continue;
+        }
+
+        size_t total = slot_wire_len(slot, 0);
+        size_t offset = 0;
+        while (offset < total) {
+            struct iovec iov[2];
+            struct msghdr msg = {};
+
+            msg.msg_iov = iov;
+            msg.msg_iovlen = slot_iov(slot, 0, offset, iov);
+            ssize_t n = sendmsg(s->sock()->fd(), &msg, MSG_NOSIGNAL);
+            if (n >= 0) {
+                offset += n;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (!co_await s->sock()->writable()) {
+                    alive = false;
+                    break;
+                }
+            } else if (errno != EINTR) {
+                if (opt_.verbose)
+                    printf("Client %s: %s\n", s->name(), strerror(errno));
+                alive = false;
+                break;
+            }
+        }
+        ring_release(&ring_, slot);
+        if (offset == total) {
+            s->frames_sent++;
+            s->bytes_sent += total;
+            stats_sent(&stats_, total);
+        }
+    }
+    finish(s);
+}
+
+// Forget the session and give back the frames it still held
+void Streamer::finish(Session *s)
+{
+    frame_slot *slot;
+    int nclients;
+
+    {
+        std::lock_guard<std::mutex> lock(sessions_lock_);
+        for (size_t i = 0; i < sessions_.size(); i++) {
+            if (sessions_[i] == s) {
+                sessions_[i] = sessions_.back();
+                sessions_.pop_back();
+                break;
+            }
+        }
+        nclients = static_cast<int>(sessions_.size());
+    }
+    while ((slot = s->pop()) != nullptr)
+        ring_release(&ring_, slot);
+    if (opt_.verbose)
+        printf("✓ Client %s disconnected: sent %lu frames (%llu bytes), dropped %lu "
+               "(%d connected)\n",
+               s->name(), s->frames_sent, s->bytes_sent, s->frames_dropped(), nclients);
+    exec_.unwatch(s->sock());
+    delete s;
+}
+
+int listen_on(int port)
+{
+    sockaddr_in addr = {};
+    int opt = 1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        perror("Bind failed");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, SOMAXCONN) < 0) {
+        perror("Listen failed");
+        close(fd);
+        return -1;
+    }
+    printf("✓ Listening on port %d...\n", port);
+    return fd;
+}
+
+// One fd per client: lift the soft limit as far as the hard one allows
+void raise_fd_limit(int max_clients)
+{
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+        return;
+    rlim_t want = static_cast<rlim_t>(max_clients) + 64;
+    if (rl.rlim_cur >= want)
+        return;
+    rl.rlim_cur = std::min(want, rl.rlim_max);
+    setrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur < want)
+        printf("Note: open file limit %lu, fewer than %d clients fit\n",
+               static_cast<unsigned long>(rl.rlim_cur), max_clients);
+}
+
+void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  -n, --frames N        frames to capture, 0 = unlimited (default 0)\n");
+    printf("  -d, --ring-depth N    frame buffers between capture and send (default %d)\n",
+           kRingDepth);
+    printf("  -q, --client-depth N  frames queued per client before it drops (default %d)\n",
+           kClientDepth);
+    printf("  -C, --compress        lossless RC12 compression of every frame\n");
+    printf("  -i, --source SPEC     device[:PATH] | synthetic[:WxH[@FPS]] | replay:FILE\n");
+    printf("                        (default device:%s)\n", SOURCE_DEFAULT_DEVICE);
+    printf("  -M, --max-rate        replay or synthesize as fast as possible\n");
+    printf("  -t, --threads N       worker threads, 0 = one per CPU (default 0)\n");
+    printf("  -s, --stats SECS      print a summary line every SECS, 0 = off (default 1)\n");
+    printf("  -v, --verbose         print a line per frame and per client\n");
+    printf("  -c, --max-clients N   concurrent clients (default %d)\n", kMaxClients);
+    printf("  -w, --wait-clients N  start capturing once N clients are connected (default 1)\n");
+    printf("  -h, --help            show this help\n");
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        { "frames",       required_argument, nullptr, 'n' },
+        { "ring-depth",   required_argument, nullptr, 'd' },
+        { "client-depth", required_argument, nullptr, 'q' },
+        { "compress",     no_argument,       nullptr, 'C' },
+        { "source",       required_argument, nullptr, 'i' },
+        { "max-rate",     no_argument,       nullptr, 'M' },
+        { "threads",      required_argument, nullptr, 't' },
+        { "stats",        required_argument, nullptr, 's' },
+        { "verbose",      no_argument,       nullptr, 'v' },
+        { "max-clients",  required_argument, nullptr, 'c' },
+        { "wait-clients", required_argument, nullptr, 'w' },
+        { "help",         no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    frame_source src = {};
+    Options opt;
+    bool max_rate = false;
+    int c;
+
+    src.stop = &stop_requested;
+    source_parse(&src, "device");
+    while ((c = getopt_long(argc, argv, "n:d:q:Ci:Mt:s:vc:w:h", long_options, nullptr)) != -1) {
+        switch (c) {
+        case 'n':
+            opt.frames = atoi(optarg);
+            break;
+        case 'd':
+            opt.ring_depth = atoi(optarg);
+            break;
+        case 'q':
+            opt.client_depth = atoi(optarg);
+            break;
+        case 'C':
+            opt.compress = true;
+            break;
+        case 'i':
+            if (source_parse(&src, optarg) < 0) {
+                fprintf(stderr, "Invalid source: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'M':
+            max_rate = true;
+            break;
+        case 't':
+            opt.threads = atoi(optarg);
+            break;
+        case 's':
+            opt.stats = atoi(optarg);
+            break;
+        case 'v':
+            opt.verbose = true;
+            opt.stats = 0;
+            break;
+        case 'c':
+            opt.max_clients = atoi(optarg);
+            break;
+        case 'w':
+            opt.wait_clients = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt.frames < 0 || opt.ring_depth < 1 || opt.client_depth < 1 || opt.max_clients < 1 ||
+        opt.wait_clients < 0 || opt.threads < 0 || opt.stats < 0) {
+        fprintf(stderr, "Invalid option value\n");
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (max_rate) {
+        src.max_rate = 1;
+        if (src.kind == SOURCE_SYNTHETIC)
+            src.fps = 0;
+    }
+
+    printf("=== Coroutine Frame Streamer ===\n\n");
+
+    struct sigaction sa = {};
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    if (source_open(&src) < 0)
+        return 1;
+    raise_fd_limit(opt.max_clients);
+
+    int ret = 1;
+    {
+        coro::Executor exec(opt.threads);
+        Streamer streamer(exec, opt, src);
+        int listen_fd;
+
+        if (!exec.ok()) {
+            fprintf(stderr, "Failed to start executor: %s\n", strerror(exec.error()));
+        } else if ((listen_fd = listen_on(kPort)) >= 0 && streamer.init(listen_fd) == 0) {
+            printf("✓ Executor: 1 reactor thread, %d worker threads\n", exec.threads());
+            if (opt.wait_clients > 0)
+                printf("Waiting for %d client(s)...\n", opt.wait_clients);
+            stats_start(&streamer.stats(), opt.stats);
+            streamer.start();
+            ret = exec.run() < 0 ? 1 : 0;
+            stats_stop(&streamer.stats());
+            if (ret)
+                fprintf(stderr, "epoll_wait failed: %s\n", strerror(exec.error()));
+            printf("\n✓ Captured %d frames, ring dropped %lu, up to %d clients.\n",
+                   streamer.captured(), streamer.ring_dropped(), streamer.peak_clients());
+            printf("✓ Sent %llu frames (%.1f MB)\n", streamer.stats().frames_sent,
+                   streamer.stats().bytes_sent / 1e6);
+        }
+    }
+    source_close(&src);
+    return ret;
+}
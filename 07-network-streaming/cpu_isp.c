@@ -0,0 +1,391 @@
+// cpu_isp.c - Run the tiled CPU ISP on frames from a source, report throughput
+//
+// Frames come from any frame source (default: the driver's test pattern
+// synthesized at 3840x2160 as fast as possible) and go through
+// isp_pipeline.c on a work-stealing pool; only the ISP is timed.
+// --scaling processes the same frames at 1, 2, 4 ... threads and prints
+// the speedup over one thread; --unfused runs the six full-frame passes
+// instead of the fused tiles, for comparison. --output saves the last
+// frame as a PPM.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "frame_source.h"
+#include "isp_pipeline.h"
+#include "raw_codec.h"
+
+#define DEFAULT_SOURCE "synthetic:3840x2160@0"
+#define DEFAULT_FRAMES 30
+#define SCALING_FRAMES 4    // distinct frames kept in memory for --scaling
+
+static volatile sig_atomic_t stop_requested;
+
+static void handle_sigint(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  -i, --source SPEC     device[:PATH] | synthetic[:WxH[@FPS]] | replay:FILE\n");
+    printf("                        (default %s)\n", DEFAULT_SOURCE);
+    printf("  -n, --frames N        frames to process (default %d)\n", DEFAULT_FRAMES);
+    printf("  -t, --threads N       worker threads, 0 = one per online CPU (default 0)\n");
+    printf("  -T, --tile WxH        tile size (default: a tile and its halo fit half of L2)\n");
+    printf("  -m, --method M        demosaic: bilinear|edge (default edge)\n");
+    printf("  -b, --black-level N   12-bit black level (default 64)\n");
+    printf("  -w, --wb R,G,B|auto   white balance gains, or gray world (default auto)\n");
+    printf("  -g, --gamma G         display gamma (default 2.2)\n");
+    printf("  -d, --denoise N       denoise strength in 12-bit levels, 0 = off (default 24)\n");
+    printf("  -s, --sharpen N       sharpening in sixteenths, 0-64 (default 8)\n");
+    printf("  -u, --unfused         six full-frame passes instead of fused tiles\n");
+    printf("  -S, --scaling         time 1, 2, 4 ... --threads threads on the same frames\n");
+    printf("  -o, --output FILE     write the last frame as a binary PPM\n");
+    printf("  -h, --help            show this help\n");
+}
+
+/* The next RAW12 frame into px; RC12 recordings are decoded. 1, 0 at the end, -1 on error. */
+static int next_frame(struct frame_source *src, void *buf, uint16_t *px)
+{
+    struct frame_header hdr;
+    size_t samples = (size_t)src->width * src->height;
+    ssize_t len;
+    int ret;
+
+    ret = source_wait(src);
+    if (ret <= 0)
+        return ret;
+    len = source_read(src, buf, &hdr, NULL);
+    if (len <= 0)
+        return len < 0 ? -1 : 0;
+
+    if (hdr.pixel_format != PIX_FMT_RAW12_RGGB || hdr.width != (uint32_t)src->width ||
+        hdr.height != (uint32_t)src->height) {
+        fprintf(stderr, "Frame %u is not %dx%d RAW12 RGGB\n", hdr.sequence, src->width,
+                src->height);
+        return -1;
+    }
+    if (hdr.flags & FRAME_FLAG_RC12) {
+        if (raw_decode(buf, len, px, samples) < 0) {
+            fprintf(stderr, "Frame %u: bad RC12 payload\n", hdr.sequence);
+            return -1;
+        }
+    } else if ((size_t)len < samples * 2) {
+        fprintf(stderr, "Frame %u: short payload (%zd bytes)\n", hdr.sequence, len);
+        return -1;
+    } else {
+        memcpy(px, buf, samples * 2);
+    }
+    return 1;
+}
+
+static int process(struct isp_pipeline *isp, int unfused, const uint16_t *px, uint8_t *rgb)
+{
+    return unfused ? isp_process_passes(isp, px, rgb) : isp_process(isp, px, rgb);
+}
+
+static int write_ppm(const char *path, const uint8_t *rgb, int width, int height)
+{
+    FILE *f = fopen(path, "wb");
+    size_t size = (size_t)width * height * 3;
+    int ok;
+
+    if (!f) {
+        perror("Failed to create output");
+        return -1;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    ok = fwrite(rgb, 1, size, f) == size;
+    if (fclose(f) != 0)
+        ok = 0;
+    if (!ok) {
+        perror("Failed to write output");
+        return -1;
+    }
+    printf("✓ Wrote %s (%dx%d)\n", path, width, height);
+    return 0;
+}
+
+/* sweep_max > 0: the --scaling sweep, 1 to sweep_max threads */
+static void print_config(const struct isp_pipeline *isp, const struct isp_params *params,
+                         int unfused, int sweep_max)
+{
+    char threads[32];
+    int tw, th;
+
+    isp_tile_size(isp, &tw, &th);
+    if (sweep_max > 1)
+        snprintf(threads, sizeof(threads), "1-%d threads", sweep_max);
+    else
+        snprintf(threads, sizeof(threads), "%d threads", sweep_max ? 1 : isp_threads(isp));
+    printf("ISP: %s demosaic (%s), black %d, gamma %.2f, denoise %d, sharpen %d, %s\n",
+           demosaic_method_name(params->method), demosaic_isa_name(DEMOSAIC_AUTO),
+           params->black_level, params->gamma, params->denoise, params->sharpen,
+           params->awb ? "gray world" : "fixed gains");
+    if (unfused)
+        printf("     six full-frame passes, %s\n", threads);
+    else
+        printf("     fused %dx%d tiles, %s\n", tw, th, threads);
+}
+
+/* Same frames at 1, 2, 4 ... max threads (and max itself) */
+static int run_scaling(struct frame_source *src, const struct isp_params *params, int threads,
+                       int tile_w, int tile_h, int unfused, int frames, uint16_t **px,
+                       int nframes, uint8_t *rgb)
+{
+    double mp = (double)src->width * src->height / 1e6;
+    double base_fps = 0;
+    int n, i;
+
+    if (threads < 1) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    for (n = 1; !stop_requested; n = n * 2 < threads ? n * 2 : threads) {
+        struct isp_pipeline *isp = isp_create(src->width, src->height, params, n, tile_w,
+                                              tile_h);
+        double t0, t, fps;
+
+        if (!isp)
+            return -1;
+        if (n == 1)
+            print_config(isp, params, unfused, threads);
+        // One untimed frame: page faults, scratch and tables
+        if (process(isp, unfused, px[0], rgb) < 0) {
+            isp_destroy(isp);
+            return -1;
+        }
+        t0 = now_sec();
+        for (i = 0; i < frames && !stop_requested; i++)
+            process(isp, unfused, px[i % nframes], rgb);
+        t = now_sec() - t0;
+        isp_destroy(isp);
+        if (i == 0)
+            break;
+
+        fps = i / t;
+        if (n == 1)
+            base_fps = fps;
+        printf("  %3d threads: %7.2f ms/frame, %6.1f fps, %7.1f MP/s, %5.2fx (%3.0f%% "
+               "efficiency)\n", n, t / i * 1e3, fps, fps * mp, fps / base_fps,
+               100 * fps / base_fps / n);
+        fflush(stdout);
+        if (n == threads)
+            break;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct frame_source src;
+    struct isp_params params;
+    struct isp_pipeline *isp = NULL;
+    struct sigaction sa;
+    const char *spec = DEFAULT_SOURCE;
+    const char *output = NULL;
+    uint16_t *px[SCALING_FRAMES] = { NULL };
+    uint8_t *rgb = NULL;
+    void *buf = NULL;
+    int frames = DEFAULT_FRAMES, threads = 0, tile_w = 0, tile_h = 0;
+    int unfused = 0, scaling = 0;
+    int nframes = 0, done = 0, exit_code = 1;
+    double t_isp = 0, t_min = 0, t_max = 0;
+    int i, opt;
+
+    static const struct option long_opts[] = {
+        { "source",      required_argument, NULL, 'i' },
+        { "frames",      required_argument, NULL, 'n' },
+        { "threads",     required_argument, NULL, 't' },
+        { "tile",        required_argument, NULL, 'T' },
+        { "method",      required_argument, NULL, 'm' },
+        { "black-level", required_argument, NULL, 'b' },
+        { "wb",          required_argument, NULL, 'w' },
+        { "gamma",       required_argument, NULL, 'g' },
+        { "denoise",     required_argument, NULL, 'd' },
+        { "sharpen",     required_argument, NULL, 's' },
+        { "unfused",     no_argument,       NULL, 'u' },
+        { "scaling",     no_argument,       NULL, 'S' },
+        { "output",      required_argument, NULL, 'o' },
+        { "help",        no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    isp_params_default(&params);
+    while ((opt = getopt_long(argc, argv, "i:n:t:T:m:b:w:g:d:s:uSo:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'i':
+            spec = optarg;
+            break;
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'T':
+            if (sscanf(optarg, "%dx%d", &tile_w, &tile_h) != 2 || tile_w < 2 || tile_h < 2) {
+                fprintf(stderr, "Invalid tile size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'm':
+            if (parse_demosaic_method(optarg, &params.method) < 0) {
+                fprintf(stderr, "Unknown demosaic method: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'b':
+            params.black_level = atoi(optarg);
+            break;
+        case 'w':
+            if (strcmp(optarg, "auto") == 0) {
+                params.awb = 1;
+            } else if (sscanf(optarg, "%lf,%lf,%lf", &params.gain[0], &params.gain[1],
+                              &params.gain[2]) == 3) {
+                params.awb = 0;
+            } else {
+                fprintf(stderr, "Invalid white balance: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'g':
+            params.gamma = atof(optarg);
+            break;
+        case 'd':
+            params.denoise = atoi(optarg);
+            break;
+        case 's':
+            params.sharpen = atoi(optarg);
+            break;
+        case 'u':
+            unfused = 1;
+            break;
+        case 'S':
+            scaling = 1;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (frames < 1 || threads < 0) {
+        fprintf(stderr, "Invalid option value\n");
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigint;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    memset(&src, 0, sizeof(src));
+    if (source_parse(&src, spec) < 0) {
+        fprintf(stderr, "Invalid source: %s\n", spec);
+        return 1;
+    }
+    src.stop = &stop_requested;
+    if (source_open(&src) < 0)
+        return 1;
+
+    // --scaling keeps a few frames in memory, otherwise one is enough
+    nframes = scaling ? (frames < SCALING_FRAMES ? frames : SCALING_FRAMES) : 1;
+    buf = malloc(src.max_frame);
+    rgb = malloc((size_t)src.width * src.height * 3);
+    for (i = 0; i < nframes; i++) {
+        px[i] = malloc((size_t)src.width * src.height * sizeof(uint16_t));
+        if (!px[i])
+            break;
+    }
+    if (!buf || !rgb || i < nframes) {
+        perror("Failed to allocate frame buffers");
+        goto out;
+    }
+    printf("Source: %s, %dx%d\n", source_name(&src), src.width, src.height);
+
+    if (scaling) {
+        for (i = 0; i < nframes; i++) {
+            int ret = next_frame(&src, buf, px[i]);
+
+            if (ret < 0)
+                goto out;
+            if (ret == 0)
+                break;
+        }
+        if (i == 0) {
+            fprintf(stderr, "No frames from the source\n");
+            goto out;
+        }
+        if (run_scaling(&src, &params, threads, tile_w, tile_h, unfused, frames, px, i,
+                        rgb) < 0)
+            goto out;
+        done = 1;
+    } else {
+        isp = isp_create(src.width, src.height, &params, threads, tile_w, tile_h);
+        if (!isp)
+            goto out;
+        print_config(isp, &params, unfused, 0);
+
+        while (done < frames && !stop_requested) {
+            double t0, t;
+            int ret = next_frame(&src, buf, px[0]);
+
+            if (ret < 0)
+                goto out;
+            if (ret == 0)
+                break;
+            t0 = now_sec();
+            if (process(isp, unfused, px[0], rgb) < 0)
+                goto out;
+            t = now_sec() - t0;
+            t_isp += t;
+            t_min = done == 0 || t < t_min ? t : t_min;
+            t_max = t > t_max ? t : t_max;
+            done++;
+        }
+        if (done > 0) {
+            double gain[3];
+
+            isp_gains(isp, gain);
+            printf("\n✓ %d frames: %.2f ms/frame (min %.2f, max %.2f), %.1f fps, "
+                   "%.1f MP/s\n", done, t_isp / done * 1e3, t_min * 1e3, t_max * 1e3,
+                   done / t_isp, (double)src.width * src.height * done / t_isp / 1e6);
+            printf("  White balance: R %.3f, G %.3f, B %.3f\n", gain[0], gain[1], gain[2]);
+        }
+    }
+
+    if (done > 0 && output && write_ppm(output, rgb, src.width, src.height) < 0)
+        goto out;
+    exit_code = done > 0 ? 0 : 1;
+
+out:
+    isp_destroy(isp);
+    for (i = 0; i < SCALING_FRAMES; i++)
+        free(px[i]);
+    free(rgb);
+    free(buf);
+    source_close(&src);
+    return exit_code;
+}
@@ -0,0 +1,564 @@
+// demosaic.c - Bilinear and edge-aware RGGB demosaic (see demosaic.h)
+#include <stdlib.h>
+#include <string.h>
+
+#include "demosaic.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DEMOSAIC_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DEMOSAIC_ARM 1
+#endif
+
+/* Row kernels of one instruction set; lanes 0 = the per-pixel reference */
+struct kernels {
+    int lanes;
+    int (*bilinear_row)(const uint16_t *up, const uint16_t *mid, const uint16_t *dn,
+                        int odd_row, int x, int end, uint16_t *r, uint16_t *g,
+                        uint16_t *b, int ox);
+    int (*green_row)(const uint16_t *const rows[5], int odd_row, int x, int end,
+                     uint16_t *g, int ox);
+    int (*rb_row)(const uint16_t *up, const uint16_t *mid, const uint16_t *dn,
+                  const uint16_t *gup, const uint16_t *gmid, const uint16_t *gdn,
+                  int odd_row, int x, int end, uint16_t *r, uint16_t *b, int ox);
+};
+
+static const struct kernels reference_kernels = { 0, NULL, NULL, NULL };
+
+#if DEMOSAIC_X86
+/*
+ * SSE4.1 and AVX2 are compiled for whatever CFLAGS say and picked at run
+ * time, so one binary uses AVX2 where it exists without requiring it
+ */
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#define LANES 8
+#define V __m128i
+#define FN(name) name##_sse41
+#define V_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define V_STORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define V_SET1(k) _mm_set1_epi16(k)
+#define V_EVEN _mm_set1_epi32(0xffff)
+#define V_ADD _mm_add_epi16
+#define V_SUB _mm_sub_epi16
+#define V_SRAI _mm_srai_epi16
+#define V_ABS _mm_abs_epi16
+#define V_MIN _mm_min_epi16
+#define V_MAX _mm_max_epi16
+#define V_LT(a, b) _mm_cmplt_epi16(a, b)
+#define V_SEL(m, a, b) _mm_blendv_epi8(b, a, m)
+#include "demosaic_kernels.h"
+#undef LANES
+#undef V
+#undef FN
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_EVEN
+#undef V_ADD
+#undef V_SUB
+#undef V_SRAI
+#undef V_ABS
+#undef V_MIN
+#undef V_MAX
+#undef V_LT
+#undef V_SEL
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define LANES 16
+#define V __m256i
+#define FN(name) name##_avx2
+#define V_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define V_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define V_SET1(k) _mm256_set1_epi16(k)
+#define V_EVEN _mm256_set1_epi32(0xffff)
+#define V_ADD _mm256_add_epi16
+#define V_SUB _mm256_sub_epi16
+#define V_SRAI _mm256_srai_epi16
+#define V_ABS _mm256_abs_epi16
+#define V_MIN _mm256_min_epi16
+#define V_MAX _mm256_max_epi16
+#define V_LT(a, b) _mm256_cmpgt_epi16(b, a)
+#define V_SEL(m, a, b) _mm256_blendv_epi8(b, a, m)
+#include "demosaic_kernels.h"
+#pragma GCC pop_options
+
+static const struct kernels sse41_kernels = {
+    8, bilinear_row_sse41, green_row_sse41, rb_row_sse41,
+};
+static const struct kernels avx2_kernels = {
+    16, bilinear_row_avx2, green_row_avx2, rb_row_avx2,
+};
+#elif DEMOSAIC_ARM
+#define LANES 8
+#define V int16x8_t
+#define FN(name) name##_neon
+#define V_LOAD(p) vreinterpretq_s16_u16(vld1q_u16(p))
+#define V_STORE(p, v) vst1q_u16(p, vreinterpretq_u16_s16(v))
+#define V_SET1(k) vdupq_n_s16(k)
+#define V_EVEN vreinterpretq_s16_u32(vdupq_n_u32(0xffff))
+#define V_ADD vaddq_s16
+#define V_SUB vsubq_s16
+#define V_SRAI vshrq_n_s16
+#define V_ABS vabsq_s16
+#define V_MIN vminq_s16
+#define V_MAX vmaxq_s16
+#define V_LT(a, b) vreinterpretq_s16_u16(vcltq_s16(a, b))
+#define V_SEL(m, a, b) vbslq_s16(vreinterpretq_u16_s16(m), a, b)
+#include "demosaic_kernels.h"
+
+static const struct kernels neon_kernels = {
+    8, bilinear_row_neon, green_row_neon, rb_row_neon,
+};
+#endif
+
+/*
+ * Per-pixel reference. Coordinates outside the frame are mirrored about
+ * the first and last row / column (-1 -> 1, -2 -> 2), which keeps the
+ * colour of every site; the row kernels only run where no mirroring is
+ * needed, and this does the border around them.
+ */
+struct bayer {
+    const uint16_t *raw;
+    size_t stride;
+    int width;
+    int height;
+};
+
+static inline int mirror(int i, int n)
+{
+    if (i < 0)
+        return -i;
+    if (i >= n)
+        return 2 * (n - 1) - i;
+    return i;
+}
+
+static inline int at(const struct bayer *bay, int x, int y)
+{
+    return bay->raw[(size_t)mirror(y, bay->height) * bay->stride + mirror(x, bay->width)];
+}
+
+static inline int clamp12(int v)
+{
+    return v < 0 ? 0 : v > 4095 ? 4095 : v;
+}
+
+static void bilinear_px(const struct bayer *bay, int x, int y, uint16_t *r, uint16_t *g,
+                        uint16_t *b)
+{
+    int c = at(bay, x, y);
+    int w = at(bay, x - 1, y), e = at(bay, x + 1, y);
+    int n = at(bay, x, y - 1), s = at(bay, x, y + 1);
+    int cross = (w + e + n + s + 2) >> 2;
+    int diag = (at(bay, x - 1, y - 1) + at(bay, x + 1, y - 1) +
+                at(bay, x - 1, y + 1) + at(bay, x + 1, y + 1) + 2) >> 2;
+    int h = (w + e + 1) >> 1, v = (n + s + 1) >> 1;
+
+    switch ((y & 1) << 1 | (x & 1)) {
+    case 0:     // R
+        *r = c, *g = cross, *b = diag;
+        break;
+    case 1:     // G on an R row
+        *r = h, *g = c, *b = v;
+        break;
+    case 2:     // G on a B row
+        *r = v, *g = c, *b = h;
+        break;
+    default:    // B
+        *r = diag, *g = cross, *b = c;
+        break;
+    }
+}
+
+/* Hamilton-Adams green: along the direction with the smaller gradient */
+static int edge_green(const struct bayer *bay, int x, int y)
+{
+    int c = at(bay, x, y);
+    int gw, ge, gn, gs, lh, lv, dh, dv, gh, gv;
+
+    if ((x ^ y) & 1)
+        return c;
+    gw = at(bay, x - 1, y), ge = at(bay, x + 1, y);
+    gn = at(bay, x, y - 1), gs = at(bay, x, y + 1);
+    lh = 2 * c - at(bay, x - 2, y) - at(bay, x + 2, y);
+    lv = 2 * c - at(bay, x, y - 2) - at(bay, x, y + 2);
+    dh = abs(gw - ge) + abs(lh);
+    dv = abs(gn - gs) + abs(lv);
+    gh = clamp12((2 * (gw + ge) + lh + 2) >> 2);
+    gv = clamp12((2 * (gn + gs) + lv + 2) >> 2);
+    return dh < dv ? gh : dv < dh ? gv : (gh + gv + 1) >> 1;
+}
+
+/* Green of the rectangle being demosaiced (already written) or around it */
+struct green_plane {
+    const uint16_t *g;
+    size_t stride;
+    int x0, y0, w, h;
+};
+
+static int green_at(const struct bayer *bay, const struct green_plane *gp, int x, int y)
+{
+    x = mirror(x, bay->width);
+    y = mirror(y, bay->height);
+    if (x >= gp->x0 && x < gp->x0 + gp->w && y >= gp->y0 && y < gp->y0 + gp->h)
+        return gp->g[(size_t)(y - gp->y0) * gp->stride + (x - gp->x0)];
+    return edge_green(bay, x, y);
+}
+
+/* Red and blue from the colour differences to green around x,y */
+static void edge_rb_px(const struct bayer *bay, const struct green_plane *gp, int x, int y,
+                       uint16_t *r, uint16_t *b)
+{
+#define DIFF(dx, dy) (at(bay, x + (dx), y + (dy)) - green_at(bay, gp, x + (dx), y + (dy)))
+    int c = at(bay, x, y), g = green_at(bay, gp, x, y);
+    int hc = clamp12(g + ((DIFF(-1, 0) + DIFF(1, 0) + 1) >> 1));
+    int vc = clamp12(g + ((DIFF(0, -1) + DIFF(0, 1) + 1) >> 1));
+    int dc = clamp12(g + ((DIFF(-1, -1) + DIFF(1, -1) + DIFF(-1, 1) + DIFF(1, 1) + 2) >> 2));
+#undef DIFF
+
+    switch ((y & 1) << 1 | (x & 1)) {
+    case 0:     // R
+        *r = c, *b = dc;
+        break;
+    case 1:     // G on an R row
+        *r = hc, *b = vc;
+        break;
+    case 2:     // G on a B row
+        *r = vc, *b = hc;
+        break;
+    default:    // B
+        *r = dc, *b = c;
+        break;
+    }
+}
+
+/*
+ * Plain C row kernels, the SIMD kernels' contract with two lanes: one
+ * Bayer pair per step from an even x, no mirroring. Site 0 of the pair is
+ * R (R rows) or G (B rows), site 1 is G or B.
+ */
+static int bilinear_row_c(const uint16_t *up, const uint16_t *mid, const uint16_t *dn,
+                          int odd_row, int x, int end, uint16_t *r, uint16_t *g,
+                          uint16_t *b, int ox)
+{
+    for (; x + 2 <= end; x += 2) {
+        int i = x - ox;
+        int h0 = mid[x - 1] + mid[x + 1], v0 = up[x] + dn[x];
+        int h1 = mid[x] + mid[x + 2], v1 = up[x + 1] + dn[x + 1];
+
+        if (!odd_row) {         // R G
+            r[i] = mid[x];
+            g[i] = (h0 + v0 + 2) >> 2;
+            b[i] = (up[x - 1] + up[x + 1] + dn[x - 1] + dn[x + 1] + 2) >> 2;
+            r[i + 1] = (h1 + 1) >> 1;
+            g[i + 1] = mid[x + 1];
+            b[i + 1] = (v1 + 1) >> 1;
+        } else {                // G B
+            r[i] = (v0 + 1) >> 1;
+            g[i] = mid[x];
+            b[i] = (h0 + 1) >> 1;
+            r[i + 1] = (up[x] + up[x + 2] + dn[x] + dn[x + 2] + 2) >> 2;
+            g[i + 1] = (h1 + v1 + 2) >> 2;
+            b[i + 1] = mid[x + 1];
+        }
+    }
+    return x;
+}
+
+/* edge_green() at an R or B site with no mirroring; rows[0..4] are y-2 .. y+2 */
+static inline int green_at_site(const uint16_t *const rows[5], int x)
+{
+    const uint16_t *mid = rows[2];
+    int c = mid[x], gw = mid[x - 1], ge = mid[x + 1], gn = rows[1][x], gs = rows[3][x];
+    int lh = 2 * c - mid[x - 2] - mid[x + 2];
+    int lv = 2 * c - rows[0][x] - rows[4][x];
+    int dh = abs(gw - ge) + abs(lh), dv = abs(gn - gs) + abs(lv);
+    int gh = clamp12((2 * (gw + ge) + lh + 2) >> 2);
+    int gv = clamp12((2 * (gn + gs) + lv + 2) >> 2);
+
+    return dh < dv ? gh : dv < dh ? gv : (gh + gv + 1) >> 1;
+}
+
+static int green_row_c(const uint16_t *const rows[5], int odd_row, int x, int end,
+                       uint16_t *g, int ox)
+{
+    const uint16_t *mid = rows[2];
+
+    for (; x + 2 <= end; x += 2) {
+        int i = x - ox;
+
+        if (!odd_row) {
+            g[i] = green_at_site(rows, x);
+            g[i + 1] = mid[x + 1];
+        } else {
+            g[i] = mid[x];
+            g[i + 1] = green_at_site(rows, x + 1);
+        }
+    }
+    return x;
+}
+
+static int rb_row_c(const uint16_t *up, const uint16_t *mid, const uint16_t *dn,
+                    const uint16_t *gup, const uint16_t *gmid, const uint16_t *gdn,
+                    int odd_row, int x, int end, uint16_t *r, uint16_t *b, int ox)
+{
+    // Colour difference at column x + k of a raw row and its green row
+#define DIFF(row, grow, k) ((row)[x + (k)] - (grow)[i + (k)])
+#define HC(k) clamp12(gmid[i + (k)] + \
+                      ((DIFF(mid, gmid, (k) - 1) + DIFF(mid, gmid, (k) + 1) + 1) >> 1))
+#define VC(k) clamp12(gmid[i + (k)] + ((DIFF(up, gup, k) + DIFF(dn, gdn, k) + 1) >> 1))
+#define DC(k) clamp12(gmid[i + (k)] + \
+                      ((DIFF(up, gup, (k) - 1) + DIFF(up, gup, (k) + 1) + \
+                        DIFF(dn, gdn, (k) - 1) + DIFF(dn, gdn, (k) + 1) + 2) >> 2))
+    for (; x + 2 <= end; x += 2) {
+        int i = x - ox;
+
+        if (!odd_row) {         // R G
+            r[i] = mid[x];
+            b[i] = DC(0);
+            r[i + 1] = HC(1);
+            b[i + 1] = VC(1);
+        } else {                // G B
+            r[i] = VC(0);
+            b[i] = HC(0);
+            r[i + 1] = DC(1);
+            b[i + 1] = mid[x + 1];
+        }
+    }
+    return x;
+#undef DIFF
+#undef HC
+#undef VC
+#undef DC
+}
+
+static const struct kernels c_kernels = {
+    2, bilinear_row_c, green_row_c, rb_row_c,
+};
+
+static const struct kernels *kernels_for(enum demosaic_isa isa)
+{
+    if (isa == DEMOSAIC_AUTO)
+        isa = demosaic_best_isa();
+    if (!demosaic_isa_supported(isa))
+        return NULL;
+    switch (isa) {
+#if DEMOSAIC_X86
+    case DEMOSAIC_SSE41:
+        return &sse41_kernels;
+    case DEMOSAIC_AVX2:
+        return &avx2_kernels;
+#elif DEMOSAIC_ARM
+    case DEMOSAIC_NEON:
+        return &neon_kernels;
+#endif
+    case DEMOSAIC_SCALAR:
+        return &c_kernels;
+    default:
+        return &reference_kernels;
+    }
+}
+
+/*
+ * Where a kernel may run on a row: from the first even x >= max(x0, lo)
+ * to min(x0 + w, hi). Returns the start, past x0 + w if there is none.
+ * Rows whose kernel stops short of the end run it once more, ending
+ * there: the overlap is computed twice, to the same values, instead of
+ * up to lanes - 1 pixels taking the per-pixel path.
+ */
+static int vector_start(int x0, int w, int lo)
+{
+    int x = x0 > lo ? x0 : lo;
+
+    x += x & 1;
+    return x < x0 + w ? x : x0 + w;
+}
+
+static void bilinear_rect(const struct bayer *bay, const struct kernels *k, int x0, int y0,
+                          int w, int h, const struct demosaic_out *out)
+{
+    int x, y;
+
+    for (y = y0; y < y0 + h; y++) {
+        size_t o = (size_t)(y - y0) * out->stride;
+        uint16_t *r = out->r + o, *g = out->g + o, *b = out->b + o;
+
+        x = x0;
+        // Kernels read x-1 .. x+lanes on rows y-1 .. y+1
+        if (k->lanes && y >= 1 && y < bay->height - 1) {
+            const uint16_t *mid = bay->raw + (size_t)y * bay->stride;
+            int start = vector_start(x0, w, 1);
+            int end = x0 + w < bay->width - 1 ? x0 + w : bay->width - 1;
+
+            for (; x < start; x++)
+                bilinear_px(bay, x, y, r + x - x0, g + x - x0, b + x - x0);
+            x = k->bilinear_row(mid - bay->stride, mid, mid + bay->stride, y & 1, x, end,
+                                r, g, b, x0);
+            if (x < end && end - start >= k->lanes)
+                x = k->bilinear_row(mid - bay->stride, mid, mid + bay->stride, y & 1,
+                                    (end - k->lanes) & ~1, end, r, g, b, x0);
+        }
+        for (; x < x0 + w; x++)
+            bilinear_px(bay, x, y, r + x - x0, g + x - x0, b + x - x0);
+    }
+}
+
+static void edge_rect(const struct bayer *bay, const struct kernels *k, int x0, int y0,
+                      int w, int h, const struct demosaic_out *out)
+{
+    struct green_plane gp = { out->g, out->stride, x0, y0, w, h };
+    int x, y;
+
+    // Pass 1: green everywhere in the rectangle
+    for (y = y0; y < y0 + h; y++) {
+        uint16_t *g = out->g + (size_t)(y - y0) * out->stride;
+
+        x = x0;
+        // Kernels read x-2 .. x+lanes+1 on rows y-2 .. y+2
+        if (k->lanes && y >= 2 && y < bay->height - 2) {
+            const uint16_t *rows[5];
+            int start = vector_start(x0, w, 2);
+            int end = x0 + w < bay->width - 2 ? x0 + w : bay->width - 2;
+            int i;
+
+            for (i = 0; i < 5; i++)
+                rows[i] = bay->raw + (size_t)(y + i - 2) * bay->stride;
+            for (; x < start; x++)
+                g[x - x0] = edge_green(bay, x, y);
+            x = k->green_row(rows, y & 1, x, end, g, x0);
+            if (x < end && end - start >= k->lanes)
+                x = k->green_row(rows, y & 1, (end - k->lanes) & ~1, end, g, x0);
+        }
+        for (; x < x0 + w; x++)
+            g[x - x0] = edge_green(bay, x, y);
+    }
+
+    // Pass 2: red and blue, from the green just written
+    for (y = y0; y < y0 + h; y++) {
+        size_t o = (size_t)(y - y0) * out->stride;
+        uint16_t *r = out->r + o, *b = out->b + o;
+
+        x = x0;
+        // Kernels read x-1 .. x+lanes of rows y-1 .. y+1, raw and green;
+        // green only exists inside the rectangle
+        if (k->lanes && y > y0 && y < y0 + h - 1 && y < bay->height - 1) {
+            const uint16_t *mid = bay->raw + (size_t)y * bay->stride;
+            const uint16_t *gmid = out->g + o;
+            int start = vector_start(x0, w, x0 + 1);
+            int end = x0 + w - 1 < bay->width - 1 ? x0 + w - 1 : bay->width - 1;
+
+            for (; x < start; x++)
+                edge_rb_px(bay, &gp, x, y, r + x - x0, b + x - x0);
+            x = k->rb_row(mid - bay->stride, mid, mid + bay->stride, gmid - out->stride, gmid,
+                          gmid + out->stride, y & 1, x, end, r, b, x0);
+            if (x < end && end - start >= k->lanes)
+                x = k->rb_row(mid - bay->stride, mid, mid + bay->stride, gmid - out->stride,
+                              gmid, gmid + out->stride, y & 1, (end - k->lanes) & ~1, end,
+                              r, b, x0);
+        }
+        for (; x < x0 + w; x++)
+            edge_rb_px(bay, &gp, x, y, r + x - x0, b + x - x0);
+    }
+}
+
+int demosaic_rect(const uint16_t *raw, size_t stride, int width, int height,
+                  int x0, int y0, int w, int h, const struct demosaic_out *out,
+                  enum demosaic_method method, enum demosaic_isa isa)
+{
+    const struct bayer bay = { raw, stride, width, height };
+    const struct kernels *k = kernels_for(isa);
+
+    if (!k || width < 4 || height < 4 || stride < (size_t)width || x0 < 0 || y0 < 0 ||
+        w < 1 || h < 1 || x0 + w > width || y0 + h > height || out->stride < (size_t)w)
+        return -1;
+
+    if (method == DEMOSAIC_EDGE)
+        edge_rect(&bay, k, x0, y0, w, h, out);
+    else
+        bilinear_rect(&bay, k, x0, y0, w, h, out);
+    return 0;
+}
+
+int demosaic(const uint16_t *raw, int width, int height, uint16_t *rgb,
+             enum demosaic_method method)
+{
+    size_t plane = (size_t)width * height;
+    struct demosaic_out out = { rgb, rgb + plane, rgb + 2 * plane, (size_t)width };
+
+    return demosaic_rect(raw, width, width, height, 0, 0, width, height, &out, method,
+                         DEMOSAIC_AUTO);
+}
+
+int demosaic_isa_supported(enum demosaic_isa isa)
+{
+    switch (isa) {
+    case DEMOSAIC_AUTO:
+    case DEMOSAIC_REFERENCE:
+    case DEMOSAIC_SCALAR:
+        return 1;
+#if DEMOSAIC_X86
+    case DEMOSAIC_SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case DEMOSAIC_AVX2:
+        return __builtin_cpu_supports("avx2");
+#elif DEMOSAIC_ARM
+    case DEMOSAIC_NEON:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+enum demosaic_isa demosaic_best_isa(void)
+{
+    static const enum demosaic_isa order[] = {
+        DEMOSAIC_AVX2, DEMOSAIC_SSE41, DEMOSAIC_NEON,
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(order) / sizeof(order[0]); i++)
+        if (demosaic_isa_supported(order[i]))
+            return order[i];
+    return DEMOSAIC_SCALAR;
+}
+
+const char *demosaic_isa_name(enum demosaic_isa isa)
+{
+    switch (isa) {
+    case DEMOSAIC_AUTO:
+        return demosaic_isa_name(demosaic_best_isa());
+    case DEMOSAIC_REFERENCE:
+        return "reference";
+    case DEMOSAIC_SCALAR:
+        return "scalar";
+    case DEMOSAIC_SSE41:
+        return "sse4.1";
+    case DEMOSAIC_AVX2:
+        return "avx2";
+    case DEMOSAIC_NEON:
+        return "neon";
+    }
+    return "?";
+}
+
+int parse_demosaic_method(const char *name, enum demosaic_method *method)
+{
+    if (strcmp(name, "bilinear") == 0)
+        *method = DEMOSAIC_BILINEAR;
+    else if (strcmp(name, "edge") == 0)
+        *method = DEMOSAIC_EDGE;
+    else
+        return -1;
+    return 0;
+}
+
+const char *demosaic_method_name(enum demosaic_method method)
+{
+    return method == DEMOSAIC_EDGE ? "edge" : "bilinear";
+}
@@ -0,0 +1,79 @@
+// demosaic.h - RGGB Bayer to RGB on the CPU
+//
+// The driver's RAW12 frames (12-bit samples in 16-bit containers, RGGB)
+// become three 16-bit planes, R, G and B, still in the 0..4095 range, for
+// hosts without the GPU ISP:
+//
+//   bilinear  each missing colour is the average of its nearest samples
+//             of that colour (2 or 4 of them)
+//   edge      green is interpolated along the smoother direction, with a
+//             second-derivative correction from the centre colour
+//             (Hamilton-Adams); red and blue then follow the colour
+//             differences to that green, so edges keep their colour
+//
+// Row kernels exist for AVX2 and SSE4.1 (picked at run time), NEON and
+// plain C; they run on the interior and a per-pixel path does the border,
+// where frame edges are mirrored (which keeps the Bayer phase). All of
+// them match bit for bit a reference that mirrors every read, kept for
+// the tests.
+#ifndef DEMOSAIC_H
+#define DEMOSAIC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum demosaic_method {
+    DEMOSAIC_BILINEAR,
+    DEMOSAIC_EDGE,
+};
+
+enum demosaic_isa {
+    DEMOSAIC_AUTO,          // the best this CPU supports
+    DEMOSAIC_REFERENCE,     // per pixel, every read mirrored: slow, for tests
+    DEMOSAIC_SCALAR,        // plain C row kernels, no SIMD
+    DEMOSAIC_SSE41,
+    DEMOSAIC_AVX2,
+    DEMOSAIC_NEON,
+};
+
+/* Output planes; stride in samples, shared by all three */
+struct demosaic_out {
+    uint16_t *r;
+    uint16_t *g;
+    uint16_t *b;
+    size_t stride;
+};
+
+/*
+ * Demosaic the w x h rectangle at x0,y0 of a width x height RGGB frame
+ * (raw rows 'stride' samples apart) into out, whose first sample is
+ * pixel x0,y0. Pixels around the rectangle are read as needed, so tiles
+ * of one frame give the same result as the whole frame. Samples above
+ * 4095 give meaningless colours. Returns 0, or -1 for a bad rectangle, a
+ * frame under 4x4 or an instruction set this CPU or build lacks.
+ */
+int demosaic_rect(const uint16_t *raw, size_t stride, int width, int height,
+                  int x0, int y0, int w, int h, const struct demosaic_out *out,
+                  enum demosaic_method method, enum demosaic_isa isa);
+
+/* Whole frame into planar rgb: R, G, then B, width * height samples each */
+int demosaic(const uint16_t *raw, int width, int height, uint16_t *rgb,
+             enum demosaic_method method);
+
+int demosaic_isa_supported(enum demosaic_isa isa);
+enum demosaic_isa demosaic_best_isa(void);
+const char *demosaic_isa_name(enum demosaic_isa isa);
+
+/* "bilinear" or "edge" */
+int parse_demosaic_method(const char *name, enum demosaic_method *method);
+const char *demosaic_method_name(enum demosaic_method method);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEMOSAIC_H */
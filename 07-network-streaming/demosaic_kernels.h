@@ -0,0 +1,115 @@
+// demosaic_kernels.h - Row kernels of demosaic.c, written once for every
+// instruction set
+//
+// Included by demosaic.c once per SIMD target with these defined:
+//
+//   V             vector of LANES int16 samples
+//   FN(name)      name with the target's suffix
+//   V_LOAD(p) V_STORE(p, v) V_SET1(k) V_EVEN (lanes 0, 2, ... all ones)
+//   V_ADD V_SUB V_SRAI(v, n) V_ABS V_MIN V_MAX
+//   V_LT(a, b)    all-ones lanes where a < b
+//   V_SEL(m, a, b) a where m is set, else b
+//
+// Samples are 12-bit, so every intermediate fits int16. Each kernel does
+// whole vectors from x (even, so V_EVEN lines up with the Bayer phase)
+// while x + LANES <= end and returns where it stopped; demosaic.c does
+// the rest with the per-pixel reference. Output pointers are the
+// rectangle's row, whose first sample is pixel ox.
+
+#define V_CLAMP12(v) V_MIN(V_MAX(v, V_SET1(0)), V_SET1(4095))
+
+/* Rows y-1, y, y+1 of the raw frame */
+static int FN(bilinear_row)(const uint16_t *up, const uint16_t *mid, const uint16_t *dn,
+                            int odd_row, int x, int end, uint16_t *r, uint16_t *g,
+                            uint16_t *b, int ox)
+{
+    const V even = V_EVEN, one = V_SET1(1), two = V_SET1(2);
+
+    for (; x + LANES <= end; x += LANES) {
+        V c = V_LOAD(mid + x), w = V_LOAD(mid + x - 1), e = V_LOAD(mid + x + 1);
+        V n = V_LOAD(up + x), s = V_LOAD(dn + x);
+        V diag = V_ADD(V_ADD(V_LOAD(up + x - 1), V_LOAD(up + x + 1)),
+                       V_ADD(V_LOAD(dn + x - 1), V_LOAD(dn + x + 1)));
+        V cross = V_SRAI(V_ADD(V_ADD(V_ADD(w, e), V_ADD(n, s)), two), 2);
+        V h = V_SRAI(V_ADD(V_ADD(w, e), one), 1);
+        V v = V_SRAI(V_ADD(V_ADD(n, s), one), 1);
+
+        diag = V_SRAI(V_ADD(diag, two), 2);
+        if (!odd_row) {         // R G R G ...
+            V_STORE(r + x - ox, V_SEL(even, c, h));
+            V_STORE(g + x - ox, V_SEL(even, cross, c));
+            V_STORE(b + x - ox, V_SEL(even, diag, v));
+        } else {                // G B G B ...
+            V_STORE(r + x - ox, V_SEL(even, v, diag));
+            V_STORE(g + x - ox, V_SEL(even, c, cross));
+            V_STORE(b + x - ox, V_SEL(even, h, c));
+        }
+    }
+    return x;
+}
+
+/* Green at every pixel of row y; rows[0..4] are y-2 .. y+2 */
+static int FN(green_row)(const uint16_t *const rows[5], int odd_row, int x, int end,
+                         uint16_t *g, int ox)
+{
+    const V one = V_SET1(1), two = V_SET1(2);
+    // R and B sites: even lanes on R rows, odd lanes on B rows
+    const V site = odd_row ? V_SUB(V_SET1(-1), V_EVEN) : V_EVEN;
+    const uint16_t *mid = rows[2];
+
+    for (; x + LANES <= end; x += LANES) {
+        V c = V_LOAD(mid + x), c2 = V_ADD(c, c);
+        V gw = V_LOAD(mid + x - 1), ge = V_LOAD(mid + x + 1);
+        V gn = V_LOAD(rows[1] + x), gs = V_LOAD(rows[3] + x);
+        V lh = V_SUB(V_SUB(c2, V_LOAD(mid + x - 2)), V_LOAD(mid + x + 2));
+        V lv = V_SUB(V_SUB(c2, V_LOAD(rows[0] + x)), V_LOAD(rows[4] + x));
+        V dh = V_ADD(V_ABS(V_SUB(gw, ge)), V_ABS(lh));
+        V dv = V_ADD(V_ABS(V_SUB(gn, gs)), V_ABS(lv));
+        V sh = V_ADD(gw, ge), sv = V_ADD(gn, gs);
+        V gh = V_CLAMP12(V_SRAI(V_ADD(V_ADD(sh, sh), V_ADD(lh, two)), 2));
+        V gv = V_CLAMP12(V_SRAI(V_ADD(V_ADD(sv, sv), V_ADD(lv, two)), 2));
+        V avg = V_SRAI(V_ADD(V_ADD(gh, gv), one), 1);
+        V green = V_SEL(V_LT(dh, dv), gh, V_SEL(V_LT(dv, dh), gv, avg));
+
+        V_STORE(g + x - ox, V_SEL(site, green, c));
+    }
+    return x;
+}
+
+/*
+ * Red and blue of row y from colour differences to green: raw rows
+ * y-1 .. y+1 and the matching rows of the green plane (first sample ox)
+ */
+static int FN(rb_row)(const uint16_t *up, const uint16_t *mid, const uint16_t *dn,
+                      const uint16_t *gup, const uint16_t *gmid, const uint16_t *gdn,
+                      int odd_row, int x, int end, uint16_t *r, uint16_t *b, int ox)
+{
+    const V even = V_EVEN, one = V_SET1(1), two = V_SET1(2);
+
+    for (; x + LANES <= end; x += LANES) {
+        int gx = x - ox;
+        V c = V_LOAD(mid + x), g = V_LOAD(gmid + gx);
+        V dw = V_SUB(V_LOAD(mid + x - 1), V_LOAD(gmid + gx - 1));
+        V de = V_SUB(V_LOAD(mid + x + 1), V_LOAD(gmid + gx + 1));
+        V du = V_SUB(V_LOAD(up + x), V_LOAD(gup + gx));
+        V ds = V_SUB(V_LOAD(dn + x), V_LOAD(gdn + gx));
+        V dd = V_ADD(V_ADD(V_SUB(V_LOAD(up + x - 1), V_LOAD(gup + gx - 1)),
+                           V_SUB(V_LOAD(up + x + 1), V_LOAD(gup + gx + 1))),
+                     V_ADD(V_SUB(V_LOAD(dn + x - 1), V_LOAD(gdn + gx - 1)),
+                           V_SUB(V_LOAD(dn + x + 1), V_LOAD(gdn + gx + 1))));
+        V hc = V_CLAMP12(V_ADD(g, V_SRAI(V_ADD(V_ADD(dw, de), one), 1)));
+        V vc = V_CLAMP12(V_ADD(g, V_SRAI(V_ADD(V_ADD(du, ds), one), 1)));
+        V dc = V_CLAMP12(V_ADD(g, V_SRAI(V_ADD(dd, two), 2)));
+
+        if (!odd_row) {         // R G R G ...
+            V_STORE(r + x - ox, V_SEL(even, c, hc));
+            V_STORE(b + x - ox, V_SEL(even, dc, vc));
+        } else {                // G B G B ...
+            V_STORE(r + x - ox, V_SEL(even, vc, dc));
+            V_STORE(b + x - ox, V_SEL(even, hc, c));
+        }
+    }
+    return x;
+}
+
+#undef V_CLAMP12
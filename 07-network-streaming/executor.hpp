@@ -0,0 +1,461 @@
+// executor.hpp - Small C++20 coroutine executor: one epoll reactor thread
+// plus a pool of worker threads
+//
+// Streaming stages are written as coroutines that suspend instead of
+// blocking a thread:
+//
+//   co_await exec.schedule()          continue on a worker thread
+//   co_await exec.sleep_until(ns)     resume at a CLOCK_MONOTONIC time
+//   co_await io->readable()           resume once the fd polls readable
+//   co_await io->writable()             ... or writable
+//   co_await event.wait()             resume once another task set() it
+//
+// The thread calling Executor::run() only waits in epoll_wait() and hands
+// ready coroutines to the workers, so a thousand idle client sessions are
+// a thousand coroutine frames, not a thousand threads. Coroutines run to
+// their next co_await on whichever worker picked them up; code between two
+// awaits never runs concurrently with itself, but may move between threads.
+//
+// No exceptions, like the rest of the module: failures are reported by
+// ok() / error() and awaits return false once their fd or event is closed.
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace coro {
+
+inline uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+class Executor;
+
+// A coroutine started with Executor::spawn(). It owns nothing once
+// spawned: the frame frees itself when the body returns, and run() keeps
+// going until every spawned task has.
+class Task {
+public:
+    struct promise_type {
+        Executor *exec = nullptr;
+
+        ~promise_type();
+        Task get_return_object()
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::abort(); }
+    };
+
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (handle_)        // never spawned
+            handle_.destroy();
+    }
+
+private:
+    friend class Executor;
+    explicit Task(std::coroutine_handle<promise_type> h) : handle_(h) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// A one-waiter wakeup that is never lost: set() before wait() makes the
+// next wait() return at once. close() wakes the waiter for good; wait()
+// then returns false.
+class Event {
+public:
+    explicit Event(Executor &exec) : exec_(exec) {}
+    Event(const Event &) = delete;
+    Event &operator=(const Event &) = delete;
+
+    void set();
+    void close();
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+    struct Awaiter {
+        Event &ev;
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> h) noexcept
+        {
+            uintptr_t v = ev.state_.load(std::memory_order_acquire);
+
+            for (;;) {
+                if (v == kClosed)
+                    return false;
+                if (v == kSet) {
+                    if (ev.state_.compare_exchange_weak(v, kIdle, std::memory_order_acq_rel))
+                        return false;
+                    continue;
+                }
+                if (ev.state_.compare_exchange_weak(
+                        v, reinterpret_cast<uintptr_t>(h.address()), std::memory_order_acq_rel))
+                    return true;
+            }
+        }
+        bool await_resume() const noexcept { return !ev.closed(); }
+    };
+
+    Awaiter wait() { return Awaiter{*this}; }
+
+private:
+    // state_ is one of these or the address of the waiting coroutine
+    static constexpr uintptr_t kIdle = 0;
+    static constexpr uintptr_t kSet = 1;
+    static constexpr uintptr_t kClosed = 2;
+
+    Executor &exec_;
+    std::atomic<uintptr_t> state_{kIdle};
+    std::atomic<bool> closed_{false};
+};
+
+// A non-blocking fd registered edge-triggered with the reactor. Try the
+// read or write first; on EAGAIN co_await readable() / writable(). Made by
+// Executor::watch(); Executor::unwatch() closes the fd and frees it.
+class Pollable {
+public:
+    int fd() const { return fd_; }
+    Event::Awaiter readable() { return in_.wait(); }
+    Event::Awaiter writable() { return out_.wait(); }
+    // Wake the readable() waiter as if the fd polled readable, e.g. to hand
+    // it work from another task while it also watches the peer
+    void wake() { in_.set(); }
+
+private:
+    friend class Executor;
+    Pollable(Executor &exec, int fd) : fd_(fd), in_(exec), out_(exec) {}
+
+    int fd_;
+    Event in_;
+    Event out_;
+};
+
+class Executor {
+public:
+    // threads 0 = one per online CPU
+    explicit Executor(int threads = 0)
+    {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (epoll_fd_ < 0 || wake_fd_ < 0 || timer_fd_ < 0 ||
+            add_fd(wake_fd_, &wake_fd_, EPOLLIN) < 0 || add_fd(timer_fd_, &timer_fd_, EPOLLIN) < 0) {
+            error_ = errno;
+            return;
+        }
+        if (threads <= 0)
+            threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int i = 0; i < threads; i++)
+            workers_.emplace_back([this] { work(); });
+    }
+
+    ~Executor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(run_lock_);
+            quit_ = true;
+        }
+        run_cv_.notify_all();
+        for (std::thread &t : workers_)
+            t.join();
+        for (Pollable *p : retired_)
+            delete p;
+        for (int fd : {epoll_fd_, wake_fd_, timer_fd_})
+            if (fd >= 0)
+                close(fd);
+    }
+
+    Executor(const Executor &) = delete;
+    Executor &operator=(const Executor &) = delete;
+
+    bool ok() const { return error_ == 0; }
+    int error() const { return error_; }
+    int threads() const { return static_cast<int>(workers_.size()); }
+
+    // Start a task on a worker; run() returns once it and all others finished
+    void spawn(Task task)
+    {
+        std::coroutine_handle<Task::promise_type> h = std::exchange(task.handle_, nullptr);
+
+        h.promise().exec = this;
+        live_.fetch_add(1, std::memory_order_relaxed);
+        post(h);
+    }
+
+    // Resume h on a worker thread
+    void post(std::coroutine_handle<> h)
+    {
+        {
+            std::lock_guard<std::mutex> lock(run_lock_);
+            run_queue_.push_back(h);
+        }
+        run_cv_.notify_one();
+    }
+
+    // The reactor: wait for fds and timers until every spawned task is done.
+    // Returns 0, or -1 if epoll failed (error() has the errno).
+    int run()
+    {
+        struct epoll_event events[64];
+
+        while (live_.load(std::memory_order_acquire) > 0) {
+            int n = epoll_wait(epoll_fd_, events, 64, -1);
+
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                error_ = errno;
+                return -1;
+            }
+            for (int i = 0; i < n; i++) {
+                void *ptr = events[i].data.ptr;
+                uint32_t ev = events[i].events;
+
+                if (ptr == &wake_fd_) {
+                    uint64_t count;
+                    if (read(wake_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                        error_ = errno;
+                } else if (ptr == &timer_fd_) {
+                    fire_timers();
+                } else {
+                    Pollable *p = static_cast<Pollable *>(ptr);
+                    if (ev & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP))
+                        p->in_.set();
+                    if (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                        p->out_.set();
+                }
+            }
+            // This batch was the last that could name them
+            std::vector<Pollable *> retired;
+            {
+                std::lock_guard<std::mutex> lock(retire_lock_);
+                retired.swap(retired_);
+            }
+            for (Pollable *p : retired)
+                delete p;
+        }
+        return 0;
+    }
+
+    // Register fd (made non-blocking by the caller); nullptr on failure
+    Pollable *watch(int fd)
+    {
+        Pollable *p = new Pollable(*this, fd);
+
+        if (add_fd(fd, p, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) < 0) {
+            error_ = errno;
+            delete p;
+            return nullptr;
+        }
+        return p;
+    }
+
+    // Make every await on p return false, now and later, so whichever task
+    // owns it winds down. The fd stays open until the owner unwatch()es it.
+    void cancel(Pollable *p)
+    {
+        p->in_.close();
+        p->out_.close();
+    }
+
+    // cancel() and close the fd. The object itself is freed by the reactor
+    // once no event can refer to it.
+    void unwatch(Pollable *p)
+    {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, p->fd_, nullptr);
+        close(p->fd_);
+        p->fd_ = -1;
+        cancel(p);
+        std::lock_guard<std::mutex> lock(retire_lock_);
+        retired_.push_back(p);
+    }
+
+    struct ScheduleAwaiter {
+        Executor &exec;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { exec.post(h); }
+        void await_resume() const noexcept {}
+    };
+
+    ScheduleAwaiter schedule() { return ScheduleAwaiter{*this}; }
+
+    struct SleepAwaiter {
+        Executor &exec;
+        uint64_t due_ns;
+
+        bool await_ready() const noexcept { return due_ns <= monotonic_ns(); }
+        void await_suspend(std::coroutine_handle<> h) { exec.add_timer(due_ns, h); }
+        void await_resume() const noexcept {}
+    };
+
+    SleepAwaiter sleep_until(uint64_t due_ns) { return SleepAwaiter{*this, due_ns}; }
+
+private:
+    friend struct Task::promise_type;
+
+    struct Timer {
+        uint64_t due_ns;
+        std::coroutine_handle<> h;
+        bool operator>(const Timer &other) const { return due_ns > other.due_ns; }
+    };
+
+    int add_fd(int fd, void *ptr, uint32_t events)
+    {
+        struct epoll_event ev = {};
+
+        ev.events = events;
+        ev.data.ptr = ptr;
+        return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    void wake()
+    {
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            error_ = errno;
+    }
+
+    void work()
+    {
+        for (;;) {
+            std::coroutine_handle<> h;
+            {
+                std::unique_lock<std::mutex> lock(run_lock_);
+                run_cv_.wait(lock, [this] { return quit_ || !run_queue_.empty(); });
+                if (run_queue_.empty())
+                    return;
+                h = run_queue_.front();
+                run_queue_.pop_front();
+            }
+            h.resume();
+        }
+    }
+
+    void task_done()
+    {
+        if (live_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            wake();         // let run() see it
+    }
+
+    // Absolute CLOCK_MONOTONIC deadline of the earliest timer
+    void arm_timer(uint64_t due_ns)
+    {
+        struct itimerspec its = {};
+
+        its.it_value.tv_sec = due_ns / 1000000000ull;
+        its.it_value.tv_nsec = due_ns % 1000000000ull;
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+            its.it_value.tv_nsec = 1;   // zero would disarm it
+        timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &its, nullptr);
+    }
+
+    void add_timer(uint64_t due_ns, std::coroutine_handle<> h)
+    {
+        std::lock_guard<std::mutex> lock(timer_lock_);
+
+        if (timers_.empty() || due_ns < timers_.top().due_ns)
+            arm_timer(due_ns);
+        timers_.push(Timer{due_ns, h});
+    }
+
+    void fire_timers()
+    {
+        uint64_t expirations;
+        if (read(timer_fd_, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+            error_ = errno;
+
+        std::lock_guard<std::mutex> lock(timer_lock_);
+        uint64_t now = monotonic_ns();
+
+        while (!timers_.empty() && timers_.top().due_ns <= now) {
+            post(timers_.top().h);
+            timers_.pop();
+        }
+        if (!timers_.empty())
+            arm_timer(timers_.top().due_ns);
+    }
+
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;          // task_done() interrupts epoll_wait()
+    int timer_fd_ = -1;         // armed for the earliest sleep_until()
+    int error_ = 0;
+    std::atomic<long> live_{0};
+
+    std::mutex run_lock_;
+    std::condition_variable run_cv_;
+    std::deque<std::coroutine_handle<>> run_queue_;
+    bool quit_ = false;
+    std::vector<std::thread> workers_;
+
+    std::mutex timer_lock_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+
+    std::mutex retire_lock_;
+    std::vector<Pollable *> retired_;
+};
+
+inline Task::promise_type::~promise_type()
+{
+    if (exec)
+        exec->task_done();
+}
+
+inline void Event::set()
+{
+    uintptr_t v = state_.load(std::memory_order_acquire);
+
+    for (;;) {
+        if (v == kSet || v == kClosed)
+            return;
+        if (v == kIdle) {
+            if (state_.compare_exchange_weak(v, kSet, std::memory_order_acq_rel))
+                return;
+            continue;
+        }
+        if (state_.compare_exchange_weak(v, kIdle, std::memory_order_acq_rel)) {
+            exec_.post(std::coroutine_handle<>::from_address(reinterpret_cast<void *>(v)));
+            return;
+        }
+    }
+}
+
+inline void Event::close()
+{
+    closed_.store(true, std::memory_order_release);
+    uintptr_t v = state_.exchange(kClosed, std::memory_order_acq_rel);
+    if (v != kIdle && v != kSet && v != kClosed)
+        exec_.post(std::coroutine_handle<>::from_address(reinterpret_cast<void *>(v)));
+}
+
+} // namespace coro
+
+#endif /* EXECUTOR_HPP */
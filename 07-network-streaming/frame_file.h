@@ -0,0 +1,47 @@
+// frame_file.h - On-disk container written by --record, read by --replay
+//
+// Everything is aligned to FILE_ALIGN so it can be written with O_DIRECT:
+//
+//   0              struct file_header, padded to FILE_ALIGN
+//   FILE_ALIGN     record 0: frame_header + payload, zero-padded to FILE_ALIGN
+//   ...            record 1, 2, ... (append-only)
+//   index_offset   struct file_index_entry[frame_count], padded to FILE_ALIGN
+//
+// The header is rewritten with index_offset and frame_count when the
+// recording is closed. If that never happened (crash, power loss) the
+// index is 0 and a reader rebuilds it by walking the records: each one
+// starts with a valid frame_header on a FILE_ALIGN boundary.
+#ifndef FRAME_FILE_H
+#define FRAME_FILE_H
+
+#include <stdint.h>
+
+#include "frame_protocol.h"
+
+#define FILE_MAGIC 0x46524643u      // 'C' 'F' 'R' 'F'
+#define FILE_VERSION 1
+#define FILE_ALIGN 4096
+
+struct file_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t align;                 // FILE_ALIGN
+    uint32_t frame_count;           // 0 until the recording is closed
+    uint32_t max_payload;
+    uint64_t index_offset;          // 0 until the recording is closed
+    uint64_t created_ns;            // CLOCK_REALTIME at record start
+};
+
+struct file_index_entry {
+    uint64_t offset;                // of the record's frame_header
+    uint32_t sequence;
+    uint32_t payload_len;
+    uint64_t timestamp_ns;          // original capture time
+};
+
+static inline uint64_t file_align_up(uint64_t n)
+{
+    return (n + FILE_ALIGN - 1) & ~(uint64_t)(FILE_ALIGN - 1);
+}
+
+#endif /* FRAME_FILE_H */
@@ -0,0 +1,219 @@
+// frame_protocol.h - Wire format between frame_streamer and its clients
+//
+// Every frame on the TCP stream is a fixed 32-byte header followed by
+// payload_len bytes of pixel data:
+//
+//   offset  size  field
+//   0       4     magic         FRAME_MAGIC ("CFRM" on the wire)
+//   4       2     version       FRAME_PROTO_VERSION
+//   6       2     header_len    sizeof(struct frame_header); skip extras
+//   8       2     width         pixels
+//   10      2     height        pixels
+//   12      2     pixel_format  enum pixel_format
+//   14      2     flags         FRAME_FLAG_*
+//   16      4     sequence      capture sequence number (gaps = drops)
+//   20      4     payload_len   bytes following the header
+//   24      8     timestamp_ns  CLOCK_REALTIME when the frame was captured
+//
+// With FRAME_FLAG_RC12 the payload is a raw_codec.h stream that decodes to
+// width * height samples; payload_len is the compressed size.
+//
+// Header extensions follow the 32 bytes in FRAME_FLAG_* bit order, each
+// only if its flag is set, and header_len covers them all; receivers skip
+// what they don't know:
+//
+//   FRAME_FLAG_TRACE   struct frame_trace (40 bytes)
+//   FRAME_FLAG_STREAM  struct frame_stream (8 bytes), when the streamer
+//                      serves several cameras; no extension = stream 0
+//   FRAME_FLAG_CROP    struct frame_crop (8 bytes), the frame is a
+//                      rectangle the client asked for with frame_roi
+//
+// Multi-camera streams: sequence counts per stream, so receivers track
+// gaps per stream_id. A client picks its streams by sending a
+// frame_subscribe message (below) at any time; until then it gets all.
+// With a frame_preview message it gets 2x2-binned PIX_FMT_MONO12 frames
+// (preview.h) instead of full RAW, same sequence numbers. A frame_roi
+// message trims every frame to a rectangle, width/height then being the
+// rectangle's size.
+//
+// All fields are little-endian. A receiver that loses sync scans for the
+// magic and checks version/header_len/payload_len before trusting it.
+#ifndef FRAME_PROTOCOL_H
+#define FRAME_PROTOCOL_H
+
+#include <stdint.h>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "frame_protocol.h assumes a little-endian host"
+#endif
+
+// Also included by the C++ receiver
+#ifdef __cplusplus
+#define FRAME_STATIC_ASSERT static_assert
+#else
+#define FRAME_STATIC_ASSERT _Static_assert
+#endif
+
+#define FRAME_MAGIC 0x4d524643u     // 'C' 'F' 'R' 'M'
+#define FRAME_PROTO_VERSION 1
+#define FRAME_MAX_PAYLOAD (64u << 20)
+
+enum pixel_format {
+    PIX_FMT_RAW12_RGGB = 1,         // 12-bit Bayer RGGB in 16-bit containers
+    PIX_FMT_MONO12 = 2,             // 12-bit binned RGGB quads (preview.h)
+};
+
+#define FRAME_FLAG_RC12 (1u << 0)   // payload is lossless RC12 (raw_codec.h)
+#define FRAME_FLAG_TRACE (1u << 1)  // struct frame_trace follows the header
+#define FRAME_FLAG_STREAM (1u << 2) // struct frame_stream follows (after a trace)
+#define FRAME_FLAG_CROP (1u << 3)   // struct frame_crop follows (last)
+
+#define FRAME_MAX_STREAMS 32        // bits in frame_subscribe.stream_mask
+
+struct frame_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_len;
+    uint16_t width;
+    uint16_t height;
+    uint16_t pixel_format;
+    uint16_t flags;
+    uint32_t sequence;
+    uint32_t payload_len;
+    uint64_t timestamp_ns;
+} __attribute__((packed));
+
+FRAME_STATIC_ASSERT(sizeof(struct frame_header) == 32, "frame_header must be 32 bytes");
+
+/*
+ * Per-stage timestamps (frame_streamer --trace), CLOCK_REALTIME ns like
+ * timestamp_ns; 0 = stage not seen by this source. The stages after
+ * queued_ns (sent, received) are logged by the streamer and the receiver
+ * and joined by test/trace_merge.py.
+ */
+struct frame_trace {
+    uint64_t synth_ns;              // driver: frame generated ("interrupt")
+    uint64_t irq_ns;                // driver: readers woken
+    uint64_t woken_ns;              // streamer: poll() returned
+    uint64_t read_ns;               // streamer: frame copied out of the source
+    uint64_t queued_ns;             // streamer: published to the ring (encoded)
+} __attribute__((packed));
+
+FRAME_STATIC_ASSERT(sizeof(struct frame_trace) == 40, "frame_trace must be 40 bytes");
+
+/* Which camera of a multi-camera streamer the frame comes from */
+struct frame_stream {
+    uint16_t stream_id;             // 0 .. stream_count - 1
+    uint16_t stream_count;          // cameras this streamer serves
+    uint32_t reserved;              // 0
+} __attribute__((packed));
+
+FRAME_STATIC_ASSERT(sizeof(struct frame_stream) == 8, "frame_stream must be 8 bytes");
+
+/* Where a cropped frame (frame_roi) sits in the frame it was cut from */
+struct frame_crop {
+    uint16_t x;                     // left column
+    uint16_t y;                     // top row
+    uint16_t full_width;            // the uncropped frame
+    uint16_t full_height;
+} __attribute__((packed));
+
+FRAME_STATIC_ASSERT(sizeof(struct frame_crop) == 8, "frame_crop must be 8 bytes");
+
+/* Room for every extension above, in whatever follows a frame_header */
+#define FRAME_EXT_MAX (sizeof(struct frame_trace) + sizeof(struct frame_stream) + \
+                       sizeof(struct frame_crop))
+
+/*
+ * Client -> streamer messages, the only things a TCP client ever sends.
+ * The leading magic says which one it is (and so its size); they take
+ * effect from the next frame on. Any other magic closes the connection.
+ */
+#define SUB_MAGIC 0x42534643u       // 'C' 'F' 'S' 'B'
+#define PREVIEW_MAGIC 0x56504643u   // 'C' 'F' 'P' 'V'
+#define ROI_MAGIC 0x49524643u       // 'C' 'F' 'R' 'I'
+
+/* Deliver only the streams whose bit is set (0 pauses) */
+struct frame_subscribe {
+    uint32_t magic;
+    uint32_t stream_mask;           // bit n = stream_id n
+} __attribute__((packed));
+
+FRAME_STATIC_ASSERT(sizeof(struct frame_subscribe) == 8, "frame_subscribe must be 8 bytes");
+
+/*
+ * Deliver frames binned down by factor instead of full RAW. A frame the
+ * streamer could not bin (an RC12 recording) still arrives full size.
+ */
+struct frame_preview {
+    uint32_t magic;
+    uint16_t factor;                // 1 = full frames (default), 2, 4 or 8
+    uint16_t reserved;              // 0
+} __attribute__((packed));
+
+FRAME_STATIC_ASSERT(sizeof(struct frame_preview) == 8, "frame_preview must be 8 bytes");
+
+/*
+ * Deliver only this rectangle of every frame, in full-frame pixels (for
+ * a preview, divided by its factor). It is clipped to each frame, and on
+ * RAW12 RGGB widened to even x/y/width/height so the Bayer phase holds.
+ * width = 0 goes back to whole frames. RC12 frames can't be cut and
+ * arrive whole, without FRAME_FLAG_CROP.
+ */
+struct frame_roi {
+    uint32_t magic;
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+} __attribute__((packed));
+
+FRAME_STATIC_ASSERT(sizeof(struct frame_roi) == 12, "frame_roi must be 12 bytes");
+
+static inline void frame_header_init(struct frame_header *hdr, uint16_t width,
+                                     uint16_t height, uint16_t pixel_format,
+                                     uint32_t sequence, uint32_t payload_len,
+                                     uint64_t timestamp_ns)
+{
+    hdr->magic = FRAME_MAGIC;
+    hdr->version = FRAME_PROTO_VERSION;
+    hdr->header_len = sizeof(*hdr);
+    hdr->width = width;
+    hdr->height = height;
+    hdr->pixel_format = pixel_format;
+    hdr->flags = 0;
+    hdr->sequence = sequence;
+    hdr->payload_len = payload_len;
+    hdr->timestamp_ns = timestamp_ns;
+}
+
+/*
+ * UDP transport (frame_streamer --udp): the wire image of a frame (header +
+ * payload, exactly as sent over TCP) is cut into fragments that each fit
+ * one datagram, and every datagram starts with a frag_header followed by
+ * the bytes at 'offset' in the wire image. A receiver reassembles by
+ * frame_id and drops frames still incomplete at a deadline.
+ */
+#define FRAG_MAGIC 0x55524643u      // 'C' 'F' 'R' 'U'
+
+struct frag_header {
+    uint32_t magic;
+    uint32_t frame_id;              // frame_header.sequence
+    uint16_t frag_index;
+    uint16_t frag_count;
+    uint32_t frame_len;             // wire image bytes (header + payload)
+    uint32_t offset;                // of this fragment in the wire image
+} __attribute__((packed));
+
+FRAME_STATIC_ASSERT(sizeof(struct frag_header) == 20, "frag_header must be 20 bytes");
+
+/* Returns 0 if the header can be trusted, -1 otherwise */
+static inline int frame_header_valid(const struct frame_header *hdr)
+{
+    return (hdr->magic == FRAME_MAGIC &&
+            hdr->version == FRAME_PROTO_VERSION &&
+            hdr->header_len >= sizeof(*hdr) &&
+            hdr->payload_len <= FRAME_MAX_PAYLOAD) ? 0 : -1;
+}
+
+#endif /* FRAME_PROTOCOL_H */
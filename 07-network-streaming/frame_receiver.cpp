@@ -0,0 +1,659 @@
+// frame_receiver.cpp - Reference TCP sink for frame_streamer
+//
+// Connects to the streamer, reads every frame straight into a pool of
+// huge-page backed, NUMA-local buffers (buffer_pool.c; one recv() per
+// header, one per payload, no intermediate copy), validates the header
+// and the sequence numbers, and
+// reports throughput, drops and capture-to-receive latency percentiles.
+// It does nothing else with the pixels, so it measures the streamer and
+// the network, not the receiver. --decode adds RC12 decompression to the
+// measured path; --json prints the summary as one line for scripts.
+// --trace logs the per-stage timestamps of traced frames (frame_streamer
+// --trace) for test/trace_merge.py. From a multi-camera streamer it
+// counts every stream separately; --streams subscribes to a subset.
+// --preview asks for 2x2-binned MONO12 frames instead of full RAW, --roi
+// for a rectangle of each frame.
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer_pool.h"
+#include "frame_protocol.h"
+#include "raw_codec.h"
+#include "thread_sched.h"
+
+namespace {
+
+volatile sig_atomic_t stop_requested = 0;
+
+void handle_signal(int) { stop_requested = 1; }
+
+uint64_t clock_ns(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// Fixed set of frame buffers, handed out round-robin. A real consumer
+// would hold a frame while processing it and release it afterwards; the
+// pool keeps that pattern without allocating per frame. Buffers grow
+// (all at once, one arena) if a frame is larger than anything seen so far.
+class FramePool {
+public:
+    FramePool(size_t count, size_t size, pool_backing backing, int node)
+        : count_(count), backing_(backing), node_(node)
+    {
+        pool_.base = nullptr;
+        pool_.stride = 0;
+        reserve(size);
+    }
+    ~FramePool() { pool_destroy(&pool_); }
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    bool reserve(size_t size)
+    {
+        if (size <= pool_.stride)
+            return true;
+        pool_destroy(&pool_);
+        return pool_init(&pool_, static_cast<int>(count_), size, backing_, node_) == 0;
+    }
+
+    uint8_t *next() { return static_cast<uint8_t *>(pool_buf(&pool_, next_++ % count_)); }
+    size_t count() const { return count_; }
+    size_t size() const { return pool_.stride; }
+    const buffer_pool &arena() const { return pool_; }
+
+private:
+    buffer_pool pool_;
+    size_t count_;
+    pool_backing backing_;
+    int node_;
+    size_t next_ = 0;
+};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    unsigned long frames = 0;       // 0 = until the server closes
+    int rcvbuf_mb = 8;
+    size_t pool = 8;
+    pool_backing backing = POOL_AUTO;
+    int numa_node = POOL_NODE_LOCAL;
+    struct thread_sched sched = { SCHED_CPU_ANY, 0, 0 };
+    bool decode = false;
+    bool verbose = false;
+    bool json = false;
+    const char *trace = nullptr;    // CSV of per-stage timestamps
+    uint32_t streams = ~0u;         // stream_ids to subscribe to
+    bool subscribe = false;         // send a frame_subscribe (--streams)
+    unsigned int preview = 1;       // downscale factor, 1 = full frames
+    struct frame_roi roi = {};      // sent if width > 0 (--roi)
+};
+
+struct Stats {
+    unsigned long frames = 0;
+    unsigned long rc12_frames = 0;
+    uint64_t bytes = 0;             // headers + payloads
+    uint64_t rc12_bytes = 0;        // compressed payload bytes that were decoded
+    uint64_t raw_bytes = 0;         // the same payloads after decoding
+    unsigned long dropped = 0;      // sequence gaps
+    unsigned long reordered = 0;    // sequence went backwards or repeated
+    unsigned long decode_errors = 0;
+    unsigned long unsubscribed = 0; // sent before the server saw --streams
+    // Sequence numbers count per stream; stream 0 without the extension
+    uint32_t streams_seen = 0;
+    uint32_t last_seq[FRAME_MAX_STREAMS] = {};
+    unsigned long stream_frames[FRAME_MAX_STREAMS] = {};
+    std::vector<double> latency_us;
+    uint64_t first_ns = 0, last_ns = 0;
+};
+
+// recv() exactly len bytes; false on EOF, error or Ctrl+C
+bool recv_full(int fd, void *buf, size_t len)
+{
+    auto *p = static_cast<uint8_t *>(buf);
+
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, MSG_WAITALL);
+        if (n > 0) {
+            p += n;
+            len -= n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR && !stop_requested)
+            continue;
+        if (n < 0 && errno != EINTR)
+            perror("recv failed");
+        return false;
+    }
+    return true;
+}
+
+// "X,Y,WxH" -> roi; false if malformed or empty
+bool parse_roi(const char *spec, struct frame_roi *roi)
+{
+    unsigned int x, y, w, h;
+    char tail;
+
+    if (sscanf(spec, "%u,%u,%ux%u%c", &x, &y, &w, &h, &tail) != 4 ||
+        w == 0 || h == 0 || x > 0xffff || y > 0xffff || w > 0xffff || h > 0xffff)
+        return false;
+    roi->magic = ROI_MAGIC;
+    roi->x = x;
+    roi->y = y;
+    roi->width = w;
+    roi->height = h;
+    return true;
+}
+
+int connect_to(const Options &opt)
+{
+    struct addrinfo hints = {}, *res, *ai;
+    int fd = -1;
+    int err;
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    err = getaddrinfo(opt.host.c_str(), opt.port.c_str(), &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", opt.host.c_str(), gai_strerror(err));
+        return -1;
+    }
+
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        // Before connect(), so the window scale is negotiated for it
+        int size = opt.rcvbuf_mb << 20;
+#ifdef SO_RCVBUFFORCE
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+#endif
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0)
+        perror("Failed to connect");
+    return fd;
+}
+
+double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t i = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+double cpu_ms()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3;
+}
+
+struct Summary {
+    double secs, fps, mb_per_s;
+    double p50, p90, p99, p999, max;    // latency, microseconds
+    double cpu_ms;
+};
+
+Summary summarize(const Stats &st, double cpu)
+{
+    Summary sm = {};
+    std::vector<double> lat = st.latency_us;
+
+    std::sort(lat.begin(), lat.end());
+    sm.secs = (st.last_ns - st.first_ns) / 1e9;
+    // Rates cover the intervals between the first and the last frame
+    if (st.frames > 1 && sm.secs > 0) {
+        sm.fps = (st.frames - 1) / sm.secs;
+        sm.mb_per_s = static_cast<double>(st.bytes) * (st.frames - 1) / st.frames / sm.secs / 1e6;
+    }
+    sm.p50 = percentile(lat, 50);
+    sm.p90 = percentile(lat, 90);
+    sm.p99 = percentile(lat, 99);
+    sm.p999 = percentile(lat, 99.9);
+    sm.max = lat.empty() ? 0 : lat.back();
+    sm.cpu_ms = cpu;
+    return sm;
+}
+
+// "0,2-3" or "all" -> stream bit mask; false if malformed
+bool parse_streams(const char *list, uint32_t *mask)
+{
+    char *end;
+
+    if (strcmp(list, "all") == 0) {
+        *mask = ~0u;
+        return true;
+    }
+    *mask = 0;
+    for (const char *p = list; *p; p = end + (*end == ',')) {
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p)
+            return false;
+        if (*end == '-')
+            hi = strtol(end + 1, &end, 10);
+        if (lo < 0 || hi < lo || hi >= FRAME_MAX_STREAMS || (*end && *end != ','))
+            return false;
+        for (; lo <= hi; lo++)
+            *mask |= 1u << lo;
+    }
+    return true;
+}
+
+int highest_stream(const Stats &st)
+{
+    return st.streams_seen ? 31 - __builtin_clz(st.streams_seen) : -1;
+}
+
+void print_json(const Stats &st, const Summary &sm, const FramePool &pool, int rcvbuf)
+{
+    std::string streams;
+
+    for (int i = 0; i <= highest_stream(st); i++)
+        streams += (i ? ", " : "") + std::to_string(st.stream_frames[i]);
+
+    printf("{\"frames\": %lu, \"bytes\": %llu, \"seconds\": %.3f, \"fps\": %.2f, "
+           "\"mb_per_s\": %.2f, \"dropped\": %lu, \"reordered\": %lu, "
+           "\"rc12_frames\": %lu, \"decode_errors\": %lu, "
+           "\"latency_us\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, "
+           "\"p99_9\": %.1f, \"max\": %.1f}, \"cpu_ms\": %.1f, "
+           "\"cpu_ms_per_frame\": %.4f, \"pool\": %zu, \"rcvbuf\": %d, "
+           "\"stream_frames\": [%s]}\n",
+           st.frames, static_cast<unsigned long long>(st.bytes), sm.secs, sm.fps,
+           sm.mb_per_s, st.dropped, st.reordered, st.rc12_frames, st.decode_errors,
+           sm.p50, sm.p90, sm.p99, sm.p999, sm.max,
+           sm.cpu_ms, st.frames ? sm.cpu_ms / st.frames : 0.0, pool.count(), rcvbuf,
+           streams.c_str());
+}
+
+void print_summary(const Stats &st, const Summary &sm, const FramePool &pool, int rcvbuf)
+{
+    printf("\n=== Summary ===\n");
+    printf("Frames:   %lu in %.3f s (%.1f fps, %.1f MB/s)\n",
+           st.frames, sm.secs, sm.fps, sm.mb_per_s);
+    printf("Dropped:  %lu (sequence gaps), %lu out of order\n", st.dropped, st.reordered);
+    if (st.unsubscribed)
+        printf("Ignored:  %lu frames of unsubscribed streams\n", st.unsubscribed);
+    if (__builtin_popcount(st.streams_seen) > 1) {
+        printf("Streams: ");
+        for (int i = 0; i <= highest_stream(st); i++) {
+            if (st.streams_seen & (1u << i))
+                printf(" %d: %lu frames%s", i, st.stream_frames[i],
+                       i < highest_stream(st) ? "," : "\n");
+        }
+    }
+    if (st.rc12_frames && st.raw_bytes)
+        printf("RC12:     %lu frames, %.2f:1, %lu decode errors\n", st.rc12_frames,
+               static_cast<double>(st.raw_bytes) / st.rc12_bytes, st.decode_errors);
+    else if (st.rc12_frames)
+        printf("RC12:     %lu frames (not decoded, see --decode)\n", st.rc12_frames);
+    if (st.frames)
+        printf("Latency:  p50 %.0f us, p90 %.0f us, p99 %.0f us, p99.9 %.0f us, max %.0f us\n",
+               sm.p50, sm.p90, sm.p99, sm.p999, sm.max);
+    printf("CPU:      %.1f ms (%.3f ms/frame)\n",
+           sm.cpu_ms, st.frames ? sm.cpu_ms / st.frames : 0.0);
+    printf("Buffers:  %zu x %zu KB pool (%s", pool.count(), pool.size() / 1024,
+           pool_backing_name(pool.arena().backing));
+    if (pool.arena().node >= 0)
+        printf(", NUMA node %d", pool.arena().node);
+    printf("), SO_RCVBUF %d KB\n", rcvbuf / 1024);
+}
+
+void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  -H, --host HOST       streamer address (default 127.0.0.1)\n");
+    printf("  -p, --port PORT       streamer port (default 8080)\n");
+    printf("  -n, --frames N        stop after N frames, 0 = until disconnect (default 0)\n");
+    printf("  -b, --rcvbuf MB       socket receive buffer (default 8)\n");
+    printf("  -k, --pool N          frame buffers in the pool (default 8)\n");
+    printf("  -B, --buffers MODE    pool memory: auto|hugetlb|thp|pages (default auto)\n");
+    printf("  -N, --numa-node N     NUMA node for the pool: N|local|any (default local)\n");
+    printf("  -c, --cpu SPEC        pin the receive thread: CPU|isolated|any[:FIFO_PRIO]\n");
+    printf("  -D, --decode          decompress RC12 frames (counted in CPU time)\n");
+    printf("  -v, --verbose         one line per frame\n");
+    printf("  -j, --json            print the summary as JSON\n");
+    printf("  -t, --trace FILE      log stage timestamps of traced frames (CSV)\n");
+    printf("  -S, --streams LIST    only these streams of a multi-camera streamer, e.g. 0,2-3\n");
+    printf("  -P, --preview FACTOR  binned preview frames, 1/FACTOR size: 2|4|8 (default 1)\n");
+    printf("  -r, --roi X,Y,WxH     only this rectangle of each frame (full-frame pixels)\n");
+    printf("  -h, --help            show this help\n");
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    Stats st;
+    struct frame_header hdr;
+    struct frame_trace trace;
+    struct frame_stream stream;
+    struct frame_crop crop;
+    FILE *trace_file = nullptr;
+    unsigned int local_port = 0;
+    std::vector<uint16_t> decoded;
+    int rcvbuf = 0;
+    socklen_t optlen = sizeof(rcvbuf);
+    int opt_char;
+    int fd;
+
+    static const struct option long_opts[] = {
+        { "host",    required_argument, nullptr, 'H' },
+        { "port",    required_argument, nullptr, 'p' },
+        { "frames",  required_argument, nullptr, 'n' },
+        { "rcvbuf",  required_argument, nullptr, 'b' },
+        { "pool",    required_argument, nullptr, 'k' },
+        { "buffers", required_argument, nullptr, 'B' },
+        { "numa-node", required_argument, nullptr, 'N' },
+        { "cpu",     required_argument, nullptr, 'c' },
+        { "decode",  no_argument,       nullptr, 'D' },
+        { "verbose", no_argument,       nullptr, 'v' },
+        { "json",    no_argument,       nullptr, 'j' },
+        { "trace",   required_argument, nullptr, 't' },
+        { "streams", required_argument, nullptr, 'S' },
+        { "preview", required_argument, nullptr, 'P' },
+        { "roi",     required_argument, nullptr, 'r' },
+        { "help",    no_argument,       nullptr, 'h' },
+        { nullptr,   0,                 nullptr, 0 }
+    };
+
+    while ((opt_char = getopt_long(argc, argv, "H:p:n:b:k:B:N:c:Dvjt:S:P:r:h", long_opts, nullptr)) != -1) {
+        switch (opt_char) {
+        case 'H':
+            opt.host = optarg;
+            break;
+        case 'p':
+            opt.port = optarg;
+            break;
+        case 'n':
+            opt.frames = strtoul(optarg, nullptr, 10);
+            break;
+        case 'b':
+            opt.rcvbuf_mb = atoi(optarg);
+            break;
+        case 'k':
+            opt.pool = strtoul(optarg, nullptr, 10);
+            break;
+        case 'B':
+            if (parse_pool_backing(optarg, &opt.backing) < 0) {
+                fprintf(stderr, "Unknown buffer backing: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'N':
+            if (parse_pool_node(optarg, &opt.numa_node) < 0) {
+                fprintf(stderr, "Invalid NUMA node: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'c':
+            if (parse_thread_sched(optarg, &opt.sched) < 0) {
+                fprintf(stderr, "Invalid thread spec: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'D':
+            opt.decode = true;
+            break;
+        case 'v':
+            opt.verbose = true;
+            break;
+        case 'j':
+            opt.json = true;
+            break;
+        case 't':
+            opt.trace = optarg;
+            break;
+        case 'S':
+            if (!parse_streams(optarg, &opt.streams)) {
+                fprintf(stderr, "Invalid stream list: %s\n", optarg);
+                return 1;
+            }
+            opt.subscribe = true;
+            break;
+        case 'P':
+            opt.preview = strtoul(optarg, nullptr, 10);
+            if (opt.preview != 1 && opt.preview != 2 && opt.preview != 4 && opt.preview != 8) {
+                fprintf(stderr, "Invalid preview factor: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'r':
+            if (!parse_roi(optarg, &opt.roi)) {
+                fprintf(stderr, "Invalid ROI (X,Y,WxH): %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt.rcvbuf_mb < 1 || opt.rcvbuf_mb > 1024 || opt.pool < 1) {
+        fprintf(stderr, "Invalid --rcvbuf or --pool\n");
+        return 1;
+    }
+
+    // No SA_RESTART: Ctrl+C interrupts a blocking recv() and we report
+    struct sigaction sa = {};
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    // Pin first: "local" below is then the pinned CPU's node
+    if (thread_sched_apply(&opt.sched, "receive thread") < 0)
+        return 1;
+
+    // This thread receives every frame: "local" is its node
+    FramePool pool(opt.pool, 640 * 480 * 2, opt.backing, opt.numa_node);
+    if (pool.size() == 0) {
+        perror("Failed to allocate frame pool");
+        return 1;
+    }
+
+    if (!opt.json)
+        printf("Connecting to %s:%s...\n", opt.host.c_str(), opt.port.c_str());
+    fd = connect_to(opt);
+    if (fd < 0)
+        return 1;
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen);
+
+    if (opt.trace) {
+        // The streamer logs send times under our port number
+        struct sockaddr_storage local;
+        socklen_t len = sizeof(local);
+
+        if (getsockname(fd, reinterpret_cast<struct sockaddr *>(&local), &len) == 0)
+            local_port = ntohs(local.ss_family == AF_INET6 ?
+                               reinterpret_cast<struct sockaddr_in6 *>(&local)->sin6_port :
+                               reinterpret_cast<struct sockaddr_in *>(&local)->sin_port);
+        trace_file = fopen(opt.trace, "w");
+        if (!trace_file) {
+            perror("Failed to create trace file");
+            close(fd);
+            return 1;
+        }
+        fprintf(trace_file, "sequence,client_port,synth_ns,irq_ns,woken_ns,read_ns,"
+                            "queued_ns,recv_ns\n");
+    }
+    if (opt.subscribe) {
+        struct frame_subscribe sub = { SUB_MAGIC, opt.streams };
+
+        if (send(fd, &sub, sizeof(sub), MSG_NOSIGNAL) != sizeof(sub)) {
+            perror("Failed to subscribe");
+            close(fd);
+            return 1;
+        }
+    }
+    if (opt.preview > 1) {
+        struct frame_preview req = { PREVIEW_MAGIC, static_cast<uint16_t>(opt.preview), 0 };
+
+        if (send(fd, &req, sizeof(req), MSG_NOSIGNAL) != sizeof(req)) {
+            perror("Failed to request preview");
+            close(fd);
+            return 1;
+        }
+    }
+    if (opt.roi.width &&
+        send(fd, &opt.roi, sizeof(opt.roi), MSG_NOSIGNAL) != sizeof(opt.roi)) {
+        perror("Failed to request ROI");
+        close(fd);
+        return 1;
+    }
+    if (!opt.json)
+        printf("✓ Connected (SO_RCVBUF %d KB, %zu frame buffers)\n", rcvbuf / 1024, pool.count());
+
+    double cpu_start = cpu_ms();
+    int exit_code = 0;
+
+    while (!stop_requested && (opt.frames == 0 || st.frames < opt.frames)) {
+        if (!recv_full(fd, &hdr, sizeof(hdr)))
+            break;
+        if (frame_header_valid(&hdr) < 0) {
+            fprintf(stderr, "Invalid frame header after %lu frames (magic 0x%08x)\n",
+                    st.frames, hdr.magic);
+            exit_code = 1;
+            break;
+        }
+
+        size_t extra = hdr.header_len - sizeof(hdr);
+        bool traced = (hdr.flags & FRAME_FLAG_TRACE) && extra >= sizeof(trace);
+        if (traced) {
+            if (!recv_full(fd, &trace, sizeof(trace)))
+                break;
+            extra -= sizeof(trace);
+        }
+        stream.stream_id = 0;
+        if ((hdr.flags & FRAME_FLAG_STREAM) && extra >= sizeof(stream)) {
+            if (!recv_full(fd, &stream, sizeof(stream)))
+                break;
+            extra -= sizeof(stream);
+        }
+        bool cropped = (hdr.flags & FRAME_FLAG_CROP) && extra >= sizeof(crop);
+        if (cropped) {
+            if (!recv_full(fd, &crop, sizeof(crop)))
+                break;
+            extra -= sizeof(crop);
+        }
+
+        // Newer streamers may append header fields we don't know yet
+        while (extra > 0) {
+            uint8_t skip[64];
+            size_t n = std::min(extra, sizeof(skip));
+            if (!recv_full(fd, skip, n))
+                goto done;
+            extra -= n;
+        }
+
+        if (!pool.reserve(hdr.payload_len)) {
+            perror("Failed to grow frame pool");
+            exit_code = 1;
+            break;
+        }
+        uint8_t *buf = pool.next();
+        if (!recv_full(fd, buf, hdr.payload_len))
+            break;
+
+        uint64_t now = clock_ns(CLOCK_REALTIME);
+        unsigned int id = stream.stream_id % FRAME_MAX_STREAMS;
+        // The subscription takes effect server-side only once it is read
+        if (!(opt.streams & (1u << id))) {
+            st.unsubscribed++;
+            continue;
+        }
+        uint32_t &last_seq = st.last_seq[id];
+        st.last_ns = clock_ns(CLOCK_MONOTONIC);
+        if (st.frames == 0)
+            st.first_ns = st.last_ns;
+        if (!(st.streams_seen & (1u << id)))
+            st.streams_seen |= 1u << id;
+        else if (hdr.sequence > last_seq + 1)
+            st.dropped += hdr.sequence - last_seq - 1;
+        else if (hdr.sequence <= last_seq)
+            st.reordered++;
+        last_seq = hdr.sequence;
+
+        st.frames++;
+        st.stream_frames[id]++;
+        st.bytes += hdr.header_len + hdr.payload_len;
+        st.latency_us.push_back(now > hdr.timestamp_ns ? (now - hdr.timestamp_ns) / 1e3 : 0);
+        if (traced && trace_file)
+            fprintf(trace_file, "%u,%u,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                    hdr.sequence, local_port,
+                    static_cast<unsigned long long>(trace.synth_ns),
+                    static_cast<unsigned long long>(trace.irq_ns),
+                    static_cast<unsigned long long>(trace.woken_ns),
+                    static_cast<unsigned long long>(trace.read_ns),
+                    static_cast<unsigned long long>(trace.queued_ns),
+                    static_cast<unsigned long long>(now));
+
+        if (hdr.flags & FRAME_FLAG_RC12) {
+            st.rc12_frames++;
+            if (opt.decode) {
+                size_t samples = static_cast<size_t>(hdr.width) * hdr.height;
+                if (decoded.size() < samples)
+                    decoded.resize(samples);
+                if (raw_decode(buf, hdr.payload_len, decoded.data(), decoded.size()) < 0)
+                    st.decode_errors++;
+                else {
+                    st.rc12_bytes += hdr.payload_len;
+                    st.raw_bytes += samples * 2;
+                }
+            }
+        }
+
+        if (opt.verbose) {
+            printf("[%u:%u] %ux%u", id, hdr.sequence, hdr.width, hdr.height);
+            if (cropped)
+                printf(" at %u,%u of %ux%u", crop.x, crop.y, crop.full_width, crop.full_height);
+            printf(", %u bytes%s, latency %.2f ms\n", hdr.payload_len,
+                   (hdr.flags & FRAME_FLAG_RC12) ? " (RC12)" :
+                   hdr.pixel_format == PIX_FMT_MONO12 ? " (MONO12)" : "",
+                   st.latency_us.back() / 1e3);
+        }
+    }
+done:
+    close(fd);
+    if (trace_file)
+        fclose(trace_file);
+
+    Summary sm = summarize(st, cpu_ms() - cpu_start);
+    if (opt.json)
+        print_json(st, sm, pool, rcvbuf);
+    else
+        print_summary(st, sm, pool, rcvbuf);
+    return exit_code;
+}
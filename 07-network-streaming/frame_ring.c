@@ -0,0 +1,375 @@
+// frame_ring.c - Ring of preallocated frame buffers (see frame_ring.h)
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "frame_ring.h"
+
+static int ring_setup(struct frame_ring *ring, int depth, size_t frame_size,
+                      enum drop_policy policy, enum pool_backing backing, int node,
+                      size_t reserve, int shared)
+{
+    int ret, i;
+
+    memset(ring, 0, sizeof(*ring));
+    if (depth < 1)
+        return -1;
+
+    ring->depth = depth;
+    ring->frame_size = frame_size;
+    ring->policy = policy;
+
+    ring->slots = aligned_alloc(64, depth * sizeof(*ring->slots));
+    ring->free_list = calloc(depth, sizeof(int));
+    ring->ready = calloc(depth, sizeof(int));
+    if (!ring->slots || !ring->free_list || !ring->ready)
+        goto fail;
+    memset(ring->slots, 0, depth * sizeof(*ring->slots));
+
+    /* All buffers are allocated up front: no malloc() per frame */
+    if (shared)
+        ret = pool_init_shared(&ring->pool, depth, frame_size, reserve, backing, node);
+    else
+        ret = pool_init(&ring->pool, depth, frame_size, backing, node);
+    if (ret < 0)
+        goto fail;
+    for (i = 0; i < depth; i++) {
+        ring->slots[i].data = pool_buf(&ring->pool, i);
+        ring->slots[i].index = i;
+        ring->free_list[ring->free_count++] = i;
+    }
+
+    ring->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ring->notify_fd < 0)
+        goto fail;
+
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->not_empty, NULL);
+    pthread_cond_init(&ring->not_full, NULL);
+    return 0;
+
+fail:
+    pool_destroy(&ring->pool);
+    free(ring->slots);
+    free(ring->free_list);
+    free(ring->ready);
+    memset(ring, 0, sizeof(*ring));
+    return -1;
+}
+
+int ring_init(struct frame_ring *ring, int depth, size_t frame_size,
+              enum drop_policy policy, enum pool_backing backing, int node)
+{
+    return ring_setup(ring, depth, frame_size, policy, backing, node, 0, 0);
+}
+
+int ring_init_shared(struct frame_ring *ring, int depth, size_t frame_size,
+                     enum drop_policy policy, enum pool_backing backing, int node,
+                     size_t reserve)
+{
+    return ring_setup(ring, depth, frame_size, policy, backing, node, reserve, 1);
+}
+
+void ring_destroy(struct frame_ring *ring)
+{
+    if (!ring->slots)
+        return;
+
+    pool_destroy(&ring->pool);
+    free(ring->slots);
+    free(ring->free_list);
+    free(ring->ready);
+    close(ring->notify_fd);
+
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->not_empty);
+    pthread_cond_destroy(&ring->not_full);
+    memset(ring, 0, sizeof(*ring));
+}
+
+struct frame_slot *ring_acquire(struct frame_ring *ring)
+{
+    struct frame_slot *slot = NULL;
+    int idx;
+
+    pthread_mutex_lock(&ring->lock);
+
+    if (ring->policy == DROP_BLOCK) {
+        while (ring->free_count == 0 && !ring->closed)
+            pthread_cond_wait(&ring->not_full, &ring->lock);
+    }
+
+    if (ring->closed)
+        goto out;
+
+    if (ring->free_count > 0 && ring->pool.fd >= 0) {
+        /*
+         * Shared slots: reuse the one released longest ago. The newest
+         * frames are what other processes are still reading in place.
+         */
+        idx = ring->free_list[0];
+        ring->free_count--;
+        memmove(ring->free_list, ring->free_list + 1, ring->free_count * sizeof(int));
+        slot = &ring->slots[idx];
+        slot->refs = 1;
+    } else if (ring->free_count > 0) {
+        idx = ring->free_list[--ring->free_count];
+        slot = &ring->slots[idx];
+        slot->refs = 1;
+    } else if (ring->policy == DROP_OLDEST && ring->ready_count > 0) {
+        /* Steal the oldest frame still waiting for the sender */
+        idx = ring->ready[ring->ready_head];
+        ring->ready_head = (ring->ready_head + 1) % ring->depth;
+        ring->ready_count--;
+        ring->dropped++;
+        slot = &ring->slots[idx];
+        slot->refs = 1;
+    } else {
+        /*
+         * DROP_NEWEST, or DROP_OLDEST while every slot is being sent:
+         * the caller still has to consume the frame from the device
+         */
+        ring->dropped++;
+    }
+
+out:
+    pthread_mutex_unlock(&ring->lock);
+    return slot;
+}
+
+static void ring_notify(struct frame_ring *ring)
+{
+    uint64_t one = 1;
+
+    if (write(ring->notify_fd, &one, sizeof(one)) < 0) {
+        /* Counter saturated: the consumer has a wakeup pending anyway */
+    }
+}
+
+void ring_publish(struct frame_ring *ring, struct frame_slot *slot)
+{
+    int tail;
+
+    pthread_mutex_lock(&ring->lock);
+    tail = (ring->ready_head + ring->ready_count) % ring->depth;
+    ring->ready[tail] = slot->index;
+    ring->ready_count++;
+    pthread_cond_signal(&ring->not_empty);
+    pthread_mutex_unlock(&ring->lock);
+    ring_notify(ring);
+}
+
+void ring_close(struct frame_ring *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    ring->closed = 1;
+    pthread_cond_broadcast(&ring->not_empty);
+    pthread_cond_broadcast(&ring->not_full);
+    pthread_mutex_unlock(&ring->lock);
+    ring_notify(ring);
+}
+
+struct frame_slot *ring_consume(struct frame_ring *ring)
+{
+    struct frame_slot *slot = NULL;
+    int idx;
+
+    pthread_mutex_lock(&ring->lock);
+    while (ring->ready_count == 0 && !ring->closed)
+        pthread_cond_wait(&ring->not_empty, &ring->lock);
+
+    /* Frames published before close are still delivered */
+    if (ring->ready_count > 0) {
+        idx = ring->ready[ring->ready_head];
+        ring->ready_head = (ring->ready_head + 1) % ring->depth;
+        ring->ready_count--;
+        slot = &ring->slots[idx];
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return slot;
+}
+
+struct frame_slot *ring_try_consume(struct frame_ring *ring, int *drained)
+{
+    struct frame_slot *slot = NULL;
+    int idx;
+
+    pthread_mutex_lock(&ring->lock);
+    if (ring->ready_count > 0) {
+        idx = ring->ready[ring->ready_head];
+        ring->ready_head = (ring->ready_head + 1) % ring->depth;
+        ring->ready_count--;
+        slot = &ring->slots[idx];
+    }
+    *drained = ring->closed && ring->ready_count == 0;
+    pthread_mutex_unlock(&ring->lock);
+    return slot;
+}
+
+void ring_get(struct frame_slot *slot)
+{
+    __atomic_add_fetch(&slot->refs, 1, __ATOMIC_RELAXED);
+}
+
+void ring_release(struct frame_ring *ring, struct frame_slot *slot)
+{
+    if (__atomic_sub_fetch(&slot->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    pthread_mutex_lock(&ring->lock);
+    ring->free_list[ring->free_count++] = slot->index;
+    pthread_cond_signal(&ring->not_full);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+static const struct slot_view *slot_preview(const struct frame_slot *slot, int level)
+{
+    if (level < 1 || level > PREVIEW_LEVELS || slot->preview[level - 1].len == 0)
+        return NULL;
+    return &slot->preview[level - 1];
+}
+
+size_t slot_wire_len(const struct frame_slot *slot, int level)
+{
+    const struct slot_view *v = slot_preview(slot, level);
+
+    return v ? v->hdr.header_len + v->len : slot->hdr.header_len + slot->len;
+}
+
+int slot_iov(struct frame_slot *slot, int level, size_t offset, struct iovec iov[2])
+{
+    const struct slot_view *v = slot_preview(slot, level);
+    const struct frame_header *hdr = v ? &v->hdr : &slot->hdr;
+    size_t hdr_len = hdr->header_len;       // hdr, plus its extensions
+    char *data = v ? v->data : slot->data;
+    size_t len = v ? v->len : slot->len;
+    int n = 0;
+
+    if (offset < hdr_len) {
+        iov[n].iov_base = (char *)hdr + offset;
+        iov[n].iov_len = hdr_len - offset;
+        n++;
+        offset = 0;
+    } else {
+        offset -= hdr_len;
+    }
+
+    iov[n].iov_base = data + offset;
+    iov[n].iov_len = len - offset;
+    return n + 1;
+}
+
+/* [start, start + len) clipped to [0, limit), widened to even on Bayer data */
+static void clip_span(unsigned int start, unsigned int len, unsigned int limit,
+                      int bayer, unsigned int *out_start, unsigned int *out_len)
+{
+    unsigned int end = start + len < limit ? start + len : limit;
+
+    if (start > end)
+        start = end;
+    if (bayer) {
+        start &= ~1u;
+        end = (end + 1) & ~1u;
+        if (end > limit)
+            end = limit & ~1u;
+    }
+    *out_start = start;
+    *out_len = end > start ? end - start : 0;
+}
+
+int slot_crop(const struct frame_slot *slot, int level, const struct frame_roi *roi,
+              struct slot_crop *crop)
+{
+    const struct slot_view *v = slot_preview(slot, level);
+    const struct frame_header *hdr = v ? &v->hdr : &slot->hdr;
+    const char *ext = v ? v->ext : slot->ext;
+    const char *data = v ? v->data : slot->data;
+    int shift = v ? level : 0;
+    int bayer = hdr->pixel_format == PIX_FMT_RAW12_RGGB;
+    struct frame_crop where;
+    unsigned int x, y, w, h;
+
+    if (hdr->flags & FRAME_FLAG_RC12)
+        return -1;
+
+    clip_span(roi->x >> shift, roi->width >> shift, hdr->width, bayer, &x, &w);
+    clip_span(roi->y >> shift, roi->height >> shift, hdr->height, bayer, &y, &h);
+
+    where.x = x;
+    where.y = y;
+    where.full_width = hdr->width;
+    where.full_height = hdr->height;
+
+    crop->hdr = *hdr;
+    memcpy(crop->ext, ext, hdr->header_len - sizeof(*hdr));
+    memcpy(crop->ext + (hdr->header_len - sizeof(*hdr)), &where, sizeof(where));
+    crop->hdr.header_len += sizeof(where);
+    crop->hdr.flags |= FRAME_FLAG_CROP;
+    crop->hdr.width = w;
+    crop->hdr.height = h;
+    crop->hdr.payload_len = w * h * 2;
+
+    crop->stride = (size_t)hdr->width * 2;
+    crop->row_len = (size_t)w * 2;
+    crop->data = data + y * crop->stride + x * 2;
+    return 0;
+}
+
+int crop_iov(const struct slot_crop *crop, size_t offset, struct iovec *iov, int max)
+{
+    size_t hdr_len = crop->hdr.header_len;
+    size_t row, col;
+    int n = 0;
+
+    if (offset < hdr_len) {
+        iov[n].iov_base = (char *)&crop->hdr + offset;
+        iov[n].iov_len = hdr_len - offset;
+        n++;
+        offset = 0;
+    } else {
+        offset -= hdr_len;
+    }
+    if (crop->row_len == 0)
+        return n;
+
+    // Whole rows are one contiguous run
+    if (crop->row_len == crop->stride) {
+        iov[n].iov_base = (char *)crop->data + offset;
+        iov[n].iov_len = crop->hdr.payload_len - offset;
+        return n + 1;
+    }
+
+    row = offset / crop->row_len;
+    col = offset % crop->row_len;
+    for (; n < max && row < crop->hdr.height; row++, col = 0) {
+        iov[n].iov_base = (char *)crop->data + row * crop->stride + col;
+        iov[n].iov_len = crop->row_len - col;
+        n++;
+    }
+    return n;
+}
+
+int parse_drop_policy(const char *name, enum drop_policy *policy)
+{
+    if (strcmp(name, "newest") == 0)
+        *policy = DROP_NEWEST;
+    else if (strcmp(name, "oldest") == 0)
+        *policy = DROP_OLDEST;
+    else if (strcmp(name, "block") == 0)
+        *policy = DROP_BLOCK;
+    else
+        return -1;
+    return 0;
+}
+
+const char *drop_policy_name(enum drop_policy policy)
+{
+    switch (policy) {
+    case DROP_NEWEST: return "newest";
+    case DROP_OLDEST: return "oldest";
+    case DROP_BLOCK:  return "block";
+    }
+    return "?";
+}
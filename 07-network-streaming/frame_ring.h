@@ -0,0 +1,181 @@
+// frame_ring.h - Fixed ring of preallocated frame buffers shared by the
+// capture thread (producer) and the network server (consumer)
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "buffer_pool.h"
+#include "frame_protocol.h"
+#include "preview.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * What the producer does when every slot is busy:
+ * - DROP_NEWEST: discard the frame that was just captured
+ * - DROP_OLDEST: recycle the oldest frame that nobody has picked up yet
+ * - DROP_BLOCK:  wait for the consumer (capture stalls, nothing is lost)
+ */
+enum drop_policy {
+    DROP_NEWEST,
+    DROP_OLDEST,
+    DROP_BLOCK,
+};
+
+/* A binned copy of a slot's frame, with its own wire header */
+struct slot_view {
+    struct frame_header hdr;
+    char ext[FRAME_EXT_MAX];  // same extensions as the full frame
+    char *data;
+    size_t len;             // 0 = not made for this frame
+};
+
+FRAME_STATIC_ASSERT(offsetof(struct slot_view, ext) == sizeof(struct frame_header),
+                    "slot_iov() sends hdr and its extensions as one block");
+
+/*
+ * One cache line (or more) per slot: refs is updated by the capture and
+ * network threads, so neighbouring slots must not share a line
+ */
+struct frame_slot {
+    struct frame_header hdr;  // wire header, sent in front of data
+    char ext[FRAME_EXT_MAX];  // header extensions (slot_append_ext())
+    char *data;             // frame_size bytes in ring->pool
+    size_t len;             // valid bytes after the device read
+    unsigned int frame_no;  // capture sequence number (1-based, per stream)
+    int stream;             // camera it came from, 0 with a single source
+    char *preview_mem;      // room for every preview level, NULL = none
+    struct slot_view preview[PREVIEW_LEVELS];   // level n at [n - 1]
+    int index;              // position in ring->slots
+    int refs;               // holders; back on the free list at zero
+} __attribute__((aligned(64)));
+
+FRAME_STATIC_ASSERT(offsetof(struct frame_slot, ext) == sizeof(struct frame_header),
+                    "slot_iov() sends hdr and its extensions as one block");
+
+struct frame_ring {
+    struct frame_slot *slots;
+    int depth;
+    size_t frame_size;
+    enum drop_policy policy;
+    struct buffer_pool pool;    // every slot's data, one arena
+
+    /* Slot indices: a stack of free slots and a FIFO of captured ones */
+    int *free_list;
+    int free_count;
+    int *ready;
+    int ready_head;
+    int ready_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;   // signalled on publish and close
+    pthread_cond_t not_full;    // signalled on release and close
+    int closed;
+    int notify_fd;              // eventfd, bumped on publish and close
+
+    unsigned long dropped;      // frames lost to the drop policy
+};
+
+/*
+ * Allocate depth slots of frame_size bytes from one buffer_pool arena
+ * (backing and NUMA node as for pool_init()). Nothing is allocated later.
+ */
+int ring_init(struct frame_ring *ring, int depth, size_t frame_size,
+              enum drop_policy policy, enum pool_backing backing, int node);
+
+/*
+ * The same with the slot buffers in a memfd (pool_init_shared(), 'reserve'
+ * bytes in front of them) that consumers in other processes map: frames
+ * are captured where they read them. Free slots are then reused oldest
+ * first rather than most recently released first.
+ */
+int ring_init_shared(struct frame_ring *ring, int depth, size_t frame_size,
+                     enum drop_policy policy, enum pool_backing backing, int node,
+                     size_t reserve);
+void ring_destroy(struct frame_ring *ring);
+
+/*
+ * Producer side, safe to call from several capture threads (one per
+ * camera). ring_acquire() returns a slot to read the next frame
+ * into, or NULL if the frame has to be dropped (DROP_NEWEST with a full
+ * ring) or the ring was closed.
+ */
+struct frame_slot *ring_acquire(struct frame_ring *ring);
+void ring_publish(struct frame_ring *ring, struct frame_slot *slot);
+void ring_close(struct frame_ring *ring);
+
+/*
+ * Consumer side. ring_consume() blocks until a frame is published and
+ * returns NULL once the ring is closed and drained. ring_try_consume()
+ * never blocks; it is meant for event loops woken through notify_fd and
+ * sets *drained once the ring is closed and empty.
+ *
+ * A consumed slot carries one reference. Every additional holder (e.g.
+ * each client the frame is fanned out to) takes its own with ring_get();
+ * ring_release() drops one and recycles the slot when the last one goes.
+ */
+struct frame_slot *ring_consume(struct frame_ring *ring);
+struct frame_slot *ring_try_consume(struct frame_ring *ring, int *drained);
+void ring_get(struct frame_slot *slot);
+void ring_release(struct frame_ring *ring, struct frame_slot *slot);
+
+/*
+ * Append a header extension behind hdr and flag it. Extensions go on the
+ * wire in flag order, so append a trace before the stream.
+ */
+static inline void slot_append_ext(struct frame_slot *slot, uint16_t flag,
+                                   const void *ext, size_t len)
+{
+    memcpy(slot->ext + (slot->hdr.header_len - sizeof(slot->hdr)), ext, len);
+    slot->hdr.header_len += len;
+    slot->hdr.flags |= flag;
+}
+
+/*
+ * The wire image (header + payload) sent for preview level 'level': the
+ * binned view if the slot has one, the full frame for level 0 or if not.
+ * slot_iov() describes what is left of it after 'offset' bytes have been
+ * sent and returns the number of iovecs used.
+ */
+size_t slot_wire_len(const struct frame_slot *slot, int level);
+int slot_iov(struct frame_slot *slot, int level, size_t offset, struct iovec iov[2]);
+
+/*
+ * A rectangle of the wire image for 'level', sent without a cropped copy:
+ * its own header, then one iovec per row pointing into the slot's pixels.
+ */
+struct slot_crop {
+    struct frame_header hdr;  // cropped geometry, FRAME_FLAG_CROP added
+    char ext[FRAME_EXT_MAX];
+    const char *data;       // first pixel of the rectangle
+    size_t row_len;         // bytes sent per row
+    size_t stride;          // bytes per row of the frame
+};
+
+FRAME_STATIC_ASSERT(offsetof(struct slot_crop, ext) == sizeof(struct frame_header),
+                    "crop_iov() sends hdr and its extensions as one block");
+
+/*
+ * Fill *crop with roi (frame_protocol.h rules) cut from the frame sent for
+ * 'level'. Returns -1 if that frame can't be cropped (RC12): send it whole.
+ * crop_iov() describes up to 'max' iovecs of what is left after 'offset'
+ * bytes have been sent (header + hdr.payload_len in total).
+ */
+int slot_crop(const struct frame_slot *slot, int level, const struct frame_roi *roi,
+              struct slot_crop *crop);
+int crop_iov(const struct slot_crop *crop, size_t offset, struct iovec *iov, int max);
+
+int parse_drop_policy(const char *name, enum drop_policy *policy);
+const char *drop_policy_name(enum drop_policy policy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAME_RING_H */
@@ -0,0 +1,372 @@
+// frame_source.c - Device, synthetic and replay frame sources (see frame_source.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#include "frame_source.h"
+#include "../05-interrupt-handling/camera_ioctl.h"
+
+static uint64_t realtime_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void timespec_add_ns(struct timespec *ts, uint64_t ns)
+{
+    ts->tv_sec += ns / 1000000000ull;
+    ts->tv_nsec += ns % 1000000000ull;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static int timespec_before(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec ||
+           (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static uint64_t timespec_ns(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+/* Sleep until due_ns (CLOCK_MONOTONIC) in short steps; -1 if stopped */
+static int sleep_until(const struct frame_source *src, uint64_t due_ns)
+{
+    struct timespec due = { 0, 0 }, now, step;
+
+    timespec_add_ns(&due, due_ns);
+    for (;;) {
+        if (*src->stop)
+            return -1;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (!timespec_before(&now, &due))
+            return 0;
+        // At most 100 ms at a time so Ctrl+C is noticed, like the device poll()
+        step = now;
+        timespec_add_ns(&step, 100000000);
+        if (timespec_before(&due, &step))
+            step = due;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &step, NULL);
+    }
+}
+
+int source_parse(struct frame_source *src, const char *spec)
+{
+    const char *arg = strchr(spec, ':');
+    size_t len = arg ? (size_t)(arg - spec) : strlen(spec);
+
+    if (arg)
+        arg++;
+    src->width = SOURCE_DEFAULT_WIDTH;
+    src->height = SOURCE_DEFAULT_HEIGHT;
+
+    if (len == 6 && strncmp(spec, "device", len) == 0) {
+        src->kind = SOURCE_DEVICE;
+        src->path = arg && *arg ? arg : SOURCE_DEFAULT_DEVICE;
+        return 0;
+    }
+
+    if (len == 9 && strncmp(spec, "synthetic", len) == 0) {
+        src->kind = SOURCE_SYNTHETIC;
+        src->fps = SOURCE_DEFAULT_FPS;
+        if (!arg || !*arg)
+            return 0;
+        if (sscanf(arg, "%dx%d", &src->width, &src->height) != 2 ||
+            src->width < 2 || src->height < 2 || src->width > 16384 ||
+            src->height > 16384 || (src->width | src->height) & 1)
+            return -1;      // whole RGGB quads only
+        arg = strchr(arg, '@');
+        if (arg && (sscanf(arg + 1, "%lf", &src->fps) != 1 || src->fps < 0))
+            return -1;
+        return 0;
+    }
+
+    if (len == 6 && strncmp(spec, "replay", len) == 0 && arg && *arg) {
+        src->kind = SOURCE_REPLAY;
+        src->path = arg;
+        return 0;
+    }
+
+    return -1;
+}
+
+int source_open(struct frame_source *src)
+{
+    src->fd = -1;
+    src->count = 0;
+
+    switch (src->kind) {
+    case SOURCE_DEVICE:
+        printf("Opening %s...\n", src->path);
+        src->fd = open(src->path, O_RDONLY);
+        if (src->fd < 0) {
+            perror("Failed to open device");
+            return -1;
+        }
+        src->max_frame = (size_t)src->width * src->height * 2;
+        src->frame_info = 1;    // until the driver says otherwise
+        printf("✓ Device opened\n");
+        return 0;
+
+    case SOURCE_SYNTHETIC:
+        src->max_frame = (size_t)src->width * src->height * 2;
+        if (src->fps > 0)
+            printf("✓ Synthetic source: %dx%d test gradient at %g fps\n",
+                   src->width, src->height, src->fps);
+        else
+            printf("✓ Synthetic source: %dx%d test gradient, unpaced\n",
+                   src->width, src->height);
+        return 0;
+
+    case SOURCE_REPLAY:
+        if (replay_open(&src->replay, src->path) < 0)
+            return -1;
+        if (src->replay.count > 0) {
+            const char *payload;
+            const struct frame_header *fh = replay_frame(&src->replay, 0, &payload);
+
+            src->width = fh->width;
+            src->height = fh->height;
+        }
+        src->max_frame = src->replay.max_payload;
+        return 0;
+    }
+    return -1;
+}
+
+static int device_wait(struct frame_source *src)
+{
+    struct pollfd pfd = { .fd = src->fd, .events = POLLIN };
+
+    for (;;) {
+        // Wait for data ready (blocks until interrupt wakes us up)
+        int ret = poll(&pfd, 1, 100);
+
+        if (*src->stop)
+            return 0;
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Poll failed");
+            return -1;
+        }
+        if (ret > 0 && (pfd.revents & POLLIN))
+            return 1;
+    }
+}
+
+/* Driver-side stages of the frame just read; older drivers have no ioctl */
+static void device_trace(struct frame_source *src, struct frame_trace *trace)
+{
+    struct camera_frame_info info;
+
+    if (!src->frame_info)
+        return;
+    if (ioctl(src->fd, CAMERA_IOC_FRAME_INFO, &info) < 0) {
+        if (errno == ENOTTY || errno == EINVAL) {
+            printf("Note: driver has no CAMERA_IOC_FRAME_INFO, tracing from poll() on\n");
+            src->frame_info = 0;
+        }
+        return;
+    }
+    trace->synth_ns = info.synth_ns;
+    trace->irq_ns = info.irq_ns;
+}
+
+static ssize_t device_read(struct frame_source *src, void *dst, struct frame_header *hdr,
+                           struct frame_trace *trace)
+{
+    // The driver woke us: that is as close to capture as we can see
+    uint64_t captured_ns = realtime_ns();
+    ssize_t n;
+
+    do {
+        n = read(src->fd, dst, src->max_frame);
+    } while (n < 0 && (errno == EAGAIN || errno == EINTR) && !*src->stop);
+
+    if (n < 0) {
+        if (*src->stop)
+            return 0;
+        perror("Read from device failed");
+        return -1;
+    }
+    if (n == 0) {
+        printf("No more data from device\n");
+        return 0;
+    }
+
+    src->count++;
+    frame_header_init(hdr, src->width, src->height, PIX_FMT_RAW12_RGGB,
+                      src->count, (uint32_t)n, captured_ns);
+    if (trace) {
+        trace->read_ns = realtime_ns();
+        device_trace(src, trace);
+    }
+    return n;
+}
+
+/* Frame n is due n / fps after the first one, so the rate does not drift */
+static void synthetic_due(struct frame_source *src, uint64_t *due_ns)
+{
+    if (src->count == 0)
+        clock_gettime(CLOCK_MONOTONIC, &src->start);
+    else if (src->fps > 0)
+        *due_ns = timespec_ns(&src->start) + (uint64_t)(src->count * 1e9 / src->fps);
+}
+
+/*
+ * Same gradient as generate_test_pattern() in the driver:
+ * ((row + col + frame * 10) * 16) % 4096, with the frame counter starting at 1
+ */
+static ssize_t synthetic_read(struct frame_source *src, void *dst, struct frame_header *hdr,
+                              struct frame_trace *trace)
+{
+    uint16_t *pixels = dst;
+    int i, j;
+
+    if (trace)
+        trace->synth_ns = realtime_ns();
+    src->count++;
+    for (i = 0; i < src->height; i++) {
+        uint16_t *row = pixels + (size_t)i * src->width;
+        unsigned int base = (i + src->count * 10) * 16;
+
+        for (j = 0; j < src->width; j++)
+            row[j] = (base + j * 16) & 4095;
+    }
+
+    frame_header_init(hdr, src->width, src->height, PIX_FMT_RAW12_RGGB,
+                      src->count, (uint32_t)src->max_frame, realtime_ns());
+    if (trace)
+        trace->read_ns = hdr->timestamp_ns;
+    return src->max_frame;
+}
+
+/* Keeps the recorded spacing between frames unless max_rate is set */
+static int replay_due(struct frame_source *src, uint64_t *due_ns)
+{
+    const struct frame_header *fh;
+    const char *payload;
+
+    if (src->count >= src->replay.count)
+        return 0;
+    fh = replay_frame(&src->replay, src->count, &payload);
+
+    if (src->count == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &src->start);
+        src->first_ns = fh->timestamp_ns;
+    } else if (!src->max_rate) {
+        *due_ns = timespec_ns(&src->start) +
+                  (fh->timestamp_ns > src->first_ns ? fh->timestamp_ns - src->first_ns : 0);
+    }
+    return 1;
+}
+
+/*
+ * Recorded sequence numbers, geometry and flags are kept; the timestamp is
+ * restamped so receivers still measure real latency
+ */
+static ssize_t replay_read(struct frame_source *src, void *dst, struct frame_header *hdr,
+                           struct frame_trace *trace)
+{
+    const struct frame_header *fh;
+    const char *payload;
+
+    if (src->count >= src->replay.count)
+        return 0;
+    fh = replay_frame(&src->replay, src->count++, &payload);
+
+    memcpy(dst, payload, fh->payload_len);
+    *hdr = *fh;
+    hdr->header_len = sizeof(*hdr);
+    // A recorded trace is stale, the stream is whichever this source feeds
+    hdr->flags &= ~(FRAME_FLAG_TRACE | FRAME_FLAG_STREAM);
+    hdr->timestamp_ns = realtime_ns();
+    if (trace)
+        trace->read_ns = hdr->timestamp_ns;
+    return fh->payload_len;
+}
+
+int source_due(struct frame_source *src, uint64_t *due_ns)
+{
+    *due_ns = 0;
+    switch (src->kind) {
+    case SOURCE_DEVICE:
+        return 1;
+    case SOURCE_SYNTHETIC:
+        synthetic_due(src, due_ns);
+        return 1;
+    case SOURCE_REPLAY:
+        return replay_due(src, due_ns);
+    }
+    return -1;
+}
+
+int source_wait(struct frame_source *src)
+{
+    uint64_t due_ns;
+    int ret;
+
+    if (src->kind == SOURCE_DEVICE) {
+        ret = device_wait(src);
+    } else {
+        ret = source_due(src, &due_ns);
+        if (ret > 0 && ((due_ns && sleep_until(src, due_ns) < 0) || *src->stop))
+            ret = 0;
+    }
+    if (ret > 0)
+        src->woken_ns = realtime_ns();
+    return ret;
+}
+
+ssize_t source_read(struct frame_source *src, void *dst, struct frame_header *hdr,
+                    struct frame_trace *trace)
+{
+    if (trace) {
+        memset(trace, 0, sizeof(*trace));
+        trace->woken_ns = src->woken_ns;
+    }
+
+    switch (src->kind) {
+    case SOURCE_DEVICE:
+        return device_read(src, dst, hdr, trace);
+    case SOURCE_SYNTHETIC:
+        return synthetic_read(src, dst, hdr, trace);
+    case SOURCE_REPLAY:
+        return replay_read(src, dst, hdr, trace);
+    }
+    return -1;
+}
+
+const char *source_name(const struct frame_source *src)
+{
+    switch (src->kind) {
+    case SOURCE_DEVICE:
+        return "device";
+    case SOURCE_SYNTHETIC:
+        return "synthetic";
+    case SOURCE_REPLAY:
+        return "replay";
+    }
+    return "?";
+}
+
+void source_close(struct frame_source *src)
+{
+    if (src->kind == SOURCE_REPLAY)
+        replay_close(&src->replay);
+    if (src->fd >= 0)
+        close(src->fd);
+    src->fd = -1;
+}
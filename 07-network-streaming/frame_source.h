@@ -0,0 +1,103 @@
+// frame_source.h - Where frame_streamer's frames come from
+//
+//   device      the camera driver (Module 05): poll() + read()
+//   synthetic   the driver's test gradient generated in user space, at a
+//               fixed rate or as fast as possible; no kernel module needed
+//   replay      a --record file, with the original frame spacing or as
+//               fast as possible
+//
+// The capture thread only calls source_wait() and source_read(), so the
+// ring, codec and transports behave the same whichever source feeds them.
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "frame_protocol.h"
+#include "replay.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SOURCE_DEFAULT_DEVICE "/dev/camera"
+#define SOURCE_DEFAULT_WIDTH 640
+#define SOURCE_DEFAULT_HEIGHT 480
+#define SOURCE_DEFAULT_FPS 30
+
+enum source_kind {
+    SOURCE_DEVICE,
+    SOURCE_SYNTHETIC,
+    SOURCE_REPLAY,
+};
+
+struct frame_source {
+    enum source_kind kind;
+    int width;
+    int height;
+    size_t max_frame;           // largest payload source_read() can return
+    volatile sig_atomic_t *stop;
+
+    int fd;                     // device
+    const char *path;           // device node or recording
+    int frame_info;             // driver answers CAMERA_IOC_FRAME_INFO
+
+    double fps;                 // synthetic, 0 = as fast as possible
+    int max_rate;               // replay without the recorded spacing
+
+    struct replay replay;
+    uint32_t count;             // frames delivered (synthetic: the pattern's
+                                // frame counter, replay: next index)
+    struct timespec start;      // pacing reference, set by the first frame
+    uint64_t first_ns;          // replay: first recorded timestamp
+    uint64_t woken_ns;          // when source_wait() last returned a frame
+};
+
+/*
+ * Parse a --source SPEC: "device[:PATH]", "synthetic[:WxH[@FPS]]" or
+ * "replay:FILE" (FPS 0 = as fast as possible). Only fills in the
+ * configuration; source_open() does the rest. Returns 0 or -1.
+ */
+int source_parse(struct frame_source *src, const char *spec);
+
+/* Open the device / map the recording. Returns 0 or -1 (message printed). */
+int source_open(struct frame_source *src);
+
+/*
+ * Block until the next frame is due: the driver signals data, the
+ * synthetic or replay clock reaches it. Returns 1 when source_read() can
+ * deliver it, 0 at the end of the stream or once *stop is set, -1 on error.
+ */
+int source_wait(struct frame_source *src);
+
+/*
+ * source_wait() for event loops, which wait themselves: a device frame
+ * is ready when src->fd polls readable; synthetic and replay frames are
+ * due at *due_ns (CLOCK_MONOTONIC, 0 = now). Returns 1, or 0 at the end
+ * of the stream. Never sleeps, and leaves the trace's woken_ns unset.
+ */
+int source_due(struct frame_source *src, uint64_t *due_ns);
+
+/*
+ * Write the frame to dst (max_frame bytes). hdr gets the complete wire
+ * header: geometry, flags, a 1-based sequence (the recorded one for
+ * replay) and the capture time. If trace is not NULL it gets the stages
+ * up to read_ns (from the driver too, if it supports it). Returns the
+ * payload length, 0 if the stream ended, -1 on error.
+ */
+ssize_t source_read(struct frame_source *src, void *dst, struct frame_header *hdr,
+                    struct frame_trace *trace);
+
+const char *source_name(const struct frame_source *src);
+
+void source_close(struct frame_source *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAME_SOURCE_H */
@@ -1,159 +1,918 @@
-// frame_streamer.c - Read from driver using poll() and send via network
+// frame_streamer.c - Read frames from the driver (or another source) and send via network
+//
+// A capture thread reads frames into a ring of preallocated buffers while
+// an epoll server fans each frame out to every connected client. Frames
+// are shared by reference, and a slow client only loses its own frames.
+// With several --source options (or a device glob like /dev/camera*) every
+// camera gets its own capture thread feeding the same ring and server;
+// frames carry a stream ID and clients subscribe to the streams they want.
+// Progress is a summary line every --stats seconds (--verbose: a line per
+// frame); probes.h has USDT probes for perf/bpftrace on the hot path.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <errno.h>
-#include <poll.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-
-#define DEVICE_PATH "/dev/camera"
+#include <signal.h>
+#include <getopt.h>
+#include <glob.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "frame_ring.h"
+#include "net_server.h"
+#include "pacer.h"
+#include "probes.h"
+#include "raw_codec.h"
+#include "udp_sender.h"
+#include "shm_server.h"
+#include "recorder.h"
+#include "frame_source.h"
+#include "preview.h"
+#include "thread_sched.h"
+#include "uring_server.h"
+
 #define PORT 8080
-#define FRAME_SIZE 614400
 #define MAX_FRAMES 5  // Limit to 5 frames for demo
+#define DEFAULT_RING_DEPTH 8
+#define DEFAULT_CLIENT_DEPTH 4
+#define DEFAULT_MAX_CLIENTS 16
+#define DEFAULT_STATS_INTERVAL 1
 
-int main() {
-    int device_fd, server_fd, client_fd;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    char *buffer;
-    ssize_t bytes_read;
-    struct pollfd fds[1];
-    
-    // Allocate buffer for frame data
-    buffer = malloc(FRAME_SIZE);
-    if (!buffer) {
-        perror("Failed to allocate buffer");
-        return 1;
+static volatile sig_atomic_t stop_requested;
+
+struct streamer;
+
+/* One per --source: its own capture thread, all feeding one ring */
+struct camera {
+    struct streamer *s;
+    int id;                 // stream_id on the wire
+    char name[32];          // "capture thread" / "camera N capture"
+    struct frame_source src;
+    struct thread_sched sched;
+    pthread_t tid;
+    int running;
+    char *scratch;          // drain buffer for frames the ring drops, and
+                            // the read buffer when compressing
+    int frames_captured;
+};
+
+struct streamer {
+    struct camera cams[FRAME_MAX_STREAMS];
+    int ncams;
+    int cams_active;        // capture threads still running, the last one
+                            // closes the ring
+    glob_t devices;         // expanded device globs, paths used by cams
+    int globbed;
+    int max_frames;         // per camera
+    int compress;           // RC12-encode each frame before it is queued
+    int trace;              // send a frame_trace with every frame
+    int verbose;            // a line per frame instead of the summary
+    int stats_interval;     // seconds between summary lines, 0 = quiet
+    struct stream_stats stats;
+    struct frame_ring ring;
+    struct net_server server;
+    struct udp_sender udp;
+    struct shm_server shm;
+    struct recorder rec;
+
+    struct thread_sched capture_sched;  // template for every camera
+    struct buffer_pool scratch_pool;    // one scratch buffer per camera
+    struct buffer_pool preview_pool;    // binned frames, one per ring slot
+};
+
+static void handle_sigint(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static uint64_t realtime_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  -n, --frames N        frames to capture, 0 = unlimited (default %d)\n",
+           MAX_FRAMES);
+    printf("  -d, --ring-depth N    frame buffers per camera between capture and send (default %d)\n",
+           DEFAULT_RING_DEPTH);
+    printf("  -p, --drop-policy P   when the ring is full: newest|oldest|block (default newest)\n");
+    printf("  -q, --client-depth N  frames queued per client before it drops (default %d)\n",
+           DEFAULT_CLIENT_DEPTH);
+    printf("  -l, --client-policy P when a client falls behind: fifo|latest (default fifo)\n");
+    printf("  -z, --zerocopy        transmit with MSG_ZEROCOPY (falls back automatically)\n");
+    printf("  -r, --pace RATE       cap each client (UDP: the stream) at RATE Mbit/s, or\n");
+    printf("                        auto = spread frames over the frame interval; add\n");
+    printf("                        :user for the token bucket instead of the kernel\n");
+    printf("  -C, --compress        lossless RC12 compression of every frame\n");
+    printf("  -u, --io-uring        run capture and network on one io_uring instance\n");
+    printf("  -U, --udp HOST:PORT   stream over UDP to one receiver instead of TCP\n");
+    printf("  -m, --mtu N           link MTU for --udp fragments (default %d)\n",
+           UDP_DEFAULT_MTU);
+    printf("  -L, --udp-loss PCT    drop PCT%% of UDP fragments (loss testing)\n");
+    printf("  -S, --shm PATH        serve same-host consumers from shared memory\n");
+    printf("  -R, --record FILE     write frames to a container file instead of serving\n");
+    printf("  -i, --source SPEC     device[:PATH] | synthetic[:WxH[@FPS]] | replay:FILE\n");
+    printf("                        (default device:%s, synthetic 640x480@%d); repeat\n",
+           SOURCE_DEFAULT_DEVICE, SOURCE_DEFAULT_FPS);
+    printf("                        or use a PATH glob for several cameras (stream IDs 0..)\n");
+    printf("  -P, --replay FILE     same as --source replay:FILE\n");
+    printf("  -M, --max-rate        replay or synthesize as fast as possible\n");
+    printf("  -T, --trace FILE      send per-stage timestamps, log send times to FILE\n");
+    printf("  -b, --buffers MODE    frame memory: auto|hugetlb|thp|pages (default auto)\n");
+    printf("  -N, --numa-node N     NUMA node for frame memory: N|local|any (default local)\n");
+    printf("  -a, --capture-cpu SPEC pin capture threads: CPU|isolated|any[:FIFO_PRIO]\n");
+    printf("  -e, --send-cpu SPEC   pin the send thread (all sending, io_uring mode: all work)\n");
+    printf("  -s, --stats SECS      print a summary line every SECS, 0 = off (default %d)\n",
+           DEFAULT_STATS_INTERVAL);
+    printf("  -Q, --quiet           same as --stats 0\n");
+    printf("  -v, --verbose         print a line per frame read and sent\n");
+    printf("  -c, --max-clients N   concurrent clients (default %d)\n", DEFAULT_MAX_CLIENTS);
+    printf("  -w, --wait-clients N  start capturing once N clients are connected (default 1)\n");
+    printf("  -h, --help            show this help\n");
+}
+
+/*
+ * --pace auto: the rate at which every camera's largest frame takes 90%
+ * of its frame interval. 0 if some source has no known frame rate.
+ */
+static double auto_pace_mbit(const struct streamer *s)
+{
+    double bytes_per_s = 0;
+    int i;
+
+    for (i = 0; i < s->ncams; i++) {
+        const struct frame_source *src = &s->cams[i].src;
+
+        if (src->kind != SOURCE_SYNTHETIC || src->fps <= 0)
+            return 0;
+        bytes_per_s += (sizeof(struct frame_header) + FRAME_EXT_MAX + src->max_frame) * src->fps;
     }
-    
-    // 1. Open camera device
-    printf("Opening %s...\n", DEVICE_PATH);
-    device_fd = open(DEVICE_PATH, O_RDONLY);
-    if (device_fd < 0) {
-        perror("Failed to open device");
-        free(buffer);
-        return 1;
+    return bytes_per_s * 8 / 1e6 / 0.9;
+}
+
+/*
+ * Bin the raw frame into preview levels 1 .. level for the clients that
+ * asked for them (net_server preview_level), each level from the one
+ * before. The views share the full frame's sequence, time and extensions.
+ */
+static void make_previews(struct frame_slot *slot, const uint16_t *raw, int level)
+{
+    const uint16_t *src = raw;
+    char *dst = slot->preview_mem;
+    int w = slot->hdr.width, h = slot->hdr.height;
+    int i;
+
+    for (i = 0; i < PREVIEW_LEVELS; i++)
+        slot->preview[i].len = 0;
+    if (!dst || slot->hdr.pixel_format != PIX_FMT_RAW12_RGGB)
+        return;
+
+    for (i = 0; i < level; i++) {
+        struct slot_view *v = &slot->preview[i];
+
+        bin2x2(src, w, h, (uint16_t *)dst);
+        w /= 2;
+        h /= 2;
+
+        v->hdr = slot->hdr;
+        memcpy(v->ext, slot->ext, sizeof(v->ext));
+        v->hdr.width = w;
+        v->hdr.height = h;
+        v->hdr.pixel_format = PIX_FMT_MONO12;
+        v->hdr.flags &= ~FRAME_FLAG_RC12;
+        v->data = dst;
+        v->len = (size_t)w * h * 2;
+        v->hdr.payload_len = (uint32_t)v->len;
+
+        src = (const uint16_t *)dst;
+        dst += v->len;
     }
-    printf("✓ Device opened\n");
-    
-    // 2. Create TCP socket
-    printf("Creating socket...\n");
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
-        perror("Socket creation failed");
-        close(device_fd);
-        free(buffer);
-        return 1;
+}
+
+/* A capture thread is done; the last one ends the stream */
+static void camera_done(struct streamer *s)
+{
+    if (__atomic_sub_fetch(&s->cams_active, 1, __ATOMIC_ACQ_REL) == 0)
+        ring_close(&s->ring);
+}
+
+/*
+ * Capture thread, one per camera: wait for the source and read each frame
+ * into a free ring slot. It never touches a socket, so stalled clients
+ * can only fill the ring; what happens then is decided by the drop policy.
+ */
+static void *capture_thread(void *arg)
+{
+    struct camera *cam = arg;
+    struct streamer *s = cam->s;
+    struct frame_stream stream = { cam->id, s->ncams, 0 };
+    struct frame_header hdr;
+    struct frame_trace trace;
+    struct frame_slot *slot;
+    char *dst;
+    ssize_t len;
+    int ret, level;
+
+    if (thread_sched_apply(&cam->sched, cam->name) < 0) {
+        // Without this camera the run is not what was asked for
+        stop_requested = 1;
+        camera_done(s);
+        return NULL;
     }
-    
-    // Allow port reuse
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    
-    // 3. Bind to port
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
-    
-    if (bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Bind failed");
-        close(server_fd);
-        close(device_fd);
-        free(buffer);
-        return 1;
+
+    while (s->max_frames == 0 || cam->frames_captured < s->max_frames) {
+        ret = source_wait(&cam->src);
+        if (ret <= 0)
+            break;
+        PROBE_POLL_RETURN(cam->frames_captured + 1);
+
+        // The frame must be read even when it is dropped, otherwise the
+        // driver keeps data_ready set and poll() returns immediately
+        slot = ring_acquire(&s->ring);
+        dst = slot && !s->compress ? slot->data : cam->scratch;
+        // --shm: consumers may still be reading this slot's last frame
+        if (slot && s->shm.hdr)
+            shm_server_claim(&s->shm, slot);
+
+        len = source_read(&cam->src, dst, &hdr, s->trace ? &trace : NULL);
+        if (len <= 0) {
+            if (slot)
+                ring_release(&s->ring, slot);
+            break;
+        }
+
+        cam->frames_captured++;
+        if (!slot) {
+            PROBE_RING_DROP(cam->frames_captured);
+            stats_dropped(&s->stats);
+            if (s->verbose)
+                printf("[%d:%d] Ring full, frame dropped\n", cam->id, cam->frames_captured);
+            continue;
+        }
+
+        slot->len = len;
+        slot->frame_no = cam->frames_captured;
+        slot->stream = cam->id;
+        slot->hdr = hdr;
+        if (s->compress && !(hdr.flags & FRAME_FLAG_RC12)) {
+            slot->len = raw_encode((const uint16_t *)cam->scratch, hdr.width,
+                                   hdr.height, slot->data, s->ring.frame_size);
+            slot->hdr.payload_len = (uint32_t)slot->len;
+            slot->hdr.flags |= FRAME_FLAG_RC12;
+            if (s->verbose)
+                printf("[%d:%d] Read %zd bytes (%ux%u RAW frame), RC12 %zu bytes\n",
+                       cam->id, cam->frames_captured, len, hdr.width, hdr.height,
+                       slot->len);
+        } else {
+            if (s->compress)    // a compressed recording, pass it through
+                memcpy(slot->data, cam->scratch, len);
+            if (s->verbose)
+                printf("[%d:%d] Read %zd bytes (%ux%u %s frame)\n", cam->id,
+                       cam->frames_captured, len, hdr.width, hdr.height,
+                       (hdr.flags & FRAME_FLAG_RC12) ? "RC12" : "RAW");
+        }
+        PROBE_READ_DONE(slot->frame_no, len, slot->len);
+        stats_read(&s->stats, slot->len);
+        if (s->trace) {
+            trace.queued_ns = realtime_ns();
+            slot_append_ext(slot, FRAME_FLAG_TRACE, &trace, sizeof(trace));
+        }
+        // A single camera keeps the wire format it always had
+        if (s->ncams > 1)
+            slot_append_ext(slot, FRAME_FLAG_STREAM, &stream, sizeof(stream));
+        // Only raw pixels can be binned, not a passed-through RC12 frame
+        level = __atomic_load_n(&s->server.preview_level, __ATOMIC_RELAXED);
+        make_previews(slot, (const uint16_t *)(s->compress ? cam->scratch : slot->data),
+                      (hdr.flags & FRAME_FLAG_RC12) ? 0 : level);
+        ring_publish(&s->ring, slot);
     }
-    printf("✓ Bound to port %d\n", PORT);
-    
-    // 4. Start listening
-    if (listen(server_fd, 1) < 0) {
-        perror("Listen failed");
-        close(server_fd);
-        close(device_fd);
-        free(buffer);
-        return 1;
+
+    camera_done(s);
+    return NULL;
+}
+
+static int frames_captured(const struct streamer *s)
+{
+    int i, n = 0;
+
+    for (i = 0; i < s->ncams; i++)
+        n += s->cams[i].frames_captured;
+    return n;
+}
+
+static int add_camera(struct streamer *s, const struct frame_source *src)
+{
+    if (s->ncams == FRAME_MAX_STREAMS) {
+        fprintf(stderr, "At most %d sources\n", FRAME_MAX_STREAMS);
+        return -1;
     }
-    printf("✓ Listening on port %d...\n", PORT);
-    
-    // 5. Accept connection
-    printf("Waiting for client connection...\n");
-    client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-    if (client_fd < 0) {
-        perror("Accept failed");
-        close(server_fd);
-        close(device_fd);
-        free(buffer);
-        return 1;
+    s->cams[s->ncams++].src = *src;
+    return 0;
+}
+
+/* Append one camera per source; a device PATH glob adds every match */
+static int add_sources(struct streamer *s, const char *spec)
+{
+    struct frame_source src;
+    size_t i, first;
+
+    memset(&src, 0, sizeof(src));
+    if (source_parse(&src, spec) < 0) {
+        fprintf(stderr, "Invalid source: %s\n", spec);
+        return -1;
     }
-    printf("✓ Client connected from %s:%d\n", 
-           inet_ntoa(client_addr.sin_addr), 
-           ntohs(client_addr.sin_port));
-    
-    // 6. Setup poll structure
-    fds[0].fd = device_fd;
-    fds[0].events = POLLIN;
-    
-    // 7. Main loop: poll, read, and send
-    printf("\n=== Starting frame streaming (640x480 RAW) ===\n");
-    printf("Will transmit %d frames and stop.\n", MAX_FRAMES);
-    int frame_count = 0;
-    
-    while (frame_count < MAX_FRAMES) {
-        // Wait for data ready (blocks until interrupt wakes us up)
-        int ret = poll(fds, 1, -1);
-        
-        if (ret < 0) {
-            perror("Poll failed");
-            break;
+    if (src.kind != SOURCE_DEVICE || !strpbrk(src.path, "*?["))
+        return add_camera(s, &src);
+
+    // gl_pathv only grows with GLOB_APPEND, earlier paths stay valid
+    first = s->globbed ? s->devices.gl_pathc : 0;
+    if (glob(src.path, s->globbed ? GLOB_APPEND : 0, NULL, &s->devices) != 0 ||
+        s->devices.gl_pathc == first) {
+        fprintf(stderr, "No device matches %s\n", src.path);
+        return -1;
+    }
+    s->globbed = 1;
+    for (i = first; i < s->devices.gl_pathc; i++) {
+        src.path = s->devices.gl_pathv[i];
+        if (add_camera(s, &src) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Called by the server once enough clients are connected */
+static void start_capture(void *arg)
+{
+    struct streamer *s = arg;
+    int i;
+
+    if (s->ncams == 1)
+        printf("\n=== Starting frame streaming (%dx%d RAW, %s source) ===\n",
+               s->cams[0].src.width, s->cams[0].src.height, source_name(&s->cams[0].src));
+    else
+        printf("\n=== Starting frame streaming (%d cameras) ===\n", s->ncams);
+    if (s->max_frames)
+        printf("Will capture %d frames%s and stop.\n", s->max_frames,
+               s->ncams > 1 ? " per camera" : "");
+    if (!s->verbose)
+        stats_start(&s->stats, s->stats_interval);
+
+    s->cams_active = s->ncams;
+    for (i = 0; i < s->ncams; i++) {
+        struct camera *cam = &s->cams[i];
+
+        if (pthread_create(&cam->tid, NULL, capture_thread, cam) != 0) {
+            perror("Failed to start capture thread");
+            stop_requested = 1;
+            for (; i < s->ncams; i++)
+                camera_done(s);
+            return;
         }
-        
-        // Check if data is ready
-        if (fds[0].revents & POLLIN) {
-            // Data ready, now read
-            bytes_read = read(device_fd, buffer, FRAME_SIZE);
-            
-            if (bytes_read < 0) {
-                perror("Read from device failed");
-                break;
+        cam->running = 1;
+    }
+}
+
+/* Wait for every capture thread and report what they captured */
+static void stop_capture(struct streamer *s, int captured)
+{
+    int i;
+
+    ring_close(&s->ring);
+    for (i = 0; i < s->ncams; i++) {
+        if (s->cams[i].running)
+            pthread_join(s->cams[i].tid, NULL);
+    }
+    printf("\n✓ Captured %d frames, ring dropped %lu.\n", captured, s->ring.dropped);
+    for (i = 0; s->ncams > 1 && i < s->ncams; i++)
+        printf("  stream %d: %d frames (%s)\n", i, s->cams[i].frames_captured,
+               s->cams[i].src.path ? s->cams[i].src.path : source_name(&s->cams[i].src));
+}
+
+int main(int argc, char *argv[]) {
+    struct streamer s;
+    struct sigaction sa;
+    int ring_depth = DEFAULT_RING_DEPTH;
+    int client_depth = DEFAULT_CLIENT_DEPTH;
+    int max_clients = DEFAULT_MAX_CLIENTS;
+    int wait_clients = 1;
+    int zerocopy = 0;
+    int use_uring = 0;
+    struct pace_config pace = { 0, 0, 0 };
+    size_t slot_size, preview_size;
+    const char *udp_dest = NULL;
+    int mtu = UDP_DEFAULT_MTU;
+    double udp_loss = 0;
+    const char *shm_path = NULL;
+    const char *record_path = NULL;
+    const char *trace_path = NULL;
+    FILE *trace_file = NULL;
+    int max_rate = 0;
+    enum pool_backing backing = POOL_AUTO;
+    int numa_node = POOL_NODE_LOCAL;
+    struct thread_sched send_sched;
+    struct rusage ru;
+    enum drop_policy policy = DROP_NEWEST;
+    enum client_policy client_policy = CLIENT_FIFO;
+    struct frame_source replay_src;
+    int exit_code = 1;
+    int opened = 0;
+    int i, opt, ret;
+
+    static const struct option long_opts[] = {
+        { "frames",        required_argument, NULL, 'n' },
+        { "ring-depth",    required_argument, NULL, 'd' },
+        { "drop-policy",   required_argument, NULL, 'p' },
+        { "client-depth",  required_argument, NULL, 'q' },
+        { "client-policy", required_argument, NULL, 'l' },
+        { "zerocopy",      no_argument,       NULL, 'z' },
+        { "pace",          required_argument, NULL, 'r' },
+        { "compress",      no_argument,       NULL, 'C' },
+        { "io-uring",      no_argument,       NULL, 'u' },
+        { "udp",           required_argument, NULL, 'U' },
+        { "mtu",           required_argument, NULL, 'm' },
+        { "udp-loss",      required_argument, NULL, 'L' },
+        { "shm",           required_argument, NULL, 'S' },
+        { "record",        required_argument, NULL, 'R' },
+        { "source",        required_argument, NULL, 'i' },
+        { "replay",        required_argument, NULL, 'P' },
+        { "max-rate",      no_argument,       NULL, 'M' },
+        { "trace",         required_argument, NULL, 'T' },
+        { "buffers",       required_argument, NULL, 'b' },
+        { "numa-node",     required_argument, NULL, 'N' },
+        { "capture-cpu",   required_argument, NULL, 'a' },
+        { "send-cpu",      required_argument, NULL, 'e' },
+        { "stats",         required_argument, NULL, 's' },
+        { "quiet",         no_argument,       NULL, 'Q' },
+        { "verbose",       no_argument,       NULL, 'v' },
+        { "max-clients",   required_argument, NULL, 'c' },
+        { "wait-clients",  required_argument, NULL, 'w' },
+        { "help",          no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    memset(&s, 0, sizeof(s));
+    s.max_frames = MAX_FRAMES;
+    s.stats_interval = DEFAULT_STATS_INTERVAL;
+    parse_thread_sched("any", &s.capture_sched);
+    parse_thread_sched("any", &send_sched);
+
+    while ((opt = getopt_long(argc, argv, "n:d:p:q:l:zr:CuU:m:L:S:R:i:P:MT:b:N:a:e:s:Qvc:w:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            s.max_frames = atoi(optarg);
+            break;
+        case 'd':
+            ring_depth = atoi(optarg);
+            break;
+        case 'p':
+            if (parse_drop_policy(optarg, &policy) < 0) {
+                fprintf(stderr, "Unknown drop policy: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'q':
+            client_depth = atoi(optarg);
+            break;
+        case 'l':
+            if (parse_client_policy(optarg, &client_policy) < 0) {
+                fprintf(stderr, "Unknown client policy: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'z':
+            zerocopy = 1;
+            break;
+        case 'C':
+            s.compress = 1;
+            break;
+        case 'u':
+            use_uring = 1;
+            break;
+        case 'U':
+            udp_dest = optarg;
+            break;
+        case 'm':
+            mtu = atoi(optarg);
+            break;
+        case 'L':
+            udp_loss = atof(optarg);
+            break;
+        case 'S':
+            shm_path = optarg;
+            break;
+        case 'R':
+            record_path = optarg;
+            break;
+        case 'i':
+            if (add_sources(&s, optarg) < 0)
+                return 1;
+            break;
+        case 'P':
+            memset(&replay_src, 0, sizeof(replay_src));
+            replay_src.kind = SOURCE_REPLAY;
+            replay_src.path = optarg;
+            if (add_camera(&s, &replay_src) < 0)
+                return 1;
+            break;
+        case 'M':
+            max_rate = 1;
+            break;
+        case 'T':
+            trace_path = optarg;
+            break;
+        case 'b':
+            if (parse_pool_backing(optarg, &backing) < 0) {
+                fprintf(stderr, "Unknown buffer backing: %s\n", optarg);
+                return 1;
             }
-            
-            if (bytes_read == 0) {
-                printf("No more data from device\n");
-                break;
+            break;
+        case 'N':
+            if (parse_pool_node(optarg, &numa_node) < 0) {
+                fprintf(stderr, "Invalid NUMA node: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'a':
+        case 'e':
+            if (parse_thread_sched(optarg, opt == 'a' ? &s.capture_sched : &send_sched) < 0) {
+                fprintf(stderr, "Invalid thread spec: %s\n", optarg);
+                return 1;
             }
-            
-            frame_count++;
-            printf("[%d] Read %zd bytes (640x480 RAW frame)\n", 
-                   frame_count, bytes_read);
-            
-            // Send via network
-            ssize_t total_sent = 0;
-            while (total_sent < bytes_read) {
-                ssize_t sent = send(client_fd, buffer + total_sent, 
-                                   bytes_read - total_sent, 0);
-                if (sent < 0) {
-                    perror("Send failed");
-                    goto cleanup;
-                }
-                total_sent += sent;
+            break;
+        case 's':
+            s.stats_interval = atoi(optarg);
+            break;
+        case 'Q':
+            s.stats_interval = 0;
+            break;
+        case 'v':
+            s.verbose = 1;
+            break;
+        case 'c':
+            max_clients = atoi(optarg);
+            break;
+        case 'w':
+            wait_clients = atoi(optarg);
+            break;
+        case 'r':
+            if (parse_pace(optarg, &pace) < 0) {
+                fprintf(stderr, "Invalid pacing rate: %s\n", optarg);
+                return 1;
             }
-            printf("[%d] Sent %zd bytes\n", frame_count, total_sent);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
         }
     }
-    
-    printf("\n✓ Transmitted %d frames. Closing connection.\n", frame_count);
-    
-cleanup:
-    // 8. Cleanup
+
+    if (ring_depth < 1 || s.max_frames < 0 || client_depth < 1 || s.stats_interval < 0 ||
+        max_clients < 1 || wait_clients < 0 || wait_clients > max_clients) {
+        fprintf(stderr, "Invalid option value\n");
+        return 1;
+    }
+    // One extra slot per client: the frame currently on the wire
+    if (ring_depth <= client_depth + 1)
+        fprintf(stderr, "Warning: --ring-depth should exceed --client-depth + 1, "
+                "or one slow client can starve capture\n");
+
+    // Ctrl+C stops capture; queued frames are still flushed
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigint;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // 1. Open the frame sources: they decide the frame geometry
+    if (s.ncams == 0 && add_sources(&s, "device") < 0)
+        return 1;
+    for (i = 0; i < s.ncams; i++) {
+        struct camera *cam = &s.cams[i];
+
+        cam->s = &s;
+        cam->id = i;
+        cam->src.stop = &stop_requested;
+        if (max_rate) {
+            cam->src.max_rate = 1;
+            if (cam->src.kind == SOURCE_SYNTHETIC)
+                cam->src.fps = 0;
+        }
+        if (s.ncams > 1)
+            printf("Stream %d:\n", i);
+        if (source_open(&cam->src) < 0)
+            goto close_source;
+        opened++;
+    }
+    if (s.ncams > 1 && (udp_dest || shm_path)) {
+        fprintf(stderr, "--udp and --shm carry one stream, serve %d cameras over TCP\n",
+                s.ncams);
+        goto close_source;
+    }
+    if (trace_path && s.ncams > 1) {
+        // trace_merge.py joins on sequence numbers, which repeat across streams
+        printf("Note: --trace follows a single camera, not tracing %d streams\n", s.ncams);
+        trace_path = NULL;
+    }
+    if (trace_path) {
+        // Capture stages travel with the frame; the TCP server logs send times
+        trace_file = fopen(trace_path, "w");
+        if (!trace_file) {
+            perror("Failed to create trace file");
+            goto close_source;
+        }
+        fprintf(trace_file, "sequence,client_port,sent_ns,done_ns\n");
+        s.trace = 1;
+        if (use_uring || udp_dest || shm_path || record_path)
+            printf("Note: only the epoll TCP server logs send times (%s)\n", trace_path);
+        use_uring = 0;
+    }
+    if (pace.automatic) {
+        pace.mbit = auto_pace_mbit(&s);
+        if (pace.mbit <= 0) {
+            fprintf(stderr, "--pace auto needs synthetic sources with a frame rate, "
+                    "give Mbit/s instead\n");
+            goto close_source;
+        }
+    }
+    if (pace.mbit > 0 && (shm_path || record_path)) {
+        printf("Note: --pace applies to TCP and UDP only\n");
+        pace.mbit = 0;
+    }
+    if (pace.user && use_uring) {
+        printf("Note: the --pace token bucket needs the epoll server\n");
+        use_uring = 0;
+    }
+    if (use_uring && (s.ncams > 1 || s.cams[0].src.kind != SOURCE_DEVICE)) {
+        printf("Note: --io-uring reads one device itself, using epoll for %s\n",
+               s.ncams > 1 ? "several cameras" : source_name(&s.cams[0].src));
+        use_uring = 0;
+    }
+
+    // Pin this (send) thread before allocating: "local" frame memory is
+    // then on its node. The capture CPUs are reserved first so an
+    // unpinned send thread already keeps off them.
+    if (use_uring && s.capture_sched.cpu != SCHED_CPU_ANY)
+        printf("Note: io_uring mode captures on the send thread, --capture-cpu unused\n");
+    for (i = 0; i < s.ncams; i++) {
+        struct camera *cam = &s.cams[i];
+
+        if (s.ncams > 1)
+            snprintf(cam->name, sizeof(cam->name), "camera %d capture", i);
+        else
+            snprintf(cam->name, sizeof(cam->name), "capture thread");
+        cam->sched = s.capture_sched;
+        if (!use_uring)
+            thread_sched_claim(&cam->sched, cam->name);
+    }
+    if (thread_sched_apply(&send_sched, "send thread") < 0)
+        goto close_source;
+
+    // Allocate the frame ring (all buffers up front), ring_depth slots
+    // per camera. Compressed frames are usually smaller, but a slot must
+    // hold the worst case of any camera. This thread runs the server, so
+    // "local" is the node that sends them.
+    slot_size = 0;
+    for (i = 0; i < s.ncams; i++) {
+        const struct frame_source *src = &s.cams[i].src;
+
+        if (src->max_frame > slot_size)
+            slot_size = src->max_frame;
+        if (s.compress && raw_codec_bound(src->width, src->height) > slot_size)
+            slot_size = raw_codec_bound(src->width, src->height);
+    }
+    // --shm: the slots are the shared memory, captured where consumers read
+    if (shm_path)
+        ret = ring_init_shared(&s.ring, ring_depth, slot_size, policy, backing, numa_node,
+                               shm_server_reserve(ring_depth));
+    else
+        ret = ring_init(&s.ring, ring_depth * s.ncams, slot_size, policy, backing,
+                        numa_node);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to allocate frame ring\n");
+        goto close_source;
+    }
+    if (pool_init(&s.scratch_pool, s.ncams, slot_size, backing, numa_node) < 0) {
+        fprintf(stderr, "Failed to allocate buffer\n");
+        goto free_buffers;
+    }
+    for (i = 0; i < s.ncams; i++)
+        s.cams[i].scratch = pool_buf(&s.scratch_pool, i);
+    printf("✓ Frame ring: %d x %zu bytes, drop policy '%s'\n",
+           s.ring.depth, slot_size, drop_policy_name(policy));
+    if (s.ring.pool.node >= 0)
+        printf("✓ Frame memory: %zu KB arena, backing '%s', NUMA node %d\n",
+               s.ring.pool.map_size / 1024, pool_backing_name(s.ring.pool.backing),
+               s.ring.pool.node);
+    else
+        printf("✓ Frame memory: %zu KB arena, backing '%s'\n",
+               s.ring.pool.map_size / 1024, pool_backing_name(s.ring.pool.backing));
+    if (FRAME_PROBES)
+        printf("✓ USDT probes: frame_streamer:{poll_return,read_done,ring_drop,"
+               "send_start,send_done}\n");
+    if (s.compress)
+        printf("✓ RC12 lossless compression (%s)\n", raw_codec_simd());
+
+    // 2a. Record mode: frames go to a container file, not to the network
+    if (record_path) {
+        if (recorder_open(&s.rec, record_path, s.ring.frame_size) < 0)
+            goto free_buffers;
+        s.rec.stats = &s.stats;
+
+        start_capture(&s);
+        if (recorder_run(&s.rec, &s.ring) == 0)
+            exit_code = 0;
+        else
+            stop_requested = 1;     // capture would block on a full ring
+
+        stop_capture(&s, frames_captured(&s));
+        if (recorder_close(&s.rec) < 0)
+            exit_code = 1;
+        goto report;
+    }
+
+    // 2b. UDP mode: push every frame to one receiver, nothing to wait for
+    if (udp_dest) {
+        if (use_uring || zerocopy)
+            printf("Note: --io-uring and --zerocopy apply to TCP only\n");
+        if (udp_sender_init(&s.udp, udp_dest, mtu, udp_loss, &s.ring) < 0)
+            goto free_buffers;
+        s.udp.stats = &s.stats;
+        if (pace.mbit > 0) {
+            udp_sender_pace(&s.udp, pace.mbit);
+            s.stats.pace_mbit = pace.mbit;
+            s.stats.pace_mode = "token bucket";
+            printf("✓ Pacing: %.0f Mbit/s, one GSO message at a time\n", pace.mbit);
+        }
+
+        start_capture(&s);
+        if (udp_sender_run(&s.udp, &s.ring) == 0)
+            exit_code = 0;
+        else
+            stop_requested = 1;     // capture would block on a full ring
+
+        stop_capture(&s, frames_captured(&s));
+        udp_sender_destroy(&s.udp);
+        goto report;
+    }
+
+    // 2c. Shared-memory mode: consumers on this host map the frames
+    if (shm_path) {
+        if (shm_server_init(&s.shm, shm_path, &s.ring) < 0)
+            goto free_buffers;
+        s.shm.min_consumers = wait_clients;
+        s.shm.on_ready = start_capture;
+        s.shm.arg = &s;
+        s.shm.stop = &stop_requested;
+        s.shm.stats = &s.stats;
+
+        if (wait_clients > 0) {
+            printf("Waiting for %d consumer(s)...\n", wait_clients);
+        } else {
+            s.shm.started = 1;
+            start_capture(&s);
+        }
+        if (shm_server_run(&s.shm) == 0)
+            exit_code = 0;
+
+        stop_capture(&s, frames_captured(&s));
+        shm_server_destroy(&s.shm);
+        goto report;
+    }
+
+    // 2d. io_uring mode: device, accepts and sends on one ring, one thread
+    if (use_uring) {
+        struct uring_server_config cfg = {
+            .device_fd = s.cams[0].src.fd,
+            .ring = &s.ring,
+            .scratch = s.cams[0].scratch,
+            .width = s.cams[0].src.width,
+            .height = s.cams[0].src.height,
+            .max_frames = s.max_frames,
+            .compress = s.compress,
+            .client_depth = client_depth,
+            .client_policy = client_policy,
+            .max_clients = max_clients,
+            .min_clients = wait_clients,
+            .stop = &stop_requested,
+            .verbose = s.verbose,
+            .stats = &s.stats,
+        };
+
+        if (zerocopy)
+            printf("Note: --zerocopy is not used in io_uring mode\n");
+
+        cfg.listen_fd = net_listen(PORT, 0);
+        if (cfg.listen_fd < 0)
+            goto free_buffers;
+        // Accepted sockets inherit the listener's SO_MAX_PACING_RATE
+        if (pace.mbit > 0) {
+            if (pace_socket(cfg.listen_fd, pace.mbit) == 0) {
+                s.stats.pace_mbit = pace.mbit;
+                s.stats.pace_mode = "SO_MAX_PACING_RATE";
+                printf("✓ Pacing: %.0f Mbit/s per client (SO_MAX_PACING_RATE)\n", pace.mbit);
+            } else {
+                printf("Note: SO_MAX_PACING_RATE unavailable, io_uring mode not paced\n");
+            }
+        }
+        if (wait_clients > 0)
+            printf("Waiting for %d client connection(s)...\n", wait_clients);
+        if (!s.verbose)
+            stats_start(&s.stats, s.stats_interval);
+
+        ret = uring_server_run(&cfg);
+        close(cfg.listen_fd);
+        if (ret != 1) {
+            printf("\n✓ Captured %d frames, ring dropped %lu.\n",
+                   cfg.frames_captured, s.ring.dropped);
+            printf("io_uring: %lu io_uring_enter() calls\n", cfg.enters);
+            exit_code = ret == 0 ? 0 : 1;
+            goto report;
+        }
+        printf("io_uring unavailable, falling back to epoll\n");
+    }
+
+    // 2e. Create the TCP server (socket, bind, listen, epoll), with room
+    // in every slot for the preview frames clients may ask for
+    preview_size = 0;
+    for (i = 0; i < s.ncams; i++) {
+        size_t n = preview_bytes(s.cams[i].src.width, s.cams[i].src.height);
+
+        if (n > preview_size)
+            preview_size = n;
+    }
+    if (pool_init(&s.preview_pool, s.ring.depth, preview_size, backing, numa_node) < 0) {
+        fprintf(stderr, "Failed to allocate preview buffers\n");
+        goto free_buffers;
+    }
+    for (i = 0; i < s.ring.depth; i++)
+        s.ring.slots[i].preview_mem = pool_buf(&s.preview_pool, i);
+    printf("✓ Preview frames: 2x2 binning (%s), %zu KB per slot\n",
+           preview_simd(), s.preview_pool.stride / 1024);
+
+    if (net_server_init(&s.server, PORT, &s.ring, client_depth, max_clients) < 0)
+        goto free_buffers;
+    s.server.client_policy = client_policy;
+    s.server.zerocopy = zerocopy;
+    s.server.min_clients = wait_clients;
+    s.server.on_ready = start_capture;
+    s.server.arg = &s;
+    s.server.stop = &stop_requested;
+    s.server.trace = trace_file;
+    s.server.verbose = s.verbose;
+    s.server.stats = &s.stats;
+    if (pace.mbit > 0) {
+        // Probe the kernel once on the listener; clients are capped as they connect
+        s.server.pace_mbit = pace.mbit;
+        s.server.pace_user = pace.user || pace_socket(s.server.listen_fd, pace.mbit) < 0;
+        s.stats.pace_mbit = pace.mbit;
+        s.stats.pace_mode = s.server.pace_user ? "token bucket" : "SO_MAX_PACING_RATE";
+        printf("✓ Pacing: %.0f Mbit/s per client (%s)\n", pace.mbit, s.stats.pace_mode);
+    }
+
+    // 3. Serve clients; capture starts once enough of them are connected
+    if (wait_clients > 0) {
+        printf("Waiting for %d client connection(s)...\n", wait_clients);
+    } else {
+        s.server.started = 1;
+        start_capture(&s);
+    }
+
+    if (net_server_run(&s.server) == 0)
+        exit_code = 0;
+
+    // 4. Stop capture (normally finished already) and report
+    stop_capture(&s, frames_captured(&s));
+    net_server_destroy(&s.server);
+
+report:
+    stats_stop(&s.stats);
+    // Context switches are where the io_uring mode is meant to win
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+        printf("Context switches: %ld voluntary, %ld involuntary\n",
+               ru.ru_nvcsw, ru.ru_nivcsw);
+
+    // 5. Cleanup
     printf("=== Cleaning up ===\n");
-    close(client_fd);
-    close(server_fd);
-    close(device_fd);
-    free(buffer);
-    
-    return 0;
+free_buffers:
+    pool_destroy(&s.preview_pool);
+    pool_destroy(&s.scratch_pool);
+    ring_destroy(&s.ring);
+close_source:
+    for (i = 0; i < opened; i++)
+        source_close(&s.cams[i].src);
+    if (s.globbed)
+        globfree(&s.devices);
+    if (trace_file)
+        fclose(trace_file);
+
+    return exit_code;
 }
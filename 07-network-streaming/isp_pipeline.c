@@ -0,0 +1,705 @@
+// isp_pipeline.c - Fused, tiled CPU ISP (see isp_pipeline.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "isp_pipeline.h"
+#include "work_pool.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define ISP_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ISP_NEON 1
+#endif
+
+#define RGB_HALO 2          // denoise and sharpen read 1 pixel around each
+#define RAW_HALO 6          // RGB_HALO + the edge demosaic's 3, kept even
+                            // so the scratch raw starts on an R site
+#define BAND_ROWS 16        // rows per item in isp_process_passes()
+#define TILE_MAX_W 256
+#define TILE_MIN_H 16
+#define TILE_MAX_H 512
+#define TILE_BYTES_PER_PIXEL 19   // raw in + BLC 2 + 2, RGB 6, denoised 6, out 3
+#define DENOISE_MAX 2048    // 12 pulls of this still fit int16
+#define SHARPEN_MAX 64
+#define DETAIL_MAX 511      // sharpening adds at most SHARPEN_MAX * 511 / 16,
+                            // which keeps strong edges from ringing (and int16)
+#define SHARPEN_CHUNK 256   // pixels per planar -> RGB interleave
+
+/* Per worker; aligned so the statistics of two workers never share a line */
+struct isp_scratch {
+    uint16_t *raw;          // BLC'd raw of the tile and RAW_HALO around it
+    uint16_t *rgb;          // 3 planes: the tile and RGB_HALO around it
+    uint16_t *den;          // 3 planes: the tile and 1 pixel around it
+    uint64_t sum[4];        // this frame's BLC'd samples per Bayer site
+} __attribute__((aligned(64)));
+
+/*
+ * Three planes holding frame pixels x0 .. x0+w-1, y0 .. y0+h-1; x0 and y0
+ * are negative where the box hangs over the frame's top or left edge
+ */
+struct planes {
+    uint16_t *p;
+    size_t plane;           // samples from one plane to the next
+    int stride;
+    int x0, y0, w, h;
+};
+
+enum isp_pass {
+    PASS_BLC,
+    PASS_DEMOSAIC,
+    PASS_GAIN,
+    PASS_GAMMA,
+    PASS_DENOISE,
+    PASS_SHARPEN,
+};
+
+struct isp_pipeline {
+    int width;
+    int height;
+    struct isp_params params;
+    struct work_pool *pool;
+    struct isp_scratch *scratch;
+
+    int tile_w, tile_h;
+    int tiles_x, tiles_y;
+
+    double gain[3];
+    uint16_t blc_lut[4096];
+    uint16_t gamma_lut[4096];
+    uint16_t gain_lut[3][4096];
+    uint16_t lut[3][4096];      // gain, then gamma
+
+    // The frame being processed
+    const uint16_t *raw;
+    uint8_t *out;
+    enum isp_pass pass;
+
+    // isp_process_passes() only, allocated on first use
+    uint16_t *full_blc;
+    struct planes full_rgb;
+    struct planes full_den;
+};
+
+static inline int min_int(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+static inline int max_int(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+static inline int mirror(int i, int n)
+{
+    if (i < 0)
+        return -i;
+    if (i >= n)
+        return 2 * (n - 1) - i;
+    return i;
+}
+
+static inline uint16_t *planes_at(const struct planes *pl, int c, int x, int y)
+{
+    return pl->p + c * pl->plane + (size_t)(y - pl->y0) * pl->stride + (x - pl->x0);
+}
+
+/* BLC one row; samples above 12 bits count as 4095 */
+static void blc_row(const uint16_t *lut, const uint16_t *src, uint16_t *dst, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = lut[src[i] > 4095 ? 4095 : src[i]];
+}
+
+/* Add a w x h rectangle of BLC'd raw at frame position x0,y0 to sum[site] */
+static void bayer_sums(const uint16_t *p, size_t stride, int x0, int y0, int w, int h,
+                       uint64_t sum[4])
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        const uint16_t *row = p + (size_t)y * stride;
+        int site = ((y0 + y) & 1) << 1;
+        uint64_t even = 0, odd = 0;
+
+        for (x = 0; x + 1 < w; x += 2) {
+            even += row[x];
+            odd += row[x + 1];
+        }
+        if (x < w)
+            even += row[x];
+        // Column x0 decides which of the pair is the R / Gb site
+        sum[site | (x0 & 1)] += even;
+        sum[site | (~x0 & 1)] += odd;
+    }
+}
+
+/* Table lookup per channel over a rectangle of frame pixels */
+static void lut_rect(const struct planes *pl, const uint16_t *const lut[3],
+                     int x0, int y0, int w, int h)
+{
+    int c, x, y;
+
+    for (c = 0; c < 3; c++)
+        for (y = y0; y < y0 + h; y++) {
+            uint16_t *row = planes_at(pl, c, x0, y);
+
+            for (x = 0; x < w; x++)
+                row[x] = lut[c][row[x]];
+        }
+}
+
+/* Fill the cells of the box outside the frame from their mirror images inside it */
+static void mirror_pad(const struct planes *pl, int width, int height)
+{
+    int xa = max_int(pl->x0, 0), xb = min_int(pl->x0 + pl->w, width);
+    int ya = max_int(pl->y0, 0), yb = min_int(pl->y0 + pl->h, height);
+    int c, x, y;
+
+    for (c = 0; c < 3; c++) {
+        for (y = ya; y < yb; y++) {
+            uint16_t *row = planes_at(pl, c, pl->x0, y);
+
+            for (x = pl->x0; x < xa; x++)
+                row[x - pl->x0] = row[mirror(x, width) - pl->x0];
+            for (x = xb; x < pl->x0 + pl->w; x++)
+                row[x - pl->x0] = row[mirror(x, width) - pl->x0];
+        }
+        for (y = pl->y0; y < pl->y0 + pl->h; y++)
+            if (y < ya || y >= yb)
+                memcpy(planes_at(pl, c, pl->x0, y), planes_at(pl, c, pl->x0, mirror(y, height)),
+                       pl->w * sizeof(uint16_t));
+    }
+}
+
+static inline int pull(int d, int t)
+{
+    return d < -t ? -t : d > t ? t : d;
+}
+
+/*
+ * Each neighbour moves the pixel towards itself by at most t, weighted
+ * 2 (edge) or 1 (corner) out of 16; a real edge moves it by t at most
+ */
+static void denoise_row(const uint16_t *up, const uint16_t *mid, const uint16_t *dn,
+                        uint16_t *out, int n, int t)
+{
+    int i = 0;
+
+#if ISP_SSE2
+    const __m128i tp = _mm_set1_epi16(t), tn = _mm_set1_epi16(-t);
+    const __m128i eight = _mm_set1_epi16(8), top = _mm_set1_epi16(4095);
+
+#define LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define PULL(p) _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(LOAD(p), c), tn), tp)
+    for (; i + 8 <= n; i += 8) {
+        __m128i c = LOAD(mid + i);
+        __m128i e = _mm_add_epi16(_mm_add_epi16(PULL(mid + i - 1), PULL(mid + i + 1)),
+                                  _mm_add_epi16(PULL(up + i), PULL(dn + i)));
+        __m128i k = _mm_add_epi16(_mm_add_epi16(PULL(up + i - 1), PULL(up + i + 1)),
+                                  _mm_add_epi16(PULL(dn + i - 1), PULL(dn + i + 1)));
+        __m128i s = _mm_add_epi16(_mm_add_epi16(e, e), _mm_add_epi16(k, eight));
+        __m128i v = _mm_add_epi16(c, _mm_srai_epi16(s, 4));
+
+        v = _mm_min_epi16(_mm_max_epi16(v, _mm_setzero_si128()), top);
+        _mm_storeu_si128((__m128i *)(out + i), v);
+    }
+#undef PULL
+#undef LOAD
+#elif ISP_NEON
+    const int16x8_t tp = vdupq_n_s16(t), tn = vdupq_n_s16(-t);
+
+#define LOAD(p) vreinterpretq_s16_u16(vld1q_u16(p))
+#define PULL(p) vminq_s16(vmaxq_s16(vsubq_s16(LOAD(p), c), tn), tp)
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t c = LOAD(mid + i);
+        int16x8_t e = vaddq_s16(vaddq_s16(PULL(mid + i - 1), PULL(mid + i + 1)),
+                                vaddq_s16(PULL(up + i), PULL(dn + i)));
+        int16x8_t k = vaddq_s16(vaddq_s16(PULL(up + i - 1), PULL(up + i + 1)),
+                                vaddq_s16(PULL(dn + i - 1), PULL(dn + i + 1)));
+        int16x8_t s = vaddq_s16(vaddq_s16(e, e), vaddq_s16(k, vdupq_n_s16(8)));
+        int16x8_t v = vaddq_s16(c, vshrq_n_s16(s, 4));
+
+        v = vminq_s16(vmaxq_s16(v, vdupq_n_s16(0)), vdupq_n_s16(4095));
+        vst1q_u16(out + i, vreinterpretq_u16_s16(v));
+    }
+#undef PULL
+#undef LOAD
+#endif
+    for (; i < n; i++) {
+        int c = mid[i];
+        int s = 2 * (pull(mid[i - 1] - c, t) + pull(mid[i + 1] - c, t) +
+                     pull(up[i] - c, t) + pull(dn[i] - c, t)) +
+                pull(up[i - 1] - c, t) + pull(up[i + 1] - c, t) +
+                pull(dn[i - 1] - c, t) + pull(dn[i + 1] - c, t);
+        int v = c + ((s + 8) >> 4);
+
+        out[i] = v < 0 ? 0 : v > 4095 ? 4095 : v;
+    }
+}
+
+/*
+ * Unsharp mask against the 3x3 binomial blur, detail limited to
+ * DETAIL_MAX, then 12 -> 8 bits. The blur sum fits 16 bits unsigned.
+ */
+static void sharpen_row(const uint16_t *up, const uint16_t *mid, const uint16_t *dn,
+                        uint8_t *out, int n, int amount)
+{
+    int i = 0;
+
+#if ISP_SSE2
+    const __m128i a = _mm_set1_epi16(amount), eight = _mm_set1_epi16(8);
+    const __m128i lim = _mm_set1_epi16(DETAIL_MAX), top = _mm_set1_epi16(4095);
+
+#define LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define ROW3(p) _mm_add_epi16(_mm_add_epi16(LOAD(p - 1), LOAD(p + 1)), _mm_slli_epi16(LOAD(p), 1))
+    for (; i + 8 <= n; i += 8) {
+        __m128i m = LOAD(mid + i);
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(ROW3(up + i), ROW3(dn + i)),
+                                    _mm_slli_epi16(ROW3(mid + i), 1));
+        __m128i blur = _mm_srli_epi16(_mm_add_epi16(sum, eight), 4);
+        __m128i d = _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(m, blur),
+                                                _mm_sub_epi16(_mm_setzero_si128(), lim)), lim);
+        __m128i v = _mm_add_epi16(m, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(d, a),
+                                                                  eight), 4));
+
+        v = _mm_min_epi16(_mm_max_epi16(v, _mm_setzero_si128()), top);
+        v = _mm_srli_epi16(v, 4);
+        _mm_storel_epi64((__m128i *)(out + i), _mm_packus_epi16(v, v));
+    }
+#undef ROW3
+#undef LOAD
+#elif ISP_NEON
+    const int16x8_t a = vdupq_n_s16(amount), lim = vdupq_n_s16(DETAIL_MAX);
+
+#define ROW3(p) vaddq_u16(vaddq_u16(vld1q_u16(p - 1), vld1q_u16(p + 1)), vshlq_n_u16(vld1q_u16(p), 1))
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t sum = vaddq_u16(vaddq_u16(ROW3(up + i), ROW3(dn + i)),
+                                   vshlq_n_u16(ROW3(mid + i), 1));
+        int16x8_t blur = vreinterpretq_s16_u16(vshrq_n_u16(vaddq_u16(sum, vdupq_n_u16(8)), 4));
+        int16x8_t m = vreinterpretq_s16_u16(vld1q_u16(mid + i));
+        int16x8_t d = vminq_s16(vmaxq_s16(vsubq_s16(m, blur), vnegq_s16(lim)), lim);
+        int16x8_t v = vaddq_s16(m, vshrq_n_s16(vaddq_s16(vmulq_s16(d, a), vdupq_n_s16(8)), 4));
+
+        v = vminq_s16(vmaxq_s16(v, vdupq_n_s16(0)), vdupq_n_s16(4095));
+        vst1_u8(out + i, vmovn_u16(vshrq_n_u16(vreinterpretq_u16_s16(v), 4)));
+    }
+#undef ROW3
+#endif
+    for (; i < n; i++) {
+        int m = mid[i];
+        int blur = (up[i - 1] + 2 * up[i] + up[i + 1] +
+                    2 * (mid[i - 1] + 2 * m + mid[i + 1]) +
+                    dn[i - 1] + 2 * dn[i] + dn[i + 1] + 8) >> 4;
+        int d = m - blur;
+        int v;
+
+        d = d < -DETAIL_MAX ? -DETAIL_MAX : d > DETAIL_MAX ? DETAIL_MAX : d;
+        v = m + ((amount * d + 8) >> 4);
+        v = v < 0 ? 0 : v > 4095 ? 4095 : v;
+        out[i] = v >> 4;
+    }
+}
+
+/* Denoise frame pixels x0,y0 w x h of src (padded 1 around them) into dst */
+static void denoise_rect(const struct planes *src, const struct planes *dst, int t,
+                         int x0, int y0, int w, int h)
+{
+    int c, y;
+
+    for (c = 0; c < 3; c++)
+        for (y = y0; y < y0 + h; y++) {
+            const uint16_t *mid = planes_at(src, c, x0, y);
+
+            if (t > 0)
+                denoise_row(mid - src->stride, mid, mid + src->stride,
+                            planes_at(dst, c, x0, y), w, t);
+            else
+                memcpy(planes_at(dst, c, x0, y), mid, w * sizeof(uint16_t));
+        }
+}
+
+/* Sharpen frame pixels x0,y0 w x h of src (padded 1 around them) into RGB */
+static void sharpen_rect(const struct planes *src, uint8_t *out, int width, int amount,
+                         int x0, int y0, int w, int h)
+{
+    uint8_t px[3][SHARPEN_CHUNK];
+    int c, i, n, x, y;
+
+    for (y = y0; y < y0 + h; y++)
+        for (x = x0; x < x0 + w; x += n) {
+            uint8_t *o = out + ((size_t)y * width + x) * 3;
+
+            n = min_int(SHARPEN_CHUNK, x0 + w - x);
+            for (c = 0; c < 3; c++) {
+                const uint16_t *mid = planes_at(src, c, x, y);
+
+                sharpen_row(mid - src->stride, mid, mid + src->stride, px[c], n, amount);
+            }
+            for (i = 0; i < n; i++) {
+                o[3 * i] = px[0][i];
+                o[3 * i + 1] = px[1][i];
+                o[3 * i + 2] = px[2][i];
+            }
+        }
+}
+
+/* All six stages on one tile, in the worker's scratch */
+static void isp_tile(void *arg, int item, int worker)
+{
+    struct isp_pipeline *isp = arg;
+    struct isp_scratch *s = &isp->scratch[worker];
+    const int width = isp->width, height = isp->height;
+    const uint16_t *const lut[3] = { isp->lut[0], isp->lut[1], isp->lut[2] };
+    int tx = item % isp->tiles_x * isp->tile_w, ty = item / isp->tiles_x * isp->tile_h;
+    int tw = min_int(isp->tile_w, width - tx), th = min_int(isp->tile_h, height - ty);
+    // Raw with halo and the RGB the last two stages read, clipped to the frame
+    int ax = max_int(tx - RAW_HALO, 0), ay = max_int(ty - RAW_HALO, 0);
+    int aw = min_int(tx + tw + RAW_HALO, width) - ax, ah = min_int(ty + th + RAW_HALO, height) - ay;
+    int rx = max_int(tx - RGB_HALO, 0), ry = max_int(ty - RGB_HALO, 0);
+    int rw = min_int(tx + tw + RGB_HALO, width) - rx, rh = min_int(ty + th + RGB_HALO, height) - ry;
+    int dx = max_int(tx - 1, 0), dy = max_int(ty - 1, 0);
+    struct planes rgb = {
+        s->rgb, (size_t)(isp->tile_w + 2 * RGB_HALO) * (isp->tile_h + 2 * RGB_HALO),
+        isp->tile_w + 2 * RGB_HALO, tx - RGB_HALO, ty - RGB_HALO,
+        tw + 2 * RGB_HALO, th + 2 * RGB_HALO,
+    };
+    struct planes den = {
+        s->den, (size_t)(isp->tile_w + 2) * (isp->tile_h + 2),
+        isp->tile_w + 2, tx - 1, ty - 1, tw + 2, th + 2,
+    };
+    struct demosaic_out out = {
+        planes_at(&rgb, 0, rx, ry), planes_at(&rgb, 1, rx, ry), planes_at(&rgb, 2, rx, ry),
+        rgb.stride,
+    };
+    int y;
+
+    // 1. BLC; statistics over the tile itself, so each pixel counts once
+    for (y = 0; y < ah; y++)
+        blc_row(isp->blc_lut, isp->raw + (size_t)(ay + y) * width + ax,
+                s->raw + (size_t)y * aw, aw);
+    bayer_sums(s->raw + (size_t)(ty - ay) * aw + (tx - ax), aw, tx, ty, tw, th, s->sum);
+
+    // 2. Demosaic, with the scratch raw as the frame: its edges are either
+    //    the frame's or far enough out that the mirroring never shows
+    demosaic_rect(s->raw, aw, aw, ah, rx - ax, ry - ay, rw, rh, &out, isp->params.method,
+                  DEMOSAIC_AUTO);
+
+    // 3, 4. AWB and gamma, one table per channel
+    lut_rect(&rgb, lut, rx, ry, rw, rh);
+    mirror_pad(&rgb, width, height);
+
+    // 5. Denoise the tile and the pixel around it that sharpening reads
+    denoise_rect(&rgb, &den, isp->params.denoise, dx, dy,
+                 min_int(tx + tw + 1, width) - dx, min_int(ty + th + 1, height) - dy);
+    mirror_pad(&den, width, height);
+
+    // 6. Sharpen straight into the frame
+    sharpen_rect(&den, isp->out, width, isp->params.sharpen, tx, ty, tw, th);
+}
+
+/* One band of rows of one full-frame pass */
+static void isp_band(void *arg, int item, int worker)
+{
+    struct isp_pipeline *isp = arg;
+    const int width = isp->width;
+    int y0 = item * BAND_ROWS, n = min_int(BAND_ROWS, isp->height - y0);
+    int y;
+
+    switch (isp->pass) {
+    case PASS_BLC:
+        for (y = y0; y < y0 + n; y++)
+            blc_row(isp->blc_lut, isp->raw + (size_t)y * width,
+                    isp->full_blc + (size_t)y * width, width);
+        bayer_sums(isp->full_blc + (size_t)y0 * width, width, 0, y0, width, n,
+                   isp->scratch[worker].sum);
+        break;
+    case PASS_DEMOSAIC: {
+        const struct planes *pl = &isp->full_rgb;
+        struct demosaic_out out = {
+            planes_at(pl, 0, 0, y0), planes_at(pl, 1, 0, y0), planes_at(pl, 2, 0, y0),
+            pl->stride,
+        };
+
+        demosaic_rect(isp->full_blc, width, width, isp->height, 0, y0, width, n, &out,
+                      isp->params.method, DEMOSAIC_AUTO);
+        break;
+    }
+    case PASS_GAIN: {
+        const uint16_t *const lut[3] = { isp->gain_lut[0], isp->gain_lut[1], isp->gain_lut[2] };
+
+        lut_rect(&isp->full_rgb, lut, 0, y0, width, n);
+        break;
+    }
+    case PASS_GAMMA: {
+        const uint16_t *const lut[3] = { isp->gamma_lut, isp->gamma_lut, isp->gamma_lut };
+
+        lut_rect(&isp->full_rgb, lut, 0, y0, width, n);
+        break;
+    }
+    case PASS_DENOISE:
+        denoise_rect(&isp->full_rgb, &isp->full_den, isp->params.denoise, 0, y0, width, n);
+        break;
+    case PASS_SHARPEN:
+        sharpen_rect(&isp->full_den, isp->out, width, isp->params.sharpen, 0, y0, width, n);
+        break;
+    }
+}
+
+static void build_luts(struct isp_pipeline *isp)
+{
+    int c, v;
+
+    for (c = 0; c < 3; c++) {
+        int q = (int)lround(isp->gain[c] * 256);
+
+        for (v = 0; v < 4096; v++) {
+            int g = (v * q + 128) >> 8;
+
+            isp->gain_lut[c][v] = g > 4095 ? 4095 : g;
+            isp->lut[c][v] = isp->gamma_lut[isp->gain_lut[c][v]];
+        }
+    }
+}
+
+static void begin_frame(struct isp_pipeline *isp, const uint16_t *raw, uint8_t *rgb)
+{
+    int i;
+
+    isp->raw = raw;
+    isp->out = rgb;
+    for (i = 0; i < work_pool_threads(isp->pool); i++)
+        memset(isp->scratch[i].sum, 0, sizeof(isp->scratch[i].sum));
+}
+
+/* Gray world: R and B gains that bring their means to green's, for the next frame */
+static void end_frame(struct isp_pipeline *isp)
+{
+    uint64_t sum[4] = { 0, 0, 0, 0 };
+    double n[4], mean_g;
+    int i, c;
+
+    if (!isp->params.awb)
+        return;
+    for (i = 0; i < work_pool_threads(isp->pool); i++)
+        for (c = 0; c < 4; c++)
+            sum[c] += isp->scratch[i].sum[c];
+    for (c = 0; c < 4; c++)
+        n[c] = (double)((isp->height + 1 - (c >> 1)) / 2) * ((isp->width + 1 - (c & 1)) / 2);
+
+    mean_g = (sum[1] + sum[2]) / (n[1] + n[2]);
+    for (c = 0; c < 3; c += 2) {
+        double mean = sum[c == 0 ? 0 : 3] / n[c == 0 ? 0 : 3];
+        double gain = mean > 0 ? isp->gain[1] * mean_g / mean : isp->gain[1];
+
+        isp->gain[c] = gain < 0.125 ? 0.125 : gain > 8 ? 8 : gain;
+    }
+    build_luts(isp);
+}
+
+void isp_params_default(struct isp_params *params)
+{
+    memset(params, 0, sizeof(*params));
+    params->black_level = 64;
+    params->awb = 1;
+    params->gain[0] = params->gain[1] = params->gain[2] = 1.0;
+    params->gamma = 2.2;
+    params->denoise = 24;
+    params->sharpen = 8;
+    params->method = DEMOSAIC_EDGE;
+}
+
+/*
+ * TILE_MAX_W wide (less for narrow frames), and as tall as lets a tile
+ * with its halo fit half of L2: the other half is for the tables, the
+ * stack and the neighbouring tile's rows
+ */
+static void pick_tile(int width, int *tile_w, int *tile_h)
+{
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    long h;
+
+    if (l2 <= 0)
+        l2 = 256 * 1024;
+    *tile_w = min_int(TILE_MAX_W, (width + 1) & ~1);
+    h = l2 / 2 / TILE_BYTES_PER_PIXEL / (*tile_w + 2 * RAW_HALO) - 2 * RAW_HALO;
+    h = h < TILE_MIN_H ? TILE_MIN_H : h > TILE_MAX_H ? TILE_MAX_H : h;
+    *tile_h = (int)h & ~1;
+}
+
+struct isp_pipeline *isp_create(int width, int height, const struct isp_params *params,
+                                int threads, int tile_w, int tile_h)
+{
+    struct isp_pipeline *isp;
+    size_t raw_size, rgb_size, den_size;
+    int i, v;
+
+    if (width < 4 || height < 4 || params->black_level < 0 || params->black_level > 4094 ||
+        params->gamma <= 0 || params->denoise < 0 || params->denoise > DENOISE_MAX ||
+        params->sharpen < 0 || params->sharpen > SHARPEN_MAX || tile_w < 0 || tile_h < 0) {
+        fprintf(stderr, "Invalid ISP configuration\n");
+        return NULL;
+    }
+    for (i = 0; i < 3; i++)
+        if (params->gain[i] <= 0 || params->gain[i] > 8) {
+            fprintf(stderr, "White balance gains must be in (0, 8]\n");
+            return NULL;
+        }
+
+    isp = calloc(1, sizeof(*isp));
+    if (!isp) {
+        perror("Failed to allocate ISP pipeline");
+        return NULL;
+    }
+    isp->width = width;
+    isp->height = height;
+    isp->params = *params;
+    if (tile_w == 0 || tile_h == 0) {
+        pick_tile(width, &isp->tile_w, &isp->tile_h);
+    } else {
+        // Even, so every tile and its scratch raw start on an R site
+        isp->tile_w = (tile_w + 1) & ~1;
+        isp->tile_h = (tile_h + 1) & ~1;
+    }
+    isp->tiles_x = (width + isp->tile_w - 1) / isp->tile_w;
+    isp->tiles_y = (height + isp->tile_h - 1) / isp->tile_h;
+
+    // Black level: (v - black) stretched so that 4095 stays 4095
+    for (v = 0; v < 4096; v++) {
+        int range = 4095 - params->black_level, d = v - params->black_level;
+
+        isp->blc_lut[v] = d <= 0 ? 0 : (d * 4095 + range / 2) / range;
+        isp->gamma_lut[v] = (uint16_t)lround(4095 * pow(v / 4095.0, 1 / params->gamma));
+    }
+    for (i = 0; i < 3; i++)
+        isp->gain[i] = params->gain[i];
+    build_luts(isp);
+
+    isp->pool = work_pool_create(threads);
+    if (!isp->pool)
+        goto fail;
+    threads = work_pool_threads(isp->pool);
+    isp->scratch = aligned_alloc(64, threads * sizeof(*isp->scratch));
+    if (!isp->scratch) {
+        perror("Failed to allocate ISP scratch");
+        goto fail;
+    }
+    memset(isp->scratch, 0, threads * sizeof(*isp->scratch));
+    raw_size = (size_t)(isp->tile_w + 2 * RAW_HALO) * (isp->tile_h + 2 * RAW_HALO);
+    rgb_size = (size_t)3 * (isp->tile_w + 2 * RGB_HALO) * (isp->tile_h + 2 * RGB_HALO);
+    den_size = (size_t)3 * (isp->tile_w + 2) * (isp->tile_h + 2);
+    for (i = 0; i < threads; i++) {
+        struct isp_scratch *s = &isp->scratch[i];
+
+        s->raw = malloc(raw_size * sizeof(uint16_t));
+        s->rgb = malloc(rgb_size * sizeof(uint16_t));
+        s->den = malloc(den_size * sizeof(uint16_t));
+        if (!s->raw || !s->rgb || !s->den) {
+            perror("Failed to allocate ISP scratch");
+            goto fail;
+        }
+    }
+    return isp;
+
+fail:
+    isp_destroy(isp);
+    return NULL;
+}
+
+int isp_process(struct isp_pipeline *isp, const uint16_t *raw, uint8_t *rgb)
+{
+    begin_frame(isp, raw, rgb);
+    work_pool_run(isp->pool, isp->tiles_x * isp->tiles_y, isp_tile, isp);
+    end_frame(isp);
+    return 0;
+}
+
+/* Full-frame buffers for isp_process_passes(), padded like a tile's */
+static int alloc_passes(struct isp_pipeline *isp)
+{
+    const int width = isp->width, height = isp->height;
+    struct planes rgb = {
+        NULL, (size_t)(width + 2 * RGB_HALO) * (height + 2 * RGB_HALO), width + 2 * RGB_HALO,
+        -RGB_HALO, -RGB_HALO, width + 2 * RGB_HALO, height + 2 * RGB_HALO,
+    };
+    struct planes den = {
+        NULL, (size_t)(width + 2) * (height + 2), width + 2, -1, -1, width + 2, height + 2,
+    };
+
+    isp->full_blc = malloc((size_t)width * height * sizeof(uint16_t));
+    rgb.p = malloc(3 * rgb.plane * sizeof(uint16_t));
+    den.p = malloc(3 * den.plane * sizeof(uint16_t));
+    isp->full_rgb = rgb;
+    isp->full_den = den;
+    if (!isp->full_blc || !rgb.p || !den.p) {
+        perror("Failed to allocate full-frame buffers");
+        return -1;
+    }
+    return 0;
+}
+
+int isp_process_passes(struct isp_pipeline *isp, const uint16_t *raw, uint8_t *rgb)
+{
+    int bands = (isp->height + BAND_ROWS - 1) / BAND_ROWS;
+    enum isp_pass pass;
+
+    if (!isp->full_blc && alloc_passes(isp) < 0)
+        return -1;
+
+    begin_frame(isp, raw, rgb);
+    for (pass = PASS_BLC; pass <= PASS_SHARPEN; pass++) {
+        isp->pass = pass;
+        work_pool_run(isp->pool, bands, isp_band, isp);
+        // The borders the next pass reads
+        if (pass == PASS_GAMMA)
+            mirror_pad(&isp->full_rgb, isp->width, isp->height);
+        else if (pass == PASS_DENOISE)
+            mirror_pad(&isp->full_den, isp->width, isp->height);
+    }
+    end_frame(isp);
+    return 0;
+}
+
+void isp_gains(const struct isp_pipeline *isp, double gain[3])
+{
+    memcpy(gain, isp->gain, sizeof(isp->gain));
+}
+
+void isp_tile_size(const struct isp_pipeline *isp, int *tile_w, int *tile_h)
+{
+    *tile_w = isp->tile_w;
+    *tile_h = isp->tile_h;
+}
+
+int isp_threads(const struct isp_pipeline *isp)
+{
+    return work_pool_threads(isp->pool);
+}
+
+void isp_destroy(struct isp_pipeline *isp)
+{
+    int i;
+
+    if (!isp)
+        return;
+    if (isp->scratch) {
+        for (i = 0; i < work_pool_threads(isp->pool); i++) {
+            free(isp->scratch[i].raw);
+            free(isp->scratch[i].rgb);
+            free(isp->scratch[i].den);
+        }
+        free(isp->scratch);
+    }
+    work_pool_destroy(isp->pool);
+    free(isp->full_blc);
+    free(isp->full_rgb.p);
+    free(isp->full_den.p);
+    free(isp);
+}
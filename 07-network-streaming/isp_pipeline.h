@@ -0,0 +1,76 @@
+// isp_pipeline.h - Fused, tiled CPU ISP: RAW12 RGGB to 8-bit RGB
+//
+// Six stages, in order:
+//
+//   BLC       subtract the black level, stretch back to 0..4095
+//   demosaic  demosaic.c, bilinear or edge-aware
+//   AWB       per-channel gains, fixed or gray world
+//   gamma     to display gamma, still 12-bit
+//   denoise   3x3: every neighbour pulls the pixel towards itself by at
+//             most 'denoise' levels, so edges survive and noise does not
+//   sharpen   unsharp mask against a 3x3 binomial blur, then to 8 bits
+//
+// isp_process() runs all six on one tile at a time, each tile plus the
+// halo its later stages read (2 pixels of RGB, 6 of raw), in buffers
+// small enough to stay in L2; tiles are spread over a work_pool. Only
+// the raw frame is read from memory and only the RGB result written.
+// isp_process_passes() runs the same stages as six full-frame passes
+// (parallel over row bands): the reference the tiles match bit for bit,
+// and the baseline they are measured against.
+//
+// Gray world AWB uses the channel means of the previous frame, gathered
+// during BLC, like the statistics of a hardware ISP: a frame never waits
+// for a full pass over itself.
+#ifndef ISP_PIPELINE_H
+#define ISP_PIPELINE_H
+
+#include <stdint.h>
+
+#include "demosaic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct isp_params {
+    int black_level;            // 12-bit, default 64
+    int awb;                    // gray world from the previous frame
+    double gain[3];             // R, G, B gains: fixed, or the first frame's
+    double gamma;               // default 2.2, 1 = linear
+    int denoise;                // largest pull in 12-bit levels, 0 = off
+    int sharpen;                // detail added back in sixteenths, 0 = off
+    enum demosaic_method method;
+};
+
+struct isp_pipeline;
+
+void isp_params_default(struct isp_params *params);
+
+/*
+ * A pipeline for width x height frames (at least 4x4) on 'threads'
+ * workers (< 1: one per online CPU). tile_w x tile_h 0 picks tiles whose
+ * working set fits half of L2; given sizes are rounded up to even. NULL
+ * on error (message printed).
+ */
+struct isp_pipeline *isp_create(int width, int height, const struct isp_params *params,
+                                int threads, int tile_w, int tile_h);
+
+/* raw frame to interleaved RGB, 3 bytes per pixel. Returns 0. */
+int isp_process(struct isp_pipeline *isp, const uint16_t *raw, uint8_t *rgb);
+
+/* The same as six full-frame passes. Returns 0, or -1 if out of memory. */
+int isp_process_passes(struct isp_pipeline *isp, const uint16_t *raw, uint8_t *rgb);
+
+/* White balance gains the next frame will use */
+void isp_gains(const struct isp_pipeline *isp, double gain[3]);
+
+void isp_tile_size(const struct isp_pipeline *isp, int *tile_w, int *tile_h);
+int isp_threads(const struct isp_pipeline *isp);
+
+void isp_destroy(struct isp_pipeline *isp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ISP_PIPELINE_H */
@@ -0,0 +1,901 @@
+// net_server.c - epoll fan-out server (see net_server.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+
+#include "net_server.h"
+#include "probes.h"
+
+#define MAX_EVENTS 64
+#define DRAIN_TIMEOUT_MS 5000   // give slow clients this long after the last frame
+#define ZC_COPIED_LIMIT 8       // copied completions in a row before giving up on zero-copy
+#define CROP_IOV_MAX 256        // ROI rows handed to one sendmsg()
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+int net_listen(int port, int flags)
+{
+    struct sockaddr_in server_addr;
+    int opt = 1;
+    int fd;
+
+    // Create TCP socket
+    printf("Creating socket...\n");
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    // Allow port reuse
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    // Bind to port
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        perror("Bind failed");
+        close(fd);
+        return -1;
+    }
+    printf("✓ Bound to port %d\n", port);
+
+    // Start listening
+    if (listen(fd, SOMAXCONN) < 0) {
+        perror("Listen failed");
+        close(fd);
+        return -1;
+    }
+    printf("✓ Listening on port %d...\n", port);
+    return fd;
+}
+
+int net_server_init(struct net_server *srv, int port, struct frame_ring *ring,
+                    int client_depth, int max_clients)
+{
+    struct epoll_event ev;
+
+    memset(srv, 0, sizeof(*srv));
+    srv->ring = ring;
+    srv->client_depth = client_depth;
+    srv->max_clients = max_clients;
+    srv->min_clients = 1;
+    srv->epoll_fd = -1;
+    srv->pace_fd = -1;
+
+    srv->listen_fd = net_listen(port, SOCK_NONBLOCK);
+    if (srv->listen_fd < 0)
+        return -1;
+
+    srv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (srv->epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        goto fail;
+    }
+
+    /*
+     * The listening socket and the ring's eventfd are told apart from
+     * clients by their data.ptr, which points at the fd field itself.
+     */
+    ev.events = EPOLLIN;
+    ev.data.ptr = &srv->listen_fd;
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->listen_fd, &ev) < 0)
+        goto fail_epoll;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &ring->notify_fd;
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, ring->notify_fd, &ev) < 0)
+        goto fail_epoll;
+
+    // Wakes clients paced in user space; disarmed unless one is waiting
+    srv->pace_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (srv->pace_fd < 0) {
+        perror("timerfd_create failed");
+        goto fail;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &srv->pace_fd;
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->pace_fd, &ev) < 0)
+        goto fail_epoll;
+
+    return 0;
+
+fail_epoll:
+    perror("epoll_ctl failed");
+fail:
+    if (srv->pace_fd >= 0)
+        close(srv->pace_fd);
+    if (srv->epoll_fd >= 0)
+        close(srv->epoll_fd);
+    close(srv->listen_fd);
+    srv->listen_fd = -1;
+    srv->epoll_fd = -1;
+    srv->pace_fd = -1;
+    return -1;
+}
+
+static long long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Same clock as frame_header.timestamp_ns, for --trace */
+static uint64_t realtime_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* ============================================
+ * Client Lifecycle
+ * ============================================ */
+
+static void client_pop(struct net_server *srv, struct client *c)
+{
+    ring_release(srv->ring, c->queue[c->q_head]);
+    c->q_head = (c->q_head + 1) % c->q_size;
+    c->q_count--;
+    c->offset = 0;
+}
+
+/* ============================================
+ * Zero-copy Transmit
+ * ============================================ */
+
+/*
+ * With MSG_ZEROCOPY the kernel transmits straight from our ring slot
+ * instead of copying it into socket buffers. In exchange, the buffer must
+ * not be reused until the kernel reports completion on the socket error
+ * queue. Every zero-copy sendmsg() that queues data gets the next 32-bit
+ * id; completions report ranges of ids [lo, hi].
+ *
+ * If the kernel had to copy anyway (loopback, NIC without scatter-gather
+ * or checksum offload), the completion carries ZEROCOPY_COPIED. After a
+ * run of those we quietly switch the client back to plain sends, which
+ * are cheaper than a copy plus page pinning plus notifications.
+ */
+static int zc_enable(int fd)
+{
+    int one = 1;
+
+    return setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one));
+}
+
+/* Head frame fully sent: keep it pinned until its last send completes */
+static void zc_hold(struct client *c, struct frame_slot *slot)
+{
+    ring_get(slot);
+    c->zc[(c->zc_head + c->zc_count) % c->zc_size] =
+        (struct zc_pending){ .slot = slot, .id = c->zc_next_id - 1 };
+    c->zc_count++;
+}
+
+static void zc_complete(struct net_server *srv, struct client *c, uint32_t hi)
+{
+    while (c->zc_count > 0) {
+        struct zc_pending *p = &c->zc[c->zc_head];
+
+        // TCP completes in order; wrap-safe "p->id <= hi"
+        if ((int32_t)(p->id - hi) > 0)
+            break;
+        ring_release(srv->ring, p->slot);
+        c->zc_head = (c->zc_head + 1) % c->zc_size;
+        c->zc_count--;
+    }
+}
+
+/*
+ * Drain the socket error queue. Returns -1 if it holds a real error (or
+ * EPOLLERR fired without any queued notification), 0 otherwise.
+ */
+static int zc_reap(struct net_server *srv, struct client *c)
+{
+    char control[128];
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct sock_extended_err *serr;
+    int reaped = 0;
+
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(c->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR))
+                continue;
+            serr = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                fprintf(stderr, "Socket error on %s: %s\n",
+                        c->name, strerror(serr->ee_errno));
+                return -1;
+            }
+
+            c->zc_completions += serr->ee_data - serr->ee_info + 1;
+            zc_complete(srv, c, serr->ee_data);
+            reaped++;
+
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                c->zc_copied++;
+                if (++c->zc_copied_streak == ZC_COPIED_LIMIT && c->zerocopy) {
+                    c->zerocopy = 0;
+                    printf("Client %s: kernel copies anyway, falling back to plain send\n",
+                           c->name);
+                }
+            } else {
+                c->zc_copied_streak = 0;
+            }
+        }
+    }
+
+    return reaped ? 0 : -1;
+}
+
+static void client_push(struct client *c, struct frame_slot *slot)
+{
+    ring_get(slot);
+    c->queue[(c->q_head + c->q_count) % c->q_size] = slot;
+    c->q_count++;
+}
+
+/*
+ * Latest-frame-wins: throw away every queued frame the client has not
+ * started to receive. A frame already partly on the wire has to be
+ * finished, otherwise the stream would lose its frame boundaries.
+ */
+static void client_skip_stale(struct net_server *srv, struct client *c)
+{
+    int keep = c->offset > 0 ? 1 : 0;
+    int skipped = 0;
+
+    while (c->q_count > keep) {
+        int tail = (c->q_head + c->q_count - 1) % c->q_size;
+
+        ring_release(srv->ring, c->queue[tail]);
+        c->q_count--;
+        skipped++;
+    }
+
+    c->frames_skipped += skipped;
+    if (skipped)
+        printf("Client %s behind: skipped %d stale frame(s) (%lu total)\n",
+               c->name, skipped, c->frames_skipped);
+}
+
+/* Capture threads bin frames down to the deepest level anyone wants */
+static void update_preview_level(struct net_server *srv)
+{
+    struct client *c;
+    int level = 0;
+
+    for (c = srv->clients; c; c = c->next) {
+        if (!c->dead && c->preview > level)
+            level = c->preview;
+    }
+    __atomic_store_n(&srv->preview_level, level, __ATOMIC_RELAXED);
+}
+
+static void client_close(struct net_server *srv, struct client *c)
+{
+    printf("✓ Client %s disconnected: sent %lu frames (%llu bytes), "
+           "dropped %lu, skipped %lu\n",
+           c->name, c->frames_sent, c->bytes_sent,
+           c->frames_dropped, c->frames_skipped);
+    if (c->frames_filtered)
+        printf("  subscription 0x%x: %lu frames of other streams not sent\n",
+               c->streams, c->frames_filtered);
+
+    if (c->zc_used)
+        printf("  zero-copy: %lu completions, %lu copied by the kernel\n",
+               c->zc_completions, c->zc_copied);
+
+    while (c->q_count > 0)
+        client_pop(srv, c);
+
+    /*
+     * A clean drain waits for every zero-copy completion, so frames are
+     * still pinned only when the client is abandoned. After a plain close()
+     * the kernel would go on sending the unsent tail from those pages while
+     * capture reuses them, and the completions could no longer be read.
+     * Abort the connection instead: with SO_LINGER 0, close() sends a RST
+     * and purges the send queue. Segments already handed to the device may
+     * still read a page until their transmit completes; the client is
+     * gone by then, so at worst it gets a torn frame it can't use anyway.
+     */
+    if (c->zc_count > 0) {
+        struct linger abort_close = { .l_onoff = 1, .l_linger = 0 };
+
+        setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &abort_close, sizeof(abort_close));
+    }
+    zc_complete(srv, c, c->zc_next_id - 1);
+
+    epoll_ctl(srv->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    srv->nclients--;
+
+    /*
+     * Events for this client may still be pending in the batch returned
+     * by epoll_wait(), so the memory is only released after the batch
+     */
+    c->dead = 1;
+    c->next = srv->graveyard;
+    srv->graveyard = c;
+    if (c->preview)
+        update_preview_level(srv);
+}
+
+static void free_graveyard(struct net_server *srv)
+{
+    struct client *c;
+
+    while ((c = srv->graveyard) != NULL) {
+        srv->graveyard = c->next;
+        free(c->zc);
+        free(c->queue);
+        free(c);
+    }
+}
+
+static void unlink_client(struct net_server *srv, struct client *c)
+{
+    struct client **pp;
+
+    for (pp = &srv->clients; *pp; pp = &(*pp)->next) {
+        if (*pp == c) {
+            *pp = c->next;
+            break;
+        }
+    }
+    client_close(srv, c);
+}
+
+static int client_want_write(struct net_server *srv, struct client *c, int on)
+{
+    struct epoll_event ev;
+
+    if (c->want_write == on)
+        return 0;
+
+    ev.events = EPOLLIN | (on ? EPOLLOUT : 0);
+    ev.data.ptr = c;
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) < 0)
+        return -1;
+    c->want_write = on;
+    return 0;
+}
+
+/* Wake the event loop at 'when' (CLOCK_MONOTONIC ns), unless it wakes earlier */
+static void pace_arm(struct net_server *srv, uint64_t when)
+{
+    struct itimerspec its;
+
+    if (srv->pace_armed && srv->pace_armed <= when)
+        return;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = when / 1000000000ull;
+    its.it_value.tv_nsec = when % 1000000000ull;
+    if (timerfd_settime(srv->pace_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0)
+        srv->pace_armed = when;
+}
+
+/* Cut an iovec list down to max bytes; returns the iovecs left */
+static int iov_trim(struct iovec *iov, int n, size_t max)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (iov[i].iov_len >= max) {
+            iov[i].iov_len = max;
+            return i + 1;
+        }
+        max -= iov[i].iov_len;
+    }
+    return n;
+}
+
+/*
+ * Push as much of the client's queue as the socket takes without
+ * blocking. Header and payload go out together in one scatter-gather
+ * sendmsg(). When the socket buffer fills up, EPOLLOUT is armed and we
+ * come back later; other clients are never held up by this one. A client
+ * paced in user space sends PACE_BURST bytes per call and, out of tokens,
+ * waits for pace_fd instead. Returns -1 if the client has to be dropped.
+ */
+static int client_flush(struct net_server *srv, struct client *c)
+{
+    struct iovec iov[1 + CROP_IOV_MAX];
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+
+    while (c->q_count > 0) {
+        struct frame_slot *slot = c->queue[c->q_head];
+        int zerocopy = c->zerocopy;
+        size_t total;
+        ssize_t sent;
+
+        // A preview or ROI request mid-frame takes effect with the next one
+        if (c->offset == 0) {
+            c->level = c->preview;
+            c->cropped = c->roi.width && slot_crop(slot, c->level, &c->roi, &c->crop) == 0;
+        }
+        total = c->cropped ? c->crop.hdr.header_len + c->crop.hdr.payload_len
+                           : slot_wire_len(slot, c->level);
+
+        // Every pinned frame needs a pending entry: wait for completions
+        if (zerocopy && c->zc_count == c->zc_size)
+            return client_want_write(srv, c, 0);
+
+        if (c->paced) {
+            uint64_t now = pace_now_ns();
+            uint64_t wait = pacer_wait_ns(&c->pacer, now, total - c->offset);
+
+            if (wait) {
+                c->pace_ns = now + wait;
+                pace_arm(srv, c->pace_ns);
+                return client_want_write(srv, c, 0);
+            }
+        }
+
+        // The first byte leaves now: queue wait ends, wire time starts
+        if (c->offset == 0) {
+            PROBE_SEND_START(slot->frame_no, c->fd, total);
+            if (srv->trace)
+                c->send_ns = realtime_ns();
+        }
+        msg.msg_iovlen = c->cropped ? crop_iov(&c->crop, c->offset, iov, 1 + CROP_IOV_MAX)
+                                    : slot_iov(slot, c->level, c->offset, iov);
+        if (c->paced)
+            msg.msg_iovlen = iov_trim(iov, msg.msg_iovlen, PACE_BURST);
+        sent = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT |
+                                    (zerocopy ? MSG_ZEROCOPY : 0));
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS && zerocopy) {
+                // Out of optmem for notifications: this chunk goes by copy
+                zerocopy = 0;
+                sent = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+            }
+        }
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return client_want_write(srv, c, 1);
+            fprintf(stderr, "Send to %s failed: %s\n", c->name, strerror(errno));
+            return -1;
+        }
+
+        if (zerocopy) {
+            c->zc_next_id++;
+            c->zc_used = 1;
+            c->zc_head_used = 1;
+        }
+
+        c->offset += sent;
+        c->bytes_sent += sent;
+        if (c->paced)
+            pacer_spend(&c->pacer, sent);
+        if (c->offset < total)
+            continue;
+
+        c->frames_sent++;
+        PROBE_SEND_DONE(slot->frame_no, c->fd, total);
+        stats_sent(srv->stats, total);
+        // Last byte handed to the socket: wire time ends at the receiver
+        if (srv->trace)
+            fprintf(srv->trace, "%u,%u,%llu,%llu\n", slot->hdr.sequence, c->port,
+                    (unsigned long long)c->send_ns, (unsigned long long)realtime_ns());
+        if (srv->verbose)
+            printf("[%u] Sent %zu bytes to %s\n", slot->frame_no, total, c->name);
+        if (c->zc_head_used)
+            zc_hold(c, slot);
+        c->zc_head_used = 0;
+        client_pop(srv, c);
+    }
+
+    return client_want_write(srv, c, 0);
+}
+
+/* Size of the message starting with magic, 0 if there is no such message */
+static size_t client_msg_size(uint32_t magic)
+{
+    switch (magic) {
+    case SUB_MAGIC:
+        return sizeof(struct frame_subscribe);
+    case PREVIEW_MAGIC:
+        return sizeof(struct frame_preview);
+    case ROI_MAGIC:
+        return sizeof(struct frame_roi);
+    }
+    return 0;
+}
+
+static int client_message(struct net_server *srv, struct client *c)
+{
+    int level;
+
+    switch (c->msg.magic) {
+    case SUB_MAGIC:
+        c->streams = c->msg.sub.stream_mask;
+        printf("Client %s subscribed to streams 0x%x\n", c->name, c->streams);
+        return 0;
+    case PREVIEW_MAGIC:
+        level = preview_level(c->msg.preview.factor);
+        if (level < 0) {
+            fprintf(stderr, "Client %s asked for preview factor %u\n",
+                    c->name, c->msg.preview.factor);
+            return -1;
+        }
+        c->preview = level;
+        update_preview_level(srv);
+        if (level)
+            printf("Client %s: 1/%u preview frames\n", c->name, 1u << level);
+        else
+            printf("Client %s: full frames\n", c->name);
+        return 0;
+    case ROI_MAGIC:
+        c->roi = c->msg.roi;
+        if (c->roi.width && !c->roi.height)
+            c->roi.width = 0;
+        if (c->roi.width)
+            printf("Client %s: ROI %ux%u at %u,%u\n", c->name, c->roi.width,
+                   c->roi.height, c->roi.x, c->roi.y);
+        else
+            printf("Client %s: whole frames\n", c->name);
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * Clients only send the small messages of frame_protocol.h, possibly in
+ * pieces: the magic first, which gives the size of the rest. A frame
+ * partly sent finishes as it started. Returns -1 on EOF or garbage.
+ */
+static int client_readable(struct net_server *srv, struct client *c)
+{
+    size_t want;
+    ssize_t n;
+
+    for (;;) {
+        want = c->msg_len < sizeof(c->msg.magic) ? sizeof(c->msg.magic)
+                                                  : client_msg_size(c->msg.magic);
+        if (want == 0) {
+            fprintf(stderr, "Client %s sent an unknown message (0x%08x)\n",
+                    c->name, c->msg.magic);
+            return -1;
+        }
+        if (c->msg_len == want) {
+            c->msg_len = 0;
+            if (client_message(srv, c) < 0)
+                return -1;
+            continue;
+        }
+
+        n = recv(c->fd, (char *)&c->msg + c->msg_len, want - c->msg_len, MSG_DONTWAIT);
+        if (n == 0)
+            return -1;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        c->msg_len += n;
+    }
+}
+
+static void accept_clients(struct net_server *srv)
+{
+    struct sockaddr_in client_addr;
+    socklen_t client_len;
+    struct epoll_event ev;
+    struct client *c;
+    int fd;
+
+    for (;;) {
+        client_len = sizeof(client_addr);
+        fd = accept4(srv->listen_fd, (struct sockaddr*)&client_addr, &client_len,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("Accept failed");
+            return;
+        }
+
+        if (srv->nclients >= srv->max_clients) {
+            fprintf(stderr, "Rejecting client: already serving %d\n", srv->nclients);
+            close(fd);
+            continue;
+        }
+
+        c = calloc(1, sizeof(*c));
+        if (c) {
+            c->q_size = srv->client_depth + 1;
+            c->queue = calloc(c->q_size, sizeof(*c->queue));
+        }
+        if (!c || !c->queue) {
+            perror("Failed to allocate client");
+            if (c)
+                free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->policy = srv->client_policy;
+        c->streams = ~0u;       // everything until the client subscribes
+        c->port = ntohs(client_addr.sin_port);
+        snprintf(c->name, sizeof(c->name), "%s:%d",
+                 inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+        if (srv->pace_mbit > 0 &&
+            (srv->pace_user || pace_socket(fd, srv->pace_mbit) < 0)) {
+            c->paced = 1;
+            pacer_init(&c->pacer, srv->pace_mbit);
+        }
+        if (srv->zerocopy) {
+            // A frame is pinned at most once per client, so ring depth bounds this
+            c->zc_size = srv->ring->depth;
+            c->zc = calloc(c->zc_size, sizeof(*c->zc));
+            if (c->zc && zc_enable(fd) == 0)
+                c->zerocopy = 1;
+            else
+                printf("Client %s: MSG_ZEROCOPY unavailable, using plain send\n",
+                       c->name);
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            free(c->zc);
+            free(c->queue);
+            free(c);
+            close(fd);
+            continue;
+        }
+
+        c->next = srv->clients;
+        srv->clients = c;
+        srv->nclients++;
+        printf("✓ Client connected from %s (%d connected)\n", c->name, srv->nclients);
+
+        /*
+         * Apply a subscription sent right behind the connect before this
+         * client can start streaming, so --wait-clients doesn't hand it
+         * frames of streams it is about to turn down
+         */
+        if (client_readable(srv, c) < 0) {
+            unlink_client(srv, c);
+            continue;
+        }
+
+        if (!srv->started && srv->nclients >= srv->min_clients) {
+            srv->started = 1;
+            if (srv->on_ready)
+                srv->on_ready(srv->arg);
+        }
+    }
+}
+
+/*
+ * Hand one captured frame to every client subscribed to its stream. Each
+ * queued copy is only a reference to the same ring slot; a client whose
+ * queue is full either misses this frame (CLIENT_FIFO) or skips its stale
+ * backlog in favour of it (CLIENT_LATEST), but never delays everybody else.
+ */
+static void fan_out(struct net_server *srv, struct frame_slot *slot)
+{
+    struct client **pp = &srv->clients;
+    struct client *c;
+
+    while ((c = *pp) != NULL) {
+        if (!(c->streams & (1u << slot->stream))) {
+            c->frames_filtered++;
+            pp = &c->next;
+            continue;
+        }
+        if (c->q_count >= srv->client_depth) {
+            if (c->policy == CLIENT_FIFO) {
+                c->frames_dropped++;
+                pp = &c->next;
+                continue;
+            }
+            client_skip_stale(srv, c);
+        }
+
+        client_push(c, slot);
+        if (client_flush(srv, c) < 0) {
+            *pp = c->next;
+            client_close(srv, c);
+            continue;
+        }
+        pp = &c->next;
+    }
+
+    // Drop the server's own reference; clients keep theirs
+    ring_release(srv->ring, slot);
+}
+
+/* pace_fd fired: flush the clients whose tokens are due, re-arm for the rest */
+static void pace_resume(struct net_server *srv)
+{
+    uint64_t now = pace_now_ns();
+    struct client *c, *next;
+    uint64_t expirations;
+
+    if (read(srv->pace_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        perror("timerfd read failed");
+    srv->pace_armed = 0;
+
+    for (c = srv->clients; c; c = next) {
+        next = c->next;
+        if (!c->pace_ns)
+            continue;
+        if (c->pace_ns > now) {
+            pace_arm(srv, c->pace_ns);
+            continue;
+        }
+        c->pace_ns = 0;
+        if (client_flush(srv, c) < 0)
+            unlink_client(srv, c);
+    }
+}
+
+static int queues_empty(struct net_server *srv)
+{
+    struct client *c;
+
+    for (c = srv->clients; c; c = c->next) {
+        if (c->q_count > 0 || c->zc_count > 0)
+            return 0;
+    }
+    return 1;
+}
+
+int net_server_run(struct net_server *srv)
+{
+    struct epoll_event events[MAX_EVENTS];
+    struct frame_slot *slot;
+    long long deadline = 0;
+    int drained = 0;
+    int i, n, timeout;
+    uint64_t counter;
+
+    for (;;) {
+        if (drained) {
+            if (queues_empty(srv))
+                break;
+            if (!deadline)
+                deadline = now_ms() + DRAIN_TIMEOUT_MS;
+            timeout = (int)(deadline - now_ms());
+            if (timeout <= 0) {
+                printf("Drain timeout, dropping unsent frames\n");
+                break;
+            }
+        } else {
+            timeout = -1;
+        }
+
+        n = epoll_wait(srv->epoll_fd, events, MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno != EINTR) {
+                perror("epoll_wait failed");
+                return -1;
+            }
+            // Interrupted before streaming ever started: nothing to drain
+            if (srv->stop && *srv->stop && !srv->started)
+                break;
+            continue;
+        }
+
+        for (i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            uint32_t mask = events[i].events;
+            struct client *c;
+
+            if (ptr == &srv->listen_fd) {
+                accept_clients(srv);
+                continue;
+            }
+
+            if (ptr == &srv->pace_fd) {
+                pace_resume(srv);
+                continue;
+            }
+
+            if (ptr == &srv->ring->notify_fd) {
+                if (read(srv->ring->notify_fd, &counter, sizeof(counter)) < 0 &&
+                    errno != EAGAIN)
+                    perror("eventfd read failed");
+                while ((slot = ring_try_consume(srv->ring, &drained)) != NULL)
+                    fan_out(srv, slot);
+                continue;
+            }
+
+            c = ptr;
+            if (c->dead)
+                continue;
+            if ((mask & EPOLLERR) && c->zc_used) {
+                // Zero-copy completions are reported as socket "errors"
+                if (zc_reap(srv, c) < 0 || client_flush(srv, c) < 0) {
+                    unlink_client(srv, c);
+                    continue;
+                }
+                mask &= ~EPOLLERR;
+            }
+            if ((mask & (EPOLLERR | EPOLLHUP)) ||
+                ((mask & EPOLLIN) && client_readable(srv, c) < 0) ||
+                ((mask & EPOLLOUT) && client_flush(srv, c) < 0))
+                unlink_client(srv, c);
+        }
+        free_graveyard(srv);
+    }
+
+    return 0;
+}
+
+void net_server_destroy(struct net_server *srv)
+{
+    while (srv->clients)
+        unlink_client(srv, srv->clients);
+    free_graveyard(srv);
+
+    if (srv->pace_fd >= 0)
+        close(srv->pace_fd);
+    if (srv->epoll_fd >= 0)
+        close(srv->epoll_fd);
+    if (srv->listen_fd >= 0)
+        close(srv->listen_fd);
+    srv->pace_fd = -1;
+    srv->epoll_fd = -1;
+    srv->listen_fd = -1;
+}
+
+int parse_client_policy(const char *name, enum client_policy *policy)
+{
+    if (strcmp(name, "fifo") == 0)
+        *policy = CLIENT_FIFO;
+    else if (strcmp(name, "latest") == 0)
+        *policy = CLIENT_LATEST;
+    else
+        return -1;
+    return 0;
+}
+
+const char *client_policy_name(enum client_policy policy)
+{
+    return policy == CLIENT_LATEST ? "latest" : "fifo";
+}
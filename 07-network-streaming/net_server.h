@@ -0,0 +1,142 @@
+// net_server.h - epoll-driven TCP server fanning captured frames out to
+// many clients
+#ifndef NET_SERVER_H
+#define NET_SERVER_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "frame_ring.h"
+#include "pacer.h"
+#include "stream_stats.h"
+
+/*
+ * What happens when a new frame arrives for a client whose queue is full:
+ * - CLIENT_FIFO:   the new frame is dropped, queued frames go out in order
+ * - CLIENT_LATEST: queued frames that have not started yet are skipped and
+ *                  the new one is sent next, so a slow viewer stays close
+ *                  to live instead of falling further and further behind
+ */
+enum client_policy {
+    CLIENT_FIFO,
+    CLIENT_LATEST,
+};
+
+/*
+ * A frame sent with MSG_ZEROCOPY: the kernel still references its pages
+ * until the completion for send call 'id' shows up on the error queue, so
+ * the ring slot stays pinned until then.
+ */
+struct zc_pending {
+    struct frame_slot *slot;
+    uint32_t id;
+};
+
+/*
+ * Per-client state. Frames are never copied per client: the queue holds
+ * a reference to the shared ring slot, and 'offset' remembers how much of
+ * the frame at the head of the queue the socket has already accepted.
+ */
+struct client {
+    int fd;
+    char name[32];                  // "ip:port" for log messages
+    uint16_t port;                  // peer port, identifies it in traces
+    uint64_t send_ns;               // when the head frame started going out
+    enum client_policy policy;
+    uint32_t streams;               // subscribed stream_ids, one bit each
+    int preview;                    // preview level (preview.h), 0 = full
+    int level;                      // level of the frame being sent
+    struct frame_roi roi;           // rectangle to send, width 0 = all
+    int cropped;                    // the frame being sent is 'crop'
+    struct slot_crop crop;
+    int paced;                      // token bucket (kernel pacing unavailable)
+    struct pacer pacer;
+    uint64_t pace_ns;               // flush again at this CLOCK_MONOTONIC
+                                    // time, 0 = not waiting for tokens
+    union {                         // client message being received
+        uint32_t magic;
+        struct frame_subscribe sub;
+        struct frame_preview preview;
+        struct frame_roi roi;
+    } msg;
+    size_t msg_len;
+    struct frame_slot **queue;      // q_size entries, one ref each
+    int q_size;                     // client_depth + 1 (frame in flight)
+    int q_head;
+    int q_count;
+    size_t offset;                  // bytes of the head frame (header
+                                    // included) already sent
+    int want_write;                 // EPOLLOUT currently armed
+    int dead;                       // closed, freed after the event batch
+
+    /* MSG_ZEROCOPY state (see net_server.c, "Zero-copy Transmit") */
+    int zerocopy;                   // use MSG_ZEROCOPY for the next sends
+    int zc_used;                    // completions may still arrive
+    int zc_head_used;               // head frame went out (partly) zero-copy
+    uint32_t zc_next_id;            // id the kernel gives the next zc send
+    struct zc_pending *zc;          // frames awaiting completion
+    int zc_size;
+    int zc_head;
+    int zc_count;
+    int zc_copied_streak;           // completions that fell back to a copy
+    unsigned long zc_completions;
+    unsigned long zc_copied;
+
+    unsigned long frames_sent;
+    unsigned long frames_filtered;  // not subscribed to their stream
+    unsigned long frames_dropped;   // CLIENT_FIFO: queue was full
+    unsigned long frames_skipped;   // CLIENT_LATEST: stale frames discarded
+    unsigned long long bytes_sent;
+
+    struct client *next;
+};
+
+struct net_server {
+    int listen_fd;
+    int epoll_fd;
+    struct frame_ring *ring;
+
+    int client_depth;               // frames queued per client before drops
+    enum client_policy client_policy;   // given to every new client
+    int max_clients;
+    int min_clients;                // streaming starts once this many joined
+    void (*on_ready)(void *arg);    // called once, when min_clients is reached
+    void *arg;
+    int started;
+    volatile sig_atomic_t *stop;    // set by the SIGINT handler
+    int zerocopy;                   // try MSG_ZEROCOPY on client sockets
+    FILE *trace;                    // "sequence,client_port,sent_ns" when a
+                                    // frame starts going out, NULL = off
+    int verbose;                    // a line per frame sent
+    struct stream_stats *stats;     // periodic summary counters, or NULL
+    int preview_level;              // highest level a client wants, read
+                                    // by capture threads to bin frames
+    double pace_mbit;               // per-client rate cap, 0 = line rate
+    int pace_user;                  // token bucket even if the kernel paces
+    int pace_fd;                    // timerfd: a paced client has tokens again
+    uint64_t pace_armed;            // when pace_fd fires, 0 = disarmed
+
+    struct client *clients;
+    int nclients;
+    struct client *graveyard;       // closed clients awaiting free()
+};
+
+/* socket() + bind() + listen() on INADDR_ANY:port; returns the fd or -1 */
+int net_listen(int port, int flags);
+
+int net_server_init(struct net_server *srv, int port, struct frame_ring *ring,
+                    int client_depth, int max_clients);
+
+/*
+ * Serve clients until the ring is closed and every queued frame has been
+ * flushed (or the drain timeout expires). Returns 0 or -1 on error.
+ */
+int net_server_run(struct net_server *srv);
+
+void net_server_destroy(struct net_server *srv);
+
+int parse_client_policy(const char *name, enum client_policy *policy);
+const char *client_policy_name(enum client_policy policy);
+
+#endif /* NET_SERVER_H */
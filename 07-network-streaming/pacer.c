@@ -0,0 +1,81 @@
+// pacer.c - Rate caps for frame senders (see pacer.h)
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "pacer.h"
+
+#ifndef SO_MAX_PACING_RATE
+#define SO_MAX_PACING_RATE 47
+#endif
+
+int parse_pace(const char *spec, struct pace_config *cfg)
+{
+    const char *colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    char *end;
+
+    memset(cfg, 0, sizeof(*cfg));
+    if (colon) {
+        if (strcmp(colon + 1, "user") != 0)
+            return -1;
+        cfg->user = 1;
+    }
+    if (len == 4 && strncmp(spec, "auto", 4) == 0) {
+        cfg->automatic = 1;
+        return 0;
+    }
+    cfg->mbit = strtod(spec, &end);
+    if (end != spec + len || cfg->mbit <= 0)
+        return -1;
+    return 0;
+}
+
+int pace_socket(int fd, double mbit)
+{
+    double bytes = mbit * 1e6 / 8;
+    // The u32 form works on every kernel; ~0U means unlimited
+    unsigned int rate = bytes >= 4294967294.0 ? 4294967294u : (unsigned int)bytes;
+
+    return setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate));
+}
+
+uint64_t pace_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void pacer_init(struct pacer *p, double mbit)
+{
+    p->rate = mbit * 1e6 / 8;
+    p->tokens = PACE_BURST;
+    p->last_ns = pace_now_ns();
+}
+
+uint64_t pacer_wait_ns(struct pacer *p, uint64_t now_ns, size_t n)
+{
+    if (p->rate <= 0)
+        return 0;
+    if (n > PACE_BURST)
+        n = PACE_BURST;
+
+    // Idle time refills the bucket, but never beyond one burst
+    if (now_ns > p->last_ns) {
+        p->tokens += (now_ns - p->last_ns) * p->rate / 1e9;
+        if (p->tokens > PACE_BURST)
+            p->tokens = PACE_BURST;
+        p->last_ns = now_ns;
+    }
+    if (p->tokens >= n)
+        return 0;
+    return (uint64_t)((n - p->tokens) * 1e9 / p->rate) + 1;
+}
+
+void pacer_spend(struct pacer *p, size_t n)
+{
+    p->tokens -= n;
+}
@@ -0,0 +1,53 @@
+// pacer.h - Spreading each frame over the frame interval (--pace)
+//
+// Without pacing a 614 KB frame leaves at line rate and the link then
+// idles until the next one: a burst that fills switch buffers and delays
+// everything else on a shared uplink. With a rate cap the frame takes
+// most of the interval instead.
+//
+// The kernel paces best: SO_MAX_PACING_RATE caps a TCP socket (internal
+// TCP pacing since Linux 4.13, the fq qdisc if installed) and, with fq,
+// a UDP socket. Where it is unavailable, or forced with ":user", a token
+// bucket in the sender hands out PACE_BURST bytes at a time.
+#ifndef PACER_H
+#define PACER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PACE_BURST (64 * 1024)      // bucket depth: one GSO message, a TSO burst
+
+struct pace_config {
+    double mbit;                    // per client (TCP) or stream (UDP), 0 = off
+    int automatic;                  // mbit from the sources' frame rates
+    int user;                       // token bucket even if the kernel can pace
+};
+
+struct pacer {
+    double rate;                    // bytes per second, 0 = unlimited
+    double tokens;                  // bytes that may go now, < 0 = in debt
+    uint64_t last_ns;               // CLOCK_MONOTONIC of the last refill
+};
+
+/* "MBIT[:user]" or "auto[:user]" -> cfg; returns 0 or -1 */
+int parse_pace(const char *spec, struct pace_config *cfg);
+
+/*
+ * Cap fd at mbit with SO_MAX_PACING_RATE. Returns 0 if the kernel took
+ * it, -1 if pacing is up to a pacer.
+ */
+int pace_socket(int fd, double mbit);
+
+void pacer_init(struct pacer *p, double mbit);
+
+/*
+ * Refill the bucket and return 0 if n bytes (at most PACE_BURST) may go
+ * now, else the nanoseconds until they may. pacer_spend() takes what was
+ * actually sent.
+ */
+uint64_t pacer_wait_ns(struct pacer *p, uint64_t now_ns, size_t n);
+void pacer_spend(struct pacer *p, size_t n);
+
+uint64_t pace_now_ns(void);
+
+#endif /* PACER_H */
@@ -0,0 +1,100 @@
+// preview.c - 2x2 binning for preview frames (see preview.h)
+#include "preview.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PREVIEW_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PREVIEW_NEON 1
+#endif
+
+#if PREVIEW_SSE2
+/* Sums of neighbouring samples as 4 x u32: v0+v1, v2+v3, v4+v5, v6+v7 */
+static inline __m128i pair_sums(__m128i v)
+{
+    return _mm_add_epi32(_mm_and_si128(v, _mm_set1_epi32(0xffff)),
+                         _mm_srli_epi32(v, 16));
+}
+
+/* (sum + 2) >> 2 for 8 blocks, as u16; SSE2 only packs signed, so bias it */
+static inline __m128i average_pack(__m128i s0, __m128i s1)
+{
+    const __m128i bias = _mm_set1_epi32(32768);
+
+    s0 = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(s0, _mm_set1_epi32(2)), 2), bias);
+    s1 = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(s1, _mm_set1_epi32(2)), 2), bias);
+    return _mm_xor_si128(_mm_packs_epi32(s0, s1), _mm_set1_epi16((short)0x8000));
+}
+#endif
+
+void bin2x2(const uint16_t *src, int width, int height, uint16_t *dst)
+{
+    int ow = width / 2, oh = height / 2;
+    int x, y;
+
+    for (y = 0; y < oh; y++) {
+        const uint16_t *r0 = src + (size_t)2 * y * width;
+        const uint16_t *r1 = r0 + width;
+        uint16_t *out = dst + (size_t)y * ow;
+
+        x = 0;
+#if PREVIEW_SSE2
+        // 16 input columns of both rows -> 8 output samples
+        for (; x + 8 <= ow; x += 8) {
+            __m128i s0 = _mm_add_epi32(
+                pair_sums(_mm_loadu_si128((const __m128i *)(r0 + 2 * x))),
+                pair_sums(_mm_loadu_si128((const __m128i *)(r1 + 2 * x))));
+            __m128i s1 = _mm_add_epi32(
+                pair_sums(_mm_loadu_si128((const __m128i *)(r0 + 2 * x + 8))),
+                pair_sums(_mm_loadu_si128((const __m128i *)(r1 + 2 * x + 8))));
+
+            _mm_storeu_si128((__m128i *)(out + x), average_pack(s0, s1));
+        }
+#elif PREVIEW_NEON
+        for (; x + 8 <= ow; x += 8) {
+            uint32x4_t s0 = vpadalq_u16(vpaddlq_u16(vld1q_u16(r0 + 2 * x)),
+                                        vld1q_u16(r1 + 2 * x));
+            uint32x4_t s1 = vpadalq_u16(vpaddlq_u16(vld1q_u16(r0 + 2 * x + 8)),
+                                        vld1q_u16(r1 + 2 * x + 8));
+
+            // Rounding narrow: (sum + 2) >> 2
+            vst1q_u16(out + x, vcombine_u16(vrshrn_n_u32(s0, 2), vrshrn_n_u32(s1, 2)));
+        }
+#endif
+        for (; x < ow; x++)
+            out[x] = (uint16_t)((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+    }
+}
+
+size_t preview_bytes(int width, int height)
+{
+    size_t total = 0;
+    int level;
+
+    for (level = 1; level <= PREVIEW_LEVELS; level++)
+        total += (size_t)(width >> level) * (height >> level) * 2;
+    return total;
+}
+
+int preview_level(unsigned int factor)
+{
+    switch (factor) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 2;
+    case 8: return 3;
+    }
+    return -1;
+}
+
+const char *preview_simd(void)
+{
+#if PREVIEW_SSE2
+    return "sse2";
+#elif PREVIEW_NEON
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,46 @@
+// preview.h - Downscaled preview frames by 2x2 binning
+//
+// A monitoring client rarely needs full-resolution RAW. Level 1 averages
+// every 2x2 RGGB quad into one sample, a 12-bit luma-like MONO12 image at
+// half the width and height (a quarter of the bytes); every further level
+// bins that 2x2 again:
+//
+//   level  factor  640x480 RAW12 (614,400 B) becomes
+//   1      2       320x240 MONO12, 153,600 B
+//   2      4       160x120 MONO12,  38,400 B
+//   3      8        80x60  MONO12,   9,600 B
+//
+// Each level is one bin2x2() pass over the previous one, with SSE2 or NEON
+// when available.
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PREVIEW_LEVELS 3
+
+/*
+ * Average each 2x2 block of a width x height image (16-bit samples, rows
+ * packed) into dst, (width / 2) x (height / 2). Rounds to nearest; an odd
+ * last column or row is left out.
+ */
+void bin2x2(const uint16_t *src, int width, int height, uint16_t *dst);
+
+/* Bytes of all levels up to PREVIEW_LEVELS for a width x height frame */
+size_t preview_bytes(int width, int height);
+
+/* Factor 1 (full frames), 2, 4 or 8 -> level 0 .. 3; -1 for anything else */
+int preview_level(unsigned int factor);
+
+const char *preview_simd(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PREVIEW_H */
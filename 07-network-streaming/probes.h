@@ -0,0 +1,56 @@
+// probes.h - USDT (user-space statically defined tracing) probes of
+// frame_streamer
+//
+// Built on <sys/sdt.h> (systemtap-sdt-dev / systemtap-sdt-devel): every
+// probe is a single nop in the hot path plus an ELF note describing where
+// its arguments live, so they cost nothing until perf or bpftrace attaches:
+//
+//   bpftrace -l 'usdt:./frame_streamer:*'
+//   bpftrace -e 'usdt:./frame_streamer:frame_streamer:send_done
+//                { @bytes[arg1] = sum(arg2); }'
+//   perf buildid-cache --add ./frame_streamer
+//   perf record -e sdt_frame_streamer:read_done ./frame_streamer ...
+//
+// Without the header (or with make PROBES=0) the probes compile to nothing.
+//
+//   poll_return(frame_no)                     source says a frame is ready
+//   read_done(frame_no, bytes_read, bytes)    frame in its ring slot (bytes:
+//                                             payload after compression)
+//   ring_drop(frame_no)                       ring full, frame discarded
+//   send_start(frame_no, fd, bytes)           first byte of the frame goes out
+//   send_done(frame_no, fd, bytes)            last byte handed to the socket
+//
+// fd is the client socket (TCP), the UDP socket or -1 for shared memory.
+#ifndef PROBES_H
+#define PROBES_H
+
+#if !defined(FRAME_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define FRAME_PROBES 1
+#endif
+#endif
+#ifndef FRAME_PROBES
+#define FRAME_PROBES 0
+#endif
+
+#if FRAME_PROBES
+#define PROBE_POLL_RETURN(frame_no) \
+    DTRACE_PROBE1(frame_streamer, poll_return, frame_no)
+#define PROBE_READ_DONE(frame_no, bytes_read, bytes) \
+    DTRACE_PROBE3(frame_streamer, read_done, frame_no, bytes_read, bytes)
+#define PROBE_RING_DROP(frame_no) \
+    DTRACE_PROBE1(frame_streamer, ring_drop, frame_no)
+#define PROBE_SEND_START(frame_no, fd, bytes) \
+    DTRACE_PROBE3(frame_streamer, send_start, frame_no, fd, bytes)
+#define PROBE_SEND_DONE(frame_no, fd, bytes) \
+    DTRACE_PROBE3(frame_streamer, send_done, frame_no, fd, bytes)
+#else
+#define PROBE_POLL_RETURN(frame_no) do { } while (0)
+#define PROBE_READ_DONE(frame_no, bytes_read, bytes) do { } while (0)
+#define PROBE_RING_DROP(frame_no) do { } while (0)
+#define PROBE_SEND_START(frame_no, fd, bytes) do { } while (0)
+#define PROBE_SEND_DONE(frame_no, fd, bytes) do { } while (0)
+#endif
+
+#endif /* PROBES_H */
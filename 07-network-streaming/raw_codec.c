@@ -0,0 +1,338 @@
+// raw_codec.c - Lossless Bayer RAW codec (see raw_codec.h)
+#include <string.h>
+
+#include "raw_codec.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define RC12_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RC12_NEON 1
+#endif
+
+/* Signed residual <-> unsigned code: 0, -1, 1, -2, 2 ... -> 0, 1, 2, 3, 4 ... */
+static inline uint16_t zigzag(uint16_t r)
+{
+    return (uint16_t)((r << 1) ^ -(r >> 15));
+}
+
+static inline uint16_t unzigzag(uint16_t z)
+{
+    return (uint16_t)((z >> 1) ^ -(z & 1));
+}
+
+/* Width code 15 stands for 16 bits: four bits cover every 16-bit input */
+static inline unsigned code_bits(unsigned code)
+{
+    return code == 15 ? 16 : code;
+}
+
+static inline unsigned width_code(unsigned or_bits)
+{
+    unsigned width = or_bits ? 32 - __builtin_clz(or_bits) : 0;
+
+    return width > 15 ? 15 : width;
+}
+
+/*
+ * Same-colour predictor: two samples to the left, or two rows up for the
+ * first two samples of a row (0 on the first two rows).
+ */
+static inline uint16_t predict(const uint16_t *cur, const uint16_t *up2, int x)
+{
+    if (x >= 2)
+        return cur[x - 2];
+    return up2 ? up2[x] : 0;
+}
+
+/*
+ * Zigzag residuals of cur[x0 .. x0+n) into z. Returns the OR of all codes,
+ * whose highest set bit gives the block width.
+ */
+static unsigned predict_block(const uint16_t *cur, const uint16_t *up2,
+                              int x0, int n, uint16_t *z)
+{
+    unsigned acc = 0;
+    int i;
+
+#if RC12_SSE2
+    if (n == RC12_BLOCK && x0 >= 2) {
+        __m128i r0 = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(cur + x0)),
+                                   _mm_loadu_si128((const __m128i *)(cur + x0 - 2)));
+        __m128i r1 = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(cur + x0 + 8)),
+                                   _mm_loadu_si128((const __m128i *)(cur + x0 + 6)));
+        __m128i z0 = _mm_xor_si128(_mm_slli_epi16(r0, 1), _mm_srai_epi16(r0, 15));
+        __m128i z1 = _mm_xor_si128(_mm_slli_epi16(r1, 1), _mm_srai_epi16(r1, 15));
+        __m128i o = _mm_or_si128(z0, z1);
+
+        _mm_storeu_si128((__m128i *)z, z0);
+        _mm_storeu_si128((__m128i *)(z + 8), z1);
+        o = _mm_or_si128(o, _mm_srli_si128(o, 8));
+        o = _mm_or_si128(o, _mm_srli_si128(o, 4));
+        o = _mm_or_si128(o, _mm_srli_si128(o, 2));
+        return (unsigned)_mm_cvtsi128_si32(o) & 0xffff;
+    }
+#elif RC12_NEON
+    if (n == RC12_BLOCK && x0 >= 2) {
+        uint16x8_t r0 = vsubq_u16(vld1q_u16(cur + x0), vld1q_u16(cur + x0 - 2));
+        uint16x8_t r1 = vsubq_u16(vld1q_u16(cur + x0 + 8), vld1q_u16(cur + x0 + 6));
+        uint16x8_t z0 = veorq_u16(vshlq_n_u16(r0, 1),
+                                  vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(r0), 15)));
+        uint16x8_t z1 = veorq_u16(vshlq_n_u16(r1, 1),
+                                  vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(r1), 15)));
+        uint64x2_t o = vreinterpretq_u64_u16(vorrq_u16(z0, z1));
+        uint64_t m = vgetq_lane_u64(o, 0) | vgetq_lane_u64(o, 1);
+
+        vst1q_u16(z, z0);
+        vst1q_u16(z + 8, z1);
+        m |= m >> 32;
+        m |= m >> 16;
+        return (unsigned)m & 0xffff;
+    }
+#endif
+
+    for (i = 0; i < n; i++) {
+        z[i] = zigzag((uint16_t)(cur[x0 + i] - predict(cur, up2, x0 + i)));
+        acc |= z[i];
+    }
+    return acc;
+}
+
+/* Inverse of predict_block(): a stride-2 prefix sum seeded from cur[x0-2] */
+static void reconstruct_block(uint16_t *cur, const uint16_t *up2,
+                              int x0, int n, const uint16_t *z)
+{
+    int i;
+
+#if RC12_SSE2
+    if (n == RC12_BLOCK && x0 >= 2) {
+        const __m128i one = _mm_set1_epi16(1);
+        __m128i carry, v;
+        uint32_t seed;
+
+        memcpy(&seed, cur + x0 - 2, sizeof(seed));
+        carry = _mm_set1_epi32((int)seed);
+        for (i = 0; i < RC12_BLOCK; i += 8) {
+            v = _mm_loadu_si128((const __m128i *)(z + i));
+            v = _mm_xor_si128(_mm_srli_epi16(v, 1),
+                              _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(v, one)));
+            v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi16(v, carry);
+            _mm_storeu_si128((__m128i *)(cur + x0 + i), v);
+            carry = _mm_shuffle_epi32(v, 0xff);
+        }
+        return;
+    }
+#elif RC12_NEON
+    if (n == RC12_BLOCK && x0 >= 2) {
+        const uint16x8_t zero = vdupq_n_u16(0);
+        uint16x8_t carry, v;
+        uint32_t seed;
+
+        memcpy(&seed, cur + x0 - 2, sizeof(seed));
+        carry = vreinterpretq_u16_u32(vdupq_n_u32(seed));
+        for (i = 0; i < RC12_BLOCK; i += 8) {
+            v = vld1q_u16(z + i);
+            v = veorq_u16(vshrq_n_u16(v, 1),
+                          vsubq_u16(zero, vandq_u16(v, vdupq_n_u16(1))));
+            v = vaddq_u16(v, vextq_u16(zero, v, 6));
+            v = vaddq_u16(v, vextq_u16(zero, v, 4));
+            v = vaddq_u16(v, carry);
+            vst1q_u16(cur + x0 + i, v);
+            carry = vreinterpretq_u16_u32(
+                vdupq_n_u32(vgetq_lane_u32(vreinterpretq_u32_u16(v), 3)));
+        }
+        return;
+    }
+#endif
+
+    for (i = 0; i < n; i++)
+        cur[x0 + i] = (uint16_t)(predict(cur, up2, x0 + i) + unzigzag(z[i]));
+}
+
+/* LSB-first bit writer; the caller guarantees room (raw_codec_bound) */
+struct bit_writer {
+    uint8_t *p;
+    uint64_t acc;
+    unsigned n;
+};
+
+static inline void bw_put(struct bit_writer *bw, uint32_t v, unsigned bits)
+{
+    bw->acc |= (uint64_t)v << bw->n;
+    bw->n += bits;
+    if (bw->n >= 32) {
+        uint32_t word = (uint32_t)bw->acc;
+
+        memcpy(bw->p, &word, sizeof(word));
+        bw->p += 4;
+        bw->acc >>= 32;
+        bw->n -= 32;
+    }
+}
+
+static inline void bw_flush(struct bit_writer *bw)
+{
+    while (bw->n > 0) {
+        *bw->p++ = (uint8_t)bw->acc;
+        bw->acc >>= 8;
+        bw->n = bw->n > 8 ? bw->n - 8 : 0;
+    }
+}
+
+struct bit_reader {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t acc;
+    unsigned n;
+};
+
+static inline void br_refill(struct bit_reader *br)
+{
+    if (br->end - br->p >= 8) {
+        uint64_t v;
+
+        // Whole-word load; bytes that do not fit are read again next time
+        memcpy(&v, br->p, sizeof(v));
+        br->acc |= v << br->n;
+        br->p += (63 - br->n) >> 3;
+        br->n |= 56;
+    } else {
+        while (br->n <= 56 && br->p < br->end) {
+            br->acc |= (uint64_t)*br->p++ << br->n;
+            br->n += 8;
+        }
+    }
+}
+
+static inline int br_get(struct bit_reader *br, unsigned bits, uint16_t *v)
+{
+    if (br->n < bits) {
+        br_refill(br);
+        if (br->n < bits)
+            return -1;
+    }
+    *v = (uint16_t)(br->acc & ((1u << bits) - 1));
+    br->acc >>= bits;
+    br->n -= bits;
+    return 0;
+}
+
+size_t raw_codec_bound(int width, int height)
+{
+    size_t blocks = ((size_t)width + RC12_BLOCK - 1) / RC12_BLOCK;
+    size_t bits = (size_t)height * (blocks * 4 + (size_t)width * 16);
+
+    return sizeof(struct rc12_header) + (bits + 7) / 8 + 8;
+}
+
+size_t raw_encode(const uint16_t *src, int width, int height,
+                  void *dst, size_t cap)
+{
+    struct rc12_header hdr;
+    struct bit_writer bw;
+    uint16_t z[RC12_BLOCK];
+    int x0, y, i;
+
+    if (width < 1 || height < 1 || width > 0xffff || height > 0xffff ||
+        cap < raw_codec_bound(width, height))
+        return 0;
+
+    hdr.magic = RC12_MAGIC;
+    hdr.width = (uint16_t)width;
+    hdr.height = (uint16_t)height;
+    memcpy(dst, &hdr, sizeof(hdr));
+
+    bw.p = (uint8_t *)dst + sizeof(hdr);
+    bw.acc = 0;
+    bw.n = 0;
+
+    for (y = 0; y < height; y++) {
+        const uint16_t *cur = src + (size_t)y * width;
+        const uint16_t *up2 = y >= 2 ? cur - 2 * (size_t)width : NULL;
+
+        for (x0 = 0; x0 < width; x0 += RC12_BLOCK) {
+            int n = width - x0 < RC12_BLOCK ? width - x0 : RC12_BLOCK;
+            unsigned code = width_code(predict_block(cur, up2, x0, n, z));
+            unsigned bits = code_bits(code);
+
+            bw_put(&bw, code, 4);
+            if (bits == 0)
+                continue;
+            for (i = 0; i < n; i++)
+                bw_put(&bw, z[i], bits);
+        }
+    }
+    bw_flush(&bw);
+
+    return (size_t)(bw.p - (uint8_t *)dst);
+}
+
+int raw_codec_dims(const void *src, size_t len, int *width, int *height)
+{
+    struct rc12_header hdr;
+
+    if (len < sizeof(hdr))
+        return -1;
+    memcpy(&hdr, src, sizeof(hdr));
+    if (hdr.magic != RC12_MAGIC || hdr.width == 0 || hdr.height == 0)
+        return -1;
+
+    *width = hdr.width;
+    *height = hdr.height;
+    return 0;
+}
+
+int raw_decode(const void *src, size_t len, uint16_t *dst, size_t max_samples)
+{
+    struct bit_reader br;
+    uint16_t z[RC12_BLOCK];
+    uint16_t code;
+    int width, height;
+    int x0, y, i;
+
+    if (raw_codec_dims(src, len, &width, &height) < 0 ||
+        (size_t)width * height > max_samples)
+        return -1;
+
+    br.p = (const uint8_t *)src + sizeof(struct rc12_header);
+    br.end = (const uint8_t *)src + len;
+    br.acc = 0;
+    br.n = 0;
+
+    for (y = 0; y < height; y++) {
+        uint16_t *cur = dst + (size_t)y * width;
+        const uint16_t *up2 = y >= 2 ? cur - 2 * (size_t)width : NULL;
+
+        for (x0 = 0; x0 < width; x0 += RC12_BLOCK) {
+            int n = width - x0 < RC12_BLOCK ? width - x0 : RC12_BLOCK;
+            unsigned bits;
+
+            if (br_get(&br, 4, &code) < 0)
+                return -1;
+            bits = code_bits(code);
+            if (bits == 0) {
+                memset(z, 0, sizeof(z));
+            } else {
+                for (i = 0; i < n; i++)
+                    if (br_get(&br, bits, &z[i]) < 0)
+                        return -1;
+            }
+            reconstruct_block(cur, up2, x0, n, z);
+        }
+    }
+    return 0;
+}
+
+const char *raw_codec_simd(void)
+{
+#if RC12_SSE2
+    return "sse2";
+#elif RC12_NEON
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,62 @@
+// raw_codec.h - Lossless codec for Bayer RAW frames ("RC12")
+//
+// Samples are predicted from the previous sample of the same Bayer colour
+// (two to the left; the first two of a row from two rows up), so each of the
+// four RGGB channels is delta-coded on its own. Residuals are zigzag-mapped
+// to unsigned and bit-packed in blocks of RC12_BLOCK samples, each block with
+// the smallest width that holds its largest residual:
+//
+//   stream = rc12_header, then per row, per block: 4-bit code + n * width bits
+//
+// The bitstream is little-endian, LSB first. Width code 15 means 16 bits,
+// so any 16-bit input round-trips; 12-bit sensor data never needs it.
+// Prediction and reconstruction use SSE2 or NEON when available.
+#ifndef RAW_CODEC_H
+#define RAW_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RC12_MAGIC 0x32314352u      // 'R' 'C' '1' '2'
+#define RC12_BLOCK 16
+
+struct rc12_header {
+    uint32_t magic;
+    uint16_t width;
+    uint16_t height;
+} __attribute__((packed));
+
+/* Worst-case encoded size: size encode buffers with this */
+size_t raw_codec_bound(int width, int height);
+
+/*
+ * Compress width x height 16-bit samples. Returns the encoded size, or 0
+ * if cap is below raw_codec_bound() or the dimensions are invalid.
+ */
+size_t raw_encode(const uint16_t *src, int width, int height,
+                  void *dst, size_t cap);
+
+/*
+ * Reads the dimensions from an encoded stream. Returns 0 on success, -1 if
+ * the stream does not start with a valid rc12_header.
+ */
+int raw_codec_dims(const void *src, size_t len, int *width, int *height);
+
+/*
+ * Decompress into dst, which holds max_samples samples. Returns 0 on
+ * success, -1 if the stream is truncated, corrupt or does not fit.
+ */
+int raw_decode(const void *src, size_t len, uint16_t *dst, size_t max_samples);
+
+/* "sse2", "neon" or "scalar": the path this build uses */
+const char *raw_codec_simd(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAW_CODEC_H */
@@ -0,0 +1,308 @@
+// recorder.c - frame_file.h container writer (see recorder.h)
+//
+// Frames are packed into REC_NBUFS large staging buffers. A full buffer
+// is handed to io_uring as one WRITE_FIXED at its final file offset and
+// the next buffer is filled while the kernel writes, so the recording
+// thread only waits for the disk when every buffer is in flight. O_DIRECT
+// keeps a long recording from pushing everything else out of the page
+// cache; it needs aligned addresses, lengths and offsets, which is why
+// every record is padded to FILE_ALIGN.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "recorder.h"
+
+#define REC_BUF_MIN (4u << 20)
+
+static int pwrite_full(int fd, const char *buf, size_t len, uint64_t off)
+{
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, off);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+/* Collect completions; with 'wait', block until at least one arrives */
+static int reap(struct recorder *rec, int wait)
+{
+    struct io_uring_cqe *cqe;
+
+    while (uring_submit_and_wait(&rec->u, wait ? 1 : 0) < 0) {
+        if (errno != EINTR) {
+            perror("io_uring_enter failed");
+            return -1;
+        }
+    }
+
+    while ((cqe = uring_peek_cqe(&rec->u)) != NULL) {
+        int idx = (int)cqe->user_data;
+        int res = cqe->res;
+
+        uring_cqe_seen(&rec->u);
+        if (res != rec->inflight[idx]) {
+            fprintf(stderr, "Recording write failed: %s\n",
+                    res < 0 ? strerror(-res) : "short write");
+            return -1;
+        }
+        rec->inflight[idx] = 0;
+    }
+    return 0;
+}
+
+static int wait_buf(struct recorder *rec, int idx)
+{
+    while (rec->inflight[idx])
+        if (reap(rec, 1) < 0)
+            return -1;
+    return 0;
+}
+
+static int submit_buf(struct recorder *rec, int idx, size_t len, uint64_t off)
+{
+    struct io_uring_sqe *sqe;
+
+    rec->writes++;
+    rec->bytes += len;
+
+    if (!rec->use_uring) {
+        if (pwrite_full(rec->fd, rec->bufs[idx], len, off) < 0) {
+            perror("Recording write failed");
+            return -1;
+        }
+        return 0;
+    }
+
+    // At most REC_NBUFS writes are in flight, the SQ always has room
+    sqe = uring_get_sqe(&rec->u);
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = rec->fd;
+    sqe->addr = (uint64_t)(uintptr_t)rec->bufs[idx];
+    sqe->len = len;
+    sqe->off = off;
+    sqe->buf_index = idx;
+    sqe->user_data = idx;
+    rec->inflight[idx] = (int)len;
+
+    return reap(rec, 0);    // submits without waiting
+}
+
+/* Write out the buffer being filled and move on to the next free one */
+static int flush_cur(struct recorder *rec)
+{
+    if (rec->fill == 0)
+        return 0;
+
+    if (submit_buf(rec, rec->cur, rec->fill, rec->file_off) < 0)
+        return -1;
+    rec->file_off += rec->fill;
+    rec->fill = 0;
+    rec->cur = (rec->cur + 1) % REC_NBUFS;
+    return wait_buf(rec, rec->cur);
+}
+
+/* Header block at offset 0, synchronously (only at open and close) */
+static int write_header(struct recorder *rec)
+{
+    char *blk = rec->bufs[rec->cur];
+
+    memset(blk, 0, FILE_ALIGN);
+    memcpy(blk, &rec->hdr, sizeof(rec->hdr));
+    if (pwrite_full(rec->fd, blk, FILE_ALIGN, 0) < 0) {
+        perror("Writing container header failed");
+        return -1;
+    }
+    return 0;
+}
+
+int recorder_open(struct recorder *rec, const char *path, size_t max_payload)
+{
+    struct iovec iov[REC_NBUFS];
+    struct timespec ts;
+    int i;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->u.fd = -1;
+
+    rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+    if (rec->fd >= 0) {
+        rec->direct = 1;
+    } else if (errno == EINVAL) {
+        // tmpfs and some network filesystems refuse O_DIRECT
+        rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (rec->fd < 0) {
+        perror("Failed to create recording");
+        return -1;
+    }
+
+    rec->buf_size = file_align_up(sizeof(struct frame_header) + FRAME_EXT_MAX +
+                                  max_payload);
+    if (rec->buf_size < REC_BUF_MIN)
+        rec->buf_size = REC_BUF_MIN;
+    for (i = 0; i < REC_NBUFS; i++) {
+        if (posix_memalign((void **)&rec->bufs[i], FILE_ALIGN, rec->buf_size) != 0) {
+            rec->bufs[i] = NULL;
+            perror("Failed to allocate recording buffers");
+            goto fail;
+        }
+        iov[i].iov_base = rec->bufs[i];
+        iov[i].iov_len = rec->buf_size;
+    }
+
+    rec->index_cap = 1024;
+    rec->index = malloc(rec->index_cap * sizeof(*rec->index));
+    if (!rec->index) {
+        perror("Failed to allocate recording index");
+        goto fail;
+    }
+
+    // Provisional header: identifies the file even if we never close it
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec->hdr.magic = FILE_MAGIC;
+    rec->hdr.version = FILE_VERSION;
+    rec->hdr.align = FILE_ALIGN;
+    rec->hdr.max_payload = max_payload;
+    rec->hdr.created_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    if (write_header(rec) < 0)
+        goto fail;
+    rec->file_off = FILE_ALIGN;
+
+    // io_uring with registered staging buffers, else plain pwrite()
+    if (uring_init(&rec->u, 2 * REC_NBUFS) == 0) {
+        if (uring_register(&rec->u, IORING_REGISTER_BUFFERS, iov, REC_NBUFS) == 0)
+            rec->use_uring = 1;
+        else
+            uring_exit(&rec->u);
+    }
+
+    printf("✓ Recording to %s (%s, %s, %d x %zu KB buffers)\n", path,
+           rec->direct ? "O_DIRECT" : "buffered",
+           rec->use_uring ? "io_uring" : "pwrite", REC_NBUFS, rec->buf_size / 1024);
+    return 0;
+
+fail:
+    for (i = 0; i < REC_NBUFS; i++)
+        free(rec->bufs[i]);
+    free(rec->index);
+    close(rec->fd);
+    rec->fd = -1;
+    return -1;
+}
+
+int recorder_write(struct recorder *rec, const struct frame_slot *slot)
+{
+    size_t hdr_len = slot->hdr.header_len;     // keeps trace and stream, if any
+    size_t rec_len = file_align_up(hdr_len + slot->len);
+    struct file_index_entry *e;
+    char *dst;
+
+    if (rec_len > rec->buf_size)
+        return -1;
+    if (rec->fill + rec_len > rec->buf_size && flush_cur(rec) < 0)
+        return -1;
+
+    if (rec->hdr.frame_count == rec->index_cap) {
+        struct file_index_entry *grown;
+
+        grown = realloc(rec->index, 2 * rec->index_cap * sizeof(*rec->index));
+        if (!grown) {
+            perror("Failed to grow recording index");
+            return -1;
+        }
+        rec->index = grown;
+        rec->index_cap *= 2;
+    }
+
+    dst = rec->bufs[rec->cur] + rec->fill;
+    memcpy(dst, &slot->hdr, hdr_len);
+    memcpy(dst + hdr_len, slot->data, slot->len);
+    memset(dst + hdr_len + slot->len, 0, rec_len - hdr_len - slot->len);
+
+    e = &rec->index[rec->hdr.frame_count++];
+    e->offset = rec->file_off + rec->fill;
+    e->sequence = slot->hdr.sequence;
+    e->payload_len = slot->hdr.payload_len;
+    e->timestamp_ns = slot->hdr.timestamp_ns;
+
+    rec->fill += rec_len;
+    rec->frames++;
+    stats_sent(rec->stats, hdr_len + slot->len);
+    return 0;
+}
+
+int recorder_run(struct recorder *rec, struct frame_ring *ring)
+{
+    struct frame_slot *slot;
+    int ret = 0;
+
+    while ((slot = ring_consume(ring)) != NULL) {
+        ret = recorder_write(rec, slot);
+        ring_release(ring, slot);
+        if (ret < 0) {
+            fprintf(stderr, "Recording failed, stopping\n");
+            break;
+        }
+    }
+    return ret;
+}
+
+int recorder_close(struct recorder *rec)
+{
+    size_t index_len = rec->hdr.frame_count * sizeof(*rec->index);
+    size_t done = 0;
+    int ret = 0;
+    int i;
+
+    if (rec->fd < 0)
+        return -1;
+
+    if (flush_cur(rec) < 0)
+        ret = -1;
+    for (i = 0; i < REC_NBUFS; i++)
+        if (wait_buf(rec, i) < 0)
+            ret = -1;
+
+    // Index after the last record, then the final header
+    rec->hdr.index_offset = rec->file_off;
+    while (ret == 0 && done < index_len) {
+        size_t chunk = index_len - done < rec->buf_size ? index_len - done : rec->buf_size;
+        size_t padded = file_align_up(chunk);
+
+        memset(rec->bufs[0], 0, padded);
+        memcpy(rec->bufs[0], (char *)rec->index + done, chunk);
+        if (pwrite_full(rec->fd, rec->bufs[0], padded, rec->file_off + done) < 0) {
+            perror("Writing recording index failed");
+            ret = -1;
+        }
+        done += chunk;
+    }
+    rec->cur = 0;
+    if (ret == 0 && (write_header(rec) < 0 || fdatasync(rec->fd) < 0))
+        ret = -1;
+
+    if (ret == 0)
+        printf("✓ Recorded %lu frames, %.1f MB in %lu writes\n",
+               rec->frames, rec->bytes / 1e6, rec->writes);
+
+    uring_exit(&rec->u);
+    close(rec->fd);
+    rec->fd = -1;
+    for (i = 0; i < REC_NBUFS; i++)
+        free(rec->bufs[i]);
+    free(rec->index);
+    return ret;
+}
@@ -0,0 +1,50 @@
+// recorder.h - Append frames to a frame_file.h container with O_DIRECT
+// writes of large aligned buffers, submitted asynchronously via io_uring
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame_file.h"
+#include "frame_ring.h"
+#include "stream_stats.h"
+#include "uring.h"
+
+#define REC_NBUFS 4                 // staging buffers, up to NBUFS-1 in flight
+
+struct recorder {
+    int fd;
+    int direct;                     // O_DIRECT accepted by the filesystem
+    int use_uring;                  // else synchronous pwrite()
+    struct uring u;
+
+    char *bufs[REC_NBUFS];          // FILE_ALIGN-aligned staging buffers
+    size_t buf_size;
+    int inflight[REC_NBUFS];
+    int cur;                        // buffer being filled
+    size_t fill;
+    uint64_t file_off;              // where bufs[cur] goes
+
+    struct file_header hdr;
+    struct file_index_entry *index;
+    size_t index_cap;
+
+    unsigned long frames;
+    unsigned long writes;
+    uint64_t bytes;
+    struct stream_stats *stats;     // periodic summary counters, or NULL
+};
+
+int recorder_open(struct recorder *rec, const char *path, size_t max_payload);
+
+/* Queue one frame; large writes go out when a staging buffer fills up */
+int recorder_write(struct recorder *rec, const struct frame_slot *slot);
+
+/* Record every frame the ring delivers until it is closed and drained */
+int recorder_run(struct recorder *rec, struct frame_ring *ring);
+
+/* Flush, append the index, finalize the header. Returns 0 or -1. */
+int recorder_close(struct recorder *rec);
+
+#endif /* RECORDER_H */
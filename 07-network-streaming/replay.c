@@ -0,0 +1,149 @@
+// replay.c - frame_file.h container reader (see replay.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "replay.h"
+
+/* A record the index points at must lie inside the file and look valid */
+static int record_ok(const struct replay *rp, uint64_t off)
+{
+    const struct frame_header *fh;
+
+    if (off % FILE_ALIGN || off + sizeof(*fh) > rp->size)
+        return 0;
+    fh = (const struct frame_header *)(rp->map + off);
+    return frame_header_valid(fh) == 0 &&
+           off + fh->header_len + fh->payload_len <= rp->size;
+}
+
+static int add_entry(struct replay *rp, uint32_t *cap, uint64_t off)
+{
+    const struct frame_header *fh = (const struct frame_header *)(rp->map + off);
+    struct file_index_entry *e;
+
+    if (rp->count == *cap) {
+        struct file_index_entry *grown;
+
+        *cap = *cap ? 2 * *cap : 1024;
+        grown = realloc(rp->index, *cap * sizeof(*rp->index));
+        if (!grown)
+            return -1;
+        rp->index = grown;
+    }
+    e = &rp->index[rp->count++];
+    e->offset = off;
+    e->sequence = fh->sequence;
+    e->payload_len = fh->payload_len;
+    e->timestamp_ns = fh->timestamp_ns;
+    if (fh->payload_len > rp->max_payload)
+        rp->max_payload = fh->payload_len;
+    return 0;
+}
+
+/* No index (recording was never closed): walk the aligned records */
+static int rebuild_index(struct replay *rp)
+{
+    uint32_t cap = 0;
+    uint64_t off = FILE_ALIGN;
+
+    while (record_ok(rp, off)) {
+        const struct frame_header *fh = (const struct frame_header *)(rp->map + off);
+
+        if (add_entry(rp, &cap, off) < 0)
+            return -1;
+        off += file_align_up((uint64_t)fh->header_len + fh->payload_len);
+    }
+    return 0;
+}
+
+static int load_index(struct replay *rp)
+{
+    const struct file_index_entry *src;
+    uint32_t cap = 0, i;
+
+    if (rp->hdr.index_offset + (uint64_t)rp->hdr.frame_count * sizeof(*src) > rp->size)
+        return -1;
+    src = (const struct file_index_entry *)(rp->map + rp->hdr.index_offset);
+    for (i = 0; i < rp->hdr.frame_count; i++)
+        if (!record_ok(rp, src[i].offset) || add_entry(rp, &cap, src[i].offset) < 0)
+            return -1;
+    return 0;
+}
+
+int replay_open(struct replay *rp, const char *path)
+{
+    struct stat st;
+
+    memset(rp, 0, sizeof(*rp));
+    rp->map = MAP_FAILED;
+
+    rp->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (rp->fd < 0 || fstat(rp->fd, &st) < 0) {
+        perror("Failed to open recording");
+        goto fail;
+    }
+    rp->size = st.st_size;
+    if (rp->size < FILE_ALIGN) {
+        fprintf(stderr, "%s: too short for a recording\n", path);
+        goto fail;
+    }
+
+    rp->map = mmap(NULL, rp->size, PROT_READ, MAP_SHARED, rp->fd, 0);
+    if (rp->map == MAP_FAILED) {
+        perror("mmap failed");
+        goto fail;
+    }
+    madvise((void *)rp->map, rp->size, MADV_SEQUENTIAL);
+
+    memcpy(&rp->hdr, rp->map, sizeof(rp->hdr));
+    if (rp->hdr.magic != FILE_MAGIC || rp->hdr.version != FILE_VERSION ||
+        rp->hdr.align != FILE_ALIGN) {
+        fprintf(stderr, "%s: not a frame_streamer recording\n", path);
+        goto fail;
+    }
+
+    if (rp->hdr.index_offset == 0) {
+        printf("%s was not closed cleanly, rebuilding the index\n", path);
+        if (rebuild_index(rp) < 0)
+            goto fail_index;
+    } else if (load_index(rp) < 0) {
+        goto fail_index;
+    }
+
+    printf("✓ Replaying %s: %u frames\n", path, rp->count);
+    return 0;
+
+fail_index:
+    fprintf(stderr, "%s: corrupt index\n", path);
+fail:
+    replay_close(rp);
+    return -1;
+}
+
+const struct frame_header *replay_frame(const struct replay *rp, uint32_t i,
+                                        const char **payload)
+{
+    const struct frame_header *fh =
+        (const struct frame_header *)(rp->map + rp->index[i].offset);
+
+    *payload = (const char *)fh + fh->header_len;
+    return fh;
+}
+
+void replay_close(struct replay *rp)
+{
+    if (rp->map != MAP_FAILED)
+        munmap((void *)rp->map, rp->size);
+    if (rp->fd >= 0)
+        close(rp->fd);
+    free(rp->index);
+    rp->map = MAP_FAILED;
+    rp->fd = -1;
+    rp->index = NULL;
+    rp->count = 0;
+}
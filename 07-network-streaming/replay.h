@@ -0,0 +1,37 @@
+// replay.h - Read a frame_file.h container through a read-only mapping
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame_file.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct replay {
+    int fd;
+    const char *map;
+    size_t size;
+    struct file_header hdr;
+    struct file_index_entry *index;     // validated copy, or rebuilt by a scan
+    uint32_t count;
+    uint32_t max_payload;               // largest payload actually present
+};
+
+/* Map the container and load (or rebuild) its index. Returns 0 or -1. */
+int replay_open(struct replay *rp, const char *path);
+
+/* Header of frame i; *payload points at its payload inside the mapping */
+const struct frame_header *replay_frame(const struct replay *rp, uint32_t i,
+                                        const char **payload);
+
+void replay_close(struct replay *rp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REPLAY_H */
@@ -0,0 +1,98 @@
+// shm_protocol.h - Shared-memory transport between frame_streamer and
+// consumers on the same host (frame_streamer --shm PATH)
+//
+// A consumer connects to the Unix socket at PATH and receives a shm_hello
+// message carrying two file descriptors (SCM_RIGHTS):
+//
+//   fds[0]  memfd holding the frame ring below, mapped read-only
+//   fds[1]  eventfd, incremented whenever frames were published
+//
+// Once it has mapped the ring the consumer sends one byte back: only then
+// does it count towards --wait-clients, so capture never starts before
+// the first consumers can see frame 0.
+//
+// Mapping layout:
+//
+//   0                   struct shm_ring_header
+//   SHM_SLOTS_OFFSET    struct shm_slot[nslots]: seqlock and frame header
+//   + nslots * 64       uint32_t order[nslots]
+//   data_offset         payload of slot 0 (page aligned)
+//   + slot_stride       payload of slot 1
+//   ...
+//
+// The payloads are the streamer's capture buffers themselves: frames are
+// read from the device (and RC12-encoded) straight into them and never
+// copied on the way to a consumer. Frame n (0-based publish order) is in
+// slot order[n % nslots]. Each slot is a seqlock: 'lock' is odd while the
+// slot is being overwritten and 2n+2 once it holds complete frame n. A
+// reader loads lock (acquire), reads header and payload in place, then
+// checks that lock did not change; if it did, the slot was reused for a
+// newer frame and this one must be discarded.
+#ifndef SHM_PROTOCOL_H
+#define SHM_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame_protocol.h"
+
+#define SHM_MAGIC 0x4d534643u       // 'C' 'F' 'S' 'M'
+#define SHM_VERSION 2
+#define SHM_SLOTS_OFFSET 64         // slot table, right after the header
+
+struct shm_hello {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t map_size;
+};
+
+struct shm_ring_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t nslots;
+    uint32_t slot_stride;           // bytes between payloads (page multiple)
+    uint32_t data_capacity;         // payload bytes a slot can hold
+    uint64_t data_offset;           // payload of slot 0
+    uint64_t map_size;
+    uint64_t published;             // frames published so far (release)
+    uint32_t closed;                // producer is gone, nothing more comes
+    uint32_t reserved;
+};
+
+struct shm_slot {
+    uint64_t lock;                  // seqlock, see above
+    uint64_t reserved[3];
+    struct frame_header hdr;        // same header as on the network
+};
+
+_Static_assert(sizeof(struct shm_ring_header) <= SHM_SLOTS_OFFSET,
+               "slot table overlaps the header");
+_Static_assert(sizeof(struct shm_slot) == 64, "one cache line per slot");
+
+/* Bytes in front of the payloads for nslots slots */
+static inline size_t shm_control_size(unsigned int nslots)
+{
+    return SHM_SLOTS_OFFSET + nslots * (sizeof(struct shm_slot) + sizeof(uint32_t));
+}
+
+static inline struct shm_slot *shm_slot(void *map, unsigned int index)
+{
+    return (struct shm_slot *)((char *)map + SHM_SLOTS_OFFSET) + index;
+}
+
+/* order[n % nslots]: the slot frame n was published in */
+static inline uint32_t *shm_order(void *map)
+{
+    struct shm_ring_header *h = map;
+
+    return (uint32_t *)((char *)map + SHM_SLOTS_OFFSET + h->nslots * sizeof(struct shm_slot));
+}
+
+static inline const char *shm_slot_data(void *map, unsigned int index)
+{
+    struct shm_ring_header *h = map;
+
+    return (const char *)map + h->data_offset + index * (uint64_t)h->slot_stride;
+}
+
+#endif /* SHM_PROTOCOL_H */
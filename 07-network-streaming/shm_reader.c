@@ -0,0 +1,253 @@
+/*
+ * shm_reader.c - Same-host consumer for frame_streamer --shm
+ *
+ * Attaches to the streamer's Unix socket, maps the shared frame ring it
+ * receives and reads every frame in place (no copy, no socket read),
+ * checking the slot seqlock to detect frames overwritten mid-read.
+ * The byte it sends once mapped is what lets --wait-clients start capture.
+ *
+ * Usage: ./shm_reader [socket_path] [frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "shm_protocol.h"
+
+#define DEFAULT_SOCKET "/tmp/frame_streamer.sock"
+
+static uint64_t realtime_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Receive the hello message and the memfd + eventfd that come with it */
+static int attach(const char *path, int *memfd, int *efd, uint64_t *map_size)
+{
+    struct sockaddr_un addr;
+    struct shm_hello hello;
+    union {
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+        struct cmsghdr align;
+    } ctrl;
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int fds[2];
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Connect failed");
+        close(fd);
+        return -1;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    if (recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(hello) ||
+        hello.magic != SHM_MAGIC || hello.version != SHM_VERSION) {
+        fprintf(stderr, "Unexpected hello from %s\n", path);
+        close(fd);
+        return -1;
+    }
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        fprintf(stderr, "No file descriptors in hello\n");
+        close(fd);
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    *memfd = fds[0];
+    *efd = fds[1];
+    *map_size = hello.map_size;
+
+    // Keep the socket open: closing it is how the streamer sees us leave
+    return fd;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [socket_path] [frames]\n", prog);
+    printf("  socket_path           frame_streamer --shm socket (default %s)\n",
+           DEFAULT_SOCKET);
+    printf("  frames                stop after N frames, 0 = until the stream ends (default 0)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : DEFAULT_SOCKET;
+    int max_frames = 0;
+    struct shm_ring_header *hdr;
+    struct pollfd pfd;
+    uint64_t map_size, next, published, counter;
+    unsigned long frames = 0, lapped = 0, invalid = 0;
+    double latency_sum = 0, latency_max = 0;
+    void *map;
+    int sock, memfd, efd;
+
+    if (argc > 1 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help"))) {
+        usage(argv[0]);
+        return 0;
+    }
+    if (argc > 3 || (argc > 1 && argv[1][0] == '-')) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (argc > 2) {
+        char *end;
+        long n;
+
+        errno = 0;
+        n = strtol(argv[2], &end, 10);
+        if (errno || end == argv[2] || *end || n < 0 || n > INT32_MAX) {
+            fprintf(stderr, "Invalid frame count: %s\n", argv[2]);
+            return 1;
+        }
+        max_frames = (int)n;
+    }
+
+    sock = attach(path, &memfd, &efd, &map_size);
+    if (sock < 0)
+        return 1;
+
+    // Read-only: the streamer is the only writer
+    map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, memfd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap failed");
+        return 1;
+    }
+    hdr = map;
+    if (hdr->magic != SHM_MAGIC || hdr->map_size != map_size ||
+        shm_control_size(hdr->nslots) > hdr->data_offset ||
+        hdr->data_offset + (uint64_t)hdr->nslots * hdr->slot_stride > map_size) {
+        fprintf(stderr, "Bad shared ring header\n");
+        return 1;
+    }
+    printf("✓ Attached to %s: %u slots x %u bytes\n", path, hdr->nslots,
+           hdr->data_capacity);
+
+    // Start from the newest complete frame (frame 0 if none is out yet)
+    published = __atomic_load_n(&hdr->published, __ATOMIC_ACQUIRE);
+    next = published ? published - 1 : 0;
+
+    // Mapped and positioned: tell the streamer it may start
+    if (send(sock, "", 1, MSG_NOSIGNAL) != 1) {
+        perror("Failed to signal the streamer");
+        return 1;
+    }
+    pfd.fd = efd;
+    pfd.events = POLLIN;
+
+    while (max_frames == 0 || frames < (unsigned long)max_frames) {
+        published = __atomic_load_n(&hdr->published, __ATOMIC_ACQUIRE);
+
+        if (next == published) {
+            if (__atomic_load_n(&hdr->closed, __ATOMIC_ACQUIRE))
+                break;
+            if (poll(&pfd, 1, 1000) < 0 && errno != EINTR) {
+                perror("Poll failed");
+                break;
+            }
+            if (read(efd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+                perror("eventfd read failed");
+                break;
+            }
+            continue;
+        }
+
+        // Fell more than a ring behind: those frames are gone
+        if (published - next > hdr->nslots) {
+            lapped += published - next - hdr->nslots;
+            next = published - hdr->nslots;
+        }
+
+        for (; next < published && (max_frames == 0 || frames < (unsigned long)max_frames);
+             next++) {
+            uint32_t index = __atomic_load_n(&shm_order(map)[next % hdr->nslots],
+                                             __ATOMIC_RELAXED);
+            const struct shm_slot *s;
+            uint64_t want = 2 * next + 2;
+            uint64_t lock;
+            struct frame_header fh;
+            const uint16_t *px;
+            uint64_t sum = 0;
+            size_t i, samples;
+            double latency_ms;
+
+            if (index >= hdr->nslots) {
+                invalid++;
+                continue;
+            }
+            // The slot's lock names the frame it holds: a stale order entry fails here
+            s = shm_slot(map, index);
+            lock = __atomic_load_n(&s->lock, __ATOMIC_ACQUIRE);
+            if (lock != want) {
+                lapped++;
+                continue;
+            }
+
+            // Work on the frame where it lies: here, a mean over all samples
+            fh = s->hdr;
+            if (frame_header_valid(&fh) < 0 || fh.payload_len > hdr->data_capacity) {
+                invalid++;
+                continue;
+            }
+            px = (const uint16_t *)shm_slot_data(map, index);
+            samples = fh.payload_len / 2;
+            for (i = 0; i < samples; i++)
+                sum += px[i];
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&s->lock, __ATOMIC_RELAXED) != want) {
+                lapped++;   // overwritten while we were reading it
+                continue;
+            }
+
+            latency_ms = (realtime_ns() - fh.timestamp_ns) / 1e6;
+            latency_sum += latency_ms;
+            if (latency_ms > latency_max)
+                latency_max = latency_ms;
+            frames++;
+            printf("[%u] %ux%u, %u bytes%s, mean %.1f, latency %.3f ms\n",
+                   fh.sequence, fh.width, fh.height, fh.payload_len,
+                   (fh.flags & FRAME_FLAG_RC12) ? " RC12" : "",
+                   samples ? (double)sum / samples : 0.0, latency_ms);
+        }
+    }
+
+    printf("\n✓ Read %lu frames in place, %lu lapped, %lu invalid", frames, lapped, invalid);
+    if (frames)
+        printf(", latency avg %.3f ms, max %.3f ms", latency_sum / frames, latency_max);
+    printf("\n");
+
+    munmap(map, map_size);
+    close(memfd);
+    close(efd);
+    close(sock);
+    return 0;
+}
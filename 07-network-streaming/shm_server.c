@@ -0,0 +1,358 @@
+// shm_server.c - memfd frame ring for same-host consumers (see shm_server.h)
+//
+// Compared with TCP over loopback (copy into socket buffers, copy out in
+// the receiver, two trips through the socket stack) a frame costs no copy
+// at all: the capture thread reads it into a ring slot that is already
+// shared, and publishing it writes a 64-byte slot header, the order entry
+// and one eventfd per consumer. Consumers never block the producer: a
+// reader still on a slot that capture reuses sees the seqlock change and
+// skips ahead.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "probes.h"
+#include "shm_server.h"
+
+#define MAX_EVENTS 16
+
+static int listen_unix(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Unix socket creation failed");
+        return -1;
+    }
+
+    unlink(path);   // stale socket from an earlier run
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        perror("Unix socket bind/listen failed");
+        close(fd);
+        return -1;
+    }
+    printf("✓ Listening on %s (shared memory)\n", path);
+    return fd;
+}
+
+size_t shm_server_reserve(int depth)
+{
+    return shm_control_size(depth);
+}
+
+int shm_server_init(struct shm_server *srv, const char *path, struct frame_ring *ring)
+{
+    struct buffer_pool *pool = &ring->pool;
+    struct epoll_event ev;
+
+    memset(srv, 0, sizeof(*srv));
+    srv->listen_fd = -1;
+    srv->epoll_fd = -1;
+    srv->ring = ring;
+    snprintf(srv->path, sizeof(srv->path), "%s", path);
+
+    if (pool->fd < 0 || ring->depth > 0xffff || pool->stride > UINT32_MAX ||
+        pool->reserve < shm_control_size(ring->depth)) {
+        fprintf(stderr, "Invalid shared ring geometry\n");
+        return -1;
+    }
+    // Consumers may rely on the size they were told: forbid resizing
+    fcntl(pool->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    srv->map = pool->map;
+    srv->hdr = srv->map;
+    srv->hdr->magic = SHM_MAGIC;
+    srv->hdr->version = SHM_VERSION;
+    srv->hdr->nslots = ring->depth;
+    srv->hdr->slot_stride = pool->stride;
+    srv->hdr->data_capacity = ring->frame_size;
+    srv->hdr->data_offset = pool->base - pool->map;
+    srv->hdr->map_size = pool->map_size;
+
+    srv->listen_fd = listen_unix(path);
+    if (srv->listen_fd < 0)
+        goto fail;
+
+    srv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (srv->epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        goto fail;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &srv->listen_fd;
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->listen_fd, &ev) < 0)
+        goto fail_ctl;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &ring->notify_fd;
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, ring->notify_fd, &ev) < 0)
+        goto fail_ctl;
+
+    printf("✓ Shared ring: %d slots x %zu bytes (%zu KB memfd), captured in place\n",
+           ring->depth, pool->stride, pool->map_size / 1024);
+    return 0;
+
+fail_ctl:
+    perror("epoll_ctl failed");
+fail:
+    shm_server_destroy(srv);
+    return -1;
+}
+
+/* Hand the memfd and a fresh eventfd to a new consumer */
+static int send_handles(int fd, int memfd, int efd, size_t map_size)
+{
+    struct shm_hello hello = {
+        .magic = SHM_MAGIC,
+        .version = SHM_VERSION,
+        .map_size = map_size,
+    };
+    union {
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+        struct cmsghdr align;
+    } ctrl;
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int fds[2] = { memfd, efd };
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&ctrl, 0, sizeof(ctrl));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    return sendmsg(fd, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(hello) ? 0 : -1;
+}
+
+static void accept_consumers(struct shm_server *srv)
+{
+    struct epoll_event ev;
+    struct shm_consumer *c;
+    int fd, efd;
+
+    for (;;) {
+        fd = accept4(srv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("Accept failed");
+            return;
+        }
+
+        c = calloc(1, sizeof(*c));
+        efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (!c || efd < 0 ||
+            send_handles(fd, srv->ring->pool.fd, efd, srv->ring->pool.map_size) < 0) {
+            perror("Failed to set up shared-memory consumer");
+            goto drop;
+        }
+
+        // The consumer's one byte, then only its hangup
+        c->fd = fd;
+        c->efd = efd;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            goto drop;
+        }
+
+        c->next = srv->consumers;
+        srv->consumers = c;
+        srv->nconsumers++;
+        continue;
+
+drop:
+        if (efd >= 0)
+            close(efd);
+        free(c);
+        close(fd);
+    }
+}
+
+static void remove_consumer(struct shm_server *srv, struct shm_consumer *c)
+{
+    int was_ready = c->ready;
+    struct shm_consumer **pp;
+
+    for (pp = &srv->consumers; *pp; pp = &(*pp)->next) {
+        if (*pp == c) {
+            *pp = c->next;
+            break;
+        }
+    }
+    epoll_ctl(srv->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    close(c->efd);
+    free(c);
+    srv->nconsumers--;
+    if (was_ready) {
+        srv->nready--;
+        printf("✓ Shared-memory consumer detached (%d attached)\n", srv->nready);
+    }
+}
+
+/* The consumer mapped the ring (its byte arrived) or went away */
+static void consumer_event(struct shm_server *srv, struct shm_consumer *c)
+{
+    char byte;
+    ssize_t n = recv(c->fd, &byte, sizeof(byte), 0);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return;
+    if (n <= 0) {
+        remove_consumer(srv, c);
+        return;
+    }
+    if (c->ready)
+        return;
+
+    c->ready = 1;
+    srv->nready++;
+    printf("✓ Shared-memory consumer attached (%d attached)\n", srv->nready);
+    if (!srv->started && srv->nready >= srv->min_consumers) {
+        srv->started = 1;
+        if (srv->on_ready)
+            srv->on_ready(srv->arg);
+    }
+}
+
+static void notify_consumers(struct shm_server *srv)
+{
+    struct shm_consumer *c;
+    uint64_t one = 1;
+
+    // A full counter (EAGAIN) still leaves the consumer readable
+    for (c = srv->consumers; c; c = c->next)
+        if (write(c->efd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            perror("eventfd write failed");
+}
+
+void shm_server_claim(struct shm_server *srv, const struct frame_slot *slot)
+{
+    struct shm_slot *s = shm_slot(srv->map, slot->index);
+    uint64_t lock = __atomic_load_n(&s->lock, __ATOMIC_RELAXED);
+
+    // Odd until publish(); the fence keeps it ahead of the frame's writes
+    __atomic_store_n(&s->lock, lock | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/*
+ * Make the frame captured into slot visible as frame n. Its payload is
+ * already in the shared buffer and its seqlock odd (shm_server_claim()):
+ * only the header is copied.
+ */
+static void publish(struct shm_server *srv, struct frame_slot *slot)
+{
+    uint64_t n = srv->frames_published;
+    struct shm_slot *s = shm_slot(srv->map, slot->index);
+
+    PROBE_SEND_START(slot->frame_no, -1, sizeof(s->hdr) + slot->len);
+    s->hdr = slot->hdr;
+    // No room for extensions in front of the payload: --trace covers TCP
+    s->hdr.header_len = sizeof(s->hdr);
+    s->hdr.flags &= ~(FRAME_FLAG_TRACE | FRAME_FLAG_STREAM);
+    __atomic_store_n(&shm_order(srv->map)[n % srv->hdr->nslots], slot->index,
+                     __ATOMIC_RELAXED);
+
+    __atomic_store_n(&s->lock, 2 * n + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&srv->hdr->published, n + 1, __ATOMIC_RELEASE);
+    srv->frames_published++;
+    PROBE_SEND_DONE(slot->frame_no, -1, sizeof(s->hdr) + slot->len);
+    stats_sent(srv->stats, sizeof(s->hdr) + slot->len);
+}
+
+int shm_server_run(struct shm_server *srv)
+{
+    struct epoll_event events[MAX_EVENTS];
+    struct frame_slot *slot;
+    int drained = 0;
+    int i, n, published;
+    uint64_t counter;
+
+    while (!drained) {
+        n = epoll_wait(srv->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno != EINTR) {
+                perror("epoll_wait failed");
+                return -1;
+            }
+            // Interrupted before streaming ever started: nothing to drain
+            if (srv->stop && *srv->stop && !srv->started)
+                break;
+            continue;
+        }
+
+        for (i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+
+            if (ptr == &srv->listen_fd) {
+                accept_consumers(srv);
+            } else if (ptr == &srv->ring->notify_fd) {
+                if (read(srv->ring->notify_fd, &counter, sizeof(counter)) < 0 &&
+                    errno != EAGAIN)
+                    perror("eventfd read failed");
+
+                // One wakeup per batch, however many frames it holds
+                published = 0;
+                while ((slot = ring_try_consume(srv->ring, &drained)) != NULL) {
+                    publish(srv, slot);
+                    ring_release(srv->ring, slot);
+                    published++;
+                }
+                if (published)
+                    notify_consumers(srv);
+            } else {
+                consumer_event(srv, ptr);
+            }
+        }
+    }
+
+    // Tell consumers the stream is over so they can exit once caught up
+    __atomic_store_n(&srv->hdr->closed, 1, __ATOMIC_RELEASE);
+    notify_consumers(srv);
+    printf("✓ Published %lu frames to shared memory\n", srv->frames_published);
+    return 0;
+}
+
+void shm_server_destroy(struct shm_server *srv)
+{
+    while (srv->consumers)
+        remove_consumer(srv, srv->consumers);
+
+    if (srv->epoll_fd >= 0)
+        close(srv->epoll_fd);
+    if (srv->listen_fd >= 0) {
+        close(srv->listen_fd);
+        unlink(srv->path);
+    }
+    // The memfd and its mapping belong to the ring
+    srv->epoll_fd = -1;
+    srv->listen_fd = -1;
+}
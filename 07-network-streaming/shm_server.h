@@ -0,0 +1,63 @@
+// shm_server.h - Same-host transport: the frame ring's buffers live in a
+// memfd (shm_protocol.h) that local consumers map and read in place
+#ifndef SHM_SERVER_H
+#define SHM_SERVER_H
+
+#include <signal.h>
+#include <stddef.h>
+
+#include "frame_ring.h"
+#include "shm_protocol.h"
+#include "stream_stats.h"
+
+/* A connected consumer: its Unix socket and the eventfd it was given */
+struct shm_consumer {
+    int fd;
+    int efd;
+    int ready;                      // sent its byte: the ring is mapped
+    struct shm_consumer *next;
+};
+
+struct shm_server {
+    int listen_fd;                  // Unix SOCK_SEQPACKET socket at path
+    int epoll_fd;
+    char path[108];
+    struct frame_ring *ring;        // its pool is the memfd
+
+    void *map;                      // ring->pool.map, header first
+    struct shm_ring_header *hdr;
+
+    int min_consumers;              // streaming starts once this many mapped the ring
+    void (*on_ready)(void *arg);
+    void *arg;
+    int started;
+    volatile sig_atomic_t *stop;    // set by the SIGINT handler
+
+    struct shm_consumer *consumers;
+    int nconsumers;
+    int nready;
+    unsigned long frames_published;
+    struct stream_stats *stats;     // periodic summary counters, or NULL
+};
+
+/* The 'reserve' to give ring_init_shared() for a ring of depth slots */
+size_t shm_server_reserve(int depth);
+
+/*
+ * Describe ring (from ring_init_shared()) in its memfd, one shared slot
+ * per ring slot, and listen on the Unix socket 'path'. Returns 0 or -1.
+ */
+int shm_server_init(struct shm_server *srv, const char *path, struct frame_ring *ring);
+
+/*
+ * Capture side, before anything is written to slot->data: consumers still
+ * reading the slot's previous frame see it change and discard what they read
+ */
+void shm_server_claim(struct shm_server *srv, const struct frame_slot *slot);
+
+/* Publish frames until the ring is closed and drained. Returns 0 or -1. */
+int shm_server_run(struct shm_server *srv);
+
+void shm_server_destroy(struct shm_server *srv);
+
+#endif /* SHM_SERVER_H */
@@ -0,0 +1,87 @@
+// stream_stats.c - Periodic summary reporter (see stream_stats.h)
+#include <stdio.h>
+#include <time.h>
+
+#include "stream_stats.h"
+#include "thread_sched.h"
+
+static double elapsed_s(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static unsigned long long load(const unsigned long long *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/* One line per interval: rates since the previous line, totals so far */
+static void *stats_thread(void *arg)
+{
+    struct stream_stats *st = arg;
+    struct timespec step = { 0, 100000000 };
+    unsigned long long last_frames = 0, last_read = 0, last_sent = 0;
+    double last = 0, next = st->interval;
+
+    // Keep off the CPUs the capture and send threads are pinned to
+    thread_sched_housekeeping();
+    while (!st->done) {
+        unsigned long long frames, bytes_read, bytes_sent;
+        double now, dt;
+
+        // Short sleeps so stats_stop() does not wait a whole interval
+        nanosleep(&step, NULL);
+        now = elapsed_s(&st->start);
+        if (now < next)
+            continue;
+
+        frames = load(&st->frames_read);
+        bytes_read = load(&st->bytes_read);
+        bytes_sent = load(&st->bytes_sent);
+        dt = now - last;
+        printf("[%6.1f s] %llu frames (%.1f fps, %.1f MB/s), %llu dropped, "
+               "%llu sent (%.1f MB/s)",
+               now, frames, (frames - last_frames) / dt,
+               (bytes_read - last_read) / dt / 1e6, load(&st->frames_dropped),
+               load(&st->frames_sent), (bytes_sent - last_sent) / dt / 1e6);
+        if (st->pace_mbit > 0)
+            printf(", paced at %.0f Mbit/s (%s)", st->pace_mbit, st->pace_mode);
+        printf("\n");
+        fflush(stdout);
+
+        last_frames = frames;
+        last_read = bytes_read;
+        last_sent = bytes_sent;
+        last = now;
+        next += st->interval;
+    }
+    return NULL;
+}
+
+int stats_start(struct stream_stats *st, int interval)
+{
+    clock_gettime(CLOCK_MONOTONIC, &st->start);
+    st->interval = interval;
+    st->done = 0;
+    if (interval <= 0)
+        return 0;
+
+    if (pthread_create(&st->tid, NULL, stats_thread, st) != 0) {
+        perror("Failed to start stats thread");
+        return -1;
+    }
+    st->running = 1;
+    return 0;
+}
+
+void stats_stop(struct stream_stats *st)
+{
+    if (!st->running)
+        return;
+    st->done = 1;
+    pthread_join(st->tid, NULL);
+    st->running = 0;
+}
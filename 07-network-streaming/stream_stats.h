@@ -0,0 +1,71 @@
+// stream_stats.h - Counters behind frame_streamer's periodic summary line
+//
+// Per-frame printf() costs more than the rest of the send path at high
+// frame rates, so by default the streamer only prints one line every
+// --stats seconds from a reporter thread. The capture and send paths bump
+// the counters with relaxed atomics; they never take a lock or block on
+// the terminal.
+#ifndef STREAM_STATS_H
+#define STREAM_STATS_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct stream_stats {
+    unsigned long long frames_read;     // frames taken from the source
+    unsigned long long bytes_read;      // their payload as queued (after RC12)
+    unsigned long long frames_dropped;  // ring full
+    unsigned long long frames_sent;     // frame deliveries, per client
+    unsigned long long bytes_sent;
+    double pace_mbit;                   // --pace cap per client, 0 = off
+    const char *pace_mode;              // who enforces it
+
+    /* Reporter thread */
+    int interval;                       // seconds, 0 = never started
+    int running;
+    volatile int done;
+    pthread_t tid;
+    struct timespec start;
+};
+
+static inline void stats_read(struct stream_stats *st, unsigned long long bytes)
+{
+    if (!st)
+        return;
+    __atomic_add_fetch(&st->frames_read, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&st->bytes_read, bytes, __ATOMIC_RELAXED);
+}
+
+static inline void stats_dropped(struct stream_stats *st)
+{
+    if (st)
+        __atomic_add_fetch(&st->frames_dropped, 1, __ATOMIC_RELAXED);
+}
+
+static inline void stats_sent(struct stream_stats *st, unsigned long long bytes)
+{
+    if (!st)
+        return;
+    __atomic_add_fetch(&st->frames_sent, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&st->bytes_sent, bytes, __ATOMIC_RELAXED);
+}
+
+/*
+ * Start printing a summary every interval seconds (0 = quiet, nothing is
+ * started). Returns 0 or -1.
+ */
+int stats_start(struct stream_stats *st, int interval);
+
+/* Stop the reporter, if any */
+void stats_stop(struct stream_stats *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STREAM_STATS_H */
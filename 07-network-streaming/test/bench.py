@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+# End-to-end loopback benchmark: starts frame_streamer with the chosen
+# source, connects N frame_receiver processes to it and sweeps resolution,
+# frame rate and client count. Each run reports throughput, CPU time per
+# frame (streamer and receivers, from rusage) and the latency distribution;
+# the whole sweep is written as one JSON report.
+#
+#   make bench                                   # default sweep
+#   python3 test/bench.py --res 640x480 --fps 0 --clients 1,4 --compress
+import argparse
+import datetime
+import json
+import os
+import platform
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+MODULE = os.path.dirname(HERE)
+PORT = 8080                             # fixed in frame_streamer.c
+
+
+def csv(kind):
+    return lambda s: [kind(x) for x in s.split(',') if x]
+
+
+def listening(port):
+    """True once something listens on the TCP port (connecting would count as a client)"""
+    for table in ('/proc/net/tcp', '/proc/net/tcp6'):
+        try:
+            with open(table) as f:
+                next(f)
+                for line in f:
+                    fields = line.split()
+                    if int(fields[1].rsplit(':', 1)[1], 16) == port and fields[3] == '0A':
+                        return True
+        except OSError:
+            pass
+    return False
+
+
+def git_rev():
+    try:
+        return subprocess.run(['git', 'rev-parse', '--short', 'HEAD'], cwd=MODULE,
+                              capture_output=True, text=True, timeout=5).stdout.strip()
+    except (OSError, subprocess.SubprocessError):
+        return ''
+
+
+def run_point(args, res, fps, clients, logdir):
+    spec = args.source
+    if res is not None:
+        spec = f'synthetic:{res}@{fps:g}'
+    cmd = [args.streamer, '-n', str(args.frames), '--source', spec,
+           '-w', str(clients), '-c', str(max(clients, 16)),
+           '-p', args.drop_policy, '-d', str(args.ring_depth)]
+    if fps == 0:
+        cmd.append('--max-rate')
+    if args.compress:
+        cmd.append('--compress')
+    cmd += args.streamer_arg
+
+    name = f'{spec.replace(":", "_").replace("/", "_")}_c{clients}'
+    log = open(os.path.join(logdir, name + '.log'), 'w')
+    streamer = subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT)
+    deadline = time.monotonic() + 5
+    while not listening(PORT):
+        if streamer.poll() is not None or time.monotonic() > deadline:
+            streamer.kill()
+            log.close()
+            return {'error': f'streamer did not start, see {log.name}'}
+        time.sleep(0.02)
+
+    recv_cmd = [args.receiver, '--json', '-p', str(PORT)]
+    if args.compress and args.decode:
+        recv_cmd.append('--decode')
+    receivers = [subprocess.Popen(recv_cmd, stdout=subprocess.PIPE, text=True)
+                 for _ in range(clients)]
+
+    results = []
+    for r in receivers:
+        try:
+            out, _ = r.communicate(timeout=args.timeout)
+            results.append(json.loads(out.strip().splitlines()[-1]))
+        except (subprocess.TimeoutExpired, ValueError, IndexError):
+            r.kill()
+            results.append(None)
+
+    # wait4() rather than wait(): the streamer's CPU time comes with it
+    deadline = time.monotonic() + 10
+    pid, status, ru = os.wait4(streamer.pid, os.WNOHANG)
+    while pid == 0 and time.monotonic() < deadline:
+        time.sleep(0.05)
+        pid, status, ru = os.wait4(streamer.pid, os.WNOHANG)
+    if pid == 0:
+        streamer.kill()
+        _, status, ru = os.wait4(streamer.pid, 0)
+    streamer.returncode = status
+    log.close()
+
+    good = [r for r in results if r]
+    if not good:
+        return {'error': f'no receiver finished, see {log.name}'}
+
+    frames = max(r['frames'] for r in good)
+    streamer_cpu = (ru.ru_utime + ru.ru_stime) * 1e3
+    return {
+        'frames': frames,
+        'fps': min(r['fps'] for r in good),
+        'mb_per_s_total': round(sum(r['mb_per_s'] for r in good), 2),
+        'dropped': sum(r['dropped'] for r in good),
+        'receivers_failed': len(results) - len(good),
+        'latency_us': {
+            # Worst receiver for each percentile
+            k: max(r['latency_us'][k] for r in good)
+            for k in ('p50', 'p90', 'p99', 'p99_9', 'max')
+        },
+        'streamer_cpu_ms': round(streamer_cpu, 1),
+        'streamer_cpu_ms_per_frame': round(streamer_cpu / frames, 4) if frames else None,
+        'receiver_cpu_ms_per_frame': round(max(r['cpu_ms_per_frame'] for r in good), 4),
+        'streamer_ctx_switches': ru.ru_nvcsw + ru.ru_nivcsw,
+        'receivers': results,
+    }
+
+
+def main():
+    ap = argparse.ArgumentParser(description='frame_streamer loopback benchmark')
+    ap.add_argument('--source', default='synthetic',
+                    help='synthetic (swept), device[:PATH] or replay:FILE (not swept)')
+    ap.add_argument('--res', type=csv(str), default=csv(str)('640x480,1280x720,1920x1080'),
+                    help='resolutions to sweep (synthetic only)')
+    ap.add_argument('--fps', type=csv(float), default=csv(float)('30,0'),
+                    help='frame rates to sweep, 0 = as fast as possible (synthetic only)')
+    ap.add_argument('--clients', type=csv(int), default=csv(int)('1,2,4'))
+    ap.add_argument('--frames', type=int, default=300, help='frames per run')
+    ap.add_argument('--compress', action='store_true', help='stream RC12')
+    ap.add_argument('--decode', action='store_true', help='receivers decode RC12')
+    ap.add_argument('--drop-policy', default='block',
+                    help='streamer ring policy; block measures the sustainable rate')
+    ap.add_argument('--ring-depth', type=int, default=8)
+    ap.add_argument('--streamer-arg', action='append', default=[],
+                    help='extra frame_streamer argument (repeatable)')
+    ap.add_argument('--streamer', default=os.path.join(MODULE, 'frame_streamer'))
+    ap.add_argument('--receiver', default=os.path.join(MODULE, 'frame_receiver'))
+    ap.add_argument('--timeout', type=float, default=120, help='seconds per run')
+    ap.add_argument('--out', default='bench_report.json')
+    args = ap.parse_args()
+
+    for exe in (args.streamer, args.receiver):
+        if not os.access(exe, os.X_OK):
+            sys.exit(f'{exe} not found, run make first')
+    if listening(PORT):
+        sys.exit(f'port {PORT} is busy')
+
+    if args.source == 'synthetic':
+        points = [(r, f) for r in args.res for f in args.fps]
+    else:
+        points = [(None, None)]
+
+    logdir = tempfile.mkdtemp(prefix='frame_bench_')
+    runs = []
+    print(f"{'resolution':>10} {'fps':>6} {'clients':>7} | {'fps':>8} {'MB/s':>8} "
+          f"{'drop':>5} | {'p50 us':>8} {'p99 us':>8} | {'cpu ms/frame':>12}")
+    for res, fps in points:
+        for clients in args.clients:
+            r = run_point(args, res, fps, clients, logdir)
+            r.update({'source': args.source, 'resolution': res, 'target_fps': fps,
+                      'clients': clients, 'compress': args.compress})
+            runs.append(r)
+            rate = '-' if fps is None else 'max' if fps == 0 else f'{fps:g}'
+            label = f"{res or '-':>10} {rate:>6} {clients:>7}"
+            if 'error' in r:
+                print(f"{label} | {r['error']}")
+                continue
+            print(f"{label} | {r['fps']:>8.1f} {r['mb_per_s_total']:>8.1f} {r['dropped']:>5} | "
+                  f"{r['latency_us']['p50']:>8.0f} {r['latency_us']['p99']:>8.0f} | "
+                  f"{r['streamer_cpu_ms_per_frame']:>6.3f} + {r['receiver_cpu_ms_per_frame']:.3f}")
+
+    report = {
+        'date': datetime.datetime.now().isoformat(timespec='seconds'),
+        'host': platform.node(),
+        'kernel': platform.release(),
+        'machine': platform.machine(),
+        'cpus': os.cpu_count(),
+        'git': git_rev(),
+        'frames_per_run': args.frames,
+        'drop_policy': args.drop_policy,
+        'runs': runs,
+    }
+    with open(args.out, 'w') as f:
+        json.dump(report, f, indent=2)
+    print(f'\nReport: {args.out} (streamer logs in {logdir})')
+    return 1 if any('error' in r for r in runs) else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+# Minimal frame_streamer client: validates the frame header
+# (frame_protocol.h), detects sequence gaps and prints capture->receive latency.
+# RC12-compressed frames (frame_streamer --compress) are saved as .rc12;
+# ./codec_test -d frame_001.rc12 frame_001.raw decodes them.
+import argparse
+import socket
+import struct
+import time
+
+HEADER = struct.Struct('<IHHHHHHIIQ')   # 32 bytes, see frame_protocol.h
+FRAME_MAGIC = 0x4d524643
+FRAME_PROTO_VERSION = 1
+FRAME_FLAG_RC12 = 1 << 0
+
+
+def recv_exact(sock, n):
+    buf = bytearray(n)
+    view = memoryview(buf)
+    got = 0
+    while got < n:
+        r = sock.recv_into(view[got:], n - got)
+        if r == 0:
+            return None
+        got += r
+    return buf
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--host', default='127.0.0.1')
+    ap.add_argument('--port', type=int, default=8080)
+    ap.add_argument('--save', action='store_true', help='write frame_XXX.raw files')
+    args = ap.parse_args()
+
+    sock = socket.create_connection((args.host, args.port))
+    print(f"Connected to {args.host}:{args.port}")
+
+    frames = gaps = 0
+    last_seq = None
+    while True:
+        raw = recv_exact(sock, HEADER.size)
+        if raw is None:
+            break
+        (magic, version, header_len, width, height, pix_fmt, flags,
+         seq, payload_len, ts_ns) = HEADER.unpack(raw)
+        if magic != FRAME_MAGIC or version != FRAME_PROTO_VERSION or header_len < HEADER.size:
+            print(f"Bad header (magic 0x{magic:08x}, version {version}), stream out of sync")
+            break
+        if header_len > HEADER.size and recv_exact(sock, header_len - HEADER.size) is None:
+            break
+        payload = recv_exact(sock, payload_len)
+        if payload is None:
+            print("Connection closed mid-frame")
+            break
+        latency_ms = (time.time_ns() - ts_ns) / 1e6
+
+        if last_seq is not None and seq != last_seq + 1:
+            gaps += seq - last_seq - 1
+        last_seq = seq
+        frames += 1
+        compressed = flags & FRAME_FLAG_RC12
+        codec = (f" (RC12 {width * height * 2 / max(payload_len, 1):.2f}:1)"
+                 if compressed else "")
+        print(f"[{seq}] {width}x{height} fmt {pix_fmt}, {payload_len} bytes{codec}, "
+              f"latency {latency_ms:.2f} ms")
+        if args.save:
+            ext = 'rc12' if compressed else 'raw'
+            with open(f"frame_{seq:03d}.{ext}", 'wb') as f:
+                f.write(payload)
+
+    print(f"Received {frames} frames, {gaps} missing from sequence")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+# Joins the per-frame stage timestamps written by frame_streamer --trace
+# (send times per client) and frame_receiver --trace (everything else)
+# on (sequence, client_port), then prints the latency of each stage:
+#
+#   synth -> irq -> woken -> read -> queued -> sent -> done -> recv
+#
+# sent is the first byte of the frame handed to the socket, done the last.
+#
+# synth/irq come from the driver (CAMERA_IOC_FRAME_INFO) or, for the
+# synthetic source, synth is the generation time. Stages with a missing
+# (zero) stamp are skipped, so the table shows what the source provides.
+#
+#   python3 test/trace_merge.py streamer.csv rx1.csv [rx2.csv ...]
+#   python3 test/trace_merge.py --budget sent-recv=500 --budget total=5000 ...
+import argparse
+import csv
+import json
+import sys
+
+STAMPS = ['synth_ns', 'irq_ns', 'woken_ns', 'read_ns', 'queued_ns', 'sent_ns', 'done_ns',
+          'recv_ns']
+STAGES = [(a[:-3] + '-' + b[:-3], a, b) for a, b in zip(STAMPS, STAMPS[1:])]
+
+
+def load(path):
+    with open(path, newline='') as f:
+        return list(csv.DictReader(f))
+
+
+def percentile(values, p):
+    # Rounded rank over n - 1, same as frame_receiver's summary
+    return values[min(len(values) - 1, int(p / 100 * (len(values) - 1) + 0.5))]
+
+
+def histogram(values):
+    """Counts per power-of-two microsecond bucket: {upper bound: count}"""
+    buckets = {}
+    for v in values:
+        bound = 1
+        while bound < v:
+            bound *= 2
+        buckets[bound] = buckets.get(bound, 0) + 1
+    return dict(sorted(buckets.items()))
+
+
+def merge(streamer_rows, receiver_rows):
+    sent = {(int(r['sequence']), int(r['client_port'])):
+            (int(r['sent_ns']), int(r.get('done_ns') or 0)) for r in streamer_rows}
+    frames = []
+    for r in receiver_rows:
+        key = (int(r['sequence']), int(r['client_port']))
+        stamps = {k: int(r[k]) for k in STAMPS if k in r}
+        stamps['sent_ns'], stamps['done_ns'] = sent.get(key, (0, 0))
+        frames.append(stamps)
+    return frames
+
+
+def stage_stats(frames):
+    stats = {}
+    for name, a, b in STAGES + [('total', None, 'recv_ns')]:
+        values = []
+        for f in frames:
+            # total runs from the earliest stamp the source provided
+            start = f[a] if a else next((f[k] for k in STAMPS if f[k]), 0)
+            if start and f[b] and f[b] >= start:
+                values.append((f[b] - start) / 1e3)
+        if not values:
+            continue
+        values.sort()
+        stats[name] = {
+            'count': len(values),
+            'p50': round(percentile(values, 50), 1),
+            'p90': round(percentile(values, 90), 1),
+            'p99': round(percentile(values, 99), 1),
+            'max': round(values[-1], 1),
+            'histogram_us': histogram(values),
+        }
+    return stats
+
+
+def print_table(stats, unmatched):
+    print(f"{'stage':<14} {'frames':>7} {'p50 us':>9} {'p90 us':>9} {'p99 us':>9} {'max us':>9}")
+    for name, s in stats.items():
+        print(f"{name:<14} {s['count']:>7} {s['p50']:>9.1f} {s['p90']:>9.1f} "
+              f"{s['p99']:>9.1f} {s['max']:>9.1f}")
+    if unmatched:
+        print(f"\n{unmatched} received frames had no send time "
+              f"(streamer not run with --trace, or not the epoll TCP server)")
+
+    for name, s in stats.items():
+        print(f'\n{name} (us)')
+        peak = max(s['histogram_us'].values())
+        for bound, count in s['histogram_us'].items():
+            print(f"  <= {bound:>8} {count:>7} {'#' * max(1, count * 40 // peak)}")
+
+
+def main():
+    ap = argparse.ArgumentParser(description='per-stage latency from frame traces')
+    ap.add_argument('streamer', help='frame_streamer --trace CSV')
+    ap.add_argument('receivers', nargs='+', help='frame_receiver --trace CSVs')
+    ap.add_argument('--json', action='store_true', help='print the stats as JSON')
+    ap.add_argument('--budget', action='append', default=[], metavar='STAGE=US',
+                    help='fail (exit 1) if the stage p99 exceeds US (repeatable)')
+    args = ap.parse_args()
+
+    budgets = {}
+    for b in args.budget:
+        stage, _, us = b.partition('=')
+        try:
+            budgets[stage] = float(us)
+        except ValueError:
+            sys.exit(f'bad budget {b!r}, expected STAGE=US')
+
+    receiver_rows = [row for path in args.receivers for row in load(path)]
+    frames = merge(load(args.streamer), receiver_rows)
+    if not frames:
+        sys.exit('no traced frames in the receiver logs')
+    stats = stage_stats(frames)
+
+    if args.json:
+        print(json.dumps(stats))
+    else:
+        print_table(stats, sum(1 for f in frames if not f['sent_ns']))
+
+    status = 0
+    for stage, limit in budgets.items():
+        if stage not in stats:
+            print(f'budget {stage}: no samples', file=sys.stderr)
+            status = 1
+        elif stats[stage]['p99'] > limit:
+            print(f"budget {stage}: p99 {stats[stage]['p99']:.1f} us > {limit:g} us",
+                  file=sys.stderr)
+            status = 1
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+# Receiver for frame_streamer --udp: reassembles fragmented frames
+# (frag_header in frame_protocol.h), drops frames still incomplete at the
+# deadline and reports loss statistics, optionally as JSON.
+import argparse
+import json
+import socket
+import struct
+import time
+
+FRAG = struct.Struct('<IIHHII')         # 20 bytes, see frame_protocol.h
+HEADER = struct.Struct('<IHHHHHHIIQ')   # 32 bytes
+FRAG_MAGIC = 0x55524643
+FRAME_MAGIC = 0x4d524643
+FRAME_PROTO_VERSION = 1
+FRAME_FLAG_RC12 = 1 << 0
+SO_RCVBUFFORCE = 33
+
+
+class Partial:
+    def __init__(self, frame_len, frag_count, now):
+        self.buf = bytearray(frame_len)
+        self.have = set()
+        self.frag_count = frag_count
+        self.first_seen = now
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--port', type=int, default=9000)
+    ap.add_argument('--deadline-ms', type=float, default=100.0,
+                    help='drop a frame this long after its first fragment')
+    ap.add_argument('--idle', type=float, default=2.0,
+                    help='stop after this many seconds without datagrams')
+    ap.add_argument('--json', action='store_true', help='print stats as JSON')
+    ap.add_argument('--save', action='store_true', help='write complete frames to disk')
+    args = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    # A whole frame arrives as one burst: the default 208 KB is too small
+    try:
+        sock.setsockopt(socket.SOL_SOCKET, SO_RCVBUFFORCE, 8 << 20)
+    except OSError:
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 8 << 20)
+    rcvbuf = sock.getsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF)
+    sock.bind(('0.0.0.0', args.port))
+    sock.settimeout(0.01)
+    print(f"Listening on UDP port {args.port} (SO_RCVBUF {rcvbuf} bytes)")
+
+    deadline = args.deadline_ms / 1000.0
+    partial = {}
+    done = set()            # frame ids completed or expired, to spot late fragments
+    stats = dict(frames_complete=0, frames_incomplete=0, frames_missing=0,
+                 datagrams=0, bytes=0, bad_datagrams=0, late_fragments=0,
+                 duplicate_fragments=0, fragments_missing=0, bad_frames=0)
+    latencies = []
+    first_id = last_id = None
+    last_rx = time.monotonic()
+
+    def expire(now, force=False):
+        for fid in [f for f, p in partial.items()
+                    if force or now - p.first_seen > deadline]:
+            p = partial.pop(fid)
+            stats['frames_incomplete'] += 1
+            stats['fragments_missing'] += p.frag_count - len(p.have)
+            done.add(fid)
+            print(f"[{fid}] incomplete: {len(p.have)}/{p.frag_count} fragments, dropped")
+
+    while True:
+        now = time.monotonic()
+        try:
+            data = sock.recv(65536)
+        except socket.timeout:
+            expire(now)
+            if now - last_rx > args.idle and (first_id is not None):
+                break
+            continue
+        except KeyboardInterrupt:
+            break
+        last_rx = now
+
+        if len(data) < FRAG.size:
+            stats['bad_datagrams'] += 1
+            continue
+        magic, fid, idx, count, frame_len, offset = FRAG.unpack_from(data)
+        chunk = memoryview(data)[FRAG.size:]
+        if (magic != FRAG_MAGIC or idx >= count or
+                offset + len(chunk) > frame_len):
+            stats['bad_datagrams'] += 1
+            continue
+        stats['datagrams'] += 1
+        stats['bytes'] += len(data)
+
+        if fid in done:
+            stats['late_fragments'] += 1
+            continue
+        if first_id is None:
+            first_id = fid
+        last_id = fid if last_id is None else max(last_id, fid)
+
+        p = partial.get(fid)
+        if p is None:
+            p = partial[fid] = Partial(frame_len, count, now)
+        if idx in p.have:
+            stats['duplicate_fragments'] += 1
+            continue
+        p.buf[offset:offset + len(chunk)] = chunk
+        p.have.add(idx)
+
+        if len(p.have) == p.frag_count:
+            del partial[fid]
+            done.add(fid)
+            (fmagic, version, header_len, width, height, pix_fmt, flags,
+             seq, payload_len, ts_ns) = HEADER.unpack_from(p.buf)
+            if (fmagic != FRAME_MAGIC or version != FRAME_PROTO_VERSION or
+                    header_len + payload_len != len(p.buf)):
+                print(f"[{fid}] bad frame header after reassembly")
+                stats['bad_frames'] += 1
+                continue
+            latency_ms = (time.time_ns() - ts_ns) / 1e6
+            latencies.append(latency_ms)
+            stats['frames_complete'] += 1
+            print(f"[{seq}] {width}x{height} fmt {pix_fmt}, {payload_len} bytes in "
+                  f"{p.frag_count} fragments, latency {latency_ms:.2f} ms")
+            if args.save:
+                ext = 'rc12' if flags & FRAME_FLAG_RC12 else 'raw'
+                with open(f"frame_{seq:03d}.{ext}", 'wb') as f:
+                    f.write(p.buf[header_len:])
+
+        expire(now)
+
+    expire(time.monotonic(), force=True)
+    if first_id is not None:
+        seen = stats['frames_complete'] + stats['frames_incomplete']
+        stats['frames_missing'] = (last_id - first_id + 1) - seen
+    total = stats['frames_complete'] + stats['frames_incomplete'] + stats['frames_missing']
+    stats['frame_loss_pct'] = round(100.0 * (total - stats['frames_complete']) / total, 2) if total else 0.0
+    if latencies:
+        latencies.sort()
+        stats['latency_ms_p50'] = round(latencies[len(latencies) // 2], 3)
+        stats['latency_ms_max'] = round(latencies[-1], 3)
+
+    if args.json:
+        print(json.dumps(stats))
+    else:
+        print(f"Frames: {stats['frames_complete']} complete, "
+              f"{stats['frames_incomplete']} incomplete (dropped at deadline), "
+              f"{stats['frames_missing']} never seen ({stats['frame_loss_pct']}% lost)")
+        print(f"Datagrams: {stats['datagrams']}, {stats['fragments_missing']} fragments missing, "
+              f"{stats['late_fragments']} late, {stats['duplicate_fragments']} duplicate, "
+              f"{stats['bad_datagrams']} bad")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,205 @@
+// thread_sched.c - CPU pinning and real-time priorities (see thread_sched.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "thread_sched.h"
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static cpu_set_t initial;       // process affinity before any pinning
+static cpu_set_t isolated;      // isolcpus= and nohz_full= CPUs
+static cpu_set_t claimed;       // CPUs a thread has been pinned to
+
+/* Add a sysfs cpulist ("0-3,8,10-11") to set; missing or "(null)" adds nothing */
+static void read_cpulist(const char *path, cpu_set_t *set)
+{
+    char buf[1024], *p, *end;
+    FILE *f = fopen(path, "r");
+    long lo, hi;
+
+    if (!f)
+        return;
+    if (!fgets(buf, sizeof(buf), f))
+        buf[0] = '\0';
+    fclose(f);
+
+    for (p = buf; *p >= '0' && *p <= '9'; p = end + (*end == ',')) {
+        lo = hi = strtol(p, &end, 10);
+        if (*end == '-')
+            hi = strtol(end + 1, &end, 10);
+        for (; lo <= hi && lo < CPU_SETSIZE; lo++)
+            CPU_SET(lo, set);
+    }
+}
+
+static void init_sets(void)
+{
+    if (sched_getaffinity(0, sizeof(initial), &initial) < 0) {
+        long cpu;
+
+        CPU_ZERO(&initial);
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &initial);
+    }
+    CPU_ZERO(&isolated);
+    read_cpulist("/sys/devices/system/cpu/isolated", &isolated);
+    read_cpulist("/sys/devices/system/cpu/nohz_full", &isolated);
+    CPU_ZERO(&claimed);
+}
+
+int parse_thread_sched(const char *spec, struct thread_sched *ts)
+{
+    const char *colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    char *end;
+    long n;
+
+    ts->cpu = SCHED_CPU_ANY;
+    ts->fifo_prio = 0;
+    ts->claimed = 0;
+
+    if (len == 3 && strncmp(spec, "any", 3) == 0) {
+        ts->cpu = SCHED_CPU_ANY;
+    } else if (len == 8 && strncmp(spec, "isolated", 8) == 0) {
+        ts->cpu = SCHED_CPU_ISOLATED;
+    } else {
+        n = strtol(spec, &end, 10);
+        if (len == 0 || end != spec + len || n < 0 || n >= CPU_SETSIZE)
+            return -1;
+        ts->cpu = (int)n;
+    }
+
+    if (colon) {
+        n = strtol(colon + 1, &end, 10);
+        if (colon[1] == '\0' || *end != '\0' || n < 1 || n > 99)
+            return -1;
+        ts->fifo_prio = (int)n;
+    }
+    return 0;
+}
+
+/* Caller holds lock */
+static int pick_isolated(void)
+{
+    int cpu;
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &isolated) && !CPU_ISSET(cpu, &claimed))
+            return cpu;
+    }
+    return -1;
+}
+
+/* Caller holds lock: initial minus isolated and claimed CPUs */
+static int housekeeping_set(cpu_set_t *set)
+{
+    int cpu;
+
+    CPU_ZERO(set);
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &initial) && !CPU_ISSET(cpu, &isolated) &&
+            !CPU_ISSET(cpu, &claimed))
+            CPU_SET(cpu, set);
+    }
+    return CPU_COUNT(set);
+}
+
+void thread_sched_housekeeping(void)
+{
+    cpu_set_t set;
+    int n;
+
+    pthread_once(&once, init_sets);
+    pthread_mutex_lock(&lock);
+    n = CPU_COUNT(&claimed) > 0 ? housekeeping_set(&set) : 0;
+    pthread_mutex_unlock(&lock);
+
+    // Nothing pinned: leave the affinity the process was started with.
+    // Everything claimed: there is nowhere better to go.
+    if (n > 0)
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+void thread_sched_claim(struct thread_sched *ts, const char *name)
+{
+    int cpu = ts->cpu;
+
+    pthread_once(&once, init_sets);
+    if (ts->claimed)
+        return;
+    ts->claimed = 1;
+    if (cpu == SCHED_CPU_ANY)
+        return;
+
+    pthread_mutex_lock(&lock);
+    if (cpu == SCHED_CPU_ISOLATED) {
+        cpu = pick_isolated();
+        if (cpu < 0) {
+            pthread_mutex_unlock(&lock);
+            printf("Note: no free isolated CPU (isolcpus=/nohz_full=), %s not pinned\n",
+                   name);
+            ts->cpu = SCHED_CPU_ANY;
+            return;
+        }
+    } else if (CPU_COUNT(&isolated) > 0 && !CPU_ISSET(cpu, &isolated)) {
+        printf("Note: CPU %d is not isolated, the %s shares it with other tasks\n",
+               cpu, name);
+    }
+    if (CPU_ISSET(cpu, &claimed))
+        printf("Note: CPU %d already runs another pinned thread\n", cpu);
+    CPU_SET(cpu, &claimed);
+    pthread_mutex_unlock(&lock);
+    ts->cpu = cpu;
+}
+
+int thread_sched_apply(struct thread_sched *ts, const char *name)
+{
+    struct sched_param param;
+    cpu_set_t set;
+    int prio = ts->fifo_prio;
+    int cpu, ret;
+
+    thread_sched_claim(ts, name);
+    cpu = ts->cpu;
+    if (cpu == SCHED_CPU_ANY) {
+        thread_sched_housekeeping();
+    } else {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret != 0) {
+            fprintf(stderr, "Failed to pin %s to CPU %d: %s\n", name, cpu, strerror(ret));
+            return -1;
+        }
+    }
+
+    if (prio > 0) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = prio;
+        ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret == EPERM) {
+            printf("Note: SCHED_FIFO needs CAP_SYS_NICE or RLIMIT_RTPRIO, "
+                   "%s stays SCHED_OTHER\n", name);
+            prio = 0;
+        } else if (ret != 0) {
+            fprintf(stderr, "Failed to set SCHED_FIFO for %s: %s\n", name, strerror(ret));
+            return -1;
+        }
+    }
+
+    if (cpu >= 0 || prio > 0) {
+        printf("✓ %s: ", name);
+        if (cpu >= 0)
+            printf("CPU %d%s", cpu, CPU_ISSET(cpu, &isolated) ? " (isolated)" : "");
+        else
+            printf("housekeeping CPUs");
+        if (prio > 0)
+            printf(", SCHED_FIFO %d", prio);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+// thread_sched.h - CPU pinning and SCHED_FIFO for the capture, send and
+// receive threads
+//
+// A thread spec is "CPU[:PRIO]":
+//   CPU    a CPU number, "isolated" (the next free CPU from isolcpus= /
+//          nohz_full=) or "any" (not pinned)
+//   PRIO   1-99 runs the thread SCHED_FIFO at that priority; without it
+//          the thread stays SCHED_OTHER
+//
+// Every CPU a thread is pinned to is claimed: unpinned threads (and
+// helpers like the stats reporter) are moved to the remaining
+// housekeeping CPUs, so nothing else lands on a pinned thread's CPU
+// behind the scheduler's back. Pair it with the driver's
+// housekeeping_cpu parameter to keep the frame timer off them too.
+#ifndef THREAD_SCHED_H
+#define THREAD_SCHED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCHED_CPU_ANY -1
+#define SCHED_CPU_ISOLATED -2
+
+struct thread_sched {
+    int cpu;                // CPU number, SCHED_CPU_ANY or SCHED_CPU_ISOLATED
+    int fifo_prio;          // 0 = SCHED_OTHER
+    int claimed;            // cpu resolved and reserved
+};
+
+/* Parse a spec as above. Returns 0 or -1. */
+int parse_thread_sched(const char *spec, struct thread_sched *ts);
+
+/*
+ * Reserve ts's CPU now (an "isolated" one is picked here) so threads that
+ * start earlier already keep off it. thread_sched_apply() does it too;
+ * claim up front when several threads are configured.
+ */
+void thread_sched_claim(struct thread_sched *ts, const char *name);
+
+/*
+ * Apply ts to the calling thread and print what it got, as 'name'. A CPU
+ * that cannot be used is an error (-1); SCHED_FIFO without the privilege
+ * for it (CAP_SYS_NICE or RLIMIT_RTPRIO) only prints a note.
+ */
+int thread_sched_apply(struct thread_sched *ts, const char *name);
+
+/* Move the calling thread to the housekeeping CPUs (see above), if any CPU is claimed */
+void thread_sched_housekeeping(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* THREAD_SCHED_H */
@@ -0,0 +1,64 @@
+// udp_sender.h - Low-latency UDP transport: frames are fragmented into
+// MTU-sized datagrams (frag_header in frame_protocol.h) and pushed to one
+// receiver, with no retransmission and no head-of-line blocking
+#ifndef UDP_SENDER_H
+#define UDP_SENDER_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "frame_ring.h"
+#include "pacer.h"
+#include "stream_stats.h"
+
+#define UDP_DEFAULT_MTU 1500
+
+struct udp_sender {
+    int fd;
+    struct sockaddr_in dest;
+    size_t datagram_size;           // frag_header + data, every fragment but
+                                    // the last of a frame
+    size_t frag_data;               // wire image bytes per fragment
+    int gso;                        // UDP_SEGMENT: one send per 64 KB batch
+    int gso_segs;                   // fragments per GSO send
+    double loss;                    // simulated loss, 0..1 (testing only)
+    unsigned int seed;
+    struct pacer pacer;             // --pace, rate 0 = line rate
+
+    /* Per-frame scratch, sized for the largest frame the ring holds */
+    int max_frags;
+    struct frag_header *hdrs;
+    struct iovec *iov;
+    struct mmsghdr *msgs;
+
+    unsigned long frames_sent;
+    unsigned long datagrams_sent;
+    unsigned long send_calls;       // sendmmsg() calls
+    unsigned long sim_dropped;      // fragments discarded by the loss shim
+    unsigned long send_errors;      // fragments the kernel refused (ENOBUFS...)
+    unsigned long pace_waits;       // sleeps for the token bucket
+    unsigned long long bytes_sent;
+    struct stream_stats *stats;     // periodic summary counters, or NULL
+};
+
+/*
+ * Create the socket for "host:port". mtu is the link MTU the fragments
+ * must fit in (IPv4 + UDP headers are subtracted); loss_pct drops that
+ * share of fragments before they are sent, to test receivers.
+ */
+int udp_sender_init(struct udp_sender *us, const char *dest, int mtu,
+                    double loss_pct, struct frame_ring *ring);
+
+/*
+ * Cap the stream at mbit: one GSO message at a time through a token
+ * bucket, plus SO_MAX_PACING_RATE so an fq qdisc spreads each message.
+ */
+void udp_sender_pace(struct udp_sender *us, double mbit);
+
+/* Send every frame the ring delivers until it is closed and drained */
+int udp_sender_run(struct udp_sender *us, struct frame_ring *ring);
+
+void udp_sender_destroy(struct udp_sender *us);
+
+#endif /* UDP_SENDER_H */
@@ -0,0 +1,160 @@
+// uring.c - Minimal io_uring wrapper (see uring.h)
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                              unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+int uring_init(struct uring *u, unsigned entries)
+{
+    struct io_uring_params p;
+
+    memset(u, 0, sizeof(*u));
+    memset(&p, 0, sizeof(p));
+
+    u->fd = sys_io_uring_setup(entries, &p);
+    if (u->fd < 0)
+        return -1;
+
+    u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    // Since 5.4 both rings live in one mapping
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_len > u->sq_len)
+            u->sq_len = u->cq_len;
+        u->cq_len = u->sq_len;
+    }
+
+    u->sq_ptr = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ptr == MAP_FAILED)
+        goto fail;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ptr = u->sq_ptr;
+    } else {
+        u->cq_ptr = mmap(NULL, u->cq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_ptr == MAP_FAILED)
+            goto fail_sq;
+    }
+
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED)
+        goto fail_cq;
+
+    u->sq_head = (unsigned *)((char *)u->sq_ptr + p.sq_off.head);
+    u->sq_tail = (unsigned *)((char *)u->sq_ptr + p.sq_off.tail);
+    u->sq_mask = (unsigned *)((char *)u->sq_ptr + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)((char *)u->sq_ptr + p.sq_off.array);
+    u->sq_entries = p.sq_entries;
+    u->sqe_tail = *u->sq_tail;
+
+    u->cq_head = (unsigned *)((char *)u->cq_ptr + p.cq_off.head);
+    u->cq_tail = (unsigned *)((char *)u->cq_ptr + p.cq_off.tail);
+    u->cq_mask = (unsigned *)((char *)u->cq_ptr + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)((char *)u->cq_ptr + p.cq_off.cqes);
+    return 0;
+
+fail_cq:
+    if (u->cq_ptr != u->sq_ptr)
+        munmap(u->cq_ptr, u->cq_len);
+fail_sq:
+    munmap(u->sq_ptr, u->sq_len);
+fail:
+    close(u->fd);
+    u->fd = -1;
+    return -1;
+}
+
+void uring_exit(struct uring *u)
+{
+    if (u->fd < 0)
+        return;
+
+    munmap(u->sqes, u->sqes_len);
+    if (u->cq_ptr != u->sq_ptr)
+        munmap(u->cq_ptr, u->cq_len);
+    munmap(u->sq_ptr, u->sq_len);
+    close(u->fd);
+    u->fd = -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(struct uring *u)
+{
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    struct io_uring_sqe *sqe;
+
+    if (u->sqe_tail - head >= u->sq_entries)
+        return NULL;
+
+    sqe = &u->sqes[u->sqe_tail & *u->sq_mask];
+    // Identity mapping: SQ array slot i always points at SQE i
+    u->sq_array[u->sqe_tail & *u->sq_mask] = u->sqe_tail & *u->sq_mask;
+    u->sqe_tail++;
+
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+unsigned uring_sq_space(struct uring *u)
+{
+    return u->sq_entries - (u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE));
+}
+
+int uring_submit_and_wait(struct uring *u, unsigned wait_nr)
+{
+    unsigned to_submit;
+    int ret;
+
+    // Publish the new tail; the kernel reads SQEs up to it
+    __atomic_store_n(u->sq_tail, u->sqe_tail, __ATOMIC_RELEASE);
+
+    // Counted from the kernel's head so SQEs left over by an interrupted
+    // call are handed in again
+    to_submit = u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+
+    if (to_submit == 0 && wait_nr == 0)
+        return 0;
+
+    u->enters++;
+    ret = sys_io_uring_enter(u->fd, to_submit, wait_nr,
+                             wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    return ret;
+}
+
+struct io_uring_cqe *uring_peek_cqe(struct uring *u)
+{
+    unsigned head = *u->cq_head;
+
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &u->cqes[head & *u->cq_mask];
+}
+
+void uring_cqe_seen(struct uring *u)
+{
+    __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int uring_register(struct uring *u, unsigned opcode, const void *arg,
+                   unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, u->fd, opcode, arg, nr_args);
+}
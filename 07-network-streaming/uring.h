@@ -0,0 +1,61 @@
+// uring.h - Minimal io_uring wrapper on top of the raw system calls
+//
+// liburing is not available on every target image, and frame_streamer only
+// needs a handful of operations, so this talks to the kernel directly:
+// io_uring_setup() + mmap() for the rings, io_uring_enter() to submit and
+// wait, io_uring_register() for fixed files and buffers.
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+struct uring {
+    int fd;
+
+    /* Submission queue (shared with the kernel) */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    unsigned sqe_tail;          // SQEs handed out, published on submit
+    struct io_uring_sqe *sqes;
+
+    /* Completion queue */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+
+    unsigned long enters;       // io_uring_enter() calls, for statistics
+};
+
+int uring_init(struct uring *u, unsigned entries);
+void uring_exit(struct uring *u);
+
+/* Next free SQE (zeroed), or NULL when the queue is full: submit first */
+struct io_uring_sqe *uring_get_sqe(struct uring *u);
+unsigned uring_sq_space(struct uring *u);
+
+/*
+ * Submit everything queued with uring_get_sqe() and wait for at least
+ * wait_nr completions, in a single io_uring_enter(). Returns the number
+ * submitted or -1 with errno set (EINTR when a signal arrived).
+ */
+int uring_submit_and_wait(struct uring *u, unsigned wait_nr);
+
+/* Completion at the head of the CQ, or NULL; uring_cqe_seen() consumes it */
+struct io_uring_cqe *uring_peek_cqe(struct uring *u);
+void uring_cqe_seen(struct uring *u);
+
+int uring_register(struct uring *u, unsigned opcode, const void *arg,
+                   unsigned nr_args);
+
+#endif /* URING_H */
@@ -0,0 +1,608 @@
+// uring_server.c - Single-threaded io_uring streamer (see uring_server.h)
+//
+// Instead of poll() + read() + send() per frame (plus epoll_wait() and a
+// thread handoff), every operation is an SQE on one ring:
+//
+//   POLL_ADD(device) --link--> READ_FIXED(device, slot buffer)
+//   ACCEPT(listen socket), re-armed after every connection
+//   SENDMSG(client, header + payload), one in flight per client
+//
+// Registered files skip the fd table lookup on every request and
+// registered buffers skip pinning the slot pages on every read. SQEs
+// produced while handling a batch of completions are submitted together
+// with the wait for the next batch: one io_uring_enter() per loop.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "probes.h"
+#include "raw_codec.h"
+#include "uring.h"
+#include "uring_server.h"
+
+/* Registered file table layout */
+#define FILE_DEVICE  0
+#define FILE_LISTEN  1
+#define FILE_CLIENT0 2
+
+enum uring_op {
+    OP_ACCEPT = 1,
+    OP_POLL,
+    OP_READ,
+    OP_SEND,
+};
+
+#define UDATA(op, idx)  (((uint64_t)(op) << 32) | (uint32_t)(idx))
+#define UDATA_OP(d)     ((int)((d) >> 32))
+#define UDATA_IDX(d)    ((int)(uint32_t)(d))
+
+struct uclient {
+    int fd;                         // -1: entry unused
+    char name[32];
+    struct frame_slot **queue;      // same scheme as struct client
+    int q_size;
+    int q_head;
+    int q_count;
+    size_t offset;
+    int sending;                    // SENDMSG in flight (owns msg/iov)
+    struct iovec iov[2];
+    struct msghdr msg;
+
+    unsigned long frames_sent;
+    unsigned long frames_dropped;
+    unsigned long frames_skipped;
+    unsigned long long bytes_sent;
+};
+
+struct ustate {
+    struct uring u;
+    struct uring_server_config *cfg;
+    struct uclient *clients;
+    int nclients;
+
+    struct sockaddr_in accept_addr;
+    socklen_t accept_len;
+
+    struct frame_slot *read_slot;   // target of the armed read, NULL = scratch;
+                                    // with compression the read always goes to
+                                    // scratch and is encoded into read_slot
+    int capture_armed;              // poll (and read) in flight
+    int read_linked;                // the armed poll carries a linked read
+    int capture_done;
+    int started;
+    uint64_t woke_ns;
+};
+
+static uint64_t realtime_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct io_uring_sqe *get_sqe(struct ustate *st)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(&st->u);
+
+    if (!sqe) {
+        // SQ full: hand what we have to the kernel without waiting
+        uring_submit_and_wait(&st->u, 0);
+        sqe = uring_get_sqe(&st->u);
+    }
+    return sqe;
+}
+
+/* ============================================
+ * Capture: POLL_ADD -> READ_FIXED
+ * ============================================ */
+
+static void prep_read(struct ustate *st, struct io_uring_sqe *sqe)
+{
+    struct frame_ring *ring = st->cfg->ring;
+
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = FILE_DEVICE;
+    if (st->read_slot && !st->cfg->compress) {
+        sqe->addr = (uint64_t)(uintptr_t)st->read_slot->data;
+        sqe->buf_index = st->read_slot->index;
+    } else {
+        sqe->addr = (uint64_t)(uintptr_t)st->cfg->scratch;
+        sqe->buf_index = ring->depth;   // scratch is registered last
+    }
+    sqe->len = (size_t)st->cfg->width * st->cfg->height * 2;
+    sqe->user_data = UDATA(OP_READ, 0);
+}
+
+/*
+ * Arm the next capture. With a free slot, the poll and the read are
+ * linked so the read starts in the kernel as soon as the driver signals
+ * POLLIN, with no round trip to user space. With the ring full, only the
+ * poll is armed and the slot (or the scratch buffer) is chosen when the
+ * frame is actually there.
+ */
+static void arm_capture(struct ustate *st)
+{
+    struct frame_ring *ring = st->cfg->ring;
+    struct io_uring_sqe *sqe;
+
+    if (st->capture_armed || st->capture_done || !st->started)
+        return;
+
+    /*
+     * Only this thread touches the ring in io_uring mode, so free_count
+     * can be read without the lock. DROP_BLOCK waits for a release.
+     */
+    if (ring->free_count == 0 && ring->policy == DROP_BLOCK)
+        return;
+
+    if (uring_sq_space(&st->u) < 2)
+        uring_submit_and_wait(&st->u, 0);   // a link must not be split
+
+    st->read_linked = ring->free_count > 0;
+    st->read_slot = st->read_linked ? ring_acquire(ring) : NULL;
+
+    sqe = get_sqe(st);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->flags = IOSQE_FIXED_FILE | (st->read_linked ? IOSQE_IO_LINK : 0);
+    sqe->fd = FILE_DEVICE;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = UDATA(OP_POLL, 0);
+
+    if (st->read_linked)
+        prep_read(st, get_sqe(st));
+
+    st->capture_armed = 1;
+}
+
+/* ============================================
+ * Clients
+ * ============================================ */
+
+static void submit_send(struct ustate *st, int idx)
+{
+    struct uclient *c = &st->clients[idx];
+    struct frame_slot *slot;
+    struct io_uring_sqe *sqe;
+
+    if (c->sending || c->q_count == 0)
+        return;
+
+    slot = c->queue[c->q_head];
+    if (c->offset == 0)
+        PROBE_SEND_START(slot->frame_no, c->fd, slot->hdr.header_len + slot->len);
+
+    memset(&c->msg, 0, sizeof(c->msg));
+    c->msg.msg_iov = c->iov;
+    c->msg.msg_iovlen = slot_iov(slot, 0, c->offset, c->iov);
+
+    sqe = get_sqe(st);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = FILE_CLIENT0 + idx;
+    sqe->addr = (uint64_t)(uintptr_t)&c->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = UDATA(OP_SEND, idx);
+    c->sending = 1;
+}
+
+static void client_pop(struct ustate *st, struct uclient *c)
+{
+    ring_release(st->cfg->ring, c->queue[c->q_head]);
+    c->q_head = (c->q_head + 1) % c->q_size;
+    c->q_count--;
+    c->offset = 0;
+}
+
+static void update_file(struct ustate *st, int idx, int fd)
+{
+    struct io_uring_files_update up;
+
+    memset(&up, 0, sizeof(up));
+    up.offset = FILE_CLIENT0 + idx;
+    up.fds = (uint64_t)(uintptr_t)&fd;
+    if (uring_register(&st->u, IORING_REGISTER_FILES_UPDATE, &up, 1) < 0)
+        perror("IORING_REGISTER_FILES_UPDATE failed");
+}
+
+static void client_close(struct ustate *st, int idx)
+{
+    struct uclient *c = &st->clients[idx];
+
+    printf("✓ Client %s disconnected: sent %lu frames (%llu bytes), "
+           "dropped %lu, skipped %lu\n",
+           c->name, c->frames_sent, c->bytes_sent,
+           c->frames_dropped, c->frames_skipped);
+
+    while (c->q_count > 0)
+        client_pop(st, c);
+    update_file(st, idx, -1);
+    close(c->fd);
+    c->fd = -1;
+    st->nclients--;
+}
+
+static void fan_out(struct ustate *st, struct frame_slot *slot)
+{
+    struct uring_server_config *cfg = st->cfg;
+    int i;
+
+    for (i = 0; i < cfg->max_clients; i++) {
+        struct uclient *c = &st->clients[i];
+
+        if (c->fd < 0)
+            continue;
+
+        if (c->q_count >= cfg->client_depth) {
+            if (cfg->client_policy == CLIENT_FIFO) {
+                c->frames_dropped++;
+                continue;
+            }
+            // Latest-frame-wins; the head stays if it is on the wire
+            int keep = (c->sending || c->offset > 0) ? 1 : 0;
+            while (c->q_count > keep) {
+                int tail = (c->q_head + c->q_count - 1) % c->q_size;
+                ring_release(cfg->ring, c->queue[tail]);
+                c->q_count--;
+                c->frames_skipped++;
+            }
+        }
+
+        ring_get(slot);
+        c->queue[(c->q_head + c->q_count) % c->q_size] = slot;
+        c->q_count++;
+        submit_send(st, i);
+    }
+}
+
+/* ============================================
+ * Completion Handlers
+ * ============================================ */
+
+static void arm_accept(struct ustate *st)
+{
+    struct io_uring_sqe *sqe = get_sqe(st);
+
+    st->accept_len = sizeof(st->accept_addr);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = FILE_LISTEN;
+    sqe->addr = (uint64_t)(uintptr_t)&st->accept_addr;
+    sqe->addr2 = (uint64_t)(uintptr_t)&st->accept_len;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = UDATA(OP_ACCEPT, 0);
+}
+
+static void on_accept(struct ustate *st, int res)
+{
+    struct uring_server_config *cfg = st->cfg;
+    struct uclient *c = NULL;
+    int i;
+
+    if (res < 0) {
+        if (res != -EINTR && res != -EAGAIN && res != -ECONNABORTED) {
+            fprintf(stderr, "Accept failed: %s\n", strerror(-res));
+            return;     // stop accepting, keep serving who is connected
+        }
+        arm_accept(st);
+        return;
+    }
+
+    for (i = 0; i < cfg->max_clients; i++) {
+        if (st->clients[i].fd < 0) {
+            c = &st->clients[i];
+            break;
+        }
+    }
+    if (!c) {
+        fprintf(stderr, "Rejecting client: already serving %d\n", st->nclients);
+        close(res);
+        arm_accept(st);
+        return;
+    }
+
+    c->fd = res;
+    c->q_head = c->q_count = 0;
+    c->offset = 0;
+    c->sending = 0;
+    c->frames_sent = c->frames_dropped = c->frames_skipped = 0;
+    c->bytes_sent = 0;
+    snprintf(c->name, sizeof(c->name), "%s:%d",
+             inet_ntoa(st->accept_addr.sin_addr), ntohs(st->accept_addr.sin_port));
+    update_file(st, i, res);
+    st->nclients++;
+    printf("✓ Client connected from %s (%d connected)\n", c->name, st->nclients);
+
+    if (!st->started && st->nclients >= cfg->min_clients) {
+        st->started = 1;
+        printf("\n=== Starting frame streaming (%dx%d RAW, io_uring) ===\n",
+               cfg->width, cfg->height);
+        if (cfg->max_frames)
+            printf("Will capture %d frames and stop.\n", cfg->max_frames);
+        arm_capture(st);
+    }
+    arm_accept(st);
+}
+
+static void on_poll(struct ustate *st, int res)
+{
+    if (res < 0) {
+        /*
+         * The device is gone or broken: polling again would fail the same
+         * way at once. A linked read still completes with -ECANCELED and
+         * returns its slot, but capture_done keeps it from re-arming.
+         */
+        fprintf(stderr, "Poll on device failed: %s\n", strerror(-res));
+        st->capture_done = 1;
+        if (!st->read_linked)
+            st->capture_armed = 0;
+        return;
+    }
+
+    // The driver woke us: that is as close to capture as we can see
+    st->woke_ns = realtime_ns();
+    PROBE_POLL_RETURN(st->cfg->frames_captured + 1);
+
+    if (!st->read_linked) {
+        // Armed while the ring was full: pick the buffer now
+        st->read_slot = ring_acquire(st->cfg->ring);
+        prep_read(st, get_sqe(st));
+    }
+}
+
+static void on_read(struct ustate *st, int res)
+{
+    struct uring_server_config *cfg = st->cfg;
+    struct frame_slot *slot = st->read_slot;
+
+    st->capture_armed = 0;
+    st->read_slot = NULL;
+
+    if (res <= 0) {
+        if (slot)
+            ring_release(cfg->ring, slot);
+        if (res == -EAGAIN || res == -EINTR || res == -ECANCELED) {
+            arm_capture(st);
+            return;
+        }
+        if (res == 0)
+            printf("No more data from device\n");
+        else
+            fprintf(stderr, "Read from device failed: %s\n", strerror(-res));
+        st->capture_done = 1;
+        return;
+    }
+
+    cfg->frames_captured++;
+    if (cfg->max_frames && cfg->frames_captured >= cfg->max_frames)
+        st->capture_done = 1;
+
+    if (!slot) {
+        PROBE_RING_DROP(cfg->frames_captured);
+        stats_dropped(cfg->stats);
+        if (cfg->verbose)
+            printf("[%d] Ring full, frame dropped\n", cfg->frames_captured);
+    } else {
+        slot->len = res;
+        if (cfg->compress)
+            slot->len = raw_encode((const uint16_t *)cfg->scratch, cfg->width,
+                                   cfg->height, slot->data, cfg->ring->frame_size);
+        slot->frame_no = cfg->frames_captured;
+        frame_header_init(&slot->hdr, cfg->width, cfg->height,
+                          PIX_FMT_RAW12_RGGB, slot->frame_no, slot->len, st->woke_ns);
+        if (cfg->compress)
+            slot->hdr.flags |= FRAME_FLAG_RC12;
+        PROBE_READ_DONE(slot->frame_no, res, slot->len);
+        stats_read(cfg->stats, slot->len);
+        if (cfg->verbose && cfg->compress)
+            printf("[%d] Read %d bytes (%dx%d RAW frame), RC12 %zu bytes\n",
+                   cfg->frames_captured, res, cfg->width, cfg->height, slot->len);
+        else if (cfg->verbose)
+            printf("[%d] Read %d bytes (%dx%d RAW frame)\n",
+                   cfg->frames_captured, res, cfg->width, cfg->height);
+        fan_out(st, slot);
+        ring_release(cfg->ring, slot);
+    }
+
+    arm_capture(st);
+}
+
+static void on_send(struct ustate *st, int idx, int res)
+{
+    struct uclient *c = &st->clients[idx];
+    struct frame_slot *slot;
+    size_t total;
+
+    c->sending = 0;
+    if (res < 0) {
+        fprintf(stderr, "Send to %s failed: %s\n", c->name, strerror(-res));
+        client_close(st, idx);
+        arm_capture(st);    // released slots may unblock capture
+        return;
+    }
+
+    slot = c->queue[c->q_head];
+    total = slot->hdr.header_len + slot->len;
+    c->offset += res;
+    c->bytes_sent += res;
+
+    if (c->offset >= total) {
+        c->frames_sent++;
+        PROBE_SEND_DONE(slot->frame_no, c->fd, total);
+        stats_sent(st->cfg->stats, total);
+        if (st->cfg->verbose)
+            printf("[%u] Sent %zu bytes to %s\n", slot->frame_no, total, c->name);
+        client_pop(st, c);
+        arm_capture(st);
+    }
+    submit_send(st, idx);
+}
+
+static int clients_idle(struct ustate *st)
+{
+    int i;
+
+    for (i = 0; i < st->cfg->max_clients; i++) {
+        if (st->clients[i].fd >= 0 &&
+            (st->clients[i].q_count > 0 || st->clients[i].sending))
+            return 0;
+    }
+    return 1;
+}
+
+/* ============================================
+ * Setup and Main Loop
+ * ============================================ */
+
+static int register_resources(struct ustate *st)
+{
+    struct uring_server_config *cfg = st->cfg;
+    struct frame_ring *ring = cfg->ring;
+    struct iovec *bufs;
+    int *files;
+    int i, ret;
+
+    // One fixed buffer per ring slot, plus the scratch buffer
+    bufs = calloc(ring->depth + 1, sizeof(*bufs));
+    files = malloc((FILE_CLIENT0 + cfg->max_clients) * sizeof(*files));
+    if (!bufs || !files) {
+        free(bufs);
+        free(files);
+        return -1;
+    }
+
+    for (i = 0; i < ring->depth; i++) {
+        bufs[i].iov_base = ring->slots[i].data;
+        bufs[i].iov_len = ring->frame_size;
+    }
+    bufs[ring->depth].iov_base = cfg->scratch;
+    bufs[ring->depth].iov_len = ring->frame_size;
+
+    files[FILE_DEVICE] = cfg->device_fd;
+    files[FILE_LISTEN] = cfg->listen_fd;
+    for (i = 0; i < cfg->max_clients; i++)
+        files[FILE_CLIENT0 + i] = -1;   // sparse, filled on accept
+
+    ret = uring_register(&st->u, IORING_REGISTER_BUFFERS, bufs, ring->depth + 1);
+    if (ret < 0)
+        perror("IORING_REGISTER_BUFFERS failed");
+    else {
+        ret = uring_register(&st->u, IORING_REGISTER_FILES, files,
+                             FILE_CLIENT0 + cfg->max_clients);
+        if (ret < 0)
+            perror("IORING_REGISTER_FILES failed");
+    }
+
+    free(bufs);
+    free(files);
+    return ret;
+}
+
+int uring_server_run(struct uring_server_config *cfg)
+{
+    struct ustate st;
+    struct io_uring_cqe *cqe;
+    int i, ret = 0;
+
+    memset(&st, 0, sizeof(st));
+    st.cfg = cfg;
+
+    if (uring_init(&st.u, 2 * cfg->max_clients + 8) < 0) {
+        perror("io_uring_setup failed");
+        return 1;
+    }
+    if (register_resources(&st) < 0) {
+        uring_exit(&st.u);
+        return 1;
+    }
+    printf("✓ io_uring ready: %d registered buffers, %d registered files\n",
+           cfg->ring->depth + 1, FILE_CLIENT0 + cfg->max_clients);
+
+    st.clients = calloc(cfg->max_clients, sizeof(*st.clients));
+    if (!st.clients) {
+        uring_exit(&st.u);
+        return -1;
+    }
+    for (i = 0; i < cfg->max_clients; i++) {
+        st.clients[i].fd = -1;
+        st.clients[i].q_size = cfg->client_depth + 1;
+        st.clients[i].queue = calloc(st.clients[i].q_size, sizeof(struct frame_slot *));
+        if (!st.clients[i].queue) {
+            ret = -1;
+            goto out;
+        }
+    }
+
+    arm_accept(&st);
+    if (cfg->min_clients == 0) {
+        st.started = 1;
+        arm_capture(&st);
+    }
+
+    for (;;) {
+        if (st.capture_done && clients_idle(&st))
+            break;
+
+        // Submit everything queued since last time and wait, in one syscall
+        if (uring_submit_and_wait(&st.u, 1) < 0) {
+            if (errno != EINTR) {
+                perror("io_uring_enter failed");
+                ret = -1;
+                break;
+            }
+            if (*cfg->stop) {
+                if (!st.started)
+                    break;
+                st.capture_done = 1;    // flush what is queued, then exit
+            }
+            continue;
+        }
+        if (*cfg->stop)
+            st.capture_done = 1;
+
+        while ((cqe = uring_peek_cqe(&st.u)) != NULL) {
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+
+            uring_cqe_seen(&st.u);
+            switch (UDATA_OP(data)) {
+            case OP_ACCEPT:
+                on_accept(&st, res);
+                break;
+            case OP_POLL:
+                on_poll(&st, res);
+                break;
+            case OP_READ:
+                on_read(&st, res);
+                break;
+            case OP_SEND:
+                on_send(&st, UDATA_IDX(data), res);
+                break;
+            }
+        }
+    }
+
+out:
+    for (i = 0; i < cfg->max_clients; i++) {
+        if (st.clients[i].fd >= 0)
+            client_close(&st, i);
+        free(st.clients[i].queue);
+    }
+    free(st.clients);
+    if (st.read_slot)
+        ring_release(cfg->ring, st.read_slot);
+
+    cfg->enters = st.u.enters;
+    uring_exit(&st.u);  // cancels the pending accept and poll
+    return ret;
+}
@@ -0,0 +1,44 @@
+// uring_server.h - frame_streamer mode that drives device reads, accepts
+// and sends through a single io_uring instance
+#ifndef URING_SERVER_H
+#define URING_SERVER_H
+
+#include <signal.h>
+
+#include "frame_ring.h"
+#include "net_server.h"
+#include "stream_stats.h"
+
+struct uring_server_config {
+    int device_fd;
+    int listen_fd;
+    struct frame_ring *ring;    // slots double as registered buffers
+    char *scratch;              // drain buffer for dropped frames, and the
+                                // read buffer when compressing
+
+    int width;
+    int height;
+    int max_frames;             // 0 = unlimited
+    int compress;               // RC12-encode frames (ring slots sized for it)
+    int client_depth;
+    enum client_policy client_policy;
+    int max_clients;
+    int min_clients;
+    volatile sig_atomic_t *stop;
+    int verbose;                // a line per frame read and sent
+    struct stream_stats *stats; // counters for the periodic summary, or NULL
+
+    /* Filled in by uring_server_run() */
+    int frames_captured;
+    unsigned long enters;       // io_uring_enter() calls
+};
+
+/*
+ * Runs the whole streamer on the calling thread. Returns 0 once the last
+ * frame has been flushed to every client, 1 if io_uring is unavailable
+ * (nothing was touched, the caller falls back to the epoll server) and -1
+ * on failure.
+ */
+int uring_server_run(struct uring_server_config *cfg);
+
+#endif /* URING_SERVER_H */
@@ -0,0 +1,230 @@
+// work_pool.c - Work-stealing thread pool (see work_pool.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "work_pool.h"
+
+/*
+ * Items top .. bottom-1 of one worker, a Chase-Lev deque whose buffer is
+ * the item numbers themselves: nothing is pushed while a run is in
+ * progress, so only the owner's pop and the thieves' steal remain. The
+ * owner pops at bottom, thieves CAS top; only the last item is contended.
+ */
+struct work_deque {
+    long top;
+    long bottom;
+} __attribute__((aligned(64)));
+
+struct work_pool {
+    int threads;
+    pthread_t *tids;
+    int started;                // workers created
+    struct work_deque *deques;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;       // a run (or quit) is posted
+    pthread_cond_t done;        // the last worker left the run
+    unsigned long generation;   // runs posted so far
+    int busy;                   // workers 1.. still in the current run
+    int quit;
+
+    work_fn fn;
+    void *arg;
+};
+
+struct worker_arg {
+    struct work_pool *pool;
+    int id;
+};
+
+/* The owner's end. Returns an item or -1 when the deque is empty. */
+static long deque_pop(struct work_deque *dq)
+{
+    long b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+    long t;
+
+    __atomic_store_n(&dq->bottom, b, __ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&dq->top, __ATOMIC_SEQ_CST);
+    if (t < b)
+        return b;
+    if (t == b) {
+        // Last item: whoever moves top first gets it
+        int won = __atomic_compare_exchange_n(&dq->top, &t, t + 1, 0, __ATOMIC_SEQ_CST,
+                                              __ATOMIC_RELAXED);
+
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        return won ? b : -1;
+    }
+    __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    return -1;
+}
+
+/* The thieves' end. Returns an item, -1 if empty or -2 if another thread won it. */
+static long deque_steal(struct work_deque *dq)
+{
+    long t = __atomic_load_n(&dq->top, __ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&dq->bottom, __ATOMIC_SEQ_CST);
+
+    if (t >= b)
+        return -1;
+    if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0, __ATOMIC_SEQ_CST,
+                                     __ATOMIC_RELAXED))
+        return -2;
+    return t;
+}
+
+/* Own items first, then steal until every other deque is empty */
+static void work(struct work_pool *pool, int id)
+{
+    long item;
+    int i;
+
+    while ((item = deque_pop(&pool->deques[id])) >= 0)
+        pool->fn(pool->arg, (int)item, id);
+
+    // Nothing is added during a run, so one pass over the others finds everything
+    for (i = 1; i < pool->threads; i++) {
+        struct work_deque *victim = &pool->deques[(id + i) % pool->threads];
+
+        while ((item = deque_steal(victim)) != -1)
+            if (item >= 0)
+                pool->fn(pool->arg, (int)item, id);
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    struct worker_arg *wa = arg;
+    struct work_pool *pool = wa->pool;
+    int id = wa->id;
+    unsigned long seen = 0;
+
+    free(wa);
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen && !pool->quit)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->quit)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        work(pool, id);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct work_pool *work_pool_create(int threads)
+{
+    struct work_pool *pool;
+    int i;
+
+    if (threads < 1) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        threads = n > 0 ? (int)n : 1;
+    }
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        perror("Failed to allocate thread pool");
+        return NULL;
+    }
+    pool->threads = threads;
+    pool->tids = calloc(threads, sizeof(*pool->tids));
+    pool->deques = aligned_alloc(64, threads * sizeof(*pool->deques));
+    if (!pool->tids || !pool->deques) {
+        perror("Failed to allocate thread pool");
+        goto fail;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (i = 1; i < threads; i++) {
+        struct worker_arg *wa = malloc(sizeof(*wa));
+
+        if (!wa) {
+            perror("Failed to start pool worker");
+            goto fail;
+        }
+        wa->pool = pool;
+        wa->id = i;
+        if (pthread_create(&pool->tids[i], NULL, worker_thread, wa) != 0) {
+            perror("Failed to start pool worker");
+            free(wa);
+            goto fail;
+        }
+        pool->started++;
+    }
+    return pool;
+
+fail:
+    work_pool_destroy(pool);
+    return NULL;
+}
+
+int work_pool_threads(const struct work_pool *pool)
+{
+    return pool->threads;
+}
+
+void work_pool_run(struct work_pool *pool, int items, work_fn fn, void *arg)
+{
+    int i;
+
+    if (items <= 0)
+        return;
+
+    // Worker i starts with items [items * i / n, items * (i + 1) / n)
+    for (i = 0; i < pool->threads; i++) {
+        pool->deques[i].top = (long)items * i / pool->threads;
+        pool->deques[i].bottom = (long)items * (i + 1) / pool->threads;
+    }
+    pool->fn = fn;
+    pool->arg = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->busy = pool->threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void work_pool_destroy(struct work_pool *pool)
+{
+    int i;
+
+    if (!pool)
+        return;
+    if (pool->started) {
+        pthread_mutex_lock(&pool->lock);
+        pool->quit = 1;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+        for (i = 1; i <= pool->started; i++)
+            pthread_join(pool->tids[i], NULL);
+    }
+    if (pool->tids && pool->deques) {
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->start);
+        pthread_cond_destroy(&pool->done);
+    }
+    free(pool->tids);
+    free(pool->deques);
+    free(pool);
+}
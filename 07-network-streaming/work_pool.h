@@ -0,0 +1,40 @@
+// work_pool.h - Work-stealing thread pool for per-frame parallel loops
+//
+// work_pool_run() calls fn for every item 0 .. items-1 and returns when
+// all of them are done, with the calling thread working as worker 0.
+// Items start out split into one contiguous range per worker (neighbouring
+// tiles share cache lines and halo rows); a worker takes items from the
+// end of its own range and, once that is empty, steals from the start of
+// another worker's, so a worker held up by the scheduler or by slower
+// tiles does not hold up the frame.
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct work_pool;
+
+/* One item; worker is 0 .. threads-1, for per-worker scratch memory */
+typedef void (*work_fn)(void *arg, int item, int worker);
+
+/*
+ * Start threads - 1 workers (threads < 1: one per online CPU). Returns
+ * NULL if they cannot be created (message printed).
+ */
+struct work_pool *work_pool_create(int threads);
+
+/* Workers including the caller of work_pool_run() */
+int work_pool_threads(const struct work_pool *pool);
+
+/* fn(arg, i, worker) for every i in 0 .. items-1; not reentrant */
+void work_pool_run(struct work_pool *pool, int items, work_fn fn, void *arg);
+
+void work_pool_destroy(struct work_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WORK_POOL_H */